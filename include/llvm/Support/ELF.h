@@ -308,7 +308,8 @@ enum {
   EM_COGE          = 216, // Cognitive Smart Memory Processor
   EM_COOL          = 217, // iCelero CoolEngine
   EM_NORC          = 218, // Nanoradio Optimized RISC
-  EM_CSR_KALIMBA   = 219  // CSR Kalimba architecture family
+  EM_CSR_KALIMBA   = 219, // CSR Kalimba architecture family
+  EM_Z80           = 220  // Zilog Z80
 };
 
 // Object file classes.
@@ -518,6 +519,11 @@ enum {
 #include "ELFRelocs/Sparc.def"
 };
 
+// ELF Relocation types for GBZ80
+enum {
+#include "ELFRelocs/GBZ80.def"
+};
+
 #undef ELF_RELOC
 
 // Section header.
@@ -2047,6 +2047,14 @@ public:
   /// returned value is a member of the MachineJumpTableInfo::JTEntryKind enum.
   virtual unsigned getJumpTableEncoding() const;
 
+  /// Return the type of the index into a jump table with NumEntries entries,
+  /// which is carried in a virtual register from the range check to the block
+  /// with the jump. The index is zero extended to the pointer type for the
+  /// BR_JT node.
+  virtual MVT getJumpTableRegTy(uint64_t NumEntries) const {
+    return getPointerTy();
+  }
+
   virtual const MCExpr *
   LowerCustomJumpTableEntry(const MachineJumpTableInfo * /*MJTI*/,
                             const MachineBasicBlock * /*MBB*/, unsigned /*uid*/,
@@ -1737,13 +1737,18 @@ void SelectionDAGBuilder::visitSwitchCase(CaseBlock &CB,
 void SelectionDAGBuilder::visitJumpTable(JumpTable &JT) {
   // Emit the code for the jump table
   assert(JT.Reg != -1U && "Should lower JT Header first!");
-  EVT PTy = DAG.getTargetLoweringInfo().getPointerTy();
+  const TargetLowering &TLI = DAG.getTargetLoweringInfo();
+  EVT PTy = TLI.getPointerTy();
+  unsigned NumEntries =
+    FuncInfo.MF->getJumpTableInfo()->getJumpTables()[JT.JTI].MBBs.size();
   SDValue Index = DAG.getCopyFromReg(getControlRoot(), getCurSDLoc(),
-                                     JT.Reg, PTy);
+                                     JT.Reg,
+                                     TLI.getJumpTableRegTy(NumEntries));
   SDValue Table = DAG.getJumpTable(JT.JTI, PTy);
   SDValue BrJumpTable = DAG.getNode(ISD::BR_JT, getCurSDLoc(),
-                                    MVT::Other, Index.getValue(1),
-                                    Table, Index);
+                                    MVT::Other, Index.getValue(1), Table,
+                                    DAG.getZExtOrTrunc(Index, getCurSDLoc(),
+                                                       PTy));
   DAG.setRoot(BrJumpTable);
 }
 
@@ -1766,9 +1771,10 @@ void SelectionDAGBuilder::visitJumpTableHeader(JumpTable &JT,
   // This value may be smaller or larger than the target's pointer type, and
   // therefore require extension or truncating.
   const TargetLowering &TLI = DAG.getTargetLoweringInfo();
-  SwitchOp = DAG.getZExtOrTrunc(Sub, getCurSDLoc(), TLI.getPointerTy());
+  MVT RegTy = TLI.getJumpTableRegTy((JTH.Last - JTH.First).getZExtValue() + 1);
+  SwitchOp = DAG.getZExtOrTrunc(Sub, getCurSDLoc(), RegTy);
 
-  unsigned JumpTableReg = FuncInfo.CreateReg(TLI.getPointerTy());
+  unsigned JumpTableReg = FuncInfo.CreateReg(RegTy);
   SDValue CopyTo = DAG.getCopyToReg(getControlRoot(), getCurSDLoc(),
                                     JumpTableReg, SwitchOp);
   JT.Reg = JumpTableReg;
@@ -90,6 +90,13 @@ StringRef getELFRelocationTypeName(uint32_t Machine, uint32_t Type) {
       break;
     }
     break;
+  case ELF::EM_Z80:
+    switch (Type) {
+#include "llvm/Support/ELFRelocs/GBZ80.def"
+    default:
+      break;
+    }
+    break;
   default:
     break;
   }
@@ -19,10 +19,40 @@
 #include "llvm/Target/TargetMachine.h"
 
 namespace llvm {
+  namespace GBZ80 {
+    enum CondCode {
+      COND_NZ = 0,
+      COND_Z  = 1,
+      COND_NC = 2,
+      COND_C  = 3,
+
+      COND_INVALID
+    };
+
+    bool isHRAMGlobal(const GlobalValue *GV);
+
+    // ScratchSlot - The byte of high RAM that A is saved to when a spill
+    // needs a register and there is none left, ldh leaves the flags and SP
+    // alone. The AsmPrinter defines it in the modules that use it.
+    const char ScratchSlot[] = "__gbz80_scratch";
+  } // end namespace GBZ80
+
+  class GlobalValue;
+  class GBZ80RegUsageInfo;
   class GBZ80TargetMachine;
   class FunctionPass;
+  class ModulePass;
+  class Pass;
 
   FunctionPass *createGBZ80ISelDAG(GBZ80TargetMachine &TM, CodeGenOpt::Level OptLevel);
+  FunctionPass *createGBZ80BranchRelaxationPass();
+  FunctionPass *createGBZ80AccumulatorCopiesPass();
+  FunctionPass *createGBZ80CopyPropagationPass();
+  FunctionPass *createGBZ80PeepholePass();
+  ModulePass *createGBZ80StaticFramesPass(GBZ80TargetMachine &TM);
+  Pass *createGBZ80CallGraphOrderPass();
+  FunctionPass *createGBZ80RegUsageCollectorPass(GBZ80RegUsageInfo &Info);
+  FunctionPass *createGBZ80RegUsagePropagationPass(const GBZ80RegUsageInfo &Info);
 } // end namespace llvm;
 
 #endif
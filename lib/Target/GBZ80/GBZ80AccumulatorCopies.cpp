@@ -0,0 +1,143 @@
+//===-- GBZ80AccumulatorCopies.cpp - Keep ALU chains in A -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that runs before register allocation and removes
+// copies into A of a value that A still holds. Every 8-bit ALU instruction
+// reads and writes A, so instruction selection copies each result out of A
+// into a virtual register and copies it back for the next instruction of a
+// chain:
+//
+//   A = ADD8r %b
+//   %v = COPY A
+//   A = COPY %v
+//   A = XOR8r %c
+//
+// As long as nothing in between writes A, the second copy is redundant, and
+// the first one goes away as well when it was the only use of %v. The
+// register allocator is left with shorter virtual registers and A is only
+// live where it is actually needed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-acc-copies"
+
+STATISTIC(NumCopies, "Number of copies into A removed");
+
+namespace {
+  class GBZ80AccumulatorCopies : public MachineFunctionPass {
+  public:
+    static char ID;
+    GBZ80AccumulatorCopies() : MachineFunctionPass(ID) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    const char *getPassName() const override {
+      return "GBZ80 Accumulator Copy Elimination";
+    }
+
+  private:
+    bool runOnMachineBasicBlock(MachineBasicBlock &MBB);
+  };
+  char GBZ80AccumulatorCopies::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80AccumulatorCopiesPass - Returns a pass that removes copies into
+// A of the value A already holds.
+FunctionPass *llvm::createGBZ80AccumulatorCopiesPass() {
+  return new GBZ80AccumulatorCopies();
+}
+
+// isCopyOfA - Return true if MI copies A to the virtual register VReg or
+// VReg to A, without sub-registers.
+static bool isCopyOfA(const MachineInstr *MI, unsigned &VReg, bool &ToA)
+{
+  if (!MI->isCopy() || MI->getOperand(0).getSubReg() ||
+      MI->getOperand(1).getSubReg())
+    return false;
+  unsigned Dst = MI->getOperand(0).getReg(), Src = MI->getOperand(1).getReg();
+  if (Dst == GBZ80::A && TargetRegisterInfo::isVirtualRegister(Src))
+  {
+    VReg = Src;
+    ToA = true;
+    return true;
+  }
+  if (Src == GBZ80::A && TargetRegisterInfo::isVirtualRegister(Dst))
+  {
+    VReg = Dst;
+    ToA = false;
+    return true;
+  }
+  return false;
+}
+
+bool GBZ80AccumulatorCopies::runOnMachineBasicBlock(MachineBasicBlock &MBB)
+{
+  MachineRegisterInfo &MRI = MBB.getParent()->getRegInfo();
+  const TargetRegisterInfo *TRI =
+    MBB.getParent()->getSubtarget().getRegisterInfo();
+  SmallPtrSet<MachineInstr *, 8> Sources;
+  bool Changed = false;
+
+  // Held - The virtual register whose value A holds, set by the copy Start.
+  unsigned Held = 0;
+  MachineBasicBlock::iterator Start;
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E; )
+  {
+    MachineInstr *MI = I++;
+    unsigned VReg;
+    bool ToA;
+    bool IsCopy = isCopyOfA(MI, VReg, ToA);
+
+    if (IsCopy && ToA && Held && VReg == Held)
+    {
+      // A lives on from Start, drop the kills in between.
+      for (MachineBasicBlock::iterator J = Start; &*J != MI; ++J)
+        J->clearRegisterKills(GBZ80::A, TRI);
+      if (Start->getOperand(0).getReg() != GBZ80::A)
+        Sources.insert(Start);
+      MI->eraseFromParent();
+      ++NumCopies;
+      Changed = true;
+      continue;
+    }
+
+    if (MI->modifiesRegister(GBZ80::A, TRI))
+      Held = 0;
+    if (IsCopy)
+    {
+      Held = VReg;
+      Start = MI;
+    }
+  }
+
+  // A copy out of A whose value is no longer read by anything is dead.
+  for (MachineInstr *MI : Sources)
+    if (MRI.use_nodbg_empty(MI->getOperand(0).getReg()))
+      MI->eraseFromParent();
+  return Changed;
+}
+
+bool GBZ80AccumulatorCopies::runOnMachineFunction(MachineFunction &MF)
+{
+  bool Changed = false;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    Changed |= runOnMachineBasicBlock(*MBB);
+  return Changed;
+}
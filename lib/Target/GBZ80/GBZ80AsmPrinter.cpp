@@ -0,0 +1,450 @@
+//===-- GBZ80AsmPrinter.cpp - GBZ80 LLVM assembly writer ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a printer that converts from our internal representation
+// of machine-dependent LLVM code to the GBZ80 assembly language.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "InstPrinter/GBZ80InstPrinter.h"
+#include "GBZ80InstrInfo.h"
+#include "GBZ80MCInstLower.h"
+#include "GBZ80Runtime.h"
+#include "GBZ80TargetMachine.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/CodeGen/AsmPrinter.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineInstr.h"
+#include "llvm/CodeGen/MachineJumpTableInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/Target/TargetLoweringObjectFile.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "asm-printer"
+
+namespace {
+  class GBZ80AsmPrinter : public AsmPrinter {
+  public:
+    GBZ80AsmPrinter(TargetMachine &TM, std::unique_ptr<MCStreamer> Streamer)
+      : AsmPrinter(TM, std::move(Streamer)) {}
+
+    const char *getPassName() const override {
+      return "GBZ80 Assembly Printer";
+    }
+
+    void printOperand(const MachineInstr *MI, int OpNum, raw_ostream &O);
+    bool PrintAsmOperand(const MachineInstr *MI, unsigned OpNo,
+      unsigned AsmVariant, const char *ExtraCode,
+      raw_ostream &O) override;
+    bool PrintAsmMemoryOperand(const MachineInstr *MI, unsigned OpNo,
+      unsigned AsmVariant, const char *ExtraCode,
+      raw_ostream &O) override;
+    void EmitFunctionEntryLabel() override;
+    void EmitInstruction(const MachineInstr *MI) override;
+    void EmitEndOfAsmFile(Module &M) override;
+
+  private:
+    void EmitShiftLadder(const MachineInstr *MI);
+    void EmitBlockLoop(const MachineInstr *MI);
+    void EmitJumpTable(const MachineInstr *MI);
+
+    // Routines - The runtime library routines called by the module so far.
+    SmallSetVector<std::string, 8> Routines;
+  }; // end class GBZ80AsmPrinter
+} // end namespace
+
+void GBZ80AsmPrinter::printOperand(const MachineInstr *MI, int OpNum,
+  raw_ostream &O)
+{
+  const MachineOperand &MO = MI->getOperand(OpNum);
+  switch (MO.getType())
+  {
+  default: llvm_unreachable("Not implemented yet!");
+  case MachineOperand::MO_Register:
+    O << GBZ80InstPrinter::getRegisterName(MO.getReg());
+    return;
+  case MachineOperand::MO_Immediate:
+    O << MO.getImm();
+    return;
+  case MachineOperand::MO_MachineBasicBlock:
+    O << *MO.getMBB()->getSymbol();
+    return;
+  case MachineOperand::MO_GlobalAddress:
+    O << *getSymbol(MO.getGlobal());
+    if (MO.getOffset())
+      O << '+' << MO.getOffset();
+    return;
+  case MachineOperand::MO_ExternalSymbol:
+    O << *GetExternalSymbolSymbol(MO.getSymbolName());
+    return;
+  }
+}
+
+// PrintAsmOperand - Print out an operand for an inline asm expression.
+bool GBZ80AsmPrinter::PrintAsmOperand(const MachineInstr *MI, unsigned OpNo,
+  unsigned AsmVariant, const char *ExtraCode, raw_ostream &O)
+{
+  // Does this asm operand have a single letter operand modifier?
+  if (ExtraCode && ExtraCode[0])
+    return true; // Unknown modifier.
+
+  printOperand(MI, OpNo, O);
+  return false;
+}
+
+// PrintAsmMemoryOperand - Print out a memory operand for an inline asm
+// expression. The only register usable as a pointer is HL, so the operand is
+// simply wrapped in parentheses.
+bool GBZ80AsmPrinter::PrintAsmMemoryOperand(const MachineInstr *MI,
+  unsigned OpNo, unsigned AsmVariant, const char *ExtraCode, raw_ostream &O)
+{
+  if (ExtraCode && ExtraCode[0])
+    return true; // Unknown modifier.
+
+  O << '(';
+  printOperand(MI, OpNo, O);
+  O << ')';
+  return false;
+}
+
+// EmitShiftLadder - Expand a variable shift into a computed jump into a row
+// of unrolled shifts. Every step of the row is 2 bytes for a byte and 4 bytes
+// for a register pair, so the jump lands amt steps before the end:
+//   ld a, amt        ; unless amt is already in A
+//   and 7 (15)
+//   add a, a (twice for a pair)
+//   cpl
+//   scf
+//   ld hl, .Lend
+//   adc a, l         ; hl = .Lend - amt * step
+//   ld l, a
+//   ld a, h
+//   adc a, -1
+//   ld h, a
+//   jp (hl)
+//   7 (15) x step
+// .Lend:
+void GBZ80AsmPrinter::EmitShiftLadder(const MachineInstr *MI)
+{
+  const TargetRegisterInfo *TRI = MF->getSubtarget().getRegisterInfo();
+  unsigned Reg = MI->getOperand(0).getReg();
+  unsigned AmtReg = MI->getOperand(2).getReg();
+  unsigned Opc, Opc2 = 0;
+
+  switch (MI->getOpcode())
+  {
+  default: llvm_unreachable("Invalid shift ladder opcode!");
+  case GBZ80::SHL8L:   Opc = GBZ80::SLA8r; break;
+  case GBZ80::LSHR8L:  Opc = GBZ80::SRL8r; break;
+  case GBZ80::ASHR8L:  Opc = GBZ80::SRA8r; break;
+  case GBZ80::SHL16L:  Opc = GBZ80::SLA8r; Opc2 = GBZ80::RL8r; break;
+  case GBZ80::LSHR16L: Opc = GBZ80::SRL8r; Opc2 = GBZ80::RR8r; break;
+  case GBZ80::ASHR16L: Opc = GBZ80::SRA8r; Opc2 = GBZ80::RR8r; break;
+  }
+
+  // The first register of a step shifts out the bit the second one takes.
+  unsigned Reg1 = Reg, Reg2 = 0;
+  if (Opc2)
+  {
+    Reg1 = TRI->getSubReg(Reg, GBZ80::subreg_lo);
+    Reg2 = TRI->getSubReg(Reg, GBZ80::subreg_hi);
+    if (Opc2 == GBZ80::RR8r)
+      std::swap(Reg1, Reg2);
+  }
+  unsigned Max = Opc2 ? 15 : 7;
+
+  MCSymbol *End = OutContext.CreateTempSymbol();
+  const MCExpr *EndExpr = MCSymbolRefExpr::Create(End, OutContext);
+
+  if (AmtReg != GBZ80::A)
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+      .addReg(GBZ80::A).addReg(AmtReg));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::AND8i).addImm(Max));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD8r).addReg(GBZ80::A));
+  if (Opc2)
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD8r).addReg(GBZ80::A));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::CPL));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::SCF));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD16ri)
+    .addReg(GBZ80::HL).addExpr(EndExpr));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADC8r).addReg(GBZ80::L));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+    .addReg(GBZ80::L).addReg(GBZ80::A));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+    .addReg(GBZ80::A).addReg(GBZ80::H));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADC8i).addImm(-1));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+    .addReg(GBZ80::H).addReg(GBZ80::A));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::JPHL));
+
+  for (unsigned i = 0; i != Max; ++i)
+  {
+    EmitToStreamer(OutStreamer, MCInstBuilder(Opc).addReg(Reg1).addReg(Reg1));
+    if (Opc2)
+      EmitToStreamer(OutStreamer,
+                     MCInstBuilder(Opc2).addReg(Reg2).addReg(Reg2));
+  }
+
+  OutStreamer.EmitLabel(End);
+}
+
+// EmitBlockLoop - Expand a block copy or fill. B and C are both counted
+// down to zero, C first. Both are incremented up front so that a zero count
+// doesn't loop:
+//   inc b
+//   inc c
+//   jr .Lnext
+// .Lloop:
+//   ld a, (hl+)      ; copy
+//   ld (de), a
+//   inc de
+//   ld (hl+), a      ; fill
+// .Lnext:
+//   dec c
+//   jr nz, .Lloop
+//   dec b
+//   jr nz, .Lloop
+void GBZ80AsmPrinter::EmitBlockLoop(const MachineInstr *MI)
+{
+  MCSymbol *Loop = OutContext.CreateTempSymbol();
+  MCSymbol *Next = OutContext.CreateTempSymbol();
+  const MCExpr *LoopExpr = MCSymbolRefExpr::Create(Loop, OutContext);
+  const MCExpr *NextExpr = MCSymbolRefExpr::Create(Next, OutContext);
+
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::INC8r)
+    .addReg(GBZ80::B).addReg(GBZ80::B));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::INC8r)
+    .addReg(GBZ80::C).addReg(GBZ80::C));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::JR).addExpr(NextExpr));
+
+  OutStreamer.EmitLabel(Loop);
+  if (MI->getOpcode() == GBZ80::MEMCPY)
+  {
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8AHLI)
+      .addReg(GBZ80::A));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rrA)
+      .addReg(GBZ80::DE));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::INC16r)
+      .addReg(GBZ80::DE).addReg(GBZ80::DE));
+  }
+  else
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8HLIA)
+      .addReg(GBZ80::A));
+
+  OutStreamer.EmitLabel(Next);
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::DEC8r)
+    .addReg(GBZ80::C).addReg(GBZ80::C));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::JRCC)
+    .addExpr(LoopExpr).addImm(GBZ80::COND_NZ));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::DEC8r)
+    .addReg(GBZ80::B).addReg(GBZ80::B));
+  EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::JRCC)
+    .addExpr(LoopExpr).addImm(GBZ80::COND_NZ));
+}
+
+// EmitJumpTable - Expand a jump through a table, followed by the table of
+// 16-bit block addresses. The index in A is doubled and added to the address
+// of the table in HL, only A and HL are touched:
+//   add a, a
+//   ld hl, .Ltable
+//   add a, l
+//   ld l, a
+//   adc a, h
+//   sub l
+//   ld h, a
+//   ld a, (hl+)
+//   ld h, (hl)
+//   ld l, a
+//   jp (hl)
+// .Ltable:
+// The runtime does the same with the return address as the table:
+//   add a, a
+//   call __gbz80_jumptable
+// The index in a register pair is doubled into HL instead:
+//   ld hl, .Ltable
+//   add hl, idx
+//   add hl, idx
+//   ld a, (hl+)
+//   ...
+// The label of the table is a new one every time, as tail duplication may
+// have copied the jump into several blocks.
+void GBZ80AsmPrinter::EmitJumpTable(const MachineInstr *MI)
+{
+  const MachineJumpTableInfo *MJTI = MF->getJumpTableInfo();
+  const std::vector<MachineBasicBlock*> &MBBs =
+    MJTI->getJumpTables()[MI->getOperand(0).getIndex()].MBBs;
+
+  if (MI->getOpcode() == GBZ80::BR_JT8CALL)
+  {
+    MCSymbol *Sym =
+      OutContext.GetOrCreateSymbol(StringRef("__gbz80_jumptable"));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD8r)
+      .addReg(GBZ80::A));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::CALL)
+      .addExpr(MCSymbolRefExpr::Create(Sym, OutContext)));
+    Routines.insert(Sym->getName());
+  }
+  else
+  {
+    MCSymbol *Table = OutContext.CreateTempSymbol();
+    const MCExpr *TableExpr = MCSymbolRefExpr::Create(Table, OutContext);
+    if (MI->getOpcode() == GBZ80::BR_JT8)
+    {
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD8r)
+        .addReg(GBZ80::A));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD16ri)
+        .addReg(GBZ80::HL).addExpr(TableExpr));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD8r)
+        .addReg(GBZ80::L));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+        .addReg(GBZ80::L).addReg(GBZ80::A));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADC8r)
+        .addReg(GBZ80::H));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::SUB8r)
+        .addReg(GBZ80::L));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+        .addReg(GBZ80::H).addReg(GBZ80::A));
+    }
+    else
+    {
+      unsigned IdxReg = MI->getOperand(1).getReg();
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD16ri)
+        .addReg(GBZ80::HL).addExpr(TableExpr));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD16r).addReg(IdxReg));
+      EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::ADD16r).addReg(IdxReg));
+    }
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8AHLI)
+      .addReg(GBZ80::A));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rHL)
+      .addReg(GBZ80::H));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::LD8rr)
+      .addReg(GBZ80::L).addReg(GBZ80::A));
+    EmitToStreamer(OutStreamer, MCInstBuilder(GBZ80::JPHL));
+    OutStreamer.EmitLabel(Table);
+  }
+
+  for (unsigned i = 0, e = MBBs.size(); i != e; ++i)
+    OutStreamer.EmitValue(MCSymbolRefExpr::Create(MBBs[i]->getSymbol(),
+                                                  OutContext), 2);
+}
+
+// EmitFunctionEntryLabel - A handler of one of the interrupts also gets the
+// label its vector jumps to, see getGBZ80InterruptVector.
+void GBZ80AsmPrinter::EmitFunctionEntryLabel()
+{
+  AsmPrinter::EmitFunctionEntryLabel();
+
+  const Function *F = MF->getFunction();
+  StringRef Interrupt = F->getFnAttribute("interrupt").getValueAsString();
+  if (Interrupt.empty())
+    return;
+  if (!getGBZ80InterruptVector(Interrupt))
+    report_fatal_error("GBZ80: unknown interrupt '" + Interrupt +
+                       "' of function '" + F->getName() + "'");
+
+  MCSymbol *Sym = OutContext.GetOrCreateSymbol("__gbz80_isr_" + Interrupt);
+  OutStreamer.EmitSymbolAttribute(Sym, MCSA_Global);
+  OutStreamer.EmitLabel(Sym);
+}
+
+void GBZ80AsmPrinter::EmitInstruction(const MachineInstr *MI)
+{
+  switch (MI->getOpcode())
+  {
+  case GBZ80::MEMCPY:
+  case GBZ80::MEMSET:
+    EmitBlockLoop(MI);
+    return;
+  case GBZ80::SHL8L:
+  case GBZ80::LSHR8L:
+  case GBZ80::ASHR8L:
+  case GBZ80::SHL16L:
+  case GBZ80::LSHR16L:
+  case GBZ80::ASHR16L:
+    EmitShiftLadder(MI);
+    return;
+  case GBZ80::BR_JT8:
+  case GBZ80::BR_JT8CALL:
+  case GBZ80::BR_JT16:
+    EmitJumpTable(MI);
+    return;
+  }
+
+  if (MI->isCall())
+  {
+    const MachineOperand &MO = MI->getOperand(0);
+    StringRef Callee;
+    if (MO.isSymbol())
+      Callee = MO.getSymbolName();
+    else if (MO.isGlobal() && MO.getGlobal()->isDeclaration())
+      Callee = MO.getGlobal()->getName();
+    if (GBZ80Runtime::isRoutine(Callee))
+      Routines.insert(Callee);
+  }
+
+  GBZ80MCInstLower MCInstLowering(OutContext, *this);
+
+  MCInst TmpInst;
+  MCInstLowering.Lower(MI, TmpInst);
+  // A tail call is a jump, the epilogue has already been emitted.
+  if (MI->getOpcode() == GBZ80::TCRETURNdi)
+    TmpInst.setOpcode(GBZ80::JP);
+  else if (MI->getOpcode() == GBZ80::TCRETURNr)
+    TmpInst = MCInstBuilder(GBZ80::JPHL);
+  EmitToStreamer(OutStreamer, TmpInst);
+}
+
+// EmitEndOfAsmFile - Append the runtime library routines the module calls,
+// and the ones they call in turn, unless the module defines them itself.
+// Define the scratch byte of the spills if a function used it.
+void GBZ80AsmPrinter::EmitEndOfAsmFile(Module &M)
+{
+  MCSymbol *Scratch = OutContext.LookupSymbol(StringRef(GBZ80::ScratchSlot));
+  if (Scratch && Scratch->isUndefined())
+  {
+    OutStreamer.SwitchSection(OutContext.getELFSection(".hram",
+      ELF::SHT_PROGBITS, ELF::SHF_ALLOC | ELF::SHF_WRITE));
+    OutStreamer.EmitLabel(Scratch);
+    OutStreamer.EmitZeros(1);
+  }
+
+  if (Routines.empty())
+    return;
+
+  OutStreamer.SwitchSection(getObjFileLowering().getTextSection());
+  for (unsigned i = 0; i != Routines.size(); ++i)
+  {
+    std::string Name = Routines[i];
+    const Function *F = M.getFunction(Name);
+    if (F && !F->isDeclaration())
+      continue;
+
+    SmallVector<StringRef, 2> Deps;
+    GBZ80Runtime::emitRoutine(Name, OutStreamer, OutContext,
+                              getSubtargetInfo(), Deps);
+    for (unsigned j = 0, e = Deps.size(); j != e; ++j)
+      Routines.insert(Deps[j]);
+  }
+}
+
+// Force static initialization.
+extern "C" void LLVMInitializeGBZ80AsmPrinter() {
+  RegisterAsmPrinter<GBZ80AsmPrinter> X(TheGBZ80Target);
+}
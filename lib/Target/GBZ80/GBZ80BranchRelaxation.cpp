@@ -0,0 +1,157 @@
+//===-- GBZ80BranchRelaxation.cpp - Pick short or long branches -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that turns JP and JP cc into the 2 byte JR and
+// JR cc forms wherever the destination block is within reach of a signed
+// 8-bit displacement. JR is one byte shorter and 4 T-states faster, except
+// for a taken JR cc which costs the same as a taken JP cc.
+//
+// All branches start out short. Block offsets are computed from the exact
+// instruction sizes and every short branch that can't reach its destination
+// is turned back into a long one, until nothing changes. Branches only ever
+// grow, so this terminates. The pass runs last, just before the assembly
+// printer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "GBZ80InstrInfo.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-branch-relax"
+
+STATISTIC(NumShort, "Number of branches turned into jr");
+
+namespace {
+  class GBZ80BranchRelaxation : public MachineFunctionPass {
+  public:
+    static char ID;
+    GBZ80BranchRelaxation() : MachineFunctionPass(ID) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    const char *getPassName() const override {
+      return "GBZ80 Branch Relaxation";
+    }
+
+  private:
+    const GBZ80InstrInfo *TII;
+
+    // BlockOffsets - The offset of each basic block from the start of the
+    // function, indexed by block number, with the end of the function last.
+    SmallVector<unsigned, 16> BlockOffsets;
+
+    void computeBlockOffsets(MachineFunction &MF);
+    bool isInRange(const MachineInstr *MI, unsigned Offset) const;
+    void setOpcode(MachineInstr *MI, unsigned Opc);
+  };
+  char GBZ80BranchRelaxation::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80BranchRelaxationPass - Returns a pass that picks between JR and
+// JP for every branch.
+FunctionPass *llvm::createGBZ80BranchRelaxationPass() {
+  return new GBZ80BranchRelaxation();
+}
+
+void GBZ80BranchRelaxation::computeBlockOffsets(MachineFunction &MF)
+{
+  BlockOffsets.resize(MF.getNumBlockIDs() + 1);
+
+  unsigned Offset = 0;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+  {
+    BlockOffsets[MBB->getNumber()] = Offset;
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; ++I)
+      Offset += TII->getInstSizeInBytes(I);
+  }
+  BlockOffsets.back() = Offset;
+}
+
+// isInRange - Return true if a JR at Offset reaches the destination of MI.
+// The displacement is relative to the end of the 2 byte instruction.
+bool GBZ80BranchRelaxation::isInRange(const MachineInstr *MI,
+                                      unsigned Offset) const
+{
+  const MachineBasicBlock *Dest = MI->getOperand(0).getMBB();
+  int Disp = (int)BlockOffsets[Dest->getNumber()] - (int)(Offset + 2);
+  return isInt<8>(Disp);
+}
+
+void GBZ80BranchRelaxation::setOpcode(MachineInstr *MI, unsigned Opc)
+{
+  MI->setDesc(TII->get(Opc));
+}
+
+bool GBZ80BranchRelaxation::runOnMachineFunction(MachineFunction &MF)
+{
+  TII = static_cast<const GBZ80InstrInfo *>(MF.getSubtarget().getInstrInfo());
+
+  // Give the blocks of the function a dense, in-order, numbering.
+  MF.RenumberBlocks();
+
+  // Start with every branch to a block in its short form.
+  bool Changed = false;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->getFirstTerminator(),
+         IE = MBB->end(); I != IE; ++I)
+    {
+      unsigned Opc = I->getOpcode();
+      if ((Opc != GBZ80::JP && Opc != GBZ80::JPCC) ||
+          !I->getOperand(0).isMBB())
+        continue;
+      setOpcode(I, Opc == GBZ80::JP ? GBZ80::JR : GBZ80::JRCC);
+      Changed = true;
+    }
+
+  if (!Changed)
+    return false;
+
+  // Grow the branches that can't reach until all of them can.
+  bool Grown = true;
+  while (Grown)
+  {
+    Grown = false;
+    computeBlockOffsets(MF);
+
+    for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+         ++MBB)
+    {
+      unsigned Offset = BlockOffsets[MBB->getNumber()];
+      for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+           I != IE; ++I)
+      {
+        unsigned Opc = I->getOpcode();
+        if ((Opc == GBZ80::JR || Opc == GBZ80::JRCC) && !isInRange(I, Offset))
+        {
+          setOpcode(I, Opc == GBZ80::JR ? GBZ80::JP : GBZ80::JPCC);
+          Grown = true;
+        }
+        Offset += TII->getInstSizeInBytes(I);
+      }
+    }
+  }
+
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->getFirstTerminator(),
+         IE = MBB->end(); I != IE; ++I)
+      if (I->getOpcode() == GBZ80::JR || I->getOpcode() == GBZ80::JRCC)
+        ++NumShort;
+
+  BlockOffsets.clear();
+  return true;
+}
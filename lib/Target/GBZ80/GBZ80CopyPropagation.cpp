@@ -0,0 +1,142 @@
+//===-- GBZ80CopyPropagation.cpp - Remove redundant ld r,r ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that removes 8-bit register moves whose
+// destination already holds the source, after register allocation.
+//
+// MachineCopyPropagation only looks at COPY instructions. On the GB CPU most
+// moves are created after it has run, by the expansion of the copies and of
+// the spill pseudos, and by the ALU sequences that go through A:
+//
+//   ld h, a
+//   ld a, h
+//
+// This pass follows which registers hold the same value through ld r,r
+// within a block and deletes the moves that don't change anything.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-copy-prop"
+
+STATISTIC(NumDeleted, "Number of redundant ld r,r removed");
+
+namespace {
+  class GBZ80CopyPropagation : public MachineFunctionPass {
+  public:
+    static char ID;
+    GBZ80CopyPropagation() : MachineFunctionPass(ID) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    const char *getPassName() const override {
+      return "GBZ80 Copy Propagation";
+    }
+
+  private:
+    const TargetRegisterInfo *TRI;
+
+    // Move - Dst and Src hold the same value since MI.
+    struct Move {
+      unsigned Dst, Src;
+      MachineInstr *MI;
+    };
+
+    bool runOnMachineBasicBlock(MachineBasicBlock &MBB);
+  };
+  char GBZ80CopyPropagation::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80CopyPropagationPass - Returns a pass that removes ld r,r of a
+// value the destination already holds.
+FunctionPass *llvm::createGBZ80CopyPropagationPass() {
+  return new GBZ80CopyPropagation();
+}
+
+bool GBZ80CopyPropagation::runOnMachineBasicBlock(MachineBasicBlock &MBB)
+{
+  SmallVector<Move, 8> Moves;
+  bool Changed = false;
+
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E; )
+  {
+    MachineInstr *MI = I++;
+    bool IsMove = MI->getOpcode() == GBZ80::LD8rr;
+    unsigned Dst = IsMove ? MI->getOperand(0).getReg() : 0;
+    unsigned Src = IsMove ? MI->getOperand(1).getReg() : 0;
+
+    if (IsMove)
+    {
+      SmallVectorImpl<Move>::iterator M = Moves.begin(), ME = Moves.end();
+      for (; M != ME; ++M)
+        if ((M->Dst == Dst && M->Src == Src) ||
+            (M->Dst == Src && M->Src == Dst))
+          break;
+      if (Dst == Src || M != ME)
+      {
+        // Both registers now live on from the earlier move.
+        if (M != ME)
+          for (MachineBasicBlock::iterator J = M->MI; &*J != MI; ++J)
+          {
+            J->clearRegisterKills(Dst, TRI);
+            J->clearRegisterKills(Src, TRI);
+          }
+        MI->eraseFromParent();
+        ++NumDeleted;
+        Changed = true;
+        continue;
+      }
+    }
+
+    // Forget the moves whose registers MI changes.
+    for (unsigned i = 0, e = MI->getNumOperands(); i != e; ++i)
+    {
+      const MachineOperand &MO = MI->getOperand(i);
+      for (unsigned m = 0; m != Moves.size(); )
+      {
+        unsigned R[] = { Moves[m].Dst, Moves[m].Src };
+        bool Clobbered = false;
+        for (unsigned r = 0; r != 2; ++r)
+          if ((MO.isRegMask() && MO.clobbersPhysReg(R[r])) ||
+              (MO.isReg() && MO.isDef() && MO.getReg() &&
+               TRI->regsOverlap(MO.getReg(), R[r])))
+            Clobbered = true;
+        if (Clobbered)
+          Moves.erase(Moves.begin() + m);
+        else
+          ++m;
+      }
+    }
+
+    if (IsMove)
+    {
+      Move M = { Dst, Src, MI };
+      Moves.push_back(M);
+    }
+  }
+  return Changed;
+}
+
+bool GBZ80CopyPropagation::runOnMachineFunction(MachineFunction &MF)
+{
+  TRI = MF.getSubtarget().getRegisterInfo();
+
+  bool Changed = false;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    Changed |= runOnMachineBasicBlock(*MBB);
+  return Changed;
+}
@@ -0,0 +1,1228 @@
+//===-- GBZ80FastISel.cpp - GBZ80 FastISel implementation -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the GBZ80-specific support for the FastISel class, used
+// at -O0 to select instructions without building a SelectionDAG. Almost every
+// operation goes through A or HL, so the selection is written by hand instead
+// of using the tablegen'erated fastEmit functions. It covers loads and stores,
+// 8 and 16-bit arithmetic, compares, branches, calls and returns. Everything
+// else, such as selects, switches, variable shifts, multiplies and i32, is
+// left to the SelectionDAG selector.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "GBZ80ISelLowering.h"
+#include "GBZ80MachineFunctionInfo.h"
+#include "GBZ80TargetMachine.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/CodeGen/CallingConvLower.h"
+#include "llvm/CodeGen/FastISel.h"
+#include "llvm/CodeGen/FunctionLoweringInfo.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+using namespace llvm;
+
+#include "GBZ80GenCallingConv.inc"
+
+namespace {
+
+class GBZ80FastISel final : public FastISel {
+  // Address - A memory operand: an absolute address, a global or a constant,
+  // a stack object, or a register, plus a constant offset.
+  struct Address {
+    enum { RegBase, FrameIndexBase, GlobalBase, ConstantBase } Kind;
+    unsigned Reg;
+    int FI;
+    const GlobalValue *GV;
+    int64_t Offset;
+
+    Address() : Kind(RegBase), Reg(0), FI(0), GV(nullptr), Offset(0) {}
+    bool isAbsolute() const
+    {
+      return Kind == GlobalBase || Kind == ConstantBase;
+    }
+  };
+
+  LLVMContext *Context;
+
+public:
+  explicit GBZ80FastISel(FunctionLoweringInfo &FuncInfo,
+                         const TargetLibraryInfo *LibInfo)
+    : FastISel(FuncInfo, LibInfo), Context(&FuncInfo.Fn->getContext()) {}
+
+  bool fastSelectInstruction(const Instruction *I) override;
+  unsigned fastMaterializeConstant(const Constant *C) override;
+  unsigned fastMaterializeAlloca(const AllocaInst *AI) override;
+  bool fastLowerArguments() override;
+  bool fastLowerCall(CallLoweringInfo &CLI) override;
+
+  unsigned fastEmit_r(MVT VT, MVT RetVT, unsigned Opcode, unsigned Op0,
+                      bool Op0IsKill) override;
+  unsigned fastEmit_rr(MVT VT, MVT RetVT, unsigned Opcode, unsigned Op0,
+                       bool Op0IsKill, unsigned Op1, bool Op1IsKill) override;
+  unsigned fastEmit_ri(MVT VT, MVT RetVT, unsigned Opcode, unsigned Op0,
+                       bool Op0IsKill, uint64_t Imm) override;
+  unsigned fastEmit_i(MVT VT, MVT RetVT, unsigned Opcode,
+                      uint64_t Imm) override;
+
+private:
+  bool selectLoad(const Instruction *I);
+  bool selectStore(const Instruction *I);
+  bool selectBranch(const Instruction *I);
+  bool selectCmp(const Instruction *I);
+  bool selectIntCast(const Instruction *I);
+  bool selectRet(const Instruction *I);
+
+  bool isTypeLegal(Type *Ty, MVT &VT);
+  bool computeAddress(const Value *Obj, Address &Addr);
+  unsigned emitAddress(const Address &Addr);
+  MachineMemOperand *getMemOperand(const Instruction *I, unsigned Offset);
+
+  MachineInstrBuilder emitInst(unsigned Opc);
+  MachineInstrBuilder emitInst(unsigned Opc, unsigned DstReg);
+  void emitCopy(unsigned DstReg, unsigned SrcReg, unsigned SubIdx = 0);
+  unsigned copyFromPhysReg(unsigned PhysReg, const TargetRegisterClass *RC);
+  unsigned emitPair(unsigned Lo, unsigned Hi);
+
+  void emitAbsolute(MachineInstrBuilder &MIB, const Address &Addr,
+                    unsigned Offset);
+  bool isHighPage(const Address &Addr, unsigned Offset);
+  unsigned emitAbsoluteLoad(const Address &Addr, unsigned Offset,
+                            MachineMemOperand *MMO);
+  void emitAbsoluteStore(const Address &Addr, unsigned Offset, unsigned Reg,
+                         unsigned SubIdx, uint64_t Imm,
+                         MachineMemOperand *MMO);
+  void emitStoreHL(MVT VT, unsigned Reg, uint64_t Imm, const Instruction *I);
+
+  void emitOperand(unsigned Opc, unsigned Reg, unsigned SubIdx, uint64_t Imm);
+  unsigned emitALU8(unsigned Opc, unsigned LHS, unsigned LHSSub, unsigned RHS,
+                    unsigned RHSSub, uint64_t Imm);
+  unsigned emitALU16(unsigned ISDOpc, unsigned LHS, unsigned RHS,
+                     uint64_t Imm);
+  unsigned emitAdd16(unsigned LHS, unsigned RHS);
+  unsigned emitShl(MVT VT, unsigned Reg, uint64_t Amount);
+  unsigned emitExtend16(unsigned Reg, bool Signed);
+  unsigned emitNeg(unsigned Reg);
+
+  bool getCompareOperand(const Value *V, MVT VT, bool FlipSign,
+                         unsigned &Reg, uint64_t &Imm);
+  GBZ80::CondCode emitCompare(CmpInst::Predicate Pred, const Value *LHS,
+                              const Value *RHS);
+};
+
+} // end anonymous namespace
+
+// isTypeLegal - Only i8 and i16, and pointers, live in registers.
+bool GBZ80FastISel::isTypeLegal(Type *Ty, MVT &VT)
+{
+  EVT Evt = TLI.getValueType(Ty, true);
+  if (Evt == MVT::Other || !Evt.isSimple())
+    return false;
+  VT = Evt.getSimpleVT();
+  return VT == MVT::i8 || VT == MVT::i16;
+}
+
+MachineInstrBuilder GBZ80FastISel::emitInst(unsigned Opc)
+{
+  return BuildMI(*FuncInfo.MBB, FuncInfo.InsertPt, DbgLoc, TII.get(Opc));
+}
+
+MachineInstrBuilder GBZ80FastISel::emitInst(unsigned Opc, unsigned DstReg)
+{
+  return BuildMI(*FuncInfo.MBB, FuncInfo.InsertPt, DbgLoc, TII.get(Opc),
+                 DstReg);
+}
+
+void GBZ80FastISel::emitCopy(unsigned DstReg, unsigned SrcReg,
+                             unsigned SubIdx)
+{
+  emitInst(TargetOpcode::COPY, DstReg).addReg(SrcReg, 0, SubIdx);
+}
+
+// copyFromPhysReg - Copy the result of an instruction out of A or HL into a
+// new virtual register.
+unsigned GBZ80FastISel::copyFromPhysReg(unsigned PhysReg,
+                                        const TargetRegisterClass *RC)
+{
+  unsigned ResultReg = createResultReg(RC);
+  emitCopy(ResultReg, PhysReg);
+  return ResultReg;
+}
+
+// emitPair - Build an i16 out of two bytes.
+unsigned GBZ80FastISel::emitPair(unsigned Lo, unsigned Hi)
+{
+  unsigned ResultReg = createResultReg(&GBZ80::GR16RegClass);
+  emitInst(TargetOpcode::REG_SEQUENCE, ResultReg)
+    .addReg(Lo).addImm(GBZ80::subreg_lo)
+    .addReg(Hi).addImm(GBZ80::subreg_hi);
+  return ResultReg;
+}
+
+// getALUOpcode - The accumulator form of an ISD operation, or 0 if there is
+// none.
+static unsigned getALUOpcode(unsigned ISDOpc, bool IsImm, bool WithCarry)
+{
+  switch (ISDOpc)
+  {
+  default:
+    return 0;
+  case ISD::ADD:
+    if (WithCarry)
+      return IsImm ? GBZ80::ADC8i : GBZ80::ADC8r;
+    return IsImm ? GBZ80::ADD8i : GBZ80::ADD8r;
+  case ISD::SUB:
+    if (WithCarry)
+      return IsImm ? GBZ80::SBC8i : GBZ80::SBC8r;
+    return IsImm ? GBZ80::SUB8i : GBZ80::SUB8r;
+  case ISD::AND:
+    return IsImm ? GBZ80::AND8i : GBZ80::AND8r;
+  case ISD::OR:
+    return IsImm ? GBZ80::OR8i : GBZ80::OR8r;
+  case ISD::XOR:
+    return IsImm ? GBZ80::XOR8i : GBZ80::XOR8r;
+  }
+}
+
+// emitOperand - Emit the accumulator operation Opc with the register Reg, or
+// with the constant Imm if Reg is zero.
+void GBZ80FastISel::emitOperand(unsigned Opc, unsigned Reg, unsigned SubIdx,
+                                uint64_t Imm)
+{
+  MachineInstrBuilder MIB = emitInst(Opc);
+  if (Reg)
+    MIB.addReg(Reg, 0, SubIdx);
+  else
+    MIB.addImm(Imm & 0xFF);
+}
+
+// emitALU8 - Load LHS into A, apply Opc with RHS or Imm and copy the result
+// out of A again.
+unsigned GBZ80FastISel::emitALU8(unsigned Opc, unsigned LHS, unsigned LHSSub,
+                                 unsigned RHS, unsigned RHSSub, uint64_t Imm)
+{
+  emitCopy(GBZ80::A, LHS, LHSSub);
+  emitOperand(Opc, RHS, RHSSub, Imm);
+  return copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+}
+
+// isIdentityByte - Return true if the logic operation ISDOpc with the byte
+// Byte leaves the other operand unchanged.
+static bool isIdentityByte(unsigned ISDOpc, uint64_t Byte)
+{
+  switch (ISDOpc)
+  {
+  default:
+    return false;
+  case ISD::AND:
+    return Byte == 0xFF;
+  case ISD::OR:
+  case ISD::XOR:
+    return Byte == 0;
+  }
+}
+
+// emitALU16 - A 16-bit operation a byte at a time through A, the low byte
+// first so that the borrow of a subtract carries over into the high byte. The
+// right hand side is RHS, or the constant Imm if RHS is zero.
+unsigned GBZ80FastISel::emitALU16(unsigned ISDOpc, unsigned LHS, unsigned RHS,
+                                  uint64_t Imm)
+{
+  unsigned Bytes[2];
+  for (unsigned i = 0; i != 2; ++i)
+  {
+    unsigned SubIdx = i == 0 ? GBZ80::subreg_lo : GBZ80::subreg_hi;
+    uint64_t Byte = (Imm >> (8 * i)) & 0xFF;
+    if (!RHS && isIdentityByte(ISDOpc, Byte))
+      Bytes[i] = fastEmitInst_extractsubreg(MVT::i8, LHS, false, SubIdx);
+    else
+      Bytes[i] = emitALU8(getALUOpcode(ISDOpc, !RHS, i != 0), LHS, SubIdx,
+                          RHS, SubIdx, Byte);
+  }
+  return emitPair(Bytes[0], Bytes[1]);
+}
+
+// emitAdd16 - add hl,rr.
+unsigned GBZ80FastISel::emitAdd16(unsigned LHS, unsigned RHS)
+{
+  emitCopy(GBZ80::HL, LHS);
+  emitInst(GBZ80::ADD16r).addReg(RHS);
+  return copyFromPhysReg(GBZ80::HL, &GBZ80::GR16RegClass);
+}
+
+// emitShl - A shift left by a constant doubles the value with add a,a or add
+// hl,hl. An i16 shift by a byte or more is left to the SelectionDAG, which
+// moves the bytes instead.
+unsigned GBZ80FastISel::emitShl(MVT VT, unsigned Reg, uint64_t Amount)
+{
+  if (VT == MVT::i8)
+  {
+    if (Amount >= 8)
+      return fastEmit_i(VT, VT, ISD::Constant, 0);
+    emitCopy(GBZ80::A, Reg);
+    for (uint64_t i = 0; i != Amount; ++i)
+      emitInst(GBZ80::ADD8r).addReg(GBZ80::A);
+    return copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+  }
+
+  if (Amount >= 8)
+    return 0;
+  emitCopy(GBZ80::HL, Reg);
+  for (uint64_t i = 0; i != Amount; ++i)
+    emitInst(GBZ80::ADD16r).addReg(GBZ80::HL);
+  return copyFromPhysReg(GBZ80::HL, &GBZ80::GR16RegClass);
+}
+
+// emitExtend16 - Extend a byte to 16 bits. The sign is moved into the carry
+// with add a,a and spread over the high byte with sbc a,a, as in LowerSExt.
+unsigned GBZ80FastISel::emitExtend16(unsigned Reg, bool Signed)
+{
+  unsigned Hi;
+  if (Signed)
+  {
+    emitCopy(GBZ80::A, Reg);
+    emitInst(GBZ80::ADD8r).addReg(GBZ80::A);
+    emitInst(GBZ80::SBC8r).addReg(GBZ80::A);
+    Hi = copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+  }
+  else
+    Hi = fastEmit_i(MVT::i8, MVT::i8, ISD::Constant, 0);
+  return emitPair(Reg, Hi);
+}
+
+// emitNeg - cpl and inc a.
+unsigned GBZ80FastISel::emitNeg(unsigned Reg)
+{
+  emitCopy(GBZ80::A, Reg);
+  emitInst(GBZ80::NEG);
+  return copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+}
+
+unsigned GBZ80FastISel::fastEmit_i(MVT VT, MVT RetVT, unsigned Opcode,
+                                   uint64_t Imm)
+{
+  if (Opcode != ISD::Constant || VT != RetVT)
+    return 0;
+
+  unsigned ResultReg;
+  if (VT == MVT::i8)
+  {
+    ResultReg = createResultReg(&GBZ80::GR8RegClass);
+    emitInst(GBZ80::LD8ri, ResultReg).addImm(Imm & 0xFF);
+  }
+  else if (VT == MVT::i16)
+  {
+    ResultReg = createResultReg(&GBZ80::GR16RegClass);
+    emitInst(GBZ80::LD16ri, ResultReg).addImm(Imm & 0xFFFF);
+  }
+  else
+    return 0;
+  return ResultReg;
+}
+
+unsigned GBZ80FastISel::fastEmit_r(MVT VT, MVT RetVT, unsigned Opcode,
+                                   unsigned Op0, bool Op0IsKill)
+{
+  switch (Opcode)
+  {
+  default:
+    return 0;
+  case ISD::TRUNCATE:
+    if (VT != MVT::i16 || RetVT != MVT::i8)
+      return 0;
+    return fastEmitInst_extractsubreg(RetVT, Op0, Op0IsKill,
+                                      GBZ80::subreg_lo);
+  case ISD::ANY_EXTEND:
+  case ISD::ZERO_EXTEND:
+  case ISD::SIGN_EXTEND:
+    if (VT != MVT::i8 || RetVT != MVT::i16)
+      return 0;
+    return emitExtend16(Op0, Opcode == ISD::SIGN_EXTEND);
+  }
+}
+
+unsigned GBZ80FastISel::fastEmit_rr(MVT VT, MVT RetVT, unsigned Opcode,
+                                    unsigned Op0, bool Op0IsKill,
+                                    unsigned Op1, bool Op1IsKill)
+{
+  unsigned Opc = getALUOpcode(Opcode, false, false);
+  if (VT != RetVT || !Opc)
+    return 0;
+
+  if (VT == MVT::i8)
+    return emitALU8(Opc, Op0, 0, Op1, 0, 0);
+  if (VT != MVT::i16)
+    return 0;
+  if (Opcode == ISD::ADD)
+    return emitAdd16(Op0, Op1);
+  return emitALU16(Opcode, Op0, Op1, 0);
+}
+
+unsigned GBZ80FastISel::fastEmit_ri(MVT VT, MVT RetVT, unsigned Opcode,
+                                    unsigned Op0, bool Op0IsKill,
+                                    uint64_t Imm)
+{
+  if (VT != RetVT || (VT != MVT::i8 && VT != MVT::i16))
+    return 0;
+  uint64_t Mask = VT == MVT::i8 ? 0xFF : 0xFFFF;
+
+  if (Opcode == ISD::SHL)
+    return emitShl(VT, Op0, Imm);
+
+  // Subtract a constant by adding its negation.
+  if (Opcode == ISD::SUB)
+  {
+    Opcode = ISD::ADD;
+    Imm = -Imm;
+  }
+  Imm &= Mask;
+
+  if (Opcode == ISD::ADD && (Imm == 1 || Imm == Mask))
+  {
+    // inc and dec work on any register.
+    unsigned Opc;
+    if (VT == MVT::i8)
+      Opc = Imm == 1 ? GBZ80::INC8r : GBZ80::DEC8r;
+    else
+      Opc = Imm == 1 ? GBZ80::INC16r : GBZ80::DEC16r;
+    return fastEmitInst_r(Opc, TLI.getRegClassFor(VT), Op0, Op0IsKill);
+  }
+  if (VT == MVT::i16 && Opcode == ISD::ADD)
+    return emitAdd16(Op0, fastEmit_i(VT, VT, ISD::Constant, Imm));
+
+  unsigned Opc = getALUOpcode(Opcode, true, false);
+  if (!Opc)
+    return 0;
+  if (VT == MVT::i8)
+    return emitALU8(Opc, Op0, 0, 0, 0, Imm);
+  return emitALU16(Opcode, Op0, 0, Imm);
+}
+
+unsigned GBZ80FastISel::fastMaterializeConstant(const Constant *C)
+{
+  if (const ConstantInt *CI = dyn_cast<ConstantInt>(C))
+  {
+    MVT VT;
+    if (CI->getType()->isIntegerTy(1))
+      VT = MVT::i8;
+    else if (!isTypeLegal(CI->getType(), VT))
+      return 0;
+    return fastEmit_i(VT, VT, ISD::Constant, CI->getZExtValue());
+  }
+
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(C))
+  {
+    if (GV->isThreadLocal())
+      return 0;
+    unsigned ResultReg = createResultReg(&GBZ80::GR16RegClass);
+    emitInst(GBZ80::LD16ri, ResultReg).addGlobalAddress(GV);
+    return ResultReg;
+  }
+  return 0;
+}
+
+// fastMaterializeAlloca - The address of a stack object is computed into HL
+// with ld hl,sp+e, see GBZ80RegisterInfo::eliminateFrameIndex.
+unsigned GBZ80FastISel::fastMaterializeAlloca(const AllocaInst *AI)
+{
+  DenseMap<const AllocaInst *, int>::iterator SI =
+    FuncInfo.StaticAllocaMap.find(AI);
+  if (SI == FuncInfo.StaticAllocaMap.end())
+    return 0;
+
+  Address Addr;
+  Addr.Kind = Address::FrameIndexBase;
+  Addr.FI = SI->second;
+  unsigned ResultReg = createResultReg(&GBZ80::GR16RegClass);
+  emitCopy(ResultReg, emitAddress(Addr));
+  return ResultReg;
+}
+
+// computeAddress - Fold the constant offsets of GEPs and the casts of a
+// pointer into Addr. Everything else becomes a register base.
+bool GBZ80FastISel::computeAddress(const Value *Obj, Address &Addr)
+{
+  const User *U = nullptr;
+  unsigned Opcode = Instruction::UserOp1;
+  if (const Instruction *I = dyn_cast<Instruction>(Obj))
+  {
+    // Only look through instructions of this block, or of a static alloca,
+    // whose registers are known here.
+    if (FuncInfo.StaticAllocaMap.count(static_cast<const AllocaInst *>(I)) ||
+        FuncInfo.MBBMap[I->getParent()] == FuncInfo.MBB)
+    {
+      Opcode = I->getOpcode();
+      U = I;
+    }
+  }
+  else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(Obj))
+  {
+    Opcode = CE->getOpcode();
+    U = CE;
+  }
+
+  switch (Opcode)
+  {
+  default:
+    break;
+  case Instruction::BitCast:
+    return computeAddress(U->getOperand(0), Addr);
+  case Instruction::IntToPtr:
+    if (TLI.getValueType(U->getOperand(0)->getType()) == TLI.getPointerTy())
+      return computeAddress(U->getOperand(0), Addr);
+    break;
+  case Instruction::GetElementPtr:
+  {
+    APInt Offset(16, 0);
+    if (!cast<GEPOperator>(U)->accumulateConstantOffset(DL, Offset))
+      break;
+    Address SavedAddr = Addr;
+    Addr.Offset += Offset.getSExtValue();
+    if (computeAddress(U->getOperand(0), Addr))
+      return true;
+    Addr = SavedAddr;
+    break;
+  }
+  case Instruction::Alloca:
+  {
+    const AllocaInst *AI = cast<AllocaInst>(Obj);
+    DenseMap<const AllocaInst *, int>::iterator SI =
+      FuncInfo.StaticAllocaMap.find(AI);
+    if (SI != FuncInfo.StaticAllocaMap.end())
+    {
+      Addr.Kind = Address::FrameIndexBase;
+      Addr.FI = SI->second;
+      return true;
+    }
+    break;
+  }
+  }
+
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(Obj))
+  {
+    if (GV->isThreadLocal())
+      return false;
+    Addr.Kind = Address::GlobalBase;
+    Addr.GV = GV;
+    return true;
+  }
+  if (const ConstantInt *CI = dyn_cast<ConstantInt>(Obj))
+  {
+    Addr.Kind = Address::ConstantBase;
+    Addr.Offset += CI->getZExtValue();
+    return true;
+  }
+  if (isa<ConstantPointerNull>(Obj))
+  {
+    Addr.Kind = Address::ConstantBase;
+    return true;
+  }
+
+  Addr.Kind = Address::RegBase;
+  Addr.Reg = getRegForValue(Obj);
+  return Addr.Reg != 0;
+}
+
+// emitAddress - Compute a stack or register address into a register.
+unsigned GBZ80FastISel::emitAddress(const Address &Addr)
+{
+  assert(!Addr.isAbsolute() && "Absolute addresses are encoded directly");
+  if (Addr.Kind == Address::FrameIndexBase)
+  {
+    unsigned ResultReg = createResultReg(&GBZ80::GR16_HLRegClass);
+    emitInst(GBZ80::FRMIDX, ResultReg)
+      .addFrameIndex(Addr.FI).addImm(Addr.Offset);
+    return ResultReg;
+  }
+  if (Addr.Offset == 0)
+    return Addr.Reg;
+  return fastEmit_ri_(MVT::i16, ISD::ADD, Addr.Reg, false, Addr.Offset,
+                      MVT::i16);
+}
+
+// getMemOperand - The memory operand of the byte at Offset of the value the
+// load or store I accesses. Every byte is a separate access.
+MachineMemOperand *GBZ80FastISel::getMemOperand(const Instruction *I,
+                                                unsigned Offset)
+{
+  if (!I)
+    return nullptr;
+
+  const Value *Ptr;
+  unsigned Flags;
+  bool IsVolatile;
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I))
+  {
+    Ptr = LI->getPointerOperand();
+    Flags = MachineMemOperand::MOLoad;
+    IsVolatile = LI->isVolatile();
+  }
+  else
+  {
+    const StoreInst *SI = cast<StoreInst>(I);
+    Ptr = SI->getPointerOperand();
+    Flags = MachineMemOperand::MOStore;
+    IsVolatile = SI->isVolatile();
+  }
+  if (IsVolatile)
+    Flags |= MachineMemOperand::MOVolatile;
+  return FuncInfo.MF->getMachineMemOperand(MachinePointerInfo(Ptr, Offset),
+                                           Flags, 1, 1);
+}
+
+// emitAbsolute - Add the address of the byte at Offset of an absolute
+// address to MIB.
+void GBZ80FastISel::emitAbsolute(MachineInstrBuilder &MIB,
+                                 const Address &Addr, unsigned Offset)
+{
+  if (Addr.Kind == Address::GlobalBase)
+    MIB.addGlobalAddress(Addr.GV, Addr.Offset + Offset);
+  else
+    MIB.addImm((Addr.Offset + Offset) & 0xFFFF);
+}
+
+// isHighPage - Return true if the byte at Offset of an absolute address can
+// be reached with ldh, like SelectHAddr does.
+bool GBZ80FastISel::isHighPage(const Address &Addr, unsigned Offset)
+{
+  if (Addr.Kind == Address::GlobalBase)
+    return GBZ80::isHRAMGlobal(Addr.GV);
+  return ((Addr.Offset + Offset) & 0xFFFF) >= 0xFF00;
+}
+
+// emitAbsoluteLoad - ld a,(nn) or ldh a,(n) of the byte at Offset.
+unsigned GBZ80FastISel::emitAbsoluteLoad(const Address &Addr, unsigned Offset,
+                                         MachineMemOperand *MMO)
+{
+  MachineInstrBuilder MIB =
+    emitInst(isHighPage(Addr, Offset) ? GBZ80::LDH8Am : GBZ80::LD8Am);
+  emitAbsolute(MIB, Addr, Offset);
+  MIB.addMemOperand(MMO);
+  return copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+}
+
+// emitAbsoluteStore - ld (nn),a or ldh (n),a of the byte SubIdx of Reg, or of
+// the constant Imm if Reg is zero, to the byte at Offset.
+void GBZ80FastISel::emitAbsoluteStore(const Address &Addr, unsigned Offset,
+                                      unsigned Reg, unsigned SubIdx,
+                                      uint64_t Imm, MachineMemOperand *MMO)
+{
+  if (Reg)
+    emitCopy(GBZ80::A, Reg, SubIdx);
+  else
+    emitInst(GBZ80::LD8ri, GBZ80::A).addImm(Imm & 0xFF);
+  MachineInstrBuilder MIB =
+    emitInst(isHighPage(Addr, Offset) ? GBZ80::LDH8mA : GBZ80::LD8mA);
+  emitAbsolute(MIB, Addr, Offset);
+  MIB.addMemOperand(MMO);
+}
+
+bool GBZ80FastISel::selectLoad(const Instruction *I)
+{
+  const LoadInst *LI = cast<LoadInst>(I);
+  if (LI->isAtomic())
+    return false;
+
+  MVT VT;
+  if (!isTypeLegal(LI->getType(), VT))
+    return false;
+  Address Addr;
+  if (!computeAddress(LI->getPointerOperand(), Addr))
+    return false;
+
+  unsigned Lo, Hi = 0;
+  if (Addr.isAbsolute())
+  {
+    Lo = emitAbsoluteLoad(Addr, 0, getMemOperand(I, 0));
+    if (VT == MVT::i16)
+      Hi = emitAbsoluteLoad(Addr, 1, getMemOperand(I, 1));
+  }
+  else
+  {
+    unsigned AddrReg = emitAddress(Addr);
+    if (!AddrReg)
+      return false;
+    emitCopy(GBZ80::HL, AddrReg);
+    if (VT == MVT::i16)
+    {
+      // ld a,(hl+) leaves HL pointing at the high byte.
+      Lo = createResultReg(&GBZ80::GR8_ARegClass);
+      emitInst(GBZ80::LD8AHLI, Lo).addMemOperand(getMemOperand(I, 0));
+      Hi = createResultReg(&GBZ80::GR8RegClass);
+      emitInst(GBZ80::LD8rHL, Hi).addMemOperand(getMemOperand(I, 1));
+    }
+    else
+    {
+      Lo = createResultReg(&GBZ80::GR8RegClass);
+      emitInst(GBZ80::LD8rHL, Lo).addMemOperand(getMemOperand(I, 0));
+    }
+  }
+
+  updateValueMap(I, Hi ? emitPair(Lo, Hi) : Lo);
+  return true;
+}
+
+// emitStoreHL - Store the value in Reg, or the constant Imm if Reg is zero,
+// to the address in HL. The low byte of an i16 is stored with ld (hl+),a.
+void GBZ80FastISel::emitStoreHL(MVT VT, unsigned Reg, uint64_t Imm,
+                                const Instruction *I)
+{
+  unsigned Offset = 0;
+  unsigned SubIdx = 0;
+  if (VT == MVT::i16)
+  {
+    unsigned LoReg = createResultReg(&GBZ80::GR8_ARegClass);
+    if (Reg)
+      emitCopy(LoReg, Reg, GBZ80::subreg_lo);
+    else
+      emitInst(GBZ80::LD8ri, LoReg).addImm(Imm & 0xFF);
+    MachineInstrBuilder MIB = emitInst(GBZ80::LD8HLIA).addReg(LoReg);
+    if (I)
+      MIB.addMemOperand(getMemOperand(I, 0));
+    Offset = 1;
+    SubIdx = GBZ80::subreg_hi;
+    Imm >>= 8;
+  }
+
+  MachineInstrBuilder MIB;
+  if (Reg)
+    MIB = emitInst(GBZ80::LD8HLr).addReg(Reg, 0, SubIdx);
+  else
+    MIB = emitInst(GBZ80::LD8HLi).addImm(Imm & 0xFF);
+  if (I)
+    MIB.addMemOperand(getMemOperand(I, Offset));
+}
+
+bool GBZ80FastISel::selectStore(const Instruction *I)
+{
+  const StoreInst *SI = cast<StoreInst>(I);
+  if (SI->isAtomic())
+    return false;
+
+  const Value *Val = SI->getValueOperand();
+  MVT VT;
+  if (!isTypeLegal(Val->getType(), VT))
+    return false;
+
+  // Constants are stored as immediates.
+  unsigned ValReg = 0;
+  uint64_t Imm = 0;
+  if (const ConstantInt *CI = dyn_cast<ConstantInt>(Val))
+    Imm = CI->getZExtValue();
+  else if (!(ValReg = getRegForValue(Val)))
+    return false;
+
+  Address Addr;
+  if (!computeAddress(SI->getPointerOperand(), Addr))
+    return false;
+
+  if (Addr.isAbsolute())
+  {
+    if (VT == MVT::i8)
+      emitAbsoluteStore(Addr, 0, ValReg, 0, Imm, getMemOperand(I, 0));
+    else
+    {
+      emitAbsoluteStore(Addr, 0, ValReg, GBZ80::subreg_lo, Imm,
+                        getMemOperand(I, 0));
+      emitAbsoluteStore(Addr, 1, ValReg, GBZ80::subreg_hi, Imm >> 8,
+                        getMemOperand(I, 1));
+    }
+    return true;
+  }
+
+  unsigned AddrReg = emitAddress(Addr);
+  if (!AddrReg)
+    return false;
+  emitCopy(GBZ80::HL, AddrReg);
+  emitStoreHL(VT, ValReg, Imm, I);
+  return true;
+}
+
+// getCompareOperand - Get an operand of a compare as a register, or as the
+// constant Imm with Reg set to zero. FlipSign flips the sign bit for a signed
+// compare.
+bool GBZ80FastISel::getCompareOperand(const Value *V, MVT VT, bool FlipSign,
+                                      unsigned &Reg, uint64_t &Imm)
+{
+  uint64_t SignBit = VT == MVT::i8 ? 0x80 : 0x8000;
+  if (const ConstantInt *CI = dyn_cast<ConstantInt>(V))
+  {
+    Reg = 0;
+    Imm = CI->getZExtValue() ^ (FlipSign ? SignBit : 0);
+    return true;
+  }
+
+  Reg = getRegForValue(V);
+  if (Reg && FlipSign)
+    Reg = fastEmit_ri(VT, VT, ISD::XOR, Reg, false, SignBit);
+  return Reg != 0;
+}
+
+// emitCompare - Compare LHS and RHS and return the condition that is true if
+// Pred holds, or COND_INVALID if the compare is not handled. The conditions
+// are mapped as in GBZ80TargetLowering::EmitCMP, but an i16 compare is
+// emitted inline instead of with the CMP16 pseudos, which need a custom
+// inserter.
+GBZ80::CondCode GBZ80FastISel::emitCompare(CmpInst::Predicate Pred,
+                                           const Value *LHS,
+                                           const Value *RHS)
+{
+  MVT VT;
+  if (!isTypeLegal(LHS->getType(), VT))
+    return GBZ80::COND_INVALID;
+
+  GBZ80::CondCode CC;
+  bool Signed = false;
+  switch (Pred)
+  {
+  default:
+    return GBZ80::COND_INVALID;
+  case CmpInst::ICMP_NE:
+    CC = GBZ80::COND_NZ;
+    break;
+  case CmpInst::ICMP_EQ:
+    CC = GBZ80::COND_Z;
+    break;
+  case CmpInst::ICMP_SGT:
+    Signed = true;
+  case CmpInst::ICMP_UGT:
+    std::swap(LHS, RHS);
+    CC = GBZ80::COND_C;
+    break;
+  case CmpInst::ICMP_SLT:
+    Signed = true;
+  case CmpInst::ICMP_ULT:
+    CC = GBZ80::COND_C;
+    break;
+  case CmpInst::ICMP_SLE:
+    Signed = true;
+  case CmpInst::ICMP_ULE:
+    std::swap(LHS, RHS);
+    CC = GBZ80::COND_NC;
+    break;
+  case CmpInst::ICMP_SGE:
+    Signed = true;
+  case CmpInst::ICMP_UGE:
+    CC = GBZ80::COND_NC;
+    break;
+  }
+  bool IsEquality = CC == GBZ80::COND_Z || CC == GBZ80::COND_NZ;
+
+  // Keep a constant on the right where it fits in the instruction.
+  if (isa<ConstantInt>(LHS) && IsEquality)
+    std::swap(LHS, RHS);
+
+  unsigned LHSReg, RHSReg;
+  uint64_t LHSImm, RHSImm;
+  if (!getCompareOperand(LHS, VT, Signed, LHSReg, LHSImm) ||
+      !getCompareOperand(RHS, VT, Signed, RHSReg, RHSImm))
+    return GBZ80::COND_INVALID;
+  if (!LHSReg && !(LHSReg = fastEmit_i(VT, VT, ISD::Constant, LHSImm)))
+    return GBZ80::COND_INVALID;
+
+  if (VT == MVT::i8)
+  {
+    // An equality compares with xor, leaving A zero exactly if the operands
+    // are equal, for selectCmp.
+    emitCopy(GBZ80::A, LHSReg);
+    if (IsEquality)
+      emitOperand(RHSReg ? GBZ80::XOR8r : GBZ80::XOR8i, RHSReg, 0, RHSImm);
+    else
+      emitOperand(RHSReg ? GBZ80::CP8r : GBZ80::CP8i, RHSReg, 0, RHSImm);
+    return CC;
+  }
+
+  if (IsEquality)
+  {
+    if (!RHSReg && RHSImm == 0)
+    {
+      emitInst(GBZ80::TST16).addReg(LHSReg);
+      return CC;
+    }
+
+    // Again A is zero exactly if both bytes are equal.
+    emitCopy(GBZ80::A, LHSReg, GBZ80::subreg_lo);
+    emitOperand(RHSReg ? GBZ80::XOR8r : GBZ80::XOR8i, RHSReg,
+                GBZ80::subreg_lo, RHSImm);
+    unsigned LoReg = copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass);
+    emitCopy(GBZ80::A, LHSReg, GBZ80::subreg_hi);
+    emitOperand(RHSReg ? GBZ80::XOR8r : GBZ80::XOR8i, RHSReg,
+                GBZ80::subreg_hi, RHSImm >> 8);
+    emitInst(GBZ80::OR8r).addReg(LoReg);
+    return CC;
+  }
+
+  // cp on the low byte and sbc on the high byte leave the borrow of the
+  // whole subtraction in the carry.
+  emitCopy(GBZ80::A, LHSReg, GBZ80::subreg_lo);
+  emitOperand(RHSReg ? GBZ80::CP8r : GBZ80::CP8i, RHSReg, GBZ80::subreg_lo,
+              RHSImm);
+  emitCopy(GBZ80::A, LHSReg, GBZ80::subreg_hi);
+  emitOperand(RHSReg ? GBZ80::SBC8r : GBZ80::SBC8i, RHSReg, GBZ80::subreg_hi,
+              RHSImm >> 8);
+  return CC;
+}
+
+// selectCmp - Materialize a compare as 0 or 1 by adding the carry into a
+// zeroed A. After an equality compare A is zero exactly if the operands are
+// equal, cp 1 turns that into the carry.
+bool GBZ80FastISel::selectCmp(const Instruction *I)
+{
+  const CmpInst *CI = cast<CmpInst>(I);
+  GBZ80::CondCode CC = emitCompare(CI->getPredicate(), CI->getOperand(0),
+                                   CI->getOperand(1));
+  if (CC == GBZ80::COND_INVALID)
+    return false;
+
+  if (CC == GBZ80::COND_Z || CC == GBZ80::COND_NZ)
+  {
+    if (CC == GBZ80::COND_Z)
+      CC = GBZ80::COND_C;
+    else
+      CC = GBZ80::COND_NC;
+    emitInst(GBZ80::CP8i).addImm(1);
+  }
+
+  emitInst(GBZ80::LD8ri, GBZ80::A).addImm(0);
+  emitInst(GBZ80::ADC8r).addReg(GBZ80::A);
+  if (CC == GBZ80::COND_NC)
+    emitInst(GBZ80::XOR8i).addImm(1);
+  updateValueMap(I, copyFromPhysReg(GBZ80::A, &GBZ80::GR8RegClass));
+  return true;
+}
+
+// selectBranch - Fuse a compare of the same block into the branch, or test
+// bit 0 of an i1.
+bool GBZ80FastISel::selectBranch(const Instruction *I)
+{
+  const BranchInst *BI = cast<BranchInst>(I);
+  MachineBasicBlock *TrueMBB = FuncInfo.MBBMap[BI->getSuccessor(0)];
+  MachineBasicBlock *FalseMBB = FuncInfo.MBBMap[BI->getSuccessor(1)];
+
+  CmpInst::Predicate Pred = CmpInst::BAD_ICMP_PREDICATE;
+  const ICmpInst *CI = dyn_cast<ICmpInst>(BI->getCondition());
+  if (CI && CI->hasOneUse() && CI->getParent() == I->getParent())
+    Pred = CI->getPredicate();
+
+  // Fall through to the true block if it follows, by inverting the branch.
+  bool Invert = FuncInfo.MBB->isLayoutSuccessor(TrueMBB);
+  if (Invert)
+    std::swap(TrueMBB, FalseMBB);
+
+  GBZ80::CondCode CC;
+  if (Pred != CmpInst::BAD_ICMP_PREDICATE)
+  {
+    if (Invert)
+      Pred = CmpInst::getInversePredicate(Pred);
+    CC = emitCompare(Pred, CI->getOperand(0), CI->getOperand(1));
+    if (CC == GBZ80::COND_INVALID)
+      return false;
+  }
+  else
+  {
+    unsigned CondReg = getRegForValue(BI->getCondition());
+    if (!CondReg)
+      return false;
+    emitCopy(GBZ80::A, CondReg);
+    emitInst(GBZ80::AND8i).addImm(1);
+    CC = Invert ? GBZ80::COND_Z : GBZ80::COND_NZ;
+  }
+
+  emitInst(GBZ80::JPCC).addMBB(TrueMBB).addImm(CC);
+  uint32_t BranchWeight = 0;
+  if (FuncInfo.BPI)
+    BranchWeight = FuncInfo.BPI->getEdgeWeight(BI->getParent(),
+                                               TrueMBB->getBasicBlock());
+  FuncInfo.MBB->addSuccessor(TrueMBB, BranchWeight);
+  fastEmitBranch(FalseMBB, DbgLoc);
+  return true;
+}
+
+// selectIntCast - The extensions and truncations to and from i1, which
+// selectCast leaves out. The bits above bit 0 of an i1 are undefined.
+bool GBZ80FastISel::selectIntCast(const Instruction *I)
+{
+  Type *SrcTy = I->getOperand(0)->getType();
+  Type *DstTy = I->getType();
+  MVT SrcVT = MVT::i8, DstVT = MVT::i8;
+  if ((!SrcTy->isIntegerTy(1) && !isTypeLegal(SrcTy, SrcVT)) ||
+      (!DstTy->isIntegerTy(1) && !isTypeLegal(DstTy, DstVT)))
+    return false;
+
+  unsigned Reg = getRegForValue(I->getOperand(0));
+  if (!Reg)
+    return false;
+
+  if (isa<TruncInst>(I))
+  {
+    if (SrcVT == MVT::i16)
+      Reg = fastEmitInst_extractsubreg(MVT::i8, Reg, false, GBZ80::subreg_lo);
+  }
+  else
+  {
+    if (SrcTy->isIntegerTy(1))
+    {
+      Reg = fastEmit_ri(MVT::i8, MVT::i8, ISD::AND, Reg, false, 1);
+      if (isa<SExtInst>(I))
+        Reg = emitNeg(Reg);
+    }
+    if (DstVT == MVT::i16)
+      Reg = emitExtend16(Reg, isa<SExtInst>(I));
+  }
+
+  updateValueMap(I, Reg);
+  return true;
+}
+
+bool GBZ80FastISel::selectRet(const Instruction *I)
+{
+  const ReturnInst *Ret = cast<ReturnInst>(I);
+  const Function &F = *I->getParent()->getParent();
+  GBZ80MachineFunctionInfo *GBZ80FI =
+    FuncInfo.MF->getInfo<GBZ80MachineFunctionInfo>();
+
+  if (!FuncInfo.CanLowerReturn || F.isVarArg())
+    return false;
+
+  unsigned RetReg = 0;
+  if (Ret->getNumOperands() > 0)
+  {
+    // LowerReturn reports the value of an interrupt handler, and returns a
+    // signext or zeroext value in a wider register.
+    if (GBZ80FI->isInterruptHandler() ||
+        F.getAttributes().hasAttribute(AttributeSet::ReturnIndex,
+                                       Attribute::SExt) ||
+        F.getAttributes().hasAttribute(AttributeSet::ReturnIndex,
+                                       Attribute::ZExt))
+      return false;
+
+    const Value *RV = Ret->getOperand(0);
+    MVT VT;
+    if (!isTypeLegal(RV->getType(), VT))
+      return false;
+    unsigned Reg = getRegForValue(RV);
+    if (!Reg)
+      return false;
+
+    SmallVector<CCValAssign, 2> RVLocs;
+    CCState CCInfo(F.getCallingConv(), false, *FuncInfo.MF, RVLocs, *Context);
+    if (RetCC_GBZ80(0, VT, VT, CCValAssign::Full, ISD::ArgFlagsTy(), CCInfo) ||
+        !RVLocs[0].isRegLoc())
+      return false;
+    RetReg = RVLocs[0].getLocReg();
+    emitCopy(RetReg, Reg);
+    GBZ80FI->setReturnReg(RetReg);
+  }
+
+  MachineInstrBuilder MIB =
+    emitInst(GBZ80FI->isInterruptHandler() ? GBZ80::RETI : GBZ80::RET);
+  if (RetReg)
+    MIB.addReg(RetReg, RegState::Implicit);
+  return true;
+}
+
+// fastLowerArguments - Only functions whose arguments all come in registers
+// are handled, see GBZ80TargetLowering::LowerFormalArguments.
+bool GBZ80FastISel::fastLowerArguments()
+{
+  const Function *F = FuncInfo.Fn;
+  if (F->isVarArg())
+    return false;
+  // LowerFormalArguments reports the arguments of an interrupt handler.
+  if (!F->arg_empty() &&
+      FuncInfo.MF->getInfo<GBZ80MachineFunctionInfo>()->isInterruptHandler())
+    return false;
+
+  SmallVector<CCValAssign, 16> ArgLocs;
+  CCState CCInfo(F->getCallingConv(), false, *FuncInfo.MF, ArgLocs, *Context);
+  SmallVector<MVT, 8> ArgVTs;
+  unsigned Idx = 1;
+  for (Function::const_arg_iterator AI = F->arg_begin(), AE = F->arg_end();
+       AI != AE; ++AI, ++Idx)
+  {
+    if (F->getAttributes().hasAttribute(Idx, Attribute::ByVal) ||
+        F->getAttributes().hasAttribute(Idx, Attribute::InAlloca) ||
+        F->getAttributes().hasAttribute(Idx, Attribute::StructRet) ||
+        F->getAttributes().hasAttribute(Idx, Attribute::Nest))
+      return false;
+
+    MVT VT;
+    if (!isTypeLegal(AI->getType(), VT))
+      return false;
+    if (CC_GBZ80(Idx - 1, VT, VT, CCValAssign::Full, ISD::ArgFlagsTy(),
+                 CCInfo))
+      return false;
+    ArgVTs.push_back(VT);
+  }
+  for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i)
+    if (!ArgLocs[i].isRegLoc())
+      return false;
+
+  unsigned i = 0;
+  for (Function::const_arg_iterator AI = F->arg_begin(), AE = F->arg_end();
+       AI != AE; ++AI, ++i)
+  {
+    const TargetRegisterClass *RC = TLI.getRegClassFor(ArgVTs[i]);
+    unsigned SrcReg = FuncInfo.MF->addLiveIn(ArgLocs[i].getLocReg(), RC);
+    unsigned ResultReg = createResultReg(RC);
+    emitInst(TargetOpcode::COPY, ResultReg)
+      .addReg(SrcReg, getKillRegState(true));
+    updateValueMap(AI, ResultReg);
+  }
+  return true;
+}
+
+// fastLowerCall - Calls to a known function, with the arguments passed as in
+// GBZ80TargetLowering::LowerCall. Stack arguments are stored through HL
+// before the register arguments are set up.
+bool GBZ80FastISel::fastLowerCall(CallLoweringInfo &CLI)
+{
+  // Tail calls are left to SelectionDAG. LowerCall checks that the call can
+  // become a jp and stores the stack arguments over the caller's own, and
+  // the return after it is not selected.
+  if (CLI.IsTailCall || CLI.IsVarArg)
+    return false;
+
+  const GlobalValue *GV = nullptr;
+  if (CLI.Callee)
+  {
+    GV = dyn_cast<GlobalValue>(CLI.Callee->stripPointerCasts());
+    if (!GV)
+      return false;
+  }
+  else if (!CLI.SymName)
+    return false;
+
+  MVT RetVT = MVT::isVoid;
+  if (!CLI.RetTy->isVoidTy() && !isTypeLegal(CLI.RetTy, RetVT))
+    return false;
+
+  SmallVector<MVT, 8> OutVTs;
+  SmallVector<unsigned, 8> ArgRegs;
+  for (unsigned i = 0, e = CLI.OutVals.size(); i != e; ++i)
+  {
+    const Value *Val = CLI.OutVals[i];
+    ISD::ArgFlagsTy Flags = CLI.OutFlags[i];
+    if (Flags.isByVal() || Flags.isInAlloca())
+      return false;
+
+    MVT VT;
+    bool IsI1 = Val->getType()->isIntegerTy(1);
+    if (IsI1)
+      VT = MVT::i8;
+    else if (!isTypeLegal(Val->getType(), VT))
+      return false;
+
+    unsigned Reg = getRegForValue(Val);
+    if (!Reg)
+      return false;
+    // An i1 is passed as a byte, extended as the attributes ask for.
+    if (IsI1 && (Flags.isSExt() || Flags.isZExt()))
+    {
+      Reg = fastEmit_ri(MVT::i8, MVT::i8, ISD::AND, Reg, false, 1);
+      if (Flags.isSExt())
+        Reg = emitNeg(Reg);
+    }
+    OutVTs.push_back(VT);
+    ArgRegs.push_back(Reg);
+  }
+
+  SmallVector<CCValAssign, 16> ArgLocs;
+  CCState CCInfo(CLI.CallConv, false, *FuncInfo.MF, ArgLocs, *Context);
+  CCInfo.AnalyzeCallOperands(OutVTs, CLI.OutFlags, CC_GBZ80);
+  unsigned NumBytes = CCInfo.getNextStackOffset();
+
+  // The stack arguments are addressed with ld hl,sp+e.
+  for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i)
+    if (ArgLocs[i].isMemLoc() &&
+        !isInt<8>(ArgLocs[i].getLocMemOffset() + 1))
+      return false;
+
+  emitInst(TII.getCallFrameSetupOpcode()).addImm(NumBytes);
+
+  for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i)
+  {
+    CCValAssign &VA = ArgLocs[i];
+    if (!VA.isMemLoc())
+      continue;
+    unsigned AddrReg = createResultReg(&GBZ80::GR16_HLRegClass);
+    emitInst(GBZ80::LD16HLSP, AddrReg).addImm(VA.getLocMemOffset());
+    emitCopy(GBZ80::HL, AddrReg);
+    emitStoreHL(VA.getLocVT(), ArgRegs[i], 0, nullptr);
+  }
+
+  for (unsigned i = 0, e = ArgLocs.size(); i != e; ++i)
+  {
+    CCValAssign &VA = ArgLocs[i];
+    if (!VA.isRegLoc())
+      continue;
+    emitCopy(VA.getLocReg(), ArgRegs[i]);
+    CLI.OutRegs.push_back(VA.getLocReg());
+  }
+
+  MachineInstrBuilder MIB = emitInst(GBZ80::CALL);
+  if (GV)
+    MIB.addGlobalAddress(GV);
+  else
+    MIB.addExternalSymbol(CLI.SymName);
+  MIB.addRegMask(TRI.getCallPreservedMask(CLI.CallConv));
+  for (unsigned i = 0, e = CLI.OutRegs.size(); i != e; ++i)
+    MIB.addReg(CLI.OutRegs[i], RegState::Implicit);
+  CLI.Call = MIB;
+
+  emitInst(TII.getCallFrameDestroyOpcode()).addImm(NumBytes).addImm(0);
+
+  if (RetVT != MVT::isVoid)
+  {
+    SmallVector<CCValAssign, 2> RVLocs;
+    CCState RetInfo(CLI.CallConv, false, *FuncInfo.MF, RVLocs, *Context);
+    RetInfo.AnalyzeCallResult(RetVT, RetCC_GBZ80);
+    unsigned PhysReg = RVLocs[0].getLocReg();
+    CLI.ResultReg = copyFromPhysReg(PhysReg, TLI.getRegClassFor(RetVT));
+    CLI.InRegs.push_back(PhysReg);
+    CLI.NumResultRegs = 1;
+  }
+  return true;
+}
+
+bool GBZ80FastISel::fastSelectInstruction(const Instruction *I)
+{
+  switch (I->getOpcode())
+  {
+  default:
+    break;
+  case Instruction::Load:
+    return selectLoad(I);
+  case Instruction::Store:
+    return selectStore(I);
+  case Instruction::Br:
+    return selectBranch(I);
+  case Instruction::ICmp:
+    return selectCmp(I);
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt:
+    return selectIntCast(I);
+  case Instruction::Ret:
+    return selectRet(I);
+  }
+  return false;
+}
+
+namespace llvm {
+  FastISel *GBZ80::createFastISel(FunctionLoweringInfo &FuncInfo,
+                                  const TargetLibraryInfo *LibInfo)
+  {
+    return new GBZ80FastISel(FuncInfo, LibInfo);
+  }
+}
@@ -15,20 +15,43 @@
 #include "GBZ80.h"
 #include "GBZ80InstrInfo.h"
 #include "GBZ80MachineFunctionInfo.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 using namespace llvm;
 
+#define DEBUG_TYPE "gbz80-frame-lowering"
+
+STATISTIC(NumSpillPushes, "Number of spills turned into push and pop");
+
 GBZ80FrameLowering::GBZ80FrameLowering(const GBZ80TargetMachine &tm)
   : TargetFrameLowering(TargetFrameLowering::StackGrowsDown, 1, -2), TM(tm)
 {}
 
+// hasFP - Stack objects are addressed with ld hl,sp+e, which works as long
+// as SP only moves by amounts known at compile time. Only functions with
+// variable sized objects need a frame pointer.
 bool GBZ80FrameLowering::hasFP(const MachineFunction &MF) const
 {
-  const MachineFrameInfo *MFI = MF.getFrameInfo();
-  return (MFI->getMaxCallFrameSize() > 0 || (MFI->getNumObjects() > 0));
+  return MF.getFrameInfo()->hasVarSizedObjects();
+}
+
+// adjustSP - Move SP by NumBytes with add sp,e, which leaves every register
+// but the flags alone.
+static void adjustSP(MachineBasicBlock &MBB, MachineBasicBlock::iterator MBBI,
+                     DebugLoc dl, const GBZ80InstrInfo &TII, int64_t NumBytes)
+{
+  while (NumBytes)
+  {
+    int64_t Step = std::max<int64_t>(std::min<int64_t>(NumBytes, 127), -128);
+    BuildMI(MBB, MBBI, dl, TII.get(GBZ80::ADD16SPi))
+      .addImm(Step);
+    NumBytes -= Step;
+  }
 }
 
 void GBZ80FrameLowering::emitPrologue(MachineFunction &MF) const
@@ -41,26 +64,33 @@ void GBZ80FrameLowering::emitPrologue(MachineFunction &MF) const
     *static_cast<const GBZ80InstrInfo*>(MF.getSubtarget().getInstrInfo());
   DebugLoc dl = MBBI != MBB.end() ? MBBI->getDebugLoc() : DebugLoc();
 
-  uint64_t StackSize     = MFI->getStackSize();
-  uint64_t CallFrameSize = MFI->getMaxCallFrameSize();
-  uint64_t FrameSize     = GBZ80FI->getCalleeSavedFrameSize();
+  // The stack size includes the outgoing arguments and the callee-saved
+  // registers, which have already been pushed.
+  uint64_t StackSize = MFI->getStackSize();
+  uint64_t FrameSize = GBZ80FI->getCalleeSavedFrameSize();
 
-  uint64_t NumBytes = StackSize + CallFrameSize - FrameSize;
+  uint64_t NumBytes = StackSize - FrameSize;
 
-  // Skip the callee-saved push instructions.
-  while (MBBI != MBB.end() && (MBBI->getOpcode() == GBZ80::PUSH16r))
+  // Skip the callee-saved push instructions, one for each register. A spill
+  // turned into a push may follow them, it belongs to the frame.
+  for (uint64_t i = FrameSize / 2; i != 0 && MBBI != MBB.end() &&
+       (MBBI->getOpcode() == GBZ80::PUSH16r ||
+        MBBI->getOpcode() == GBZ80::PUSHAF); --i)
     MBBI++;
 
-  if (NumBytes || GBZ80FI->isNeedFP())
+  if (hasFP(MF))
   {
     unsigned FP = TII.getRegisterInfo().getFrameRegister(MF);
 
     BuildMI(MBB, MBBI, dl, TII.get(GBZ80::LD16ri), FP)
       .addImm(-NumBytes);
-    BuildMI(MBB, MBBI, dl, TII.get(GBZ80::ADD16rSP), FP);
+    BuildMI(MBB, MBBI, dl, TII.get(GBZ80::ADD16rSP), FP)
+      .addReg(FP);
     BuildMI(MBB, MBBI, dl, TII.get(GBZ80::LD16SPr))
       .addReg(FP);
   }
+  else
+    adjustSP(MBB, MBBI, dl, TII, -NumBytes);
 }
 
 void GBZ80FrameLowering::emitEpilogue(MachineFunction &MF,
@@ -75,36 +105,47 @@ void GBZ80FrameLowering::emitEpilogue(MachineFunction &MF,
   unsigned RetOpcode = MBBI->getOpcode();
   DebugLoc dl = MBBI->getDebugLoc();
 
-  if (RetOpcode != GBZ80::RET)
+  if (RetOpcode != GBZ80::RET && RetOpcode != GBZ80::RETI &&
+      RetOpcode != GBZ80::TCRETURNdi && RetOpcode != GBZ80::TCRETURNr)
     llvm_unreachable("Can only insert epilog into returning blocks");
 
   // Get the number of bytes to allocate from the FrameInfo
-  uint64_t StackSize     = MFI->getStackSize();
-  uint64_t CallFrameSize = MFI->getMaxCallFrameSize();
-  uint64_t FrameSize     = GBZ80FI->getCalleeSavedFrameSize();
+  uint64_t StackSize = MFI->getStackSize();
+  uint64_t FrameSize = GBZ80FI->getCalleeSavedFrameSize();
 
-  uint64_t NumBytes = StackSize + CallFrameSize - FrameSize;
+  uint64_t NumBytes = StackSize - FrameSize;
 
-  // Skip the callee-saved pop instructions.
+  // Skip the callee-saved pop instructions, one for each register. A
+  // reload turned into a pop may come right before them.
+  uint64_t Pops = FrameSize / 2;
   while (MBBI != MBB.begin())
   {
     MachineBasicBlock::iterator I = std::prev(MBBI);
     unsigned Opc = I->getOpcode();
-    if (Opc != GBZ80::POP16r && !I->isTerminator())
-      break;
+    if (!I->isTerminator())
+    {
+      if ((Opc != GBZ80::POP16r && Opc != GBZ80::POPAF) || !Pops)
+        break;
+      --Pops;
+    }
     MBBI--;
   }
 
-  if (NumBytes)
+  if (hasFP(MF))
   {
     unsigned FP = TII.getRegisterInfo().getFrameRegister(MF);
 
     BuildMI(MBB, MBBI, dl, TII.get(GBZ80::LD16ri), FP)
       .addImm(NumBytes);
-    BuildMI(MBB, MBBI, dl, TII.get(GBZ80::ADD16rSP), FP);
+    BuildMI(MBB, MBBI, dl, TII.get(GBZ80::ADD16rSP), FP)
+      .addReg(FP);
     BuildMI(MBB, MBBI, dl, TII.get(GBZ80::LD16SPr))
       .addReg(FP, RegState::Kill);
   }
+  else
+    // The return value is already in A or HL, and so are the arguments of
+    // a tail call. Step SP back with add sp,e which leaves them alone.
+    adjustSP(MBB, MBBI, dl, TII, NumBytes);
 }
 
 bool GBZ80FrameLowering::spillCalleeSavedRegisters(MachineBasicBlock &MBB,
@@ -123,14 +164,21 @@ bool GBZ80FrameLowering::spillCalleeSavedRegisters(MachineBasicBlock &MBB,
   GBZ80MachineFunctionInfo *MFI = MF.getInfo<GBZ80MachineFunctionInfo>();
   MFI->setCalleeSavedFrameSize(CSI.size() * 2);
 
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
   for (unsigned i = CSI.size(); i != 0; i--)
   {
     unsigned Reg = CSI[i-1].getReg();
 
-    // Add the callee-saved register as live-in. It's killed at the spill.
-    MBB.addLiveIn(Reg);
-    BuildMI(MBB, MI, dl, TII.get(GBZ80::PUSH16r))
-      .addReg(Reg, RegState::Kill);
+    // Add the callee-saved register as live-in. It's killed at the spill,
+    // unless it also carries an argument.
+    bool IsLiveIn = MRI.isLiveIn(Reg);
+    if (!IsLiveIn)
+      MBB.addLiveIn(Reg);
+    if (Reg == GBZ80::AF)
+      BuildMI(MBB, MI, dl, TII.get(GBZ80::PUSHAF));
+    else
+      BuildMI(MBB, MI, dl, TII.get(GBZ80::PUSH16r))
+        .addReg(Reg, getKillRegState(!IsLiveIn));
   }
   return true;
 }
@@ -150,18 +198,141 @@ bool GBZ80FrameLowering::restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
   const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
 
   for (unsigned i = 0, e = CSI.size(); i != e; i++)
-    BuildMI(MBB, MI, dl, TII.get(GBZ80::POP16r), CSI[i].getReg());
+    if (CSI[i].getReg() == GBZ80::AF)
+      BuildMI(MBB, MI, dl, TII.get(GBZ80::POPAF));
+    else
+      BuildMI(MBB, MI, dl, TII.get(GBZ80::POP16r), CSI[i].getReg());
 
   return true;
 }
 
+// processFunctionBeforeCalleeSavedScan - The frame pointer is saved like
+// any other register. An interrupt handler with a frame also saves HL and
+// the flags up front, every slot access goes through ld hl,sp+e and the
+// stack adjustments clobber the flags.
 void GBZ80FrameLowering::processFunctionBeforeCalleeSavedScan(
   MachineFunction &MF, RegScavenger *RS) const
 {
+  MachineRegisterInfo &MRI = MF.getRegInfo();
   if (hasFP(MF))
   {
     unsigned FP = MF.getSubtarget().getRegisterInfo()->getFrameRegister(MF);
-    MF.getRegInfo().setPhysRegUsed(FP);
+    MRI.setPhysRegUsed(FP);
+  }
+
+  if (MF.getInfo<GBZ80MachineFunctionInfo>()->isInterruptHandler() &&
+      MF.getFrameInfo()->hasStackObjects())
+  {
+    MRI.setPhysRegUsed(GBZ80::HL);
+    MRI.setPhysRegUsed(GBZ80::AF);
+  }
+}
+
+// processFunctionBeforeFrameFinalized - Turn spills that are reloaded in
+// the same block, with nothing in between that touches the stack, into
+// push and pop. A 16-bit slot access is 36 T-states through ld hl,sp+e, a
+// push and pop pair costs 28 for both, does not touch HL or the flags, and
+// the slot goes away.
+void GBZ80FrameLowering::processFunctionBeforeFrameFinalized(
+  MachineFunction &MF, RegScavenger *RS) const
+{
+  MachineFrameInfo *MFI = MF.getFrameInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+
+  // Find the slots that are stored to once and loaded from once, as a whole
+  // register pair, and not used in any other way.
+  DenseMap<int, unsigned> Stores, Loads;
+  SmallSet<int, 8> Other;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; ++I)
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i)
+      {
+        if (!I->getOperand(i).isFI())
+          continue;
+        int FI = I->getOperand(i).getIndex();
+        if (I->getOpcode() == GBZ80::LD16mr && i == 0)
+          ++Stores[FI];
+        else if (I->getOpcode() == GBZ80::LD16rm && i == 1)
+          ++Loads[FI];
+        else
+          Other.insert(FI);
+      }
+
+  SmallSet<int, 8> Candidates;
+  for (DenseMap<int, unsigned>::iterator I = Stores.begin(), E = Stores.end();
+       I != E; ++I)
+  {
+    int FI = I->first;
+    if (I->second == 1 && Loads.lookup(FI) == 1 && !Other.count(FI) &&
+        MFI->isSpillSlotObjectIndex(FI))
+      Candidates.insert(FI);
+  }
+  if (Candidates.empty())
+    return;
+
+  // Match the stores and loads of each block like brackets. Whatever else
+  // addresses the stack would see SP moved by the pushes, so it closes
+  // every open slot. A call finds its stack arguments right above its
+  // return address, a slot pushed after they are stored would move them.
+  // The call frame pseudos are gone by now, a call with stack arguments is
+  // one that follows an access to the stack.
+  bool StackArgs = MFI->getMaxCallFrameSize() != 0;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+  {
+    SmallVector<MachineInstr *, 4> Open;
+    bool TouchedStack = false;
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; )
+    {
+      MachineInstr *MI = I++;
+      unsigned Opc = MI->getOpcode();
+      if (Opc == GBZ80::LD16mr && MI->getOperand(0).isFI() &&
+          Candidates.count(MI->getOperand(0).getIndex()))
+      {
+        Open.push_back(MI);
+        continue;
+      }
+      if (Opc == GBZ80::LD16rm && MI->getOperand(1).isFI() && !Open.empty() &&
+          Open.back()->getOperand(0).getIndex() ==
+            MI->getOperand(1).getIndex())
+      {
+        MachineInstr *Store = Open.pop_back_val();
+        const MachineOperand &Src = Store->getOperand(2);
+        BuildMI(*MBB, Store, Store->getDebugLoc(), TII.get(GBZ80::PUSH16r))
+          .addReg(Src.getReg(), getKillRegState(Src.isKill()));
+        BuildMI(*MBB, MI, MI->getDebugLoc(), TII.get(GBZ80::POP16r),
+                MI->getOperand(0).getReg());
+        MFI->RemoveStackObject(MI->getOperand(1).getIndex());
+        Store->eraseFromParent();
+        MI->eraseFromParent();
+        ++NumSpillPushes;
+        continue;
+      }
+
+      // A call pops what it pushes and the call frame pseudos don't move SP
+      // here, outgoing arguments are stored through SP and close the slots.
+      if (MI->isCall())
+      {
+        if (StackArgs && TouchedStack)
+          Open.clear();
+        TouchedStack = false;
+        continue;
+      }
+      bool UsesStack = Opc != GBZ80::ADJCALLSTACKDOWN &&
+        Opc != GBZ80::ADJCALLSTACKUP &&
+        (MI->readsRegister(GBZ80::SP) ||
+         MI->modifiesRegister(GBZ80::SP, nullptr));
+      for (unsigned i = 0, e = MI->getNumOperands(); i != e && !UsesStack; ++i)
+        UsesStack = MI->getOperand(i).isFI();
+      if (UsesStack)
+      {
+        Open.clear();
+        TouchedStack = true;
+      }
+    }
   }
 }
 
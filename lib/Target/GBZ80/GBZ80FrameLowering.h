@@ -29,6 +29,8 @@ namespace llvm {
 
     void processFunctionBeforeCalleeSavedScan(MachineFunction &MF,
       RegScavenger *RS = NULL) const;
+    void processFunctionBeforeFrameFinalized(MachineFunction &MF,
+      RegScavenger *RS = NULL) const;
 
     void eliminateCallFramePseudoInstr(MachineFunction &MF,
       MachineBasicBlock &MBB, MachineBasicBlock::iterator I) const;
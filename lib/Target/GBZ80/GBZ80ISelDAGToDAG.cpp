@@ -15,6 +15,8 @@
 #include "GBZ80.h"
 #include "GBZ80TargetMachine.h"
 #include "llvm/CodeGen/SelectionDAGISel.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
@@ -27,7 +29,12 @@ namespace {
 #include "GBZ80GenDAGISel.inc"
   private:
     SDNode *Select(SDNode *N);
+    SDNode *SelectIndexedLoad(SDNode *N);
+    SDNode *SelectIndexedStore(SDNode *N);
+    SDNode *SelectStackAddr(SDNode *N);
     bool SelectIAddr(SDValue N, SDValue &Addr);
+    bool SelectHAddr(SDValue N, SDValue &Addr);
+    bool SelectCAddr(SDValue N, SDValue &Addr);
   };
 } // end namespace
 
@@ -48,17 +55,26 @@ SDNode *GBZ80DAGToDAGISel::Select(SDNode *Node)
   //   Node->dump(CurDAG);
   //   errs() << "\n");
 
-  // // If we have a custom node, we already have selected
-  // if (Node->isMachineOpcode()) {
-  //   DEBUG(errs() << "== ";
-  //     Node->dump(CurDAG);
-  //     errs() << "\n");
-  //   return NULL;
-  // }
+  // If we have a custom node, we already have selected
+  if (Node->isMachineOpcode())
+    return NULL;
 
   switch (Node->getOpcode())
   {
   default: break;
+  case ISD::LOAD:
+    if (cast<LoadSDNode>(Node)->isIndexed())
+      return SelectIndexedLoad(Node);
+    break;
+  case ISD::STORE:
+    if (cast<StoreSDNode>(Node)->isIndexed())
+      return SelectIndexedStore(Node);
+    break;
+  case ISD::FrameIndex:
+  case ISD::ADD:
+    if (SDNode *Res = SelectStackAddr(Node))
+      return Res;
+    break;
   }
 
   // Select the default instruction
@@ -72,6 +88,84 @@ SDNode *GBZ80DAGToDAGISel::Select(SDNode *Node)
   return ResNode;
 }
 
+// SelectStackAddr - Select the address of a stack object, plus an optional
+// constant offset, and SP plus a constant for the outgoing arguments. Both
+// become an ld hl,sp+e once the frame is laid out.
+SDNode *GBZ80DAGToDAGISel::SelectStackAddr(SDNode *N)
+{
+  SDValue Base = SDValue(N, 0);
+  int64_t Offset = 0;
+  if (N->getOpcode() == ISD::ADD)
+  {
+    ConstantSDNode *CN = dyn_cast<ConstantSDNode>(N->getOperand(1));
+    if (!CN)
+      return NULL;
+    Base = N->getOperand(0);
+    Offset = CN->getSExtValue();
+  }
+
+  if (FrameIndexSDNode *FIN = dyn_cast<FrameIndexSDNode>(Base))
+    return CurDAG->SelectNodeTo(N, GBZ80::FRMIDX, MVT::i16,
+      CurDAG->getTargetFrameIndex(FIN->getIndex(), MVT::i16),
+      CurDAG->getTargetConstant(Offset, MVT::i16));
+
+  if (Base.getOpcode() == ISD::CopyFromReg && isInt<8>(Offset))
+    if (RegisterSDNode *RN = dyn_cast<RegisterSDNode>(Base.getOperand(1)))
+      if (RN->getReg() == GBZ80::SP)
+        return CurDAG->SelectNodeTo(N, GBZ80::LD16HLSP, MVT::i16,
+          CurDAG->getTargetConstant(Offset, MVT::i8));
+  return NULL;
+}
+
+// SelectIndexedLoad - Select a post-indexed load as ld a,(hl+) or
+// ld a,(hl-). The pointer goes in and comes back out in HL.
+SDNode *GBZ80DAGToDAGISel::SelectIndexedLoad(SDNode *N)
+{
+  LoadSDNode *LD = cast<LoadSDNode>(N);
+  ISD::MemIndexedMode AM = LD->getAddressingMode();
+  SDLoc dl(N);
+  unsigned Opc = AM == ISD::POST_INC ? GBZ80::LD8AHLI : GBZ80::LD8AHLD;
+  SDValue Chain = CurDAG->getCopyToReg(LD->getChain(), dl, GBZ80::HL,
+    LD->getBasePtr(), SDValue());
+  MachineSDNode *Res = CurDAG->getMachineNode(Opc, dl, MVT::i8, MVT::Other,
+    MVT::Glue, Chain, Chain.getValue(1));
+
+  MachineSDNode::mmo_iterator MemOp = MF->allocateMemRefsArray(1);
+  MemOp[0] = LD->getMemOperand();
+  Res->setMemRefs(MemOp, MemOp + 1);
+
+  SDValue Ptr = CurDAG->getCopyFromReg(SDValue(Res, 1), dl, GBZ80::HL,
+    MVT::i16, SDValue(Res, 2));
+  ReplaceUses(SDValue(N, 0), SDValue(Res, 0));
+  ReplaceUses(SDValue(N, 1), Ptr);
+  ReplaceUses(SDValue(N, 2), Ptr.getValue(1));
+  return NULL;
+}
+
+// SelectIndexedStore - Select a post-indexed store as ld (hl+),a or
+// ld (hl-),a.
+SDNode *GBZ80DAGToDAGISel::SelectIndexedStore(SDNode *N)
+{
+  StoreSDNode *ST = cast<StoreSDNode>(N);
+  ISD::MemIndexedMode AM = ST->getAddressingMode();
+  SDLoc dl(N);
+  unsigned Opc = AM == ISD::POST_INC ? GBZ80::LD8HLIA : GBZ80::LD8HLDA;
+  SDValue Chain = CurDAG->getCopyToReg(ST->getChain(), dl, GBZ80::HL,
+    ST->getBasePtr(), SDValue());
+  MachineSDNode *Res = CurDAG->getMachineNode(Opc, dl, MVT::Other,
+    MVT::Glue, ST->getValue(), Chain, Chain.getValue(1));
+
+  MachineSDNode::mmo_iterator MemOp = MF->allocateMemRefsArray(1);
+  MemOp[0] = ST->getMemOperand();
+  Res->setMemRefs(MemOp, MemOp + 1);
+
+  SDValue Ptr = CurDAG->getCopyFromReg(SDValue(Res, 0), dl, GBZ80::HL,
+    MVT::i16, SDValue(Res, 1));
+  ReplaceUses(SDValue(N, 0), Ptr);
+  ReplaceUses(SDValue(N, 1), Ptr.getValue(1));
+  return NULL;
+}
+
 bool GBZ80DAGToDAGISel::SelectIAddr(SDValue N, SDValue &Addr) {
     switch (N->getOpcode()) {
         case ISD::Constant:
@@ -86,3 +180,97 @@ bool GBZ80DAGToDAGISel::SelectIAddr(SDValue N, SDValue &Addr) {
     }
     return false;
 }
+
+// isHRAMGlobal - Return true if GV is placed in the high RAM at 0xFF80 by
+// putting it into a section named .hram.
+bool GBZ80::isHRAMGlobal(const GlobalValue *GV)
+{
+  return StringRef(GV->getSection()).startswith(".hram");
+}
+
+// SelectHAddr - Match an address in the high page 0xFF00-0xFFFF, which can
+// be reached with ldh.
+bool GBZ80DAGToDAGISel::SelectHAddr(SDValue N, SDValue &Addr)
+{
+  if (ConstantSDNode *CN = dyn_cast<ConstantSDNode>(N))
+  {
+    uint64_t Val = CN->getZExtValue();
+    if (Val < 0xFF00 || Val > 0xFFFF)
+      return false;
+    Addr = CurDAG->getTargetConstant(Val, MVT::i16);
+    return true;
+  }
+
+  if (N->getOpcode() == GBZ80ISD::WRAPPER)
+    if (GlobalAddressSDNode *G =
+          dyn_cast<GlobalAddressSDNode>(N->getOperand(0)))
+      if (GBZ80::isHRAMGlobal(G->getGlobal()))
+      {
+        Addr = N->getOperand(0);
+        return true;
+      }
+  return false;
+}
+
+// isConstantByte - Return true if N is the i8 constant Val.
+static bool isConstantByte(SDValue N, uint64_t Val)
+{
+  ConstantSDNode *CN = dyn_cast<ConstantSDNode>(N);
+  return CN && (CN->getZExtValue() & 0xFF) == Val;
+}
+
+// isInsertSubreg - Return true if N is an INSERT_SUBREG into SubIdx.
+static bool isInsertSubreg(SDValue N, unsigned SubIdx)
+{
+  return N.isMachineOpcode() &&
+         N.getMachineOpcode() == TargetOpcode::INSERT_SUBREG &&
+         cast<ConstantSDNode>(N.getOperand(2))->getZExtValue() == SubIdx;
+}
+
+// getLowByte - Return the low byte of the i16 value N if its high byte is
+// known to be Hi, otherwise an empty SDValue. This looks through the
+// subregister inserts which the lowering of zext and of the i16 logic
+// operations builds.
+static SDValue getLowByte(SDValue N, uint64_t Hi)
+{
+  SDValue Lo;
+
+  // (insert_subreg (insert_subreg undef, Hi, subreg_hi), Lo, subreg_lo)
+  if (isInsertSubreg(N, GBZ80::subreg_lo) &&
+      isInsertSubreg(N.getOperand(0), GBZ80::subreg_hi) &&
+      isConstantByte(N.getOperand(0).getOperand(1), Hi))
+    Lo = N.getOperand(1);
+  // (insert_subreg (insert_subreg undef, Lo, subreg_lo), Hi, subreg_hi)
+  else if (isInsertSubreg(N, GBZ80::subreg_hi) &&
+           isConstantByte(N.getOperand(1), Hi) &&
+           isInsertSubreg(N.getOperand(0), GBZ80::subreg_lo))
+    Lo = N.getOperand(0).getOperand(1);
+  // (or/add (zext Lo), Hi << 8)
+  else if ((N.getOpcode() == ISD::OR || N.getOpcode() == ISD::ADD) &&
+           isa<ConstantSDNode>(N.getOperand(1)) &&
+           cast<ConstantSDNode>(N.getOperand(1))->getZExtValue() == Hi << 8)
+    return getLowByte(N.getOperand(0), 0);
+  else
+    return SDValue();
+
+  // The low byte may itself be extracted from a zext.
+  if (Lo.isMachineOpcode() &&
+      Lo.getMachineOpcode() == TargetOpcode::EXTRACT_SUBREG &&
+      cast<ConstantSDNode>(Lo.getOperand(1))->getZExtValue() ==
+        GBZ80::subreg_lo &&
+      isInsertSubreg(Lo.getOperand(0), GBZ80::subreg_lo))
+    Lo = Lo.getOperand(0).getOperand(1);
+  return Lo;
+}
+
+// SelectCAddr - Match 0xFF00 + X for an 8-bit X, which is reached with
+// ld (c),a and ld a,(c) once X is in C.
+bool GBZ80DAGToDAGISel::SelectCAddr(SDValue N, SDValue &Addr)
+{
+  // A constant address is better served by ldh.
+  SDValue Lo = getLowByte(N, 0xFF);
+  if (!Lo.getNode() || isa<ConstantSDNode>(Lo))
+    return false;
+  Addr = Lo;
+  return true;
+}
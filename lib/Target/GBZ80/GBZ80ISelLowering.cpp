@@ -19,9 +19,21 @@
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
+static cl::opt<cl::boolOrDefault>
+ShiftLadder("gbz80-shift-ladder", cl::Hidden,
+  cl::desc("Lower variable shifts as a jump into an unrolled ladder "
+           "(default: by cost, never when optimizing for size)"));
+
+static cl::opt<int>
+MinJumpTableEntries("gbz80-min-jump-table-entries", cl::Hidden,
+  cl::init(10),
+  cl::desc("Lower switches with at least this many cases to jump tables"));
+
 GBZ80TargetLowering::GBZ80TargetLowering(GBZ80TargetMachine &TM)
   : TargetLowering(TM)
 {
@@ -31,15 +43,51 @@ GBZ80TargetLowering::GBZ80TargetLowering(GBZ80TargetMachine &TM)
   computeRegisterProperties();
 
   setStackPointerRegisterToSaveRestore(GBZ80::SP);
+  // Saving and restoring SP are plain copies, see GBZ80InstrInfo::copyPhysReg.
+  setOperationAction(ISD::STACKSAVE, MVT::Other, Expand);
+  setOperationAction(ISD::STACKRESTORE, MVT::Other, Expand);
+
+  // Jump tables are emitted inline after the jump through them, see
+  // LowerBR_JT. A jump through a table costs 60 cycles and 13 bytes plus 2
+  // bytes per entry, a level of the compare tree 20 to 40 cycles, which puts
+  // the break-even at about seven cases. The jump clobbers HL as well as A
+  // though, which costs spills in loops that keep a value in HL across the
+  // switch, so tables are only used from ten cases on. Switches are never
+  // lowered to bit tests, which need a legal 16-bit shift.
+  setOperationAction(ISD::BR_JT, MVT::Other, Custom);
+  setMinimumJumpTableEntries(MinJumpTableEntries);
 
   setBooleanContents(ZeroOrOneBooleanContent);
 
-  setLoadExtAction(ISD::EXTLOAD, MVT::i8, MVT::i8, Expand);
-  setLoadExtAction(ISD::ZEXTLOAD, MVT::i8, MVT::i8, Expand);
-  setLoadExtAction(ISD::SEXTLOAD, MVT::i8, MVT::i8, Expand);
+  // There are only seven 8-bit registers, let the DAG scheduler weigh the
+  // cycle counts from the itineraries against register pressure.
+  setSchedulingPreference(Sched::Hybrid);
+
+  // Extending loads are a plain load and an extension of the register.
+  for (MVT VT : MVT::integer_valuetypes())
+  {
+    setLoadExtAction(ISD::EXTLOAD, VT, MVT::i1, Promote);
+    setLoadExtAction(ISD::ZEXTLOAD, VT, MVT::i1, Promote);
+    setLoadExtAction(ISD::SEXTLOAD, VT, MVT::i1, Promote);
+    setLoadExtAction(ISD::EXTLOAD, VT, MVT::i8, Expand);
+    setLoadExtAction(ISD::ZEXTLOAD, VT, MVT::i8, Expand);
+    setLoadExtAction(ISD::SEXTLOAD, VT, MVT::i8, Expand);
+  }
 
   setTruncStoreAction(MVT::i16, MVT::i8, Expand);
 
+  // Every byte of an inline copy or fill needs its own address in HL, which
+  // only pays off for the first two, where HL can step along. Anything longer
+  // becomes a loop, see GBZ80SelectionDAGInfo.
+  MaxStoresPerMemcpy = MaxStoresPerMemcpyOptSize = 2;
+  MaxStoresPerMemset = MaxStoresPerMemsetOptSize = 2;
+
+  // ld a,(hl+), ld a,(hl-), ld (hl+),a and ld (hl-),a.
+  setIndexedLoadAction(ISD::POST_INC, MVT::i8, Legal);
+  setIndexedLoadAction(ISD::POST_DEC, MVT::i8, Legal);
+  setIndexedStoreAction(ISD::POST_INC, MVT::i8, Legal);
+  setIndexedStoreAction(ISD::POST_DEC, MVT::i8, Legal);
+
   setOperationAction(ISD::LOAD,  MVT::i16, Custom);
   setOperationAction(ISD::STORE, MVT::i16, Custom);
 
@@ -55,6 +103,36 @@ GBZ80TargetLowering::GBZ80TargetLowering(GBZ80TargetMachine &TM)
   setOperationAction(ISD::SHL,  MVT::i16, Custom);
   setOperationAction(ISD::SRA,  MVT::i16, Custom);
 
+  // The 32-bit shifts by a variable amount are calls, see GBZ80Runtime.cpp.
+  setOperationAction(ISD::SHL_PARTS, MVT::i16, Expand);
+  setOperationAction(ISD::SRL_PARTS, MVT::i16, Expand);
+  setOperationAction(ISD::SRA_PARTS, MVT::i16, Expand);
+
+  // There is no multiply or divide instruction. Multiplies by a constant
+  // become shifts and adds, the rest are calls into the runtime library.
+  setOperationAction(ISD::MUL,       MVT::i8,  Custom);
+  setOperationAction(ISD::MUL,       MVT::i16, Custom);
+  setOperationAction(ISD::MULHU,     MVT::i8,  Expand);
+  setOperationAction(ISD::MULHU,     MVT::i16, Expand);
+  setOperationAction(ISD::MULHS,     MVT::i8,  Expand);
+  setOperationAction(ISD::MULHS,     MVT::i16, Expand);
+  setOperationAction(ISD::UMUL_LOHI, MVT::i8,  Expand);
+  setOperationAction(ISD::UMUL_LOHI, MVT::i16, Expand);
+  setOperationAction(ISD::SMUL_LOHI, MVT::i8,  Expand);
+  setOperationAction(ISD::SMUL_LOHI, MVT::i16, Expand);
+  setOperationAction(ISD::SDIV,      MVT::i8,  Expand);
+  setOperationAction(ISD::SDIV,      MVT::i16, Expand);
+  setOperationAction(ISD::UDIV,      MVT::i8,  Expand);
+  setOperationAction(ISD::UDIV,      MVT::i16, Expand);
+  setOperationAction(ISD::SREM,      MVT::i8,  Expand);
+  setOperationAction(ISD::SREM,      MVT::i16, Expand);
+  setOperationAction(ISD::UREM,      MVT::i8,  Expand);
+  setOperationAction(ISD::UREM,      MVT::i16, Expand);
+  setOperationAction(ISD::SDIVREM,   MVT::i8,  Expand);
+  setOperationAction(ISD::SDIVREM,   MVT::i16, Expand);
+  setOperationAction(ISD::UDIVREM,   MVT::i8,  Expand);
+  setOperationAction(ISD::UDIVREM,   MVT::i16, Expand);
+
   setOperationAction(ISD::SUB,  MVT::i16, Custom);
   setOperationAction(ISD::SUBC, MVT::i16, Custom);
   setOperationAction(ISD::AND,  MVT::i16, Custom);
@@ -67,6 +145,7 @@ GBZ80TargetLowering::GBZ80TargetLowering(GBZ80TargetMachine &TM)
   setOperationAction(ISD::BR_CC, MVT::i16, Custom);
 
   setOperationAction(ISD::GlobalAddress, MVT::i16, Custom);
+  setOperationAction(ISD::BlockAddress,  MVT::i16, Custom);
 }
 
 //===----------------------------------------------------------------------===//
@@ -75,6 +154,17 @@ GBZ80TargetLowering::GBZ80TargetLowering(GBZ80TargetMachine &TM)
 
 #include "GBZ80GenCallingConv.inc"
 
+// hasTailCalls - A tail call stores its stack arguments over the ones of the
+// function that makes it, see LowerCall.
+static bool hasTailCalls(const Function &F)
+{
+  for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+    if (const CallInst *CI = dyn_cast<CallInst>(&*I))
+      if (CI->isTailCall())
+        return true;
+  return false;
+}
+
 SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
   CallingConv::ID CallConv, bool isVarArg,
   const SmallVectorImpl<ISD::InputArg> &Ins,
@@ -84,7 +174,6 @@ SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
   MachineFunction &MF = DAG.getMachineFunction();
   MachineFrameInfo *MFI = MF.getFrameInfo();
   MachineRegisterInfo &MRI = MF.getRegInfo();
-  GBZ80MachineFunctionInfo *GBZ80FI = MF.getInfo<GBZ80MachineFunctionInfo>();
 
   // CCValAssign - represent the assignment of
   // the arguments to a location
@@ -99,6 +188,14 @@ SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
 
   assert(!isVarArg && "Varargs not supported yet!");
 
+  GBZ80MachineFunctionInfo *GBZ80FI = MF.getInfo<GBZ80MachineFunctionInfo>();
+  if (!Ins.empty() && GBZ80FI->isInterruptHandler())
+    report_fatal_error("GBZ80: an interrupt handler can't take arguments");
+
+  GBZ80FI->setArgumentStackSize(CCInfo.getNextStackOffset());
+  bool IsImmutable = CCInfo.getNextStackOffset() == 0 ||
+                     !hasTailCalls(*MF.getFunction());
+
   for (unsigned i = 0, e = ArgLocs.size(); i != e; i++)
   {
     SDValue ArgValue;
@@ -135,7 +232,6 @@ SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
     else
     {
       assert(VA.isMemLoc());
-      GBZ80FI->setNeedFP();
 
       SDValue InVal;
 
@@ -146,7 +242,8 @@ SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
         << EVT(VA.getLocVT()).getEVTString() << "\n";
 
       // Create the frame index object for this incoming parameter...
-      int FI = MFI->CreateFixedObject(Size, VA.getLocMemOffset(), true);
+      int FI = MFI->CreateFixedObject(Size, VA.getLocMemOffset(),
+                                      IsImmutable);
 
       // Create the SelectionDAG nodes corresponding to a load
       // from this parameter
@@ -161,6 +258,23 @@ SDValue GBZ80TargetLowering::LowerFormalArguments(SDValue Chain,
   return Chain;
 }
 
+FastISel *GBZ80TargetLowering::createFastISel(FunctionLoweringInfo &funcInfo,
+  const TargetLibraryInfo *libInfo) const
+{
+  return GBZ80::createFastISel(funcInfo, libInfo);
+}
+
+// CanLowerReturn - Return values that don't fit into A, HL and DE are
+// returned through a hidden pointer argument.
+bool GBZ80TargetLowering::CanLowerReturn(CallingConv::ID CallConv,
+  MachineFunction &MF, bool isVarArg,
+  const SmallVectorImpl<ISD::OutputArg> &Outs, LLVMContext &Context) const
+{
+  SmallVector<CCValAssign, 16> RVLocs;
+  CCState CCInfo(CallConv, isVarArg, MF, RVLocs, Context);
+  return CCInfo.CheckReturn(Outs, RetCC_GBZ80);
+}
+
 SDValue GBZ80TargetLowering::LowerReturn(SDValue Chain,
   CallingConv::ID CallConv, bool isVarArg,
   const SmallVectorImpl<ISD::OutputArg> &Outs,
@@ -180,12 +294,15 @@ SDValue GBZ80TargetLowering::LowerReturn(SDValue Chain,
 
   SDValue Flag;
   SmallVector<SDValue, 4> RetOps(1, Chain);
+  GBZ80MachineFunctionInfo *GBZ80FI =
+    DAG.getMachineFunction().getInfo<GBZ80MachineFunctionInfo>();
 
   // Copy the result value into the output registers.
   for (unsigned i = 0; i != RVLocs.size(); i++)
   {
     CCValAssign &VA = RVLocs[i];
     assert(VA.isRegLoc() && "Can only return in registers!");
+    GBZ80FI->setReturnReg(VA.getLocReg());
 
     Chain = DAG.getCopyToReg(Chain, dl, VA.getLocReg(), OutVals[i], Flag);
 
@@ -200,7 +317,13 @@ SDValue GBZ80TargetLowering::LowerReturn(SDValue Chain,
   if (Flag.getNode())
     RetOps.push_back(Flag);
 
-  return DAG.getNode(GBZ80ISD::RET, dl, MVT::Other);
+  if (GBZ80FI->isInterruptHandler())
+  {
+    if (!Outs.empty())
+      report_fatal_error("GBZ80: an interrupt handler can't return a value");
+    return DAG.getNode(GBZ80ISD::RETI, dl, MVT::Other, RetOps);
+  }
+  return DAG.getNode(GBZ80ISD::RET, dl, MVT::Other, RetOps);
 }
 
 SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
@@ -218,8 +341,6 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
   bool isVarArg                         = CLI.IsVarArg;
 
   MachineFunction &MF = DAG.getMachineFunction();
-  // GBZ80 target does not yet support tail call optimization
-  isTailCall = false;
 
   // Analyze operands of the call, assigning locations to each operand.
   SmallVector<CCValAssign, 16> ArgLocs;
@@ -231,12 +352,21 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
   // Get a count of how many bytes are to be pushed on the stack
   unsigned NumBytes = CCInfo.getNextStackOffset();
 
-  Chain = DAG.getCALLSEQ_START(Chain, DAG.getConstant(NumBytes,
-    getPointerTy(), true), dl);
+  if (MF.getTarget().Options.DisableTailCalls)
+    isTailCall = false;
+  if (isTailCall)
+    isTailCall = IsEligibleForTailCallOptimization(Callee, CallConv,
+      isVarArg, Outs, Ins, ArgLocs, NumBytes, DAG);
+
+  // A tail call doesn't reserve any stack, it passes its stack arguments in
+  // the slots of the caller's own.
+  if (!isTailCall)
+    Chain = DAG.getCALLSEQ_START(Chain, DAG.getConstant(NumBytes,
+      getPointerTy(), true), dl);
 
   SmallVector<std::pair<unsigned, SDValue>, 4> RegsToPass;
   SmallVector<SDValue, 12> MemOpChains;
-  SDValue StackPtr;
+  SDValue StackPtr, ArgChain;
 
   // Walk the register/memloc assignments, inserting copies/loads.
   for (unsigned i = 0, e = ArgLocs.size(); i != e; i++)
@@ -268,20 +398,38 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
     {
       assert(VA.isMemLoc());
 
-      unsigned FP = MF.getSubtarget().getRegisterInfo()->getFrameRegister(MF);
-      if (StackPtr.getNode() == 0)
-        StackPtr = DAG.getCopyFromReg(Chain, dl, FP, getPointerTy());
-
-      SDValue PtrOff = DAG.getNode(ISD::ADD, dl, getPointerTy(),
-        StackPtr, DAG.getIntPtrConstant(VA.getLocMemOffset()));
-
       SDValue MemOp;
       ISD::ArgFlagsTy Flags = Outs[i].Flags;
 
       if (Flags.isByVal()) assert(0 && "Not implemented yet!");
 
-      MemOp = DAG.getStore(Chain, dl, Arg, PtrOff, MachinePointerInfo(),
-        false, false, 0);
+      if (isTailCall)
+      {
+        // The slots may still hold incoming arguments that other arguments
+        // are loaded from, the stores wait for those loads.
+        if (ArgChain.getNode() == 0)
+          ArgChain = DAG.getStackArgumentTokenFactor(Chain);
+
+        unsigned Size = VA.getLocVT().getStoreSize();
+        int FI = MF.getFrameInfo()->CreateFixedObject(Size,
+          VA.getLocMemOffset(), false);
+        SDValue FIN = DAG.getFrameIndex(FI, getPointerTy());
+        MemOp = DAG.getStore(ArgChain, dl, Arg, FIN,
+          MachinePointerInfo::getFixedStack(FI), false, false, 0);
+      }
+      else
+      {
+        // The outgoing arguments are at the bottom of the frame, right
+        // above SP, see GBZ80DAGToDAGISel::Select.
+        if (StackPtr.getNode() == 0)
+          StackPtr = DAG.getCopyFromReg(Chain, dl, GBZ80::SP, getPointerTy());
+
+        SDValue PtrOff = DAG.getNode(ISD::ADD, dl, getPointerTy(),
+          StackPtr, DAG.getIntPtrConstant(VA.getLocMemOffset()));
+
+        MemOp = DAG.getStore(Chain, dl, Arg, PtrOff, MachinePointerInfo(),
+          false, false, 0);
+      }
 
       MemOpChains.push_back(MemOp);
     }
@@ -290,7 +438,7 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
   // Transform all store nodes into one single node because all store nodes are
   // independent of each other.
   if (!MemOpChains.empty())
-    Chain = DAG.getNode(ISD::TokenFactor, dl, MVT::Other);
+    Chain = DAG.getNode(ISD::TokenFactor, dl, MVT::Other, MemOpChains);
 
   // Build a sequence of copy-to-reg nodes chained together with token chain and
   // flag operands which copy the outgoing args into registers. The Flag is
@@ -332,7 +480,20 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
   if (Flag.getNode())
     Ops.push_back(Flag);
 
-  Chain = DAG.getNode(GBZ80ISD::CALL, dl, NodeTys);
+  // The caller returns whatever the callee does, in the same registers.
+  if (isTailCall)
+  {
+    SmallVector<CCValAssign, 4> RVLocs;
+    CCState RVInfo(CallConv, isVarArg, MF, RVLocs, *DAG.getContext());
+    RVInfo.AnalyzeCallResult(Ins, RetCC_GBZ80);
+    if (!MF.getFunction()->getReturnType()->isVoidTy())
+      for (unsigned i = 0, e = RVLocs.size(); i != e; i++)
+        MF.getInfo<GBZ80MachineFunctionInfo>()->setReturnReg(
+          RVLocs[i].getLocReg());
+    return DAG.getNode(GBZ80ISD::TC_RETURN, dl, MVT::Other, Ops);
+  }
+
+  Chain = DAG.getNode(GBZ80ISD::CALL, dl, NodeTys, Ops);
   Flag = Chain.getValue(1);
 
   // Create the CALLSEQ_END node.
@@ -348,6 +509,78 @@ SDValue GBZ80TargetLowering::LowerCall(TargetLowering::CallLoweringInfo &CLI,
   return LowerCallResult(Chain, Flag, CallConv, isVarArg, Ins, dl, DAG, InVals);
 }
 
+// IsEligibleForTailCallOptimization - A call in tail position becomes a jp
+// after the epilogue of the caller. That only works if the callee preserves
+// the registers the caller has to, and if the arguments survive the epilogue,
+// which pops the callee-saved registers. The stack arguments have to fit in
+// the slots of the caller's own.
+bool GBZ80TargetLowering::IsEligibleForTailCallOptimization(SDValue Callee,
+  CallingConv::ID CalleeCC, bool isVarArg,
+  const SmallVectorImpl<ISD::OutputArg> &Outs,
+  const SmallVectorImpl<ISD::InputArg> &Ins,
+  const SmallVectorImpl<CCValAssign> &ArgLocs,
+  unsigned NumBytes, SelectionDAG &DAG) const
+{
+  MachineFunction &MF = DAG.getMachineFunction();
+  const Function *CallerF = MF.getFunction();
+  GBZ80MachineFunctionInfo *GBZ80FI = MF.getInfo<GBZ80MachineFunctionInfo>();
+
+  // An interrupt handler has to return with reti, and the epilogue of a
+  // function with a frame pointer goes through HL.
+  if (isVarArg || CallerF->isVarArg() || GBZ80FI->isInterruptHandler() ||
+      MF.getFrameInfo()->hasVarSizedObjects())
+    return false;
+
+  if (CallerF->hasStructRetAttr())
+    return false;
+  for (unsigned i = 0, e = Outs.size(); i != e; i++)
+    if (Outs[i].Flags.isSRet() || Outs[i].Flags.isByVal())
+      return false;
+
+  if (NumBytes > GBZ80FI->getArgumentStackSize())
+    return false;
+
+  const TargetRegisterInfo *TRI = MF.getSubtarget().getRegisterInfo();
+  bool IsIndirect = !isa<GlobalAddressSDNode>(Callee) &&
+                    !isa<ExternalSymbolSDNode>(Callee);
+
+  // An indirect call jumps through HL, which can't carry an argument too.
+  if (IsIndirect)
+    for (unsigned i = 0, e = ArgLocs.size(); i != e; i++)
+      if (ArgLocs[i].isRegLoc() &&
+          TRI->regsOverlap(ArgLocs[i].getLocReg(), GBZ80::HL))
+        return false;
+
+  // The call preserved masks leave the return value registers in. The
+  // caller doesn't have to preserve them if it returns the value too.
+  SmallVector<CCValAssign, 4> RVLocs;
+  CCState RVInfo(CalleeCC, isVarArg, MF, RVLocs, *DAG.getContext());
+  RVInfo.AnalyzeCallResult(Ins, RetCC_GBZ80);
+  bool ReturnsValue = !CallerF->getReturnType()->isVoidTy();
+
+  const uint32_t *Mask = TRI->getCallPreservedMask(CalleeCC);
+  for (const MCPhysReg *CSR = TRI->getCalleeSavedRegs(&MF); *CSR; ++CSR)
+  {
+    bool IsReturned = false;
+    for (unsigned i = 0, e = RVLocs.size(); i != e; i++)
+      IsReturned |= TRI->regsOverlap(*CSR, RVLocs[i].getLocReg());
+    if (IsReturned && ReturnsValue)
+      continue;
+
+    if (IsReturned || MachineOperand::clobbersPhysReg(Mask, *CSR))
+      return false;
+
+    // The register is restored before the jump.
+    if (IsIndirect && TRI->regsOverlap(*CSR, GBZ80::HL))
+      return false;
+    for (unsigned i = 0, e = ArgLocs.size(); i != e; i++)
+      if (ArgLocs[i].isRegLoc() &&
+          TRI->regsOverlap(*CSR, ArgLocs[i].getLocReg()))
+        return false;
+  }
+  return true;
+}
+
 SDValue GBZ80TargetLowering::LowerCallResult(SDValue Chain, SDValue Flag,
   CallingConv::ID CallConv, bool isVarArg,
   const SmallVectorImpl<ISD::InputArg> &Ins,
@@ -391,9 +624,12 @@ SDValue GBZ80TargetLowering::LowerOperation(SDValue Op, SelectionDAG &DAG) const
   case ISD::AND:
   case ISD::OR:
   case ISD::XOR:           return LowerBinaryOp(Op, DAG);
+  case ISD::MUL:           return LowerMUL(Op, DAG);
   case ISD::SELECT_CC:     return LowerSelectCC(Op, DAG);
   case ISD::BR_CC:         return LowerBrCC(Op, DAG);
   case ISD::GlobalAddress: return LowerGlobalAddress(Op, DAG);
+  case ISD::BlockAddress:  return LowerBlockAddress(Op, DAG);
+  case ISD::BR_JT:         return LowerBR_JT(Op, DAG);
   case ISD::STORE:         return LowerStore(Op, DAG);
   case ISD::LOAD:          return LowerLoad(Op, DAG);
   default:
@@ -415,16 +651,25 @@ const char *GBZ80TargetLowering::getTargetNodeName(unsigned Opcode) const
   case GBZ80ISD::RR:        return "GBZ80ISD::RR";
   case GBZ80ISD::SLA:       return "GBZ80ISD::SLA";
   case GBZ80ISD::SRA:       return "GBZ80ISD::SRA";
-  case GBZ80ISD::SLL:       return "GBZ80ISD::SLL";
+  case GBZ80ISD::SWAP:      return "GBZ80ISD::SWAP";
   case GBZ80ISD::SRL:       return "GBZ80ISD::SRL";
   case GBZ80ISD::SHL:       return "GBZ80ISD::SHL";
   case GBZ80ISD::LSHR:      return "GBZ80ISD::LSHR";
   case GBZ80ISD::ASHR:      return "GBZ80ISD::ASHR";
   case GBZ80ISD::CP:        return "GBZ80ISD::CP";
+  case GBZ80ISD::CP16:      return "GBZ80ISD::CP16";
+  case GBZ80ISD::TST16:     return "GBZ80ISD::TST16";
   case GBZ80ISD::SELECT_CC: return "GBZ80ISD::SELECT_CC";
   case GBZ80ISD::BR_CC:     return "GBZ80ISD::BR_CC";
   case GBZ80ISD::CALL:      return "GBZ80ISD::CALL";
+  case GBZ80ISD::TC_RETURN: return "GBZ80ISD::TC_RETURN";
   case GBZ80ISD::RET:       return "GBZ80ISD::RET";
+  case GBZ80ISD::RETI:      return "GBZ80ISD::RETI";
+  case GBZ80ISD::MEMCPY:    return "GBZ80ISD::MEMCPY";
+  case GBZ80ISD::MEMSET:    return "GBZ80ISD::MEMSET";
+  case GBZ80ISD::BR_JT8:    return "GBZ80ISD::BR_JT8";
+  case GBZ80ISD::BR_JT8CALL: return "GBZ80ISD::BR_JT8CALL";
+  case GBZ80ISD::BR_JT16:   return "GBZ80ISD::BR_JT16";
   }
 }
 
@@ -476,8 +721,11 @@ SDValue GBZ80TargetLowering::LowerSUB(SDValue Op, SelectionDAG &DAG) const
   // Generating next code:
   // SCF, CCF - clear carry flag (FIXME: must be replaced by AND A)
   // SBC HL, $Rp - sub without carry
+  // SCF has no operands, as a target node it would be shared by every
+  // subtract of the DAG. The machine node isn't CSE'd, each subtract gets
+  // its own.
   SDValue Flag;
-  Flag = DAG.getNode(GBZ80ISD::SCF, dl, MVT::Glue);
+  Flag = SDValue(DAG.getMachineNode(GBZ80::SCF, dl, MVT::Glue), 0);
   Flag = DAG.getNode(GBZ80ISD::CCF, dl, MVT::Glue, Flag);
   return DAG.getNode(ISD::SUBE, dl, DAG.getVTList(VT, MVT::Glue), Op0, Op1, Flag);
 }
@@ -510,54 +758,239 @@ SDValue GBZ80TargetLowering::LowerShifts(SDValue Op, SelectionDAG &DAG) const
   uint64_t ShiftAmount = cast<ConstantSDNode>(N->getOperand(1))->getZExtValue();
   SDValue Victim = N->getOperand(0);
 
+  if (VT == MVT::i16)
+    return LowerShift16(Opc, Victim, ShiftAmount, dl, DAG);
+  return LowerShift8(Opc, Victim, ShiftAmount, dl, DAG);
+}
+
+// getInstrCost - Return the cost of an instruction in T-states, as given by
+// the itineraries.
+unsigned GBZ80TargetLowering::getInstrCost(unsigned Opcode) const
+{
+  const TargetSubtargetInfo *STI = getTargetMachine().getSubtargetImpl();
+  const MCInstrDesc &Desc = STI->getInstrInfo()->get(Opcode);
+  return STI->getInstrItineraryData()->getStageLatency(Desc.getSchedClass());
+}
+
+// getMaskCost - An immediate AND goes through the accumulator.
+unsigned GBZ80TargetLowering::getMaskCost() const
+{
+  return getInstrCost(GBZ80::AND8i) + 2 * getInstrCost(GBZ80::LD8rr);
+}
+
+// getSignFillCost - Cost of "add a, a; sbc a, a", which turns the sign bit
+// into 0 or -1.
+unsigned GBZ80TargetLowering::getSignFillCost() const
+{
+  return getInstrCost(GBZ80::ADD8r) + getInstrCost(GBZ80::SBC8r) +
+         2 * getInstrCost(GBZ80::LD8rr);
+}
+
+// getRotatePlan - Find the cheapest way to rotate a byte left by Amount: a
+// chain of RLC, a chain of RRC, or a SWAP followed by a shorter chain of
+// either. Returns the cost in T-states.
+unsigned GBZ80TargetLowering::getRotatePlan(unsigned Amount, bool &UseSwap,
+                                            unsigned &Count,
+                                            bool &Left) const
+{
+  unsigned Rot  = getInstrCost(GBZ80::RLC8r);
+  unsigned Swap = getInstrCost(GBZ80::SWAP8r);
+  Amount &= 7;
+
+  UseSwap = false;
+  Left    = true;
+  Count   = Amount;
+  unsigned Cost = Amount * Rot;
+
+  if ((8 - Amount) * Rot < Cost) {
+    Left  = false;
+    Count = 8 - Amount;
+    Cost  = Count * Rot;
+  }
+
+  unsigned Rest = Amount >= 4 ? Amount - 4 : 4 - Amount;
+  if (Swap + Rest * Rot < Cost) {
+    UseSwap = true;
+    Left    = Amount >= 4;
+    Count   = Rest;
+    Cost    = Swap + Rest * Rot;
+  }
+  return Cost;
+}
+
+SDValue GBZ80TargetLowering::EmitRotate8(SDValue Val, unsigned Amount,
+                                         SDLoc dl, SelectionDAG &DAG) const
+{
+  bool UseSwap, Left;
+  unsigned Count;
+  getRotatePlan(Amount, UseSwap, Count, Left);
+
+  if (UseSwap)
+    Val = DAG.getNode(GBZ80ISD::SWAP, dl, MVT::i8, Val);
+  while (Count--)
+    Val = DAG.getNode(Left ? GBZ80ISD::RLC : GBZ80ISD::RRC, dl, MVT::i8, Val);
+  return Val;
+}
+
+// EmitSignFill - Return 0 or -1 depending on the sign bit of Val.
+SDValue GBZ80TargetLowering::EmitSignFill(SDValue Val, SDLoc dl,
+                                          SelectionDAG &DAG) const
+{
+  SDValue Add  = DAG.getNode(ISD::ADDC, dl, DAG.getVTList(MVT::i8, MVT::Glue),
+                             Val, Val);
+  return DAG.getNode(ISD::SUBE, dl, MVT::i8, Add, Add, Add.getValue(1));
+}
+
+// LowerShift8 - Lower a byte shift or rotate by a constant. Each candidate
+// sequence is priced with the itinerary costs and the cheapest one is used:
+//  - one SLA/SRL/SRA per bit,
+//  - a rotate (SWAP and RLC/RRC chains) followed by an AND with the mask of
+//    the bits that survive the shift,
+//  - "add a, a; sbc a, a" for an arithmetic shift by 7.
+SDValue GBZ80TargetLowering::LowerShift8(unsigned Opc, SDValue Val,
+                                         uint64_t Amount, SDLoc dl,
+                                         SelectionDAG &DAG) const
+{
   switch (Opc)
   {
   default: llvm_unreachable("Invalid shift opcode");
-  case ISD::SRL:
-    Opc = GBZ80ISD::SRL;
-    break;
+  case ISD::ROTL: return EmitRotate8(Val, Amount & 7, dl, DAG);
+  case ISD::ROTR: return EmitRotate8(Val, (8 - (Amount & 7)) & 7, dl, DAG);
   case ISD::SHL:
-    Opc = GBZ80ISD::SLA;
+  case ISD::SRL:
+    if (Amount >= 8)
+      return DAG.getConstant(0, MVT::i8);
     break;
   case ISD::SRA:
-    Opc = GBZ80ISD::SRA;
-    break;
-  case ISD::ROTL:
-    Opc = GBZ80ISD::RLC;
-    break;
-  case ISD::ROTR:
-    Opc = GBZ80ISD::RRC;
+    if (Amount >= 8)
+      Amount = 7;
     break;
   }
 
-  if (VT == MVT::i16)
-  {
-    SDValue LO, HI, Flag;
-    EVT HalfVT = VT.getHalfSizedIntegerVT(*DAG.getContext());
-    SDVTList VTs = DAG.getVTList(HalfVT, MVT::Glue);
-    LO = DAG.getTargetExtractSubreg(GBZ80::subreg_lo, dl, HalfVT, Victim);
-    HI = DAG.getTargetExtractSubreg(GBZ80::subreg_hi, dl, HalfVT, Victim);
-    while (ShiftAmount--) {
-      if (Opc == GBZ80ISD::SLA) {
-        LO = DAG.getNode(Opc, dl, VTs, LO);
-        Flag = LO.getValue(1);
-        HI = DAG.getNode(GBZ80ISD::RL, dl, HalfVT, HI, Flag);
+  if (Amount == 0)
+    return Val;
+
+  unsigned Rot = getInstrCost(GBZ80::SLA8r);
+  unsigned PerBitCost = Amount * Rot;
+  bool UseSwap, Left;
+  unsigned Count;
+
+  if (Opc == ISD::SRA) {
+    if (Amount == 7 && getSignFillCost() < PerBitCost)
+      return EmitSignFill(Val, dl, DAG);
+  }
+  else {
+    // Rotating the other way round is folded into the plan.
+    unsigned RotAmount = Opc == ISD::SHL ? Amount : 8 - Amount;
+    unsigned RotateCost = getRotatePlan(RotAmount, UseSwap, Count, Left);
+    if (RotateCost + getMaskCost() < PerBitCost) {
+      uint8_t Mask = Opc == ISD::SHL ? 0xFF << Amount : 0xFF >> Amount;
+      Val = EmitRotate8(Val, RotAmount, dl, DAG);
+      return DAG.getNode(ISD::AND, dl, MVT::i8, Val,
+                         DAG.getConstant(Mask, MVT::i8));
+    }
+  }
+
+  unsigned ShiftOpc = Opc == ISD::SHL ? GBZ80ISD::SLA :
+                      Opc == ISD::SRL ? GBZ80ISD::SRL : GBZ80ISD::SRA;
+  while (Amount--)
+    Val = DAG.getNode(ShiftOpc, dl, MVT::i8, Val);
+  return Val;
+}
+
+// LowerShift16 - Lower a 16-bit shift by a constant. Shifts by 8 or more
+// move one byte into the other and shift that with LowerShift8. Shorter
+// shifts either shift the pair one bit at a time through the carry, or, when
+// it is cheaper, shift the value the other way round through a third byte
+// and move the bytes, e.g. x << 7 is (x >> 1) moved up by a byte.
+SDValue GBZ80TargetLowering::LowerShift16(unsigned Opc, SDValue Val,
+                                          uint64_t Amount, SDLoc dl,
+                                          SelectionDAG &DAG) const
+{
+  EVT VT = MVT::i16;
+  SDVTList VTs = DAG.getVTList(MVT::i8, MVT::Glue);
+  SDValue LO, HI, Flag;
+  LO = DAG.getTargetExtractSubreg(GBZ80::subreg_lo, dl, MVT::i8, Val);
+  HI = DAG.getTargetExtractSubreg(GBZ80::subreg_hi, dl, MVT::i8, Val);
+
+  if (Amount >= 16)
+    Amount = Opc == ISD::SRA ? 15 : 16;
+
+  if (Amount >= 8) {
+    switch (Opc)
+    {
+    default: llvm_unreachable("Unsupported shift");
+    case ISD::SHL:
+      HI = LowerShift8(Opc, LO, Amount - 8, dl, DAG);
+      LO = DAG.getConstant(0, MVT::i8);
+      break;
+    case ISD::SRL:
+      LO = LowerShift8(Opc, HI, Amount - 8, dl, DAG);
+      HI = DAG.getConstant(0, MVT::i8);
+      break;
+    case ISD::SRA:
+      LO = LowerShift8(Opc, HI, Amount - 8, dl, DAG);
+      HI = EmitSignFill(HI, dl, DAG);
+      break;
+    }
+  }
+  else if (Amount != 0) {
+    unsigned Rot = getInstrCost(GBZ80::SLA8r);
+    unsigned PerBitCost = Amount * 2 * Rot;
+    unsigned Back = 8 - Amount;
+    unsigned BackCost = getInstrCost(GBZ80::LD8ri) + Back * 3 * Rot;
+
+    if (Opc == ISD::SRA && Amount == 7 &&
+        2 * Rot + getSignFillCost() < PerBitCost) {
+      // The bit shifted out of LO ends up in HI and the sign in the carry.
+      LO   = DAG.getNode(GBZ80ISD::SLA, dl, VTs, LO);
+      HI   = DAG.getNode(GBZ80ISD::RL, dl, VTs, HI, LO.getValue(1));
+      Flag = HI.getValue(1);
+      LO   = HI;
+      HI   = DAG.getNode(ISD::SUBE, dl, MVT::i8, HI, HI, Flag);
+    }
+    else if (Opc != ISD::SRA && BackCost < PerBitCost) {
+      SDValue Z = DAG.getConstant(0, MVT::i8);
+      while (Back--) {
+        if (Opc == ISD::SHL) {
+          HI   = DAG.getNode(GBZ80ISD::SRL, dl, VTs, HI);
+          LO   = DAG.getNode(GBZ80ISD::RR, dl, VTs, LO, HI.getValue(1));
+          Z    = DAG.getNode(GBZ80ISD::RR, dl, VTs, Z, LO.getValue(1));
+        }
+        else {
+          LO   = DAG.getNode(GBZ80ISD::SLA, dl, VTs, LO);
+          HI   = DAG.getNode(GBZ80ISD::RL, dl, VTs, HI, LO.getValue(1));
+          Z    = DAG.getNode(GBZ80ISD::RL, dl, VTs, Z, HI.getValue(1));
+        }
+      }
+      if (Opc == ISD::SHL) {
+        HI = LO;
+        LO = Z;
       }
-      else if (Opc == GBZ80ISD::SRL || Opc == GBZ80ISD::SRA) {
-        HI = DAG.getNode(Opc, dl, VTs, HI);
-        Flag = HI.getValue(1);
-        LO = DAG.getNode(GBZ80ISD::RR, dl, HalfVT, LO, Flag);
+      else {
+        LO = HI;
+        HI = Z;
+      }
+    }
+    else {
+      while (Amount--) {
+        if (Opc == ISD::SHL) {
+          LO   = DAG.getNode(GBZ80ISD::SLA, dl, VTs, LO);
+          Flag = LO.getValue(1);
+          HI   = DAG.getNode(GBZ80ISD::RL, dl, MVT::i8, HI, Flag);
+        }
+        else {
+          unsigned ShiftOpc = Opc == ISD::SRL ? GBZ80ISD::SRL : GBZ80ISD::SRA;
+          HI   = DAG.getNode(ShiftOpc, dl, VTs, HI);
+          Flag = HI.getValue(1);
+          LO   = DAG.getNode(GBZ80ISD::RR, dl, MVT::i8, LO, Flag);
+        }
       }
-      else llvm_unreachable("Unsupported shift");
     }
-    Victim = DAG.getTargetInsertSubreg(GBZ80::subreg_lo, dl, VT, DAG.getUNDEF(VT), LO);
-    Victim = DAG.getTargetInsertSubreg(GBZ80::subreg_hi, dl, VT, Victim, HI);
   }
-  else
-    while (ShiftAmount--)
-      Victim = DAG.getNode(Opc, dl, VT, Victim);
 
-  return Victim;
+  Val = DAG.getTargetInsertSubreg(GBZ80::subreg_lo, dl, VT, DAG.getUNDEF(VT), LO);
+  return DAG.getTargetInsertSubreg(GBZ80::subreg_hi, dl, VT, Val, HI);
 }
 
 SDValue GBZ80TargetLowering::LowerBinaryOp(SDValue Op, SelectionDAG &DAG) const
@@ -595,6 +1028,58 @@ SDValue GBZ80TargetLowering::LowerBinaryOp(SDValue Op, SelectionDAG &DAG) const
   return Res;
 }
 
+// LowerMUL - Turn a multiply by a constant into shifts and adds of the other
+// operand. The constant is written in non-adjacent form, with digits of 1, 0
+// and -1, no two nonzero digits next to each other, which keeps the number of
+// adds and subtracts lowest: x * 10 = ((x << 2) + x) << 1. A multiply needing
+// too many of them, or by a variable, is left to the legalizer, which calls
+// __mulqi3 or __mulhi3 of the runtime library instead.
+SDValue GBZ80TargetLowering::LowerMUL(SDValue Op, SelectionDAG &DAG) const
+{
+  SDLoc dl(Op);
+  EVT VT = Op.getValueType();
+  ConstantSDNode *CN = dyn_cast<ConstantSDNode>(Op.getOperand(1));
+  if (!CN)
+    return SDValue();
+
+  // Nonzero digits as (position, sign), lowest first.
+  SmallVector<std::pair<unsigned, int>, 8> Digits;
+  int64_t Val = CN->getSExtValue();
+  for (unsigned Pos = 0; Val != 0 && Pos < VT.getSizeInBits(); ++Pos)
+  {
+    if (Val & 1)
+    {
+      int Digit = (Val & 3) == 1 ? 1 : -1;
+      Digits.push_back(std::make_pair(Pos, Digit));
+      Val -= Digit;
+    }
+    Val /= 2;
+  }
+
+  const Function *F = DAG.getMachineFunction().getFunction();
+  unsigned MaxDigits =
+    F->hasFnAttribute(Attribute::OptimizeForSize) ? 2 : 4;
+  if (Digits.empty() || Digits.size() > MaxDigits)
+    return SDValue();
+
+  SDValue X = Op.getOperand(0);
+  unsigned i = Digits.size() - 1;
+  SDValue Res = X;
+  if (Digits[i].second < 0)
+    Res = DAG.getNode(ISD::SUB, dl, VT, DAG.getConstant(0, VT), X);
+  while (i-- != 0)
+  {
+    unsigned Amount = Digits[i + 1].first - Digits[i].first;
+    Res = DAG.getNode(ISD::SHL, dl, VT, Res, DAG.getConstant(Amount, MVT::i8));
+    Res = DAG.getNode(Digits[i].second > 0 ? ISD::ADD : ISD::SUB, dl, VT,
+                      Res, X);
+  }
+  if (Digits[0].first)
+    Res = DAG.getNode(ISD::SHL, dl, VT, Res,
+                      DAG.getConstant(Digits[0].first, MVT::i8));
+  return Res;
+}
+
 SDValue GBZ80TargetLowering::EmitCMP(SDValue &LHS, SDValue &RHS,
         SDValue &GBZ80CC, ISD::CondCode CC, SDLoc dl, SelectionDAG &DAG) const {
   EVT VT = LHS.getValueType();
@@ -602,7 +1087,10 @@ SDValue GBZ80TargetLowering::EmitCMP(SDValue &LHS, SDValue &RHS,
   assert(!VT.isFloatingPoint() && "We don't handle FP yet");
   assert((VT == MVT::i8 || VT == MVT::i16) && "Invalid type in EmitCMP");
 
+  // There are no sign and overflow flags, signed compares flip the sign bits
+  // and compare unsigned.
   GBZ80::CondCode TCC = GBZ80::COND_INVALID;
+  bool Signed = false;
   switch (CC)
   {
   case ISD::SETUNE:
@@ -613,34 +1101,54 @@ SDValue GBZ80TargetLowering::EmitCMP(SDValue &LHS, SDValue &RHS,
   case ISD::SETEQ:
     TCC = GBZ80::COND_Z;
     break;
+  case ISD::SETGT:
+    Signed = true;
   case ISD::SETUGT:
     std::swap(LHS, RHS);
+    TCC = GBZ80::COND_C;
+    break;
+  case ISD::SETLT:
+    Signed = true;
   case ISD::SETULT:
     TCC = GBZ80::COND_C;
     break;
+  case ISD::SETLE:
+    Signed = true;
   case ISD::SETULE:
     std::swap(LHS, RHS);
-  case ISD::SETUGE:
     TCC = GBZ80::COND_NC;
     break;
-  case ISD::SETLE:
-    std::swap(LHS, RHS);
   case ISD::SETGE:
-    TCC = GBZ80::COND_P;
-    break;
-  case ISD::SETGT:
-    std::swap(LHS, RHS);
-  case ISD::SETLT:
-    TCC = GBZ80::COND_M;
+    Signed = true;
+  case ISD::SETUGE:
+    TCC = GBZ80::COND_NC;
     break;
   default: llvm_unreachable("Invalid integer condition!");
   }
   GBZ80CC = DAG.getConstant(TCC, MVT::i8);
 
+  if (Signed)
+  {
+    SDValue SignBit = DAG.getConstant(VT == MVT::i8 ? 0x80 : 0x8000, VT);
+    LHS = DAG.getNode(ISD::XOR, dl, VT, LHS, SignBit);
+    RHS = DAG.getNode(ISD::XOR, dl, VT, RHS, SignBit);
+  }
+
   if (VT == MVT::i8)
     return DAG.getNode(GBZ80ISD::CP, dl, MVT::Glue, LHS, RHS);
-  else // MVT::i16
-    return DAG.getNode(ISD::SUBC, dl, DAG.getVTList(VT, MVT::Glue), LHS, RHS).getValue(1);
+
+  // MVT::i16
+  if (isa<ConstantSDNode>(LHS))
+  {
+    // Keep the constant on the right, the condition is symmetric.
+    if (TCC == GBZ80::COND_Z || TCC == GBZ80::COND_NZ)
+      std::swap(LHS, RHS);
+  }
+  ConstantSDNode *C = dyn_cast<ConstantSDNode>(RHS);
+  if (C && C->isNullValue() &&
+      (TCC == GBZ80::COND_Z || TCC == GBZ80::COND_NZ))
+    return DAG.getNode(GBZ80ISD::TST16, dl, MVT::Glue, LHS);
+  return DAG.getNode(GBZ80ISD::CP16, dl, MVT::Glue, LHS, RHS);
 }
 
 SDValue GBZ80TargetLowering::LowerSelectCC(SDValue Op, SelectionDAG &DAG) const
@@ -689,6 +1197,43 @@ SDValue GBZ80TargetLowering::LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) c
   return DAG.getNode(GBZ80ISD::WRAPPER, dl, VT, Result);
 }
 
+SDValue GBZ80TargetLowering::LowerBlockAddress(SDValue Op,
+                                               SelectionDAG &DAG) const
+{
+  SDLoc dl(Op);
+  const BlockAddress *BA = cast<BlockAddressSDNode>(Op)->getBlockAddress();
+  SDValue Result = DAG.getTargetBlockAddress(BA, getPointerTy());
+
+  return DAG.getNode(GBZ80ISD::WRAPPER, dl, getPointerTy(), Result);
+}
+
+// LowerBR_JT - The table of 16-bit block addresses follows the jump through
+// it, see GBZ80AsmPrinter::EmitJumpTable. A table of at most 128 entries is
+// indexed by A, which leaves every register pair but HL alone. When
+// optimizing for size, that is done in the __gbz80_jumptable routine, which
+// saves 9 bytes per table at the cost of the call. Larger tables are indexed
+// by a register pair.
+SDValue GBZ80TargetLowering::LowerBR_JT(SDValue Op, SelectionDAG &DAG) const
+{
+  SDLoc dl(Op);
+  SDValue Chain = Op.getOperand(0);
+  SDValue Index = Op.getOperand(2);
+  unsigned JTI = cast<JumpTableSDNode>(Op.getOperand(1))->getIndex();
+  SDValue Table = DAG.getTargetJumpTable(JTI, getPointerTy());
+
+  MachineFunction &MF = DAG.getMachineFunction();
+  const MachineJumpTableInfo *MJTI = MF.getJumpTableInfo();
+  if (MJTI->getJumpTables()[JTI].MBBs.size() > 128)
+    return DAG.getNode(GBZ80ISD::BR_JT16, dl, MVT::Other, Chain, Table, Index);
+
+  bool OptSize =
+    MF.getFunction()->hasFnAttribute(Attribute::OptimizeForSize) ||
+    MF.getFunction()->hasFnAttribute(Attribute::MinSize);
+  return DAG.getNode(OptSize ? GBZ80ISD::BR_JT8CALL : GBZ80ISD::BR_JT8, dl,
+                     MVT::Other, Chain, Table,
+                     DAG.getNode(ISD::TRUNCATE, dl, MVT::i8, Index));
+}
+
 SDValue GBZ80TargetLowering::LowerStore(SDValue Op, SelectionDAG &DAG) const
 {
   SDLoc dl(Op);
@@ -700,18 +1245,6 @@ SDValue GBZ80TargetLowering::LowerStore(SDValue Op, SelectionDAG &DAG) const
   assert(!ST->isTruncatingStore() && "Truncating Store isn't supported yet!");
   assert(!ST->isIndexed() && "Indexed Store isn't supported yet!");
   
-  switch (BasePtr.getOpcode())
-  {
-  default: break;
-  case ISD::CopyFromReg:
-      if (RegisterSDNode *RN = dyn_cast<RegisterSDNode>(BasePtr.getOperand(1)))
-        if (RN->getReg() != getTargetMachine().getSubtargetImpl()->getRegisterInfo()->getFrameRegister(
-          DAG.getMachineFunction()))
-          break;
-  case ISD::FrameIndex:
-    return SDValue();
-  }
-
   SDValue Lo, Hi;
   if (ConstantSDNode *CN = dyn_cast<ConstantSDNode>(Value)) {
     Lo = DAG.getConstant(CN->getZExtValue() & 0xFF, MVT::i8);
@@ -742,12 +1275,6 @@ SDValue GBZ80TargetLowering::LowerLoad(SDValue Op, SelectionDAG &DAG) const
   assert(!LD->isIndexed() && "Indexed load isn't supported yet!");
   assert(LD->getExtensionType() == ISD::NON_EXTLOAD && "Extload isn't supported yet!");
 
-  switch (BasePtr.getOpcode())
-  {
-  default: break;
-  case ISD::FrameIndex:
-    return SDValue();
-  }
   SDValue Lo = DAG.getLoad(MVT::i8, dl, Chain, BasePtr,
     MachinePointerInfo(), LD->isVolatile(), LD->isNonTemporal(),
     LD->isInvariant(), LD->getAlignment());
@@ -768,6 +1295,69 @@ SDValue GBZ80TargetLowering::LowerLoad(SDValue Op, SelectionDAG &DAG) const
   return DAG.getMergeValues(Ops, dl);
 }
 
+bool GBZ80TargetLowering::isLegalAddressingMode(const AddrMode &AM,
+  Type *Ty) const
+{
+  // (nn) of a global. The DAG combiner asks about a register plus an offset
+  // as a bare offset, without a base register, see canFoldInAddressingMode.
+  // That isn't an absolute address, constant addresses are selected as (nn)
+  // all the same.
+  if (!AM.HasBaseReg && AM.Scale == 0)
+    return AM.BaseGV || AM.BaseOffs == 0;
+  // (hl), (bc) or (de)
+  if (AM.BaseGV || AM.BaseOffs != 0)
+    return false;
+  return AM.Scale == 0 || (AM.Scale == 1 && !AM.HasBaseReg);
+}
+
+bool GBZ80TargetLowering::getPostIndexedAddressParts(SDNode *N, SDNode *Op,
+  SDValue &Base, SDValue &Offset, ISD::MemIndexedMode &AM,
+  SelectionDAG &DAG) const
+{
+  EVT VT;
+  if (LoadSDNode *LD = dyn_cast<LoadSDNode>(N))
+  {
+    if (LD->getExtensionType() != ISD::NON_EXTLOAD)
+      return false;
+    VT = LD->getMemoryVT();
+  }
+  else if (StoreSDNode *ST = dyn_cast<StoreSDNode>(N))
+  {
+    if (ST->isTruncatingStore())
+      return false;
+    VT = ST->getMemoryVT();
+  }
+  else
+    return false;
+
+  if (VT != MVT::i8 ||
+      (Op->getOpcode() != ISD::ADD && Op->getOpcode() != ISD::SUB))
+    return false;
+
+  ConstantSDNode *CN = dyn_cast<ConstantSDNode>(Op->getOperand(1));
+  if (!CN)
+    return false;
+  int64_t Step = CN->getSExtValue();
+  if (Op->getOpcode() == ISD::SUB)
+    Step = -Step;
+  if (Step != 1 && Step != -1)
+    return false;
+
+  // The pointer is handed over in HL, which every other access through a
+  // pointer needs as well. A stepped pointer that lives on in another block
+  // would usually have to be copied out of HL again, which costs as much as
+  // stepping it there.
+  for (SDNode::use_iterator UI = Op->use_begin(), UE = Op->use_end();
+       UI != UE; ++UI)
+    if (UI->getOpcode() == ISD::CopyToReg)
+      return false;
+
+  Base   = Op->getOperand(0);
+  Offset = DAG.getConstant(1, MVT::i16);
+  AM     = Step > 0 ? ISD::POST_INC : ISD::POST_DEC;
+  return true;
+}
+
 //===----------------------------------------------------------------------===//
 //                   Instructions With Custom Inserter
 //===----------------------------------------------------------------------===//
@@ -787,6 +1377,8 @@ MachineBasicBlock* GBZ80TargetLowering::EmitInstrWithCustomInserter(MachineInstr
   case GBZ80::SHL16:
   case GBZ80::LSHR16:
   case GBZ80::ASHR16:   return EmitShiftInstr(MI, MBB);
+  case GBZ80::CMP16rr:
+  case GBZ80::CMP16ri:  return EmitCmp16(MI, MBB);
   default: llvm_unreachable("Invalid Custom Inserter Instruction");
   }
 }
@@ -831,6 +1423,44 @@ MachineBasicBlock* GBZ80TargetLowering::EmitSelectInstr(MachineInstr *MI,
   return MBB;
 }
 
+// useShiftLadder - Decide how a variable shift is expanded. A loop costs one
+// taken branch per bit, the ladder jumps into a row of unrolled shifts and
+// only pays for computing the jump address, but is much bigger. The costs are
+// compared for a shift by half the width.
+bool GBZ80TargetLowering::useShiftLadder(const MachineFunction &MF,
+                                         bool Is16) const
+{
+  if (ShiftLadder != cl::BOU_UNSET)
+    return ShiftLadder == cl::BOU_TRUE;
+
+  if (getTargetMachine().getOptLevel() == CodeGenOpt::None ||
+      MF.getFunction()->hasFnAttribute(Attribute::OptimizeForSize) ||
+      MF.getFunction()->hasFnAttribute(Attribute::MinSize))
+    return false;
+
+  unsigned Amount = Is16 ? 8 : 4;
+  unsigned Step = getInstrCost(GBZ80::SLA8r) * (Is16 ? 2 : 1);
+  unsigned Taken = getInstrCost(GBZ80::JPCC) +
+    getTargetMachine().getSubtargetImpl()->getSchedModel().MispredictPenalty;
+
+  // ld a, amt; cp 0; jp z; then per bit: shift; dec a; jp nz.
+  unsigned LoopCost = getInstrCost(GBZ80::LD8rr) + getInstrCost(GBZ80::CP8i) +
+    getInstrCost(GBZ80::JPCC) +
+    Amount * (Step + getInstrCost(GBZ80::DEC8r) + Taken) -
+    (Taken - getInstrCost(GBZ80::JPCC));
+
+  // ld a, amt; and n; add a, a (per byte of a step); cpl; scf; ld hl, end;
+  // adc a, l; ld l, a; ld a, h; adc a, 0xff; ld h, a; jp (hl).
+  unsigned LadderCost = 4 * getInstrCost(GBZ80::LD8rr) +
+    getInstrCost(GBZ80::AND8i) +
+    (Is16 ? 2 : 1) * getInstrCost(GBZ80::ADD8r) + getInstrCost(GBZ80::CPL) +
+    getInstrCost(GBZ80::SCF) + getInstrCost(GBZ80::LD16ri) +
+    getInstrCost(GBZ80::ADC8r) + getInstrCost(GBZ80::ADC8i) +
+    getInstrCost(GBZ80::JPHL) + Amount * Step;
+
+  return LadderCost < LoopCost;
+}
+
 MachineBasicBlock* GBZ80TargetLowering::EmitShiftInstr(MachineInstr *MI,
   MachineBasicBlock *MBB) const
 {
@@ -874,6 +1504,40 @@ MachineBasicBlock* GBZ80TargetLowering::EmitShiftInstr(MachineInstr *MI,
     break;
   }
 
+  unsigned DstReg = MI->getOperand(0).getReg();
+  unsigned SrcReg = MI->getOperand(1).getReg();
+  unsigned AmtReg = MI->getOperand(2).getReg();
+
+  if (useShiftLadder(*MF, Opc2 != 0))
+  {
+    unsigned LadderOpc;
+    switch (MI->getOpcode())
+    {
+    default: llvm_unreachable("Invalid shift opcode!");
+    case GBZ80::SHL8:   LadderOpc = GBZ80::SHL8L;   break;
+    case GBZ80::LSHR8:  LadderOpc = GBZ80::LSHR8L;  break;
+    case GBZ80::ASHR8:  LadderOpc = GBZ80::ASHR8L;  break;
+    case GBZ80::SHL16:  LadderOpc = GBZ80::SHL16L;  break;
+    case GBZ80::LSHR16: LadderOpc = GBZ80::LSHR16L; break;
+    case GBZ80::ASHR16: LadderOpc = GBZ80::ASHR16L; break;
+    }
+
+    // The jump address is computed in A and HL, so the value being shifted
+    // has to live in BC or DE.
+    const TargetRegisterClass *LadderRC = Opc2 ? &GBZ80::GR16_BCDERegClass
+                                               : &GBZ80::GR8_BCDERegClass;
+    unsigned LadderSrc = MRI.createVirtualRegister(LadderRC);
+    unsigned LadderDst = MRI.createVirtualRegister(LadderRC);
+
+    BuildMI(*MBB, MI, dl, TII.get(GBZ80::COPY), LadderSrc).addReg(SrcReg);
+    BuildMI(*MBB, MI, dl, TII.get(LadderOpc), LadderDst)
+      .addReg(LadderSrc).addReg(AmtReg);
+    BuildMI(*MBB, MI, dl, TII.get(GBZ80::COPY), DstReg).addReg(LadderDst);
+
+    MI->eraseFromParent();
+    return MBB;
+  }
+
   const BasicBlock *LLVM_BB = MBB->getBasicBlock();
   MachineFunction::iterator I = MBB;
   I++;
@@ -897,9 +1561,6 @@ MachineBasicBlock* GBZ80TargetLowering::EmitShiftInstr(MachineInstr *MI,
   unsigned ShiftReg2 = MRI.createVirtualRegister(RC);
   unsigned ShiftAmt  = MRI.createVirtualRegister(&GBZ80::GR8RegClass);
   unsigned ShiftAmt2 = MRI.createVirtualRegister(&GBZ80::GR8RegClass);
-  unsigned DstReg = MI->getOperand(0).getReg();
-  unsigned SrcReg = MI->getOperand(1).getReg();
-  unsigned AmtReg = MI->getOperand(2).getReg();
 
   // MBB:
   // LD A,AmtReg
@@ -972,3 +1633,64 @@ MachineBasicBlock* GBZ80TargetLowering::EmitShiftInstr(MachineInstr *MI,
   MI->eraseFromParent();
   return RemMBB;
 }
+
+// EmitCmp16 - Expand a 16-bit compare into byte compares. The high bytes
+// decide the result unless they are equal, in which case the low bytes do:
+//   ld a, hi1
+//   cp hi2
+//   jp nz, JoinMBB
+//   ld a, lo1
+//   cp lo2
+// JoinMBB:
+// Either way Z and C in JoinMBB are set as by a 16-bit subtraction, without
+// computing it.
+MachineBasicBlock* GBZ80TargetLowering::EmitCmp16(MachineInstr *MI,
+  MachineBasicBlock *MBB) const
+{
+  MachineFunction *MF = MBB->getParent();
+  DebugLoc dl = MI->getDebugLoc();
+  const TargetInstrInfo &TII = *getTargetMachine().getSubtargetImpl()->getInstrInfo();
+
+  unsigned LHS = MI->getOperand(0).getReg();
+  const MachineOperand &RHS = MI->getOperand(1);
+
+  const BasicBlock *LLVM_BB = MBB->getBasicBlock();
+  MachineFunction::iterator I = MBB;
+  I++;
+
+  MachineBasicBlock *LoMBB   = MF->CreateMachineBasicBlock(LLVM_BB);
+  MachineBasicBlock *JoinMBB = MF->CreateMachineBasicBlock(LLVM_BB);
+  MF->insert(I, LoMBB);
+  MF->insert(I, JoinMBB);
+
+  JoinMBB->splice(JoinMBB->begin(), MBB,
+    std::next(MachineBasicBlock::iterator(MI)), MBB->end());
+  JoinMBB->transferSuccessorsAndUpdatePHIs(MBB);
+  JoinMBB->addLiveIn(GBZ80::FLAGS);
+
+  // Add edges MBB => LoMBB => JoinMBB, MBB => JoinMBB
+  MBB->addSuccessor(LoMBB);
+  MBB->addSuccessor(JoinMBB);
+  LoMBB->addSuccessor(JoinMBB);
+
+  BuildMI(MBB, dl, TII.get(GBZ80::COPY), GBZ80::A)
+    .addReg(LHS, 0, GBZ80::subreg_hi);
+  if (RHS.isImm())
+    BuildMI(MBB, dl, TII.get(GBZ80::CP8i)).addImm((RHS.getImm() >> 8) & 0xFF);
+  else
+    BuildMI(MBB, dl, TII.get(GBZ80::CP8r))
+      .addReg(RHS.getReg(), 0, GBZ80::subreg_hi);
+  BuildMI(MBB, dl, TII.get(GBZ80::JPCC)).addMBB(JoinMBB)
+    .addImm(GBZ80::COND_NZ);
+
+  BuildMI(LoMBB, dl, TII.get(GBZ80::COPY), GBZ80::A)
+    .addReg(LHS, 0, GBZ80::subreg_lo);
+  if (RHS.isImm())
+    BuildMI(LoMBB, dl, TII.get(GBZ80::CP8i)).addImm(RHS.getImm() & 0xFF);
+  else
+    BuildMI(LoMBB, dl, TII.get(GBZ80::CP8r))
+      .addReg(RHS.getReg(), 0, GBZ80::subreg_lo);
+
+  MI->eraseFromParent();
+  return JoinMBB;
+}
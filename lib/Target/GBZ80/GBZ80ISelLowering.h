@@ -16,7 +16,9 @@
 #define GBZ80ISELLOWERING_H
 
 #include "llvm/CodeGen/CallingConvLower.h"
+#include "llvm/CodeGen/MachineJumpTableInfo.h"
 #include "llvm/CodeGen/SelectionDAG.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Target/TargetLowering.h"
 
 namespace llvm {
@@ -27,12 +29,14 @@ namespace llvm {
       FIRST_NUMBER = ISD::BUILTIN_OP_END,
       WRAPPER,
       SCF, CCF,
-      RLC, RRC, RL, RR, SLA, SRA, SLL, SRL,
+      RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL,
       SHL, LSHR, ASHR,
-      CP,
+      CP, CP16, TST16,
       SELECT_CC,
       BR_CC,
-      CALL, RET
+      CALL, TC_RETURN, RET, RETI,
+      MEMCPY, MEMSET,
+      BR_JT8, BR_JT8CALL, BR_JT16
     }; // end NodeType
   } // end namespace GBZ80ISD
 
@@ -55,18 +59,61 @@ namespace llvm {
     SDValue LowerSUB(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerShifts(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerBinaryOp(SDValue Op, SelectionDAG &DAG) const;
+    SDValue LowerMUL(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerSelectCC(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerBrCC(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) const;
+    SDValue LowerBlockAddress(SDValue Op, SelectionDAG &DAG) const;
+    SDValue LowerBR_JT(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerStore(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerLoad(SDValue Op, SelectionDAG &DAG) const;
 
+    // getOptimalMemOpType - Inline copies and fills go byte by byte, there
+    // are no 16-bit loads and stores.
+    EVT getOptimalMemOpType(uint64_t Size, unsigned DstAlign,
+      unsigned SrcAlign, bool IsMemset, bool ZeroMemset, bool MemcpyStrSrc,
+      MachineFunction &MF) const override { return MVT::i8; }
+
+    // isLegalAddressingMode - Memory is addressed through a register pair
+    // or an absolute address, there is no register plus offset form.
+    bool isLegalAddressingMode(const AddrMode &AM, Type *Ty) const override;
+
+    // getPostIndexedAddressParts - Fold a step of the pointer by one into a
+    // load or store of A through HL.
+    bool getPostIndexedAddressParts(SDNode *N, SDNode *Op, SDValue &Base,
+      SDValue &Offset, ISD::MemIndexedMode &AM,
+      SelectionDAG &DAG) const override;
+
+    // getJumpTableEncoding - The tables are emitted inline by the
+    // AsmPrinter, together with the jump through them.
+    unsigned getJumpTableEncoding() const override {
+      return MachineJumpTableInfo::EK_Inline;
+    }
+
+    // getJumpTableRegTy - An index that fits in a byte is carried from the
+    // range check to the jump in a single register, see LowerBR_JT.
+    MVT getJumpTableRegTy(uint64_t NumEntries) const override {
+      return NumEntries <= 256 ? MVT::i8 : MVT::i16;
+    }
+
+    // mayBeEmittedAsTailCall - Calls marked tail may become a jp, so
+    // CodeGenPrepare duplicates the return into the blocks that make them.
+    bool mayBeEmittedAsTailCall(CallInst *CI) const override {
+      return CI->isTailCall();
+    }
+
+    // createFastISel - FastISel for -O0, see GBZ80FastISel.cpp.
+    FastISel *createFastISel(FunctionLoweringInfo &funcInfo,
+      const TargetLibraryInfo *libInfo) const override;
+
     MachineBasicBlock* EmitInstrWithCustomInserter(MachineInstr *MI,
       MachineBasicBlock *MBB) const;
     MachineBasicBlock* EmitSelectInstr(MachineInstr *MI,
       MachineBasicBlock *MBB) const;
     MachineBasicBlock* EmitShiftInstr(MachineInstr *MI,
       MachineBasicBlock *MBB) const;
+    MachineBasicBlock* EmitCmp16(MachineInstr *MI,
+      MachineBasicBlock *MBB) const;
   private:
     SDValue
       LowerCallResult(SDValue Chain, SDValue Flag,
@@ -80,6 +127,9 @@ namespace llvm {
         const SmallVectorImpl<ISD::InputArg> &Ins,
         SDLoc dl, SelectionDAG &DAG,
         SmallVectorImpl<SDValue> &InVals) const;
+    bool CanLowerReturn(CallingConv::ID CallConv, MachineFunction &MF,
+      bool isVarArg, const SmallVectorImpl<ISD::OutputArg> &Outs,
+      LLVMContext &Context) const override;
     virtual SDValue
       LowerReturn(SDValue Chain,
         CallingConv::ID CallConv, bool isVarArg,
@@ -89,6 +139,29 @@ namespace llvm {
     virtual SDValue
       LowerCall(TargetLowering::CallLoweringInfo &CLI,
         SmallVectorImpl<SDValue> &InVals) const;
+    bool IsEligibleForTailCallOptimization(SDValue Callee,
+      CallingConv::ID CalleeCC, bool isVarArg,
+      const SmallVectorImpl<ISD::OutputArg> &Outs,
+      const SmallVectorImpl<ISD::InputArg> &Ins,
+      const SmallVectorImpl<CCValAssign> &ArgLocs,
+      unsigned NumBytes, SelectionDAG &DAG) const;
+
+    SDValue LowerShift8(unsigned Opc, SDValue Val, uint64_t Amount,
+      SDLoc dl, SelectionDAG &DAG) const;
+    SDValue LowerShift16(unsigned Opc, SDValue Val, uint64_t Amount,
+      SDLoc dl, SelectionDAG &DAG) const;
+    SDValue EmitRotate8(SDValue Val, unsigned Amount, SDLoc dl,
+      SelectionDAG &DAG) const;
+    SDValue EmitSignFill(SDValue Val, SDLoc dl, SelectionDAG &DAG) const;
+
+    // Cost of instructions and instruction sequences in T-states, used to
+    // pick between lowerings.
+    unsigned getInstrCost(unsigned Opcode) const;
+    unsigned getMaskCost() const;
+    unsigned getSignFillCost() const;
+    unsigned getRotatePlan(unsigned Amount, bool &UseSwap, unsigned &Count,
+      bool &Left) const;
+    bool useShiftLadder(const MachineFunction &MF, bool Is16) const;
 
     // Emit nodes that will be selected as "cp Op0, Op1", or something
     // equivalent, for use with given LLVM condition code and return
@@ -96,6 +169,11 @@ namespace llvm {
     SDValue EmitCMP(SDValue &LHS, SDValue &RHS, SDValue &Z80CC,
       ISD::CondCode CC, SDLoc dl, SelectionDAG &DAG) const;
   }; // end class GBZ80TargetLowering
+
+  namespace GBZ80 {
+    FastISel *createFastISel(FunctionLoweringInfo &funcInfo,
+      const TargetLibraryInfo *libInfo);
+  } // end namespace GBZ80
 } // end namespace llvm
 
 #endif
@@ -13,12 +13,15 @@
 
 #include "GBZ80InstrInfo.h"
 #include "GBZ80.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineJumpTableInfo.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 
-#define GET_INSTRINFO_CTOR
+#define GET_INSTRINFO_CTOR_DTOR
 #include "GBZ80GenInstrInfo.inc"
 
 using namespace llvm;
@@ -30,6 +33,20 @@ GBZ80InstrInfo::GBZ80InstrInfo(GBZ80TargetMachine &tm)
   RI(tm, *this), TM(tm)
 {}
 
+// isLiveBefore - Return true if Reg or a part of it is live right before I.
+static bool isLiveBefore(const TargetRegisterInfo &TRI, MachineBasicBlock &MBB,
+  MachineBasicBlock::iterator I, unsigned Reg)
+{
+  LivePhysRegs Live(&TRI);
+  Live.addLiveOuts(&MBB);
+  for (MachineBasicBlock::iterator J = MBB.end(); J != I; )
+    Live.stepBackward(*--J);
+  for (MCSubRegIterator SR(Reg, &TRI, true); SR.isValid(); ++SR)
+    if (Live.contains(*SR))
+      return true;
+  return false;
+}
+
 void GBZ80InstrInfo::copyPhysReg(MachineBasicBlock &MBB,
   MachineBasicBlock::iterator I, DebugLoc DL,
   unsigned DestReg, unsigned SrcReg, bool KillSrc) const
@@ -61,13 +78,63 @@ void GBZ80InstrInfo::copyPhysReg(MachineBasicBlock &MBB,
         .addReg(SrcReg);
     return;
   }
-  else if (GBZ80::GR16RegClass.contains(DestReg) ||
-           GBZ80::GR16RegClass.contains(SrcReg))
+  else if (SrcReg == GBZ80::SP && GBZ80::GR16RegClass.contains(DestReg))
   {
-    // copy GR16 to GR16
-    BuildMI(MBB, I, DL, get(GBZ80::PUSH16r))
-      .addReg(SrcReg, getKillRegState(KillSrc));
-    BuildMI(MBB, I, DL, get(GBZ80::POP16r), DestReg);
+    // SP can only be read with ld hl,sp+e, which sets the flags. Whatever of
+    // HL and the flags is live is saved on the stack meanwhile.
+    bool SaveHL = DestReg != GBZ80::HL && isLiveBefore(RI, MBB, I, GBZ80::HL);
+    bool SaveFlags = isLiveBefore(RI, MBB, I, GBZ80::FLAGS);
+    int64_t Pushed = 0;
+    if (SaveHL)
+    {
+      BuildMI(MBB, I, DL, get(GBZ80::PUSH16r))
+        .addReg(GBZ80::HL);
+      Pushed += 2;
+    }
+    if (SaveFlags)
+    {
+      MachineInstr *Push = BuildMI(MBB, I, DL, get(GBZ80::PUSHAF));
+      if (!isLiveBefore(RI, MBB, I, GBZ80::A))
+        Push->findRegisterUseOperand(GBZ80::A)->setIsUndef();
+      Pushed += 2;
+    }
+    BuildMI(MBB, I, DL, get(GBZ80::LD16HLSP), GBZ80::HL)
+      .addImm(Pushed);
+    if (SaveFlags)
+      BuildMI(MBB, I, DL, get(GBZ80::POPAF));
+    if (DestReg != GBZ80::HL)
+      copyPhysReg(MBB, I, DL, DestReg, GBZ80::HL, true);
+    if (SaveHL)
+      BuildMI(MBB, I, DL, get(GBZ80::POP16r), GBZ80::HL);
+    return;
+  }
+  else if (DestReg == GBZ80::SP && GBZ80::GR16RegClass.contains(SrcReg))
+  {
+    // ld sp,hl is the only way to write SP. Pushing HL doesn't work here,
+    // the pop would read from the new stack, so a live HL is kept in a free
+    // register pair instead.
+    if (SrcReg == GBZ80::HL)
+    {
+      BuildMI(MBB, I, DL, get(GBZ80::LD16SPr))
+        .addReg(SrcReg, getKillRegState(KillSrc));
+      return;
+    }
+    unsigned Tmp = 0;
+    if (isLiveBefore(RI, MBB, I, GBZ80::HL))
+    {
+      static const uint16_t Pairs[] = { GBZ80::DE, GBZ80::BC };
+      for (unsigned i = 0; i != array_lengthof(Pairs) && !Tmp; ++i)
+        if (Pairs[i] != SrcReg && !isLiveBefore(RI, MBB, I, Pairs[i]))
+          Tmp = Pairs[i];
+      if (!Tmp)
+        report_fatal_error("No free register pair to copy into SP");
+      copyPhysReg(MBB, I, DL, Tmp, GBZ80::HL, false);
+    }
+    copyPhysReg(MBB, I, DL, GBZ80::HL, SrcReg, KillSrc);
+    BuildMI(MBB, I, DL, get(GBZ80::LD16SPr))
+      .addReg(GBZ80::HL, RegState::Kill);
+    if (Tmp)
+      copyPhysReg(MBB, I, DL, GBZ80::HL, Tmp, true);
     return;
   }
   llvm_unreachable("Imposible reg-to-reg copy");
@@ -179,7 +246,7 @@ bool GBZ80InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       return true;
 
     // Handle unconditional branches.
-    if (I->getOpcode() == GBZ80::JP)
+    if (I->getOpcode() == GBZ80::JP || I->getOpcode() == GBZ80::JR)
     {
       if (!AllowModify)
       {
@@ -208,7 +275,8 @@ bool GBZ80InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
     }
 
     // Handle conditional branches.
-    assert(I->getOpcode() == GBZ80::JPCC && "Invalid conditional branch");
+    if (I->getOpcode() != GBZ80::JPCC && I->getOpcode() != GBZ80::JRCC)
+      return true;
     GBZ80::CondCode GBZ80CC = static_cast<GBZ80::CondCode>(I->getOperand(1).getImm());
     if (GBZ80CC == GBZ80::COND_INVALID)
       return true;
@@ -238,8 +306,8 @@ unsigned GBZ80InstrInfo::RemoveBranch(MachineBasicBlock &MBB) const
     I--;
     if (I->isDebugValue())
       continue;
-    if (I->getOpcode() != GBZ80::JP &&
-        I->getOpcode() != GBZ80::JPCC)
+    if (I->getOpcode() != GBZ80::JP && I->getOpcode() != GBZ80::JPCC &&
+        I->getOpcode() != GBZ80::JR && I->getOpcode() != GBZ80::JRCC)
         break;
     // Remove branch.
     I->eraseFromParent();
@@ -311,6 +379,30 @@ bool GBZ80InstrInfo::ReverseBranchCondition(
   return false;
 }
 
+unsigned GBZ80InstrInfo::getInstSizeInBytes(const MachineInstr *MI) const
+{
+  if (MI->isInlineAsm())
+  {
+    const MachineFunction *MF = MI->getParent()->getParent();
+    return getInlineAsmLength(MI->getOperand(0).getSymbolName(),
+                              *MF->getTarget().getMCAsmInfo());
+  }
+  // A jump through a table is followed by the table itself.
+  if (MI->getOpcode() == GBZ80::BR_JT8 ||
+      MI->getOpcode() == GBZ80::BR_JT8CALL ||
+      MI->getOpcode() == GBZ80::BR_JT16)
+  {
+    const MachineJumpTableInfo *MJTI =
+      MI->getParent()->getParent()->getJumpTableInfo();
+    unsigned JTI = MI->getOperand(0).getIndex();
+    return MI->getDesc().getSize() +
+           2 * MJTI->getJumpTables()[JTI].MBBs.size();
+  }
+  // Pseudos left at this point are either expanded by the AsmPrinter, with
+  // their size set in the .td file, or emit nothing.
+  return MI->getDesc().getSize();
+}
+
 void GBZ80InstrInfo::storeRegToStackSlot(MachineBasicBlock &MBB,
   MachineBasicBlock::iterator MI, unsigned SrcReg, bool isKill,
   int FrameIndex, const TargetRegisterClass *RC,
@@ -319,12 +411,11 @@ void GBZ80InstrInfo::storeRegToStackSlot(MachineBasicBlock &MBB,
   DebugLoc dl;
   if (MI != MBB.end()) dl = MI->getDebugLoc();
 
-  if (RC == &GBZ80::GR8RegClass)
-    BuildMI(MBB, MI, dl, get(GBZ80::LD8rr))
+  if (GBZ80::GR8RegClass.hasSubClassEq(RC))
+    BuildMI(MBB, MI, dl, get(GBZ80::LD8mr))
       .addFrameIndex(FrameIndex).addImm(0)
       .addReg(SrcReg, getKillRegState(isKill));
-  else if (RC == &GBZ80::GR16RegClass ||
-           GBZ80::GR16RegClass.contains(SrcReg)) {
+  else if (GBZ80::GR16RegClass.hasSubClassEq(RC)) {
     BuildMI(MBB, MI, dl, get(GBZ80::LD16mr))
       .addFrameIndex(FrameIndex).addImm(0)
       .addReg(SrcReg, getKillRegState(isKill));
@@ -341,11 +432,10 @@ void GBZ80InstrInfo::loadRegFromStackSlot(MachineBasicBlock &MBB,
   DebugLoc dl;
   if (MI != MBB.end()) dl = MI->getDebugLoc();
 
-  if (RC == &GBZ80::GR8RegClass)
-    BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), DestReg)
+  if (GBZ80::GR8RegClass.hasSubClassEq(RC))
+    BuildMI(MBB, MI, dl, get(GBZ80::LD8rm), DestReg)
       .addFrameIndex(FrameIndex).addImm(0);
-  else if (RC == &GBZ80::GR16RegClass ||
-           GBZ80::GR16RegClass.contains(DestReg)) {
+  else if (GBZ80::GR16RegClass.hasSubClassEq(RC)) {
     BuildMI(MBB, MI, dl, get(GBZ80::LD16rm), DestReg)
       .addFrameIndex(FrameIndex).addImm(0);
   }
@@ -353,28 +443,62 @@ void GBZ80InstrInfo::loadRegFromStackSlot(MachineBasicBlock &MBB,
     llvm_unreachable("Can't load this register from stack slot");
 }
 
+// isReallyTriviallyReMaterializable - FRMIDX reads SP, which the generic
+// check refuses. SP only moves in the prologue and epilogue and around the
+// calls, where the offsets are known, and the flags are left alone, so a
+// stack address can be recomputed anywhere.
+bool GBZ80InstrInfo::isReallyTriviallyReMaterializable(const MachineInstr *MI,
+  AliasAnalysis *AA) const
+{
+  return MI->getOpcode() == GBZ80::FRMIDX;
+}
+
 bool GBZ80InstrInfo::expandPostRAPseudo(MachineBasicBlock::iterator MI) const
 {
   MachineBasicBlock &MBB = *MI->getParent();
-  MachineFunction &MF = *MBB.getParent();
-  const TargetRegisterInfo &RI = *MF.getSubtarget().getRegisterInfo();
   DebugLoc dl = MI->getDebugLoc();
-  unsigned Opc, Reg, Imm, FPReg, Idx;
+  unsigned Opc, Reg, Lo, Hi;
 
   switch (MI->getOpcode())
   {
   default:
     return false;
+  case GBZ80::NEG:
+    // NEG A = CPL, INC A
+    BuildMI(MBB, MI, dl, get(GBZ80::CPL));
+    BuildMI(MBB, MI, dl, get(GBZ80::INC8r), GBZ80::A)
+      .addReg(GBZ80::A);
+    MI->eraseFromParent();
+    return true;
+  case GBZ80::TST16:
+    // TST16 $Rp = LD A, $Hi; OR $Lo
+    Reg = MI->getOperand(0).getReg();
+    BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), GBZ80::A)
+      .addReg(RI.getSubReg(Reg, GBZ80::subreg_hi));
+    BuildMI(MBB, MI, dl, get(GBZ80::OR8r))
+      .addReg(RI.getSubReg(Reg, GBZ80::subreg_lo));
+    MI->eraseFromParent();
+    return true;
+  case GBZ80::ADC16r:
+    Opc = GBZ80::ADC8r;
+    break;
+  case GBZ80::SBC16r:
+    Opc = GBZ80::SBC8r;
+    break;
   }
-  unsigned Lo, Hi;
-
+  Reg = MI->getOperand(0).getReg();
   Lo = RI.getSubReg(Reg, GBZ80::subreg_lo);
   Hi = RI.getSubReg(Reg, GBZ80::subreg_hi);
 
-  // DEBUG(dbgs() << "Pseudo: " << *MI);
-  // DEBUG(dbgs() << "Replaced by:\n" <<
-  //  "\t" << *MI->getPrevNode()->getPrevNode() <<
-  //  "\t" << *MI->getPrevNode());
+  // ADC/SBC HL, $Rp is done a byte at a time through the accumulator:
+  // LD A, L; ADC/SBC A, $Lo; LD L, A
+  // LD A, H; ADC/SBC A, $Hi; LD H, A
+  BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), GBZ80::A).addReg(GBZ80::L);
+  BuildMI(MBB, MI, dl, get(Opc)).addReg(Lo);
+  BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), GBZ80::L).addReg(GBZ80::A);
+  BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), GBZ80::A).addReg(GBZ80::H);
+  BuildMI(MBB, MI, dl, get(Opc)).addReg(Hi);
+  BuildMI(MBB, MI, dl, get(GBZ80::LD8rr), GBZ80::H).addReg(GBZ80::A);
 
   MI->eraseFromParent();
   return true;
@@ -22,20 +22,6 @@
 #include "GBZ80GenInstrInfo.inc"
 
 namespace llvm {
-  namespace GBZ80 {
-    enum CondCode {
-      COND_NZ = 0,
-      COND_Z  = 1,
-      COND_NC = 2,
-      COND_C  = 3,
-      COND_PO = 4,
-      COND_PE = 5,
-      COND_P  = 6,
-      COND_M  = 7,
-
-      COND_INVALID
-    };
-  } // end namespace GBZ80
   class GBZ80InstrInfo : public GBZ80GenInstrInfo {
     const GBZ80RegisterInfo RI;
     GBZ80TargetMachine &TM;
@@ -59,6 +45,9 @@ namespace llvm {
 
     virtual bool expandPostRAPseudo(MachineBasicBlock::iterator MI) const;
 
+    virtual bool isReallyTriviallyReMaterializable(const MachineInstr *MI,
+      AliasAnalysis *AA) const;
+
     virtual MachineInstr* commuteInstruction(MachineInstr *MI,
       bool NewMI = false) const;
 
@@ -73,6 +62,9 @@ namespace llvm {
       DebugLoc DL) const;
     virtual bool ReverseBranchCondition(
       SmallVectorImpl<MachineOperand> &Cond) const;
+
+    // getInstSizeInBytes - Return the number of bytes of code MI emits.
+    unsigned getInstSizeInBytes(const MachineInstr *MI) const;
   }; // end class Z80InstrInfo
 } // end namespace llvm
 
@@ -0,0 +1,46 @@
+//===-- GBZ80MCInstLower.h - Lower MachineInstr to MCInst -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80MCINSTLOWER_H
+#define GBZ80MCINSTLOWER_H
+
+#include "llvm/Support/Compiler.h"
+
+namespace llvm {
+  class AsmPrinter;
+  class MCContext;
+  class MCInst;
+  class MCOperand;
+  class MCSymbol;
+  class MachineInstr;
+  class MachineOperand;
+
+  // GBZ80MCInstLower - This class is used to lower a MachineInstr
+  // into an MCInst.
+  class LLVM_LIBRARY_VISIBILITY GBZ80MCInstLower {
+    MCContext &Ctx;
+    AsmPrinter &Printer;
+  public:
+    GBZ80MCInstLower(MCContext &ctx, AsmPrinter &printer)
+      : Ctx(ctx), Printer(printer) {}
+
+    void Lower(const MachineInstr *MI, MCInst &OutMI) const;
+
+    MCOperand LowerSymbolOperand(const MachineOperand &MO,
+      MCSymbol *Sym) const;
+
+    MCSymbol *GetGlobalAddressSymbol(const MachineOperand &MO) const;
+    MCSymbol *GetExternalSymbolSymbol(const MachineOperand &MO) const;
+    MCSymbol *GetJumpTableSymbol(const MachineOperand &MO) const;
+    MCSymbol *GetConstantPoolIndexSymbol(const MachineOperand &MO) const;
+    MCSymbol *GetBlockAddressSymbol(const MachineOperand &MO) const;
+  }; // end class GBZ80MCInstLower
+} // end namespace llvm
+
+#endif
@@ -14,28 +14,52 @@
 #ifndef GBZ80MACHINEFUNCTIONINFO_H
 #define GBZ80MACHINEFUNCTIONINFO_H
 
+#include "MCTargetDesc/GBZ80MCTargetDesc.h"
 #include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/IR/Function.h"
 
 namespace llvm {
   class GBZ80MachineFunctionInfo : public MachineFunctionInfo {
     virtual void anchor();
 
-    // needFP - Flag which indicate to use FP
-    bool needFP;
-
     // CalleeSavedFrameSize - Size of the callee-saved register portion of the
     // stack frame in bytes.
     unsigned CalleeSavedFrameSize;
+
+    // ReturnsInHL, ReturnsInDE - The return value is passed in these register
+    // pairs, which the callee can't restore on the way out.
+    bool ReturnsInHL, ReturnsInDE;
+
+    // IsInterruptHandler - The function has the "interrupt" attribute. It
+    // preserves every register it touches and returns with reti.
+    bool IsInterruptHandler;
+
+    // ArgumentStackSize - Bytes of arguments the caller passed on the stack.
+    // A tail call may pass its own arguments in their place.
+    unsigned ArgumentStackSize;
   public:
     explicit GBZ80MachineFunctionInfo(MachineFunction &MF)
-      : needFP(false), CalleeSavedFrameSize(0) {}
+      : CalleeSavedFrameSize(0), ReturnsInHL(false), ReturnsInDE(false),
+        IsInterruptHandler(
+          MF.getFunction()->hasFnAttribute("interrupt")),
+        ArgumentStackSize(0) {}
 
     unsigned getCalleeSavedFrameSize() { return CalleeSavedFrameSize; }
     void setCalleeSavedFrameSize(unsigned bytes) {
       CalleeSavedFrameSize = bytes;
     }
-    bool isNeedFP() const { return needFP; }
-    void setNeedFP() { needFP = true; }
+
+    bool returnsInHL() const { return ReturnsInHL; }
+    bool returnsInDE() const { return ReturnsInDE; }
+    void setReturnReg(unsigned Reg) {
+      ReturnsInHL |= Reg == GBZ80::HL;
+      ReturnsInDE |= Reg == GBZ80::DE;
+    }
+
+    bool isInterruptHandler() const { return IsInterruptHandler; }
+
+    unsigned getArgumentStackSize() const { return ArgumentStackSize; }
+    void setArgumentStackSize(unsigned bytes) { ArgumentStackSize = bytes; }
   }; // end class GBZ80MachineFunctionInfo
 } // end namespace llvm
 
@@ -0,0 +1,324 @@
+//===-- GBZ80Peephole.cpp - Flag and accumulator peepholes ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that cleans up the compares and loads the
+// instruction selector leaves behind, once registers are allocated and the
+// pseudos are expanded.
+//
+// - A compare with zero is dropped when the Z flag already tells whether A is
+//   zero and only Z is read afterwards. Every ALU operation, inc, dec and the
+//   CB rotates and shifts set Z from their result:
+//
+//     dec a             dec a
+//     cp 0        ->    jr nz, .LBB0_1
+//     jr nz, .LBB0_1
+//
+//   Z also stays valid for A across ld a,r of the register it was set from.
+//   A compare with zero that has to stay becomes the shorter or a, which sets
+//   Z and clears C the same way.
+// - ld r,n is deleted when r already holds n.
+// - A byte loaded through HL into a register that is only read by the next
+//   ALU operation is read from memory by the operation itself:
+//
+//     ld h, (hl)
+//     cp h        ->    cp (hl)
+//
+// Repeated ld a,r of a register A already holds are left to
+// GBZ80CopyPropagation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "GBZ80InstrInfo.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-peephole"
+
+STATISTIC(NumCompares, "Number of compares with zero removed");
+STATISTIC(NumOrs, "Number of compares with zero turned into or a");
+STATISTIC(NumImms, "Number of redundant ld r,n removed");
+STATISTIC(NumFolds, "Number of loads through HL folded into an ALU operation");
+
+namespace {
+  class GBZ80Peephole : public MachineFunctionPass {
+  public:
+    static char ID;
+    GBZ80Peephole() : MachineFunctionPass(ID) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    const char *getPassName() const override {
+      return "GBZ80 Peephole Optimizer";
+    }
+
+  private:
+    const TargetInstrInfo *TII;
+    const TargetRegisterInfo *TRI;
+
+    bool onlyZeroFlagRead(MachineBasicBlock::iterator I) const;
+    MachineInstr *foldLoad(MachineInstr *Load);
+    bool runOnMachineBasicBlock(MachineBasicBlock &MBB);
+  };
+  char GBZ80Peephole::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80PeepholePass - Returns a pass that removes redundant compares
+// and loads after register allocation.
+FunctionPass *llvm::createGBZ80PeepholePass() {
+  return new GBZ80Peephole();
+}
+
+// getZeroFlagReg - If MI sets Z when the register it writes becomes zero,
+// return that register. Otherwise return 0.
+static unsigned getZeroFlagReg(const MachineInstr *MI)
+{
+  switch (MI->getOpcode())
+  {
+  default:
+    return 0;
+  case GBZ80::ADD8r: case GBZ80::ADD8i: case GBZ80::ADD8HL:
+  case GBZ80::ADC8r: case GBZ80::ADC8i: case GBZ80::ADC8HL:
+  case GBZ80::SUB8r: case GBZ80::SUB8i: case GBZ80::SUB8HL:
+  case GBZ80::SBC8r: case GBZ80::SBC8i: case GBZ80::SBC8HL:
+  case GBZ80::AND8r: case GBZ80::AND8i: case GBZ80::AND8HL:
+  case GBZ80::XOR8r: case GBZ80::XOR8i: case GBZ80::XOR8HL:
+  case GBZ80::OR8r:  case GBZ80::OR8i:  case GBZ80::OR8HL:
+    return GBZ80::A;
+  case GBZ80::INC8r: case GBZ80::DEC8r:
+  case GBZ80::RLC8r: case GBZ80::RRC8r: case GBZ80::RL8r: case GBZ80::RR8r:
+  case GBZ80::SLA8r: case GBZ80::SRA8r: case GBZ80::SWAP8r:
+  case GBZ80::SRL8r:
+    return MI->getOperand(0).getReg();
+  }
+}
+
+// getHLForm - Returns the form of the ALU operation Opc that reads the byte
+// HL points to, or 0 if there is none.
+static unsigned getHLForm(unsigned Opc)
+{
+  switch (Opc)
+  {
+  default:           return 0;
+  case GBZ80::ADD8r: return GBZ80::ADD8HL;
+  case GBZ80::ADC8r: return GBZ80::ADC8HL;
+  case GBZ80::SUB8r: return GBZ80::SUB8HL;
+  case GBZ80::SBC8r: return GBZ80::SBC8HL;
+  case GBZ80::AND8r: return GBZ80::AND8HL;
+  case GBZ80::XOR8r: return GBZ80::XOR8HL;
+  case GBZ80::OR8r:  return GBZ80::OR8HL;
+  case GBZ80::CP8r:  return GBZ80::CP8HL;
+  }
+}
+
+// onlyZeroFlagRead - Return true if nothing after I reads any flag but Z
+// before the flags are set again.
+bool GBZ80Peephole::onlyZeroFlagRead(MachineBasicBlock::iterator I) const
+{
+  MachineBasicBlock &MBB = *I->getParent();
+  for (++I; I != MBB.end(); ++I)
+  {
+    if (I->readsRegister(GBZ80::FLAGS, TRI))
+    {
+      unsigned Opc = I->getOpcode();
+      if (Opc != GBZ80::JRCC && Opc != GBZ80::JPCC)
+        return false;
+      int64_t CC = I->getOperand(1).getImm();
+      if (CC != GBZ80::COND_Z && CC != GBZ80::COND_NZ)
+        return false;
+    }
+    if (I->modifiesRegister(GBZ80::FLAGS, TRI))
+      return true;
+  }
+  for (MachineBasicBlock::succ_iterator S = MBB.succ_begin(),
+       SE = MBB.succ_end(); S != SE; ++S)
+    if ((*S)->isLiveIn(GBZ80::FLAGS))
+      return false;
+  return true;
+}
+
+// foldLoad - If the byte Load reads through HL is only used by the ALU
+// operation right after it, replace both with the operation on (hl) and
+// return it.
+MachineInstr *GBZ80Peephole::foldLoad(MachineInstr *Load)
+{
+  MachineBasicBlock &MBB = *Load->getParent();
+  unsigned Reg = Load->getOperand(0).getReg();
+  MachineBasicBlock::iterator I = std::next(MachineBasicBlock::iterator(Load));
+  if (Reg == GBZ80::A || I == MBB.end())
+    return nullptr;
+
+  MachineInstr *Op = I;
+  unsigned Opc = getHLForm(Op->getOpcode());
+  if (!Opc || Op->getOperand(0).getReg() != Reg ||
+      !Op->getOperand(0).isKill())
+    return nullptr;
+
+  MachineInstr *Fold = BuildMI(MBB, Op, Op->getDebugLoc(), TII->get(Opc));
+  for (unsigned i = 0, e = Op->getNumOperands(); i != e; ++i)
+  {
+    const MachineOperand &MO = Op->getOperand(i);
+    if (MO.isReg() && MO.isImplicit())
+    {
+      if (MO.isDef() && MO.isDead())
+        Fold->addRegisterDead(MO.getReg(), TRI);
+      else if (MO.isUse() && MO.isKill())
+        Fold->addRegisterKilled(MO.getReg(), TRI);
+    }
+  }
+  if (Load->killsRegister(GBZ80::HL, TRI))
+    Fold->addRegisterKilled(GBZ80::HL, TRI);
+  Fold->setMemRefs(Load->memoperands_begin(), Load->memoperands_end());
+  Load->eraseFromParent();
+  Op->eraseFromParent();
+  ++NumFolds;
+  return Fold;
+}
+
+bool GBZ80Peephole::runOnMachineBasicBlock(MachineBasicBlock &MBB)
+{
+  // ZRegs - The registers that hold the value the Z flag was set from by
+  // ZSetter.
+  BitVector ZRegs(TRI->getNumRegs());
+  MachineInstr *ZSetter = nullptr;
+  // Known - The registers known to hold a constant, and where they got it.
+  DenseMap<unsigned, std::pair<int64_t, MachineInstr *>> Known;
+  bool Changed = false;
+
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E; )
+  {
+    MachineInstr *MI = I++;
+    if (MI->isDebugValue())
+      continue;
+    unsigned Opc = MI->getOpcode();
+
+    if (Opc == GBZ80::CP8i && MI->getOperand(0).getImm() == 0)
+    {
+      if (ZSetter && ZRegs.test(GBZ80::A) && onlyZeroFlagRead(MI))
+      {
+        ZSetter->findRegisterDefOperand(GBZ80::FLAGS)->setIsDead(false);
+        MI->eraseFromParent();
+        ++NumCompares;
+        Changed = true;
+        continue;
+      }
+
+      MachineOperand *AUse = MI->findRegisterUseOperand(GBZ80::A);
+      bool Kill = AUse && AUse->isKill();
+      bool FlagsDead = MI->findRegisterDefOperand(GBZ80::FLAGS)->isDead();
+      MachineInstr *Or = BuildMI(MBB, MI, MI->getDebugLoc(),
+                                 TII->get(GBZ80::OR8r))
+        .addReg(GBZ80::A, getKillRegState(Kill));
+      if (Kill)
+        Or->addRegisterDead(GBZ80::A, TRI);
+      if (FlagsDead)
+        Or->addRegisterDead(GBZ80::FLAGS, TRI);
+      MI->eraseFromParent();
+      MI = Or;
+      Opc = GBZ80::OR8r;
+      ++NumOrs;
+      Changed = true;
+    }
+    else if (Opc == GBZ80::LD8ri)
+    {
+      unsigned Dst = MI->getOperand(0).getReg();
+      auto K = Known.find(Dst);
+      if (K != Known.end() && K->second.first == MI->getOperand(1).getImm())
+      {
+        // Dst lives on from the first load.
+        for (MachineBasicBlock::iterator J = K->second.second; &*J != MI; ++J)
+          J->clearRegisterKills(Dst, TRI);
+        MI->eraseFromParent();
+        ++NumImms;
+        Changed = true;
+        continue;
+      }
+    }
+    else if (Opc == GBZ80::LD8rHL)
+    {
+      if (MachineInstr *Fold = foldLoad(MI))
+      {
+        I = Fold;
+        Changed = true;
+        continue;
+      }
+    }
+
+    // Forget what MI overwrites.
+    bool Move = Opc == GBZ80::LD8rr;
+    bool SrcZ = Move && ZRegs.test(MI->getOperand(1).getReg());
+    auto SrcKnown = Known.end();
+    if (Move)
+      SrcKnown = Known.find(MI->getOperand(1).getReg());
+    std::pair<int64_t, MachineInstr *> SrcValue;
+    if (SrcKnown != Known.end())
+      SrcValue = SrcKnown->second;
+
+    for (unsigned i = 0, e = MI->getNumOperands(); i != e; ++i)
+    {
+      const MachineOperand &MO = MI->getOperand(i);
+      if (MO.isRegMask())
+      {
+        for (int Reg = ZRegs.find_first(); Reg != -1;
+             Reg = ZRegs.find_next(Reg))
+          if (MO.clobbersPhysReg(Reg))
+            ZRegs.reset(Reg);
+        for (auto K = Known.begin(), KE = Known.end(); K != KE; ++K)
+          if (MO.clobbersPhysReg(K->first))
+            Known.erase(K);
+      }
+      else if (MO.isReg() && MO.isDef() && MO.getReg())
+        for (MCRegAliasIterator AI(MO.getReg(), TRI, true); AI.isValid(); ++AI)
+        {
+          ZRegs.reset(*AI);
+          Known.erase(*AI);
+        }
+    }
+
+    if (Move && SrcZ)
+      ZRegs.set(MI->getOperand(0).getReg());
+    if (Move && SrcKnown != Known.end())
+      Known[MI->getOperand(0).getReg()] = SrcValue;
+    if (Opc == GBZ80::LD8ri)
+      Known[MI->getOperand(0).getReg()] =
+        std::make_pair(MI->getOperand(1).getImm(), MI);
+
+    if (unsigned Reg = getZeroFlagReg(MI))
+    {
+      ZRegs.reset();
+      ZRegs.set(Reg);
+      ZSetter = MI;
+    }
+    else if (MI->modifiesRegister(GBZ80::FLAGS, TRI))
+    {
+      ZRegs.reset();
+      ZSetter = nullptr;
+    }
+  }
+  return Changed;
+}
+
+bool GBZ80Peephole::runOnMachineFunction(MachineFunction &MF)
+{
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+
+  bool Changed = false;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    Changed |= runOnMachineBasicBlock(*MBB);
+  return Changed;
+}
@@ -0,0 +1,206 @@
+//===-- GBZ80RegUsage.cpp - Interprocedural register usage ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the opt-in passes that let a caller see which registers
+// its callees really clobber, instead of assuming everything outside of the
+// calling convention's callee-saved registers is lost across a call.
+//
+// Most of the functions of a GB program are small and only touch A and HL,
+// yet every call clobbers all of the pairs the convention doesn't preserve,
+// so the caller either keeps its values in BC and DE, and has to push and pop
+// them in its own prologue and epilogue, or spills them around the call.
+//
+// - GBZ80CallGraphOrder is an empty CallGraphSCCPass. Adding it in front of
+//   the code generator nests the function passes that follow in a call graph
+//   pass manager, so the functions are compiled callees first.
+// - GBZ80RegUsageCollector runs once a function is final and records the
+//   registers it preserves: everything it doesn't write, either itself or
+//   through its calls, plus the callee-saved registers its prologue saves.
+// - GBZ80RegUsagePropagation runs before register allocation and replaces
+//   the register mask of every direct call to a function compiled already
+//   with the recorded one.
+//
+// A function whose definition may be replaced at link time keeps the mask of
+// its calling convention, as do the calls within a cycle of the call graph.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "GBZ80RegUsageInfo.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-reg-usage"
+
+STATISTIC(NumMasks, "Number of calls given the callee's register usage");
+
+namespace {
+  class GBZ80CallGraphOrder : public CallGraphSCCPass {
+  public:
+    static char ID;
+    GBZ80CallGraphOrder() : CallGraphSCCPass(ID) {
+      // llc doesn't register the IPA passes on its own.
+      initializeCallGraphWrapperPassPass(*PassRegistry::getPassRegistry());
+    }
+
+    bool runOnSCC(CallGraphSCC &SCC) override { return false; }
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      CallGraphSCCPass::getAnalysisUsage(AU);
+      AU.setPreservesAll();
+    }
+
+    const char *getPassName() const override {
+      return "GBZ80 Call Graph Order";
+    }
+  };
+  char GBZ80CallGraphOrder::ID = 0;
+
+  class GBZ80RegUsageCollector : public MachineFunctionPass {
+  public:
+    static char ID;
+    explicit GBZ80RegUsageCollector(GBZ80RegUsageInfo &Info)
+      : MachineFunctionPass(ID), Info(Info) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesAll();
+      MachineFunctionPass::getAnalysisUsage(AU);
+    }
+
+    const char *getPassName() const override {
+      return "GBZ80 Register Usage Collector";
+    }
+
+  private:
+    GBZ80RegUsageInfo &Info;
+  };
+  char GBZ80RegUsageCollector::ID = 0;
+
+  class GBZ80RegUsagePropagation : public MachineFunctionPass {
+  public:
+    static char ID;
+    explicit GBZ80RegUsagePropagation(const GBZ80RegUsageInfo &Info)
+      : MachineFunctionPass(ID), Info(Info) {}
+
+    bool runOnMachineFunction(MachineFunction &MF) override;
+
+    const char *getPassName() const override {
+      return "GBZ80 Register Usage Propagation";
+    }
+
+  private:
+    const GBZ80RegUsageInfo &Info;
+  };
+  char GBZ80RegUsagePropagation::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80CallGraphOrderPass - Returns a pass that makes the function
+// passes added after it run over the call graph bottom-up.
+Pass *llvm::createGBZ80CallGraphOrderPass() {
+  return new GBZ80CallGraphOrder();
+}
+
+// createGBZ80RegUsageCollectorPass - Returns a pass that records the
+// registers each function preserves in Info.
+FunctionPass *llvm::createGBZ80RegUsageCollectorPass(GBZ80RegUsageInfo &Info) {
+  return new GBZ80RegUsageCollector(Info);
+}
+
+// createGBZ80RegUsagePropagationPass - Returns a pass that gives the calls
+// the register masks recorded in Info.
+FunctionPass *
+llvm::createGBZ80RegUsagePropagationPass(const GBZ80RegUsageInfo &Info) {
+  return new GBZ80RegUsagePropagation(Info);
+}
+
+bool GBZ80RegUsageCollector::runOnMachineFunction(MachineFunction &MF)
+{
+  const Function *F = MF.getFunction();
+  if (F->mayBeOverridden())
+    return false;
+
+  const TargetRegisterInfo *TRI = MF.getSubtarget().getRegisterInfo();
+  unsigned NumRegs = TRI->getNumRegs();
+  BitVector Clobbered(NumRegs);
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; ++I)
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i)
+      {
+        const MachineOperand &MO = I->getOperand(i);
+        if (MO.isRegMask())
+        {
+          for (unsigned Reg = 1; Reg != NumRegs; ++Reg)
+            if (MO.clobbersPhysReg(Reg))
+              Clobbered.set(Reg);
+        }
+        else if (MO.isReg() && MO.isDef() && MO.getReg())
+          for (MCRegAliasIterator AI(MO.getReg(), TRI, true); AI.isValid();
+               ++AI)
+            Clobbered.set(*AI);
+      }
+
+  // The prologue and the epilogue restore what they save, and SP is back
+  // where it was by the time the function returns.
+  const std::vector<CalleeSavedInfo> &CSI =
+    MF.getFrameInfo()->getCalleeSavedInfo();
+  for (unsigned i = 0, e = CSI.size(); i != e; ++i)
+    for (MCSubRegIterator SR(CSI[i].getReg(), TRI, true); SR.isValid(); ++SR)
+      Clobbered.reset(*SR);
+  Clobbered.reset(GBZ80::SP);
+
+  std::vector<uint32_t> Mask((NumRegs + 31) / 32, 0);
+  for (unsigned Reg = 1; Reg != NumRegs; ++Reg)
+    if (!Clobbered.test(Reg))
+      Mask[Reg / 32] |= 1u << (Reg % 32);
+  Info.setRegMask(F, std::move(Mask));
+  return false;
+}
+
+bool GBZ80RegUsagePropagation::runOnMachineFunction(MachineFunction &MF)
+{
+  bool Changed = false;
+  for (MachineFunction::iterator MBB = MF.begin(), E = MF.end(); MBB != E;
+       ++MBB)
+    for (MachineBasicBlock::iterator I = MBB->begin(), IE = MBB->end();
+         I != IE; ++I)
+    {
+      if (!I->isCall() || !I->getOperand(0).isGlobal())
+        continue;
+      const Function *Callee =
+        dyn_cast<Function>(I->getOperand(0).getGlobal());
+      const uint32_t *Mask = Callee ? Info.getRegMask(Callee) : nullptr;
+      if (!Mask)
+        continue;
+
+      for (unsigned i = 0, e = I->getNumOperands(); i != e; ++i)
+        if (I->getOperand(i).isRegMask())
+        {
+          I->RemoveOperand(i);
+          I->addOperand(MF, MachineOperand::CreateRegMask(Mask));
+          ++NumMasks;
+          Changed = true;
+          break;
+        }
+    }
+  return Changed;
+}
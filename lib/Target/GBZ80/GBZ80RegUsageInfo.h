@@ -0,0 +1,44 @@
+//===-- GBZ80RegUsageInfo.h - Registers used by functions -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the table of the registers each function of the module
+// really preserves, filled as the functions are compiled and read by their
+// callers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80REGUSAGEINFO_H
+#define GBZ80REGUSAGEINFO_H
+
+#include "llvm/ADT/DenseMap.h"
+#include <vector>
+
+namespace llvm {
+  class Function;
+
+  class GBZ80RegUsageInfo {
+    // Masks - The register mask of every function compiled so far, in the
+    // format of TargetRegisterInfo::getCallPreservedMask.
+    DenseMap<const Function *, std::vector<uint32_t>> Masks;
+  public:
+    // getRegMask - Returns the registers F preserves, or null if F hasn't
+    // been compiled yet.
+    const uint32_t *getRegMask(const Function *F) const {
+      DenseMap<const Function *, std::vector<uint32_t>>::const_iterator I =
+        Masks.find(F);
+      return I == Masks.end() ? nullptr : I->second.data();
+    }
+
+    void setRegMask(const Function *F, std::vector<uint32_t> Mask) {
+      Masks[F] = std::move(Mask);
+    }
+  }; // end class GBZ80RegUsageInfo
+} // end namespace llvm
+
+#endif
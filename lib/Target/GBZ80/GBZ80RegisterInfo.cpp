@@ -13,15 +13,22 @@
 
 #include "GBZ80RegisterInfo.h"
 #include "GBZ80.h"
+#include "GBZ80MachineFunctionInfo.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Target/TargetFrameLowering.h"
 #include "llvm/Target/TargetInstrInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
 
 #define GET_REGINFO_TARGET_DESC
 #include "GBZ80GenRegisterInfo.inc"
@@ -31,16 +38,101 @@ using namespace llvm;
 GBZ80RegisterInfo::GBZ80RegisterInfo(GBZ80TargetMachine &tm, const TargetInstrInfo &tii)
   : GBZ80GenRegisterInfo(GBZ80::PC), TM(tm), TII(tii) {}
 
+// getCalleeSavedRegs - BC and DE are preserved across calls, fastcc
+// functions preserve nothing and coldcc functions HL as well. A pair that
+// carries the return value is left out. Interrupt handlers preserve every
+// register.
 const uint16_t* GBZ80RegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
-  static const uint16_t CalleeSavedRegs[] = {
-    GBZ80::BC, GBZ80::DE, 0
-  };
-  return CalleeSavedRegs;
+  if (!MF)
+    return CSR_16_SaveList;
+
+  const GBZ80MachineFunctionInfo *GBZ80FI =
+    MF->getInfo<GBZ80MachineFunctionInfo>();
+  if (GBZ80FI->isInterruptHandler())
+    return CSR_Interrupt_SaveList;
+
+  switch (MF->getFunction()->getCallingConv())
+  {
+  case CallingConv::Fast:
+    return CSR_NoRegs_SaveList;
+  case CallingConv::Cold:
+    if (GBZ80FI->returnsInDE())
+      return CSR_BC_SaveList;
+    if (GBZ80FI->returnsInHL())
+      return CSR_16_SaveList;
+    return CSR_Cold_SaveList;
+  default:
+    if (GBZ80FI->returnsInDE())
+      return CSR_BC_SaveList;
+    return CSR_16_SaveList;
+  }
 }
 
+// getCallPreservedMask - The return value registers are defined by the call
+// itself, so the masks don't need to leave them out.
 const uint32_t* GBZ80RegisterInfo::getCallPreservedMask(CallingConv::ID CallConv) const
 {
-  return CSR_16_RegMask;
+  switch (CallConv)
+  {
+  case CallingConv::Fast:
+    return CSR_NoRegs_RegMask;
+  case CallingConv::Cold:
+    return CSR_Cold_RegMask;
+  default:
+    return CSR_16_RegMask;
+  }
+}
+
+// getLargestLegalSuperClass - Every 8-bit register can be copied to any other
+// with ld r,r and every pair with two of them, so the allocator may inflate a
+// register constrained to a single register or pair once that constraint is
+// gone.
+const TargetRegisterClass *
+GBZ80RegisterInfo::getLargestLegalSuperClass(const TargetRegisterClass *RC) const
+{
+  if (GBZ80::GR8RegClass.hasSubClassEq(RC))
+    return &GBZ80::GR8RegClass;
+  if (GBZ80::GR16RegClass.hasSubClassEq(RC))
+    return &GBZ80::GR16RegClass;
+  return RC;
+}
+
+// getRegAllocationHints - Every 8-bit ALU instruction takes one operand in A
+// and leaves its result there, instruction selection copies the values in
+// and out. A value that is copied to or from A is hinted to A so that both
+// copies disappear, every other 8-bit value is kept out of A so that it
+// doesn't have to be moved away before the next ALU instruction.
+void GBZ80RegisterInfo::getRegAllocationHints(unsigned VirtReg,
+  ArrayRef<MCPhysReg> Order, SmallVectorImpl<MCPhysReg> &Hints,
+  const MachineFunction &MF, const VirtRegMap *VRM) const
+{
+  TargetRegisterInfo::getRegAllocationHints(VirtReg, Order, Hints, MF, VRM);
+
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  if (std::find(Order.begin(), Order.end(), GBZ80::A) == Order.end())
+    return;
+
+  bool CopiesA = false;
+  for (const MachineInstr &MI : MRI.reg_nodbg_instructions(VirtReg))
+    if (MI.isCopy() && (MI.getOperand(0).getReg() == GBZ80::A ||
+                        MI.getOperand(1).getReg() == GBZ80::A))
+    {
+      CopiesA = true;
+      break;
+    }
+
+  if (CopiesA)
+  {
+    if (std::find(Hints.begin(), Hints.end(), GBZ80::A) == Hints.end())
+      Hints.push_back(GBZ80::A);
+    return;
+  }
+
+  // Hinting every other register puts A at the end of the order.
+  for (unsigned i = 0, e = Order.size(); i != e; ++i)
+    if (Order[i] != GBZ80::A &&
+        std::find(Hints.begin(), Hints.end(), Order[i]) == Hints.end())
+      Hints.push_back(Order[i]);
 }
 
 BitVector GBZ80RegisterInfo::getReservedRegs(const MachineFunction &MF) const
@@ -50,7 +142,299 @@ BitVector GBZ80RegisterInfo::getReservedRegs(const MachineFunction &MF) const
   Reserved.set(GBZ80::PC);
   Reserved.set(GBZ80::SP);
   Reserved.set(GBZ80::FLAGS);
-  Reserved.set(getFrameRegister(MF));
+
+  // Stack objects are addressed relative to SP, HL is only taken away from
+  // the register allocator when the function needs a frame pointer.
+  if (MF.getSubtarget().getFrameLowering()->hasFP(MF))
+  {
+    Reserved.set(GBZ80::HL);
+    Reserved.set(GBZ80::H);
+    Reserved.set(GBZ80::L);
+  }
 
   return Reserved;
 }
+
+// buildStackAddr - Load SP + Offset into HL. ld hl,sp+e reaches 127 bytes
+// up the stack, anything further away is added up in HL.
+static void buildStackAddr(MachineBasicBlock &MBB,
+  MachineBasicBlock::iterator II, DebugLoc dl, const TargetInstrInfo &TII,
+  int64_t Offset)
+{
+  if (isInt<8>(Offset))
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD16HLSP), GBZ80::HL)
+      .addImm(Offset);
+  else
+  {
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD16ri), GBZ80::HL)
+      .addImm(Offset);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::ADD16rSP), GBZ80::HL)
+      .addReg(GBZ80::HL, RegState::Kill);
+  }
+}
+
+// addLiveAfter - Add the registers live right after II to Live. The
+// callee-saved registers the function doesn't save hold the values of its
+// caller, they are live all the way through.
+void GBZ80RegisterInfo::addLiveAfter(LivePhysRegs &Live,
+  MachineBasicBlock::iterator II) const
+{
+  MachineBasicBlock &MBB = *II->getParent();
+  Live.addLiveOuts(&MBB);
+  for (MachineBasicBlock::iterator I = MBB.end(); I != std::next(II); )
+    Live.stepBackward(*--I);
+  const MachineFunction &MF = *MBB.getParent();
+  const std::vector<CalleeSavedInfo> &CSI =
+    MF.getFrameInfo()->getCalleeSavedInfo();
+  for (const MCPhysReg *CSR = getCalleeSavedRegs(&MF); *CSR; ++CSR)
+  {
+    bool Saved = false;
+    for (unsigned i = 0, e = CSI.size(); i != e && !Saved; ++i)
+      Saved = CSI[i].getReg() == *CSR;
+    if (!Saved)
+      Live.addReg(*CSR);
+  }
+}
+
+// expandStackSlotAccess - Expand the spill or reload MI of one or two bytes
+// at SP + Offset. The slot is addressed with ld hl,sp+e, which clobbers HL
+// and the flags, so whatever of them is live across MI is pushed around the
+// access. A byte that has to go through a free register while HL points at
+// the slot uses A, saved to a scratch byte in high RAM when it is live.
+void GBZ80RegisterInfo::expandStackSlotAccess(MachineBasicBlock::iterator II,
+  int64_t Offset) const
+{
+  MachineInstr &MI = *II;
+  MachineBasicBlock &MBB = *MI.getParent();
+  DebugLoc dl = MI.getDebugLoc();
+  unsigned Opc = MI.getOpcode();
+  bool IsLoad = Opc == GBZ80::LD8rm || Opc == GBZ80::LD16rm;
+  unsigned Reg = MI.getOperand(IsLoad ? 0 : 2).getReg();
+
+  LivePhysRegs Live(this);
+  addLiveAfter(Live, II);
+  const MachineFunction &MF = *MBB.getParent();
+
+  SmallVector<unsigned, 2> Bytes;
+  if (GBZ80::GR16RegClass.contains(Reg))
+  {
+    Bytes.push_back(getSubReg(Reg, GBZ80::subreg_lo));
+    Bytes.push_back(getSubReg(Reg, GBZ80::subreg_hi));
+  }
+  else
+    Bytes.push_back(Reg);
+
+  bool FlagsLive = Live.contains(GBZ80::FLAGS);
+  bool InHL = Reg == GBZ80::HL || Reg == GBZ80::H || Reg == GBZ80::L;
+  bool HLLive = Live.contains(GBZ80::H) || Live.contains(GBZ80::L);
+  int64_t Pushed = 0;
+
+  if (FlagsLive)
+  {
+    // Only the flags need saving, A may hold nothing. A reload of A leaves it
+    // live after MI but not before.
+    MachineInstr *Push = BuildMI(MBB, II, dl, TII.get(GBZ80::PUSHAF));
+    if (!MI.readsRegister(GBZ80::A, this) &&
+        (!Live.contains(GBZ80::A) || MI.modifiesRegister(GBZ80::A, this)))
+      Push->findRegisterUseOperand(GBZ80::A)->setIsUndef();
+    Pushed += 2;
+  }
+
+  if (!InHL)
+  {
+    // Straight through HL, which is saved when it is live. A reload of A
+    // with the flags live is written over the saved A before AF is popped.
+    bool ThroughAF = IsLoad && Reg == GBZ80::A && FlagsLive;
+    if (HLLive)
+    {
+      BuildMI(MBB, II, dl, TII.get(GBZ80::PUSH16r))
+        .addReg(GBZ80::HL);
+      Pushed += 2;
+    }
+    buildStackAddr(MBB, II, dl, TII, Offset + Pushed);
+    for (unsigned i = 0, e = Bytes.size(); i != e; ++i)
+    {
+      if (i)
+        BuildMI(MBB, II, dl, TII.get(GBZ80::INC16r), GBZ80::HL)
+          .addReg(GBZ80::HL);
+      if (IsLoad)
+        BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rHL), Bytes[i]);
+      else
+        BuildMI(MBB, II, dl, TII.get(GBZ80::LD8HLr))
+          .addReg(Bytes[i]);
+    }
+    if (ThroughAF)
+    {
+      buildStackAddr(MBB, II, dl, TII, Pushed - 1);
+      BuildMI(MBB, II, dl, TII.get(GBZ80::LD8HLr))
+        .addReg(GBZ80::A);
+    }
+    if (HLLive)
+      BuildMI(MBB, II, dl, TII.get(GBZ80::POP16r), GBZ80::HL);
+    if (FlagsLive)
+      BuildMI(MBB, II, dl, TII.get(GBZ80::POPAF));
+    MBB.erase(II);
+    return;
+  }
+
+  // A reload of H or L that leaves the other half dead can use HL freely.
+  if (IsLoad && Bytes.size() == 1 &&
+      !Live.contains(Reg == GBZ80::H ? GBZ80::L : GBZ80::H))
+  {
+    buildStackAddr(MBB, II, dl, TII, Offset + Pushed);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rHL), Reg);
+    if (FlagsLive)
+      BuildMI(MBB, II, dl, TII.get(GBZ80::POPAF));
+    MBB.erase(II);
+    return;
+  }
+
+  // Everything else moves the bytes of HL through a free register.
+  unsigned Tmp = 0;
+  bool SavedA = false;
+  if (FlagsLive || !Live.contains(GBZ80::A))
+    Tmp = GBZ80::A;
+  else
+  {
+    static const uint16_t Regs[] = { GBZ80::B, GBZ80::C, GBZ80::D, GBZ80::E };
+    for (unsigned i = 0; i != array_lengthof(Regs) && !Tmp; ++i)
+      if (!Live.contains(Regs[i]))
+        Tmp = Regs[i];
+  }
+  // An interrupt handler can't share the scratch byte with the code it
+  // interrupts, it pushes A with the flags, which are dead here.
+  bool PushedA = false;
+  if (!Tmp && MF.getInfo<GBZ80MachineFunctionInfo>()->isInterruptHandler())
+  {
+    BuildMI(MBB, II, dl, TII.get(GBZ80::PUSHAF));
+    Pushed += 2;
+    Tmp = GBZ80::A;
+    PushedA = true;
+  }
+  else if (!Tmp)
+  {
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LDH8mA))
+      .addExternalSymbol(GBZ80::ScratchSlot);
+    Tmp = GBZ80::A;
+    SavedA = true;
+  }
+
+  if (IsLoad && Reg == GBZ80::HL)
+  {
+    // ld hl,sp+e; ld a,(hl+); ld h,(hl); ld l,a
+    buildStackAddr(MBB, II, dl, TII, Offset + Pushed);
+    if (Tmp == GBZ80::A)
+      BuildMI(MBB, II, dl, TII.get(GBZ80::LD8AHLI), GBZ80::A);
+    else
+    {
+      BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rHL), Tmp);
+      BuildMI(MBB, II, dl, TII.get(GBZ80::INC16r), GBZ80::HL)
+        .addReg(GBZ80::HL);
+    }
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rHL), GBZ80::H);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rr), GBZ80::L)
+      .addReg(Tmp);
+  }
+  else if (IsLoad)
+  {
+    // The other half of HL is live, load the byte with HL saved.
+    BuildMI(MBB, II, dl, TII.get(GBZ80::PUSH16r))
+      .addReg(GBZ80::HL);
+    buildStackAddr(MBB, II, dl, TII, Offset + Pushed + 2);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rHL), Tmp);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::POP16r), GBZ80::HL);
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rr), Reg)
+      .addReg(Tmp);
+  }
+  else
+  {
+    // Store the bytes of HL one by one, keeping HL for the next byte or
+    // whoever needs it after MI.
+    for (unsigned i = 0, e = Bytes.size(); i != e; ++i)
+    {
+      bool KeepHL = HLLive || i + 1 != e;
+      BuildMI(MBB, II, dl, TII.get(GBZ80::LD8rr), Tmp)
+        .addReg(Bytes[i]);
+      if (KeepHL)
+        BuildMI(MBB, II, dl, TII.get(GBZ80::PUSH16r))
+          .addReg(GBZ80::HL);
+      buildStackAddr(MBB, II, dl, TII, Offset + i + Pushed + (KeepHL ? 2 : 0));
+      BuildMI(MBB, II, dl, TII.get(GBZ80::LD8HLr))
+        .addReg(Tmp);
+      if (KeepHL)
+        BuildMI(MBB, II, dl, TII.get(GBZ80::POP16r), GBZ80::HL);
+    }
+  }
+
+  if (SavedA)
+    BuildMI(MBB, II, dl, TII.get(GBZ80::LDH8Am))
+      .addExternalSymbol(GBZ80::ScratchSlot);
+  if (PushedA || FlagsLive)
+    BuildMI(MBB, II, dl, TII.get(GBZ80::POPAF));
+  MBB.erase(II);
+}
+
+void GBZ80RegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
+  int SPAdj, unsigned FIOperandNum, RegScavenger *RS) const
+{
+  MachineInstr &MI = *II;
+  MachineBasicBlock &MBB = *MI.getParent();
+  MachineFunction &MF = *MBB.getParent();
+  const MachineFrameInfo *MFI = MF.getFrameInfo();
+  DebugLoc dl = MI.getDebugLoc();
+
+  if (MF.getSubtarget().getFrameLowering()->hasFP(MF))
+    report_fatal_error("GBZ80 does not support variable sized stack objects");
+
+  // Object offsets are relative to SP before the call, skip the return
+  // address and the frame itself.
+  int FI = MI.getOperand(FIOperandNum).getIndex();
+  int64_t Offset = MFI->getObjectOffset(FI) + MFI->getStackSize() + 2 +
+    MI.getOperand(FIOperandNum + 1).getImm();
+
+  switch (MI.getOpcode())
+  {
+  default:
+    llvm_unreachable("Unexpected frame index user");
+  case GBZ80::LD8rm:
+  case GBZ80::LD8mr:
+  case GBZ80::LD16rm:
+  case GBZ80::LD16mr:
+    expandStackSlotAccess(II, Offset);
+    return;
+  case GBZ80::FRMIDX:
+    break;
+  }
+
+  // Rematerialization leaves the original address behind when every use
+  // got its own copy.
+  if (MI.getOperand(0).isDead())
+  {
+    MBB.erase(II);
+    return;
+  }
+
+  // FRMIDX leaves the flags alone, they are pushed around the address where
+  // they are live. A goes along with them.
+  LivePhysRegs Live(this);
+  addLiveAfter(Live, II);
+  bool FlagsLive = Live.contains(GBZ80::FLAGS);
+  if (FlagsLive)
+  {
+    MachineInstr *Push = BuildMI(MBB, II, dl, TII.get(GBZ80::PUSHAF));
+    if (!Live.contains(GBZ80::A))
+      Push->findRegisterUseOperand(GBZ80::A)->setIsUndef();
+    Offset += 2;
+  }
+  buildStackAddr(MBB, II, dl, TII, Offset);
+  if (FlagsLive)
+    BuildMI(MBB, II, dl, TII.get(GBZ80::POPAF));
+  MBB.erase(II);
+}
+
+unsigned GBZ80RegisterInfo::getFrameRegister(const MachineFunction &MF) const
+{
+  // The frame is set up with "add hl, sp" / "ld sp, hl", which only exist
+  // for HL.
+  return GBZ80::HL;
+}
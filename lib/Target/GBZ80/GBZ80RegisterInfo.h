@@ -20,6 +20,7 @@
 namespace llvm {
   class TargetInstrInfo;
   class GBZ80TargetMachine;
+  class LivePhysRegs;
 
   class GBZ80RegisterInfo : public GBZ80GenRegisterInfo {
     GBZ80TargetMachine &TM;
@@ -33,10 +34,24 @@ namespace llvm {
 
     BitVector getReservedRegs(const MachineFunction &MF) const;
 
+    const TargetRegisterClass *
+    getLargestLegalSuperClass(const TargetRegisterClass *RC) const;
+
+    void getRegAllocationHints(unsigned VirtReg, ArrayRef<MCPhysReg> Order,
+                               SmallVectorImpl<MCPhysReg> &Hints,
+                               const MachineFunction &MF,
+                               const VirtRegMap *VRM) const;
+
     void eliminateFrameIndex(MachineBasicBlock::iterator I,
             int SPAdj, unsigned FIOperandNum, RegScavenger *RS = nullptr) const;
 
     unsigned getFrameRegister(const MachineFunction &MF) const;
+
+  private:
+    void addLiveAfter(LivePhysRegs &Live,
+                      MachineBasicBlock::iterator II) const;
+    void expandStackSlotAccess(MachineBasicBlock::iterator II,
+                               int64_t Offset) const;
   };
 } // end namespace llvm
 
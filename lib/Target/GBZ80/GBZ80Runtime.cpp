@@ -0,0 +1,631 @@
+//===-- GBZ80Runtime.cpp - GBZ80 runtime library routines -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the runtime library for the operations the GB CPU has
+// no instructions for. The legalizer turns them into calls to the usual
+// libgcc names, and the AsmPrinter emits the routines a module calls at its
+// end, as weak definitions, so a module never needs a separate library.
+//
+// The routines follow the calling convention of the code calling them: the
+// arguments come in A and H, HL and DE, or DEHL and A, the result goes back
+// in A, HL or DEHL, BC and DE are preserved, A, HL and the flags are not.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80Runtime.h"
+#include "GBZ80.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInstBuilder.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/Support/ErrorHandling.h"
+using namespace llvm;
+
+namespace {
+  enum Routine {
+    NoRoutine,
+    MulQI, MulHI,
+    UModQI, UDivQI, ModQI, DivQI, SDivQI,
+    UDivModHI, UModHI, UDivHI, SDivModHI, ModHI, DivHI,
+    ShlSI, LShrSI, AShrSI,
+    Dispatch
+  };
+
+  // RoutineEmitter - Emits the instructions of one routine.
+  class RoutineEmitter {
+    MCStreamer &OS;
+    MCContext &Ctx;
+    const MCSubtargetInfo &STI;
+    SmallVectorImpl<StringRef> &Deps;
+
+  public:
+    RoutineEmitter(MCStreamer &OS, MCContext &Ctx, const MCSubtargetInfo &STI,
+                   SmallVectorImpl<StringRef> &Deps)
+      : OS(OS), Ctx(Ctx), STI(STI), Deps(Deps) {}
+
+    MCSymbol *createLabel() { return Ctx.CreateTempSymbol(); }
+    void label(MCSymbol *Sym) { OS.EmitLabel(Sym); }
+
+    void emit(const MCInst &Inst) { OS.EmitInstruction(Inst, STI); }
+    void op(unsigned Opc) { emit(MCInstBuilder(Opc)); }
+    // alu - An ALU operation on A and Reg.
+    void alu(unsigned Opc, unsigned Reg) { emit(MCInstBuilder(Opc).addReg(Reg)); }
+    void alui(unsigned Opc, int64_t Imm) { emit(MCInstBuilder(Opc).addImm(Imm)); }
+    // unary - An operation that modifies Reg only, INC, DEC or a CB shift.
+    void unary(unsigned Opc, unsigned Reg) {
+      emit(MCInstBuilder(Opc).addReg(Reg).addReg(Reg));
+    }
+    void ld(unsigned Dst, unsigned Src) {
+      emit(MCInstBuilder(GBZ80::LD8rr).addReg(Dst).addReg(Src));
+    }
+    void ldi(unsigned Opc, unsigned Dst, int64_t Imm) {
+      emit(MCInstBuilder(Opc).addReg(Dst).addImm(Imm));
+    }
+    void push(unsigned Reg) { emit(MCInstBuilder(GBZ80::PUSH16r).addReg(Reg)); }
+    void pop(unsigned Reg) { emit(MCInstBuilder(GBZ80::POP16r).addReg(Reg)); }
+
+    void jr(MCSymbol *Sym) {
+      emit(MCInstBuilder(GBZ80::JR).addExpr(MCSymbolRefExpr::Create(Sym, Ctx)));
+    }
+    void jr(GBZ80::CondCode CC, MCSymbol *Sym) {
+      emit(MCInstBuilder(GBZ80::JRCC)
+        .addExpr(MCSymbolRefExpr::Create(Sym, Ctx)).addImm(CC));
+    }
+
+    // call, jp - Transfer control to another routine of the library.
+    void call(StringRef Name) { transfer(GBZ80::CALL, Name); }
+    void jp(StringRef Name) { transfer(GBZ80::JP, Name); }
+
+    // negate - Negate the register pair Hi:Lo, through A:
+    //   xor a
+    //   sub lo
+    //   ld lo, a
+    //   sbc a, a
+    //   sub hi
+    //   ld hi, a
+    void negate(unsigned Hi, unsigned Lo) {
+      alu(GBZ80::XOR8r, GBZ80::A);
+      alu(GBZ80::SUB8r, Lo);
+      ld(Lo, GBZ80::A);
+      alu(GBZ80::SBC8r, GBZ80::A);
+      alu(GBZ80::SUB8r, Hi);
+      ld(Hi, GBZ80::A);
+    }
+
+    // negateIfSign - Negate the byte in A, or the pair HL if Pair is set,
+    // when bit 7 of the byte pushed with AF last is set, popping it. The byte
+    // result goes from L to A first.
+    void negateIfSign(bool Pair) {
+      MCSymbol *Done = createLabel();
+      op(GBZ80::POPAF);
+      alu(GBZ80::ADD8r, GBZ80::A);
+      if (!Pair)
+        ld(GBZ80::A, GBZ80::L);
+      jr(GBZ80::COND_NC, Done);
+      if (Pair)
+        negate(GBZ80::H, GBZ80::L);
+      else
+      {
+        op(GBZ80::CPL);
+        unary(GBZ80::INC8r, GBZ80::A);
+      }
+      label(Done);
+    }
+
+  private:
+    void transfer(unsigned Opc, StringRef Name) {
+      Deps.push_back(Name);
+      MCSymbol *Sym = Ctx.GetOrCreateSymbol(Name);
+      emit(MCInstBuilder(Opc).addExpr(MCSymbolRefExpr::Create(Sym, Ctx)));
+    }
+  }; // end class RoutineEmitter
+} // end anonymous namespace
+
+static Routine getRoutine(StringRef Name)
+{
+  return StringSwitch<Routine>(Name)
+    .Case("__mulqi3",          MulQI)
+    .Case("__mulhi3",          MulHI)
+    .Case("__umodqi3",         UModQI)
+    .Case("__udivqi3",         UDivQI)
+    .Case("__modqi3",          ModQI)
+    .Case("__divqi3",          DivQI)
+    .Case("__gbz80_sdivqi",    SDivQI)
+    .Case("__gbz80_udivmodhi", UDivModHI)
+    .Case("__umodhi3",         UModHI)
+    .Case("__udivhi3",         UDivHI)
+    .Case("__gbz80_sdivmodhi", SDivModHI)
+    .Case("__modhi3",          ModHI)
+    .Case("__divhi3",          DivHI)
+    .Case("__ashlsi3",         ShlSI)
+    .Case("__lshrsi3",         LShrSI)
+    .Case("__ashrsi3",         AShrSI)
+    .Case("__gbz80_jumptable", Dispatch)
+    .Default(NoRoutine);
+}
+
+bool GBZ80Runtime::isRoutine(StringRef Name)
+{
+  return getRoutine(Name) != NoRoutine;
+}
+
+// emitMulQI - A * H -> A, shift and add over the bits of H:
+//   ld l, a
+//   xor a
+// .Lloop:
+//   srl h
+//   jr nc, .Lskip
+//   add a, l
+// .Lskip:
+//   sla l
+//   inc h
+//   dec h
+//   jr nz, .Lloop
+//   ret
+static void emitMulQI(RoutineEmitter &E)
+{
+  MCSymbol *Loop = E.createLabel(), *Skip = E.createLabel();
+  E.ld(GBZ80::L, GBZ80::A);
+  E.alu(GBZ80::XOR8r, GBZ80::A);
+  E.label(Loop);
+  E.unary(GBZ80::SRL8r, GBZ80::H);
+  E.jr(GBZ80::COND_NC, Skip);
+  E.alu(GBZ80::ADD8r, GBZ80::L);
+  E.label(Skip);
+  E.unary(GBZ80::SLA8r, GBZ80::L);
+  E.unary(GBZ80::INC8r, GBZ80::H);
+  E.unary(GBZ80::DEC8r, GBZ80::H);
+  E.jr(GBZ80::COND_NZ, Loop);
+  E.op(GBZ80::RET);
+}
+
+// emitMulHI - HL * DE -> HL, the same with the multiplier in BC:
+//   push bc
+//   push de
+//   ld b, h
+//   ld c, l
+//   ld hl, 0
+// .Lloop:
+//   srl b
+//   rr c
+//   jr nc, .Lskip
+//   add hl, de
+// .Lskip:
+//   sla e
+//   rl d
+//   ld a, b
+//   or c
+//   jr nz, .Lloop
+//   pop de
+//   pop bc
+//   ret
+static void emitMulHI(RoutineEmitter &E)
+{
+  MCSymbol *Loop = E.createLabel(), *Skip = E.createLabel();
+  E.push(GBZ80::BC);
+  E.push(GBZ80::DE);
+  E.ld(GBZ80::B, GBZ80::H);
+  E.ld(GBZ80::C, GBZ80::L);
+  E.ldi(GBZ80::LD16ri, GBZ80::HL, 0);
+  E.label(Loop);
+  E.unary(GBZ80::SRL8r, GBZ80::B);
+  E.unary(GBZ80::RR8r, GBZ80::C);
+  E.jr(GBZ80::COND_NC, Skip);
+  E.emit(MCInstBuilder(GBZ80::ADD16r).addReg(GBZ80::DE));
+  E.label(Skip);
+  E.unary(GBZ80::SLA8r, GBZ80::E);
+  E.unary(GBZ80::RL8r, GBZ80::D);
+  E.ld(GBZ80::A, GBZ80::B);
+  E.alu(GBZ80::OR8r, GBZ80::C);
+  E.jr(GBZ80::COND_NZ, Loop);
+  E.pop(GBZ80::DE);
+  E.pop(GBZ80::BC);
+  E.op(GBZ80::RET);
+}
+
+// emitUModQI - A / H -> remainder in A, quotient in L. Shift-subtract
+// division, the bits of the dividend are shifted out of L into the remainder
+// as the bits of the quotient are shifted in:
+//   push bc
+//   ld l, a
+//   xor a
+//   ld b, 8
+// .Lloop:
+//   sla l
+//   rl a
+//   jr c, .Lsub      ; the remainder doesn't fit into 8 bits
+//   cp h
+//   jr c, .Lskip
+// .Lsub:
+//   sub h
+//   inc l
+// .Lskip:
+//   dec b
+//   jr nz, .Lloop
+//   pop bc
+//   ret
+static void emitUModQI(RoutineEmitter &E)
+{
+  MCSymbol *Loop = E.createLabel(), *Sub = E.createLabel(),
+           *Skip = E.createLabel();
+  E.push(GBZ80::BC);
+  E.ld(GBZ80::L, GBZ80::A);
+  E.alu(GBZ80::XOR8r, GBZ80::A);
+  E.ldi(GBZ80::LD8ri, GBZ80::B, 8);
+  E.label(Loop);
+  E.unary(GBZ80::SLA8r, GBZ80::L);
+  E.unary(GBZ80::RL8r, GBZ80::A);
+  E.jr(GBZ80::COND_C, Sub);
+  E.alu(GBZ80::CP8r, GBZ80::H);
+  E.jr(GBZ80::COND_C, Skip);
+  E.label(Sub);
+  E.alu(GBZ80::SUB8r, GBZ80::H);
+  E.unary(GBZ80::INC8r, GBZ80::L);
+  E.label(Skip);
+  E.unary(GBZ80::DEC8r, GBZ80::B);
+  E.jr(GBZ80::COND_NZ, Loop);
+  E.pop(GBZ80::BC);
+  E.op(GBZ80::RET);
+}
+
+// emitUDivQI - A / H -> A:
+//   call __umodqi3
+//   ld a, l
+//   ret
+static void emitUDivQI(RoutineEmitter &E)
+{
+  E.call("__umodqi3");
+  E.ld(GBZ80::A, GBZ80::L);
+  E.op(GBZ80::RET);
+}
+
+// emitSDivQI - The unsigned division of the magnitudes of A and H:
+//   ld l, a
+//   ld a, h
+//   add a, a
+//   jr nc, .Lhpos
+//   xor a
+//   sub h
+//   ld h, a
+// .Lhpos:
+//   ld a, l
+//   add a, a
+//   ld a, l
+//   jr nc, .Lapos
+//   cpl
+//   inc a
+// .Lapos:
+//   jp __umodqi3
+static void emitSDivQI(RoutineEmitter &E)
+{
+  MCSymbol *HPos = E.createLabel(), *APos = E.createLabel();
+  E.ld(GBZ80::L, GBZ80::A);
+  E.ld(GBZ80::A, GBZ80::H);
+  E.alu(GBZ80::ADD8r, GBZ80::A);
+  E.jr(GBZ80::COND_NC, HPos);
+  E.alu(GBZ80::XOR8r, GBZ80::A);
+  E.alu(GBZ80::SUB8r, GBZ80::H);
+  E.ld(GBZ80::H, GBZ80::A);
+  E.label(HPos);
+  E.ld(GBZ80::A, GBZ80::L);
+  E.alu(GBZ80::ADD8r, GBZ80::A);
+  E.ld(GBZ80::A, GBZ80::L);
+  E.jr(GBZ80::COND_NC, APos);
+  E.op(GBZ80::CPL);
+  E.unary(GBZ80::INC8r, GBZ80::A);
+  E.label(APos);
+  E.jp("__umodqi3");
+}
+
+// emitDivQI - A / H -> A, rounding toward zero. The quotient is negative if
+// the signs of the operands differ:
+//   ld l, a
+//   xor h
+//   push af
+//   ld a, l
+//   call __gbz80_sdivqi
+//   pop af
+//   add a, a
+//   ld a, l
+//   jr nc, .Ldone
+//   cpl
+//   inc a
+// .Ldone:
+//   ret
+static void emitDivQI(RoutineEmitter &E)
+{
+  E.ld(GBZ80::L, GBZ80::A);
+  E.alu(GBZ80::XOR8r, GBZ80::H);
+  E.op(GBZ80::PUSHAF);
+  E.ld(GBZ80::A, GBZ80::L);
+  E.call("__gbz80_sdivqi");
+  E.negateIfSign(false);
+  E.op(GBZ80::RET);
+}
+
+// emitModQI - A % H -> A, with the sign of the dividend:
+//   push af
+//   call __gbz80_sdivqi
+//   ld l, a
+//   pop af
+//   add a, a
+//   ld a, l
+//   jr nc, .Ldone
+//   cpl
+//   inc a
+// .Ldone:
+//   ret
+static void emitModQI(RoutineEmitter &E)
+{
+  E.op(GBZ80::PUSHAF);
+  E.call("__gbz80_sdivqi");
+  E.ld(GBZ80::L, GBZ80::A);
+  E.negateIfSign(false);
+  E.op(GBZ80::RET);
+}
+
+// emitUDivModHI - HL / DE -> quotient in BC, remainder in HL, the 16-bit
+// version of __umodqi3. A holds the count, and is saved across the compare
+// that needs it:
+//   ld b, h
+//   ld c, l
+//   ld hl, 0
+//   ld a, 16
+// .Lloop:
+//   push af
+//   sla c
+//   rl b
+//   rl l
+//   rl h
+//   jr c, .Lsub
+//   ld a, h
+//   cp d
+//   jr c, .Lskip
+//   jr nz, .Lsub
+//   ld a, l
+//   cp e
+//   jr c, .Lskip
+// .Lsub:
+//   ld a, l
+//   sub e
+//   ld l, a
+//   ld a, h
+//   sbc a, d
+//   ld h, a
+//   inc c
+// .Lskip:
+//   pop af
+//   dec a
+//   jr nz, .Lloop
+//   ret
+static void emitUDivModHI(RoutineEmitter &E)
+{
+  MCSymbol *Loop = E.createLabel(), *Sub = E.createLabel(),
+           *Skip = E.createLabel();
+  E.ld(GBZ80::B, GBZ80::H);
+  E.ld(GBZ80::C, GBZ80::L);
+  E.ldi(GBZ80::LD16ri, GBZ80::HL, 0);
+  E.ldi(GBZ80::LD8ri, GBZ80::A, 16);
+  E.label(Loop);
+  E.op(GBZ80::PUSHAF);
+  E.unary(GBZ80::SLA8r, GBZ80::C);
+  E.unary(GBZ80::RL8r, GBZ80::B);
+  E.unary(GBZ80::RL8r, GBZ80::L);
+  E.unary(GBZ80::RL8r, GBZ80::H);
+  E.jr(GBZ80::COND_C, Sub);
+  E.ld(GBZ80::A, GBZ80::H);
+  E.alu(GBZ80::CP8r, GBZ80::D);
+  E.jr(GBZ80::COND_C, Skip);
+  E.jr(GBZ80::COND_NZ, Sub);
+  E.ld(GBZ80::A, GBZ80::L);
+  E.alu(GBZ80::CP8r, GBZ80::E);
+  E.jr(GBZ80::COND_C, Skip);
+  E.label(Sub);
+  E.ld(GBZ80::A, GBZ80::L);
+  E.alu(GBZ80::SUB8r, GBZ80::E);
+  E.ld(GBZ80::L, GBZ80::A);
+  E.ld(GBZ80::A, GBZ80::H);
+  E.alu(GBZ80::SBC8r, GBZ80::D);
+  E.ld(GBZ80::H, GBZ80::A);
+  E.unary(GBZ80::INC8r, GBZ80::C);
+  E.label(Skip);
+  E.op(GBZ80::POPAF);
+  E.unary(GBZ80::DEC8r, GBZ80::A);
+  E.jr(GBZ80::COND_NZ, Loop);
+  E.op(GBZ80::RET);
+}
+
+// emitUModHI - HL % DE -> HL:
+//   push bc
+//   call __gbz80_udivmodhi
+//   pop bc
+//   ret
+// emitUDivHI - HL / DE -> HL, the same with "ld h, b; ld l, c" before the
+// pop.
+static void emitUDivModHIWrapper(RoutineEmitter &E, bool Quotient)
+{
+  E.push(GBZ80::BC);
+  E.call("__gbz80_udivmodhi");
+  if (Quotient)
+  {
+    E.ld(GBZ80::H, GBZ80::B);
+    E.ld(GBZ80::L, GBZ80::C);
+  }
+  E.pop(GBZ80::BC);
+  E.op(GBZ80::RET);
+}
+
+// emitSDivModHI - The unsigned division of the magnitudes of HL and DE:
+//   ld a, h
+//   add a, a
+//   jr nc, .Lhlpos
+//   <negate hl>
+// .Lhlpos:
+//   ld a, d
+//   add a, a
+//   jr nc, .Ldepos
+//   <negate de>
+// .Ldepos:
+//   jp __gbz80_udivmodhi
+static void emitSDivModHI(RoutineEmitter &E)
+{
+  MCSymbol *HLPos = E.createLabel(), *DEPos = E.createLabel();
+  E.ld(GBZ80::A, GBZ80::H);
+  E.alu(GBZ80::ADD8r, GBZ80::A);
+  E.jr(GBZ80::COND_NC, HLPos);
+  E.negate(GBZ80::H, GBZ80::L);
+  E.label(HLPos);
+  E.ld(GBZ80::A, GBZ80::D);
+  E.alu(GBZ80::ADD8r, GBZ80::A);
+  E.jr(GBZ80::COND_NC, DEPos);
+  E.negate(GBZ80::D, GBZ80::E);
+  E.label(DEPos);
+  E.jp("__gbz80_udivmodhi");
+}
+
+// emitDivHI - HL / DE -> HL, rounding toward zero:
+//   push bc
+//   push de
+//   ld a, h
+//   xor d
+//   push af
+//   call __gbz80_sdivmodhi
+//   ld h, b
+//   ld l, c
+//   pop af
+//   add a, a
+//   jr nc, .Ldone
+//   <negate hl>
+// .Ldone:
+//   pop de
+//   pop bc
+//   ret
+// emitModHI - HL % DE -> HL, the same with the sign of the dividend and
+// without the copy of the quotient.
+static void emitSignedDivModHI(RoutineEmitter &E, bool Quotient)
+{
+  E.push(GBZ80::BC);
+  E.push(GBZ80::DE);
+  E.ld(GBZ80::A, GBZ80::H);
+  if (Quotient)
+    E.alu(GBZ80::XOR8r, GBZ80::D);
+  E.op(GBZ80::PUSHAF);
+  E.call("__gbz80_sdivmodhi");
+  if (Quotient)
+  {
+    E.ld(GBZ80::H, GBZ80::B);
+    E.ld(GBZ80::L, GBZ80::C);
+  }
+  E.negateIfSign(true);
+  E.pop(GBZ80::DE);
+  E.pop(GBZ80::BC);
+  E.op(GBZ80::RET);
+}
+
+// emitShiftSI - DEHL shifted by A -> DEHL, one bit at a time:
+//   and 31
+//   jr z, .Ldone
+// .Lloop:
+//   add hl, hl       ; or "srl d" ("sra d"), "rr e", "rr h", "rr l"
+//   rl e
+//   rl d
+//   dec a
+//   jr nz, .Lloop
+// .Ldone:
+//   ret
+static void emitShiftSI(RoutineEmitter &E, Routine R)
+{
+  MCSymbol *Loop = E.createLabel(), *Done = E.createLabel();
+  E.alui(GBZ80::AND8i, 31);
+  E.jr(GBZ80::COND_Z, Done);
+  E.label(Loop);
+  if (R == ShlSI)
+  {
+    E.emit(MCInstBuilder(GBZ80::ADD16r).addReg(GBZ80::HL));
+    E.unary(GBZ80::RL8r, GBZ80::E);
+    E.unary(GBZ80::RL8r, GBZ80::D);
+  }
+  else
+  {
+    E.unary(R == AShrSI ? GBZ80::SRA8r : GBZ80::SRL8r, GBZ80::D);
+    E.unary(GBZ80::RR8r, GBZ80::E);
+    E.unary(GBZ80::RR8r, GBZ80::H);
+    E.unary(GBZ80::RR8r, GBZ80::L);
+  }
+  E.unary(GBZ80::DEC8r, GBZ80::A);
+  E.jr(GBZ80::COND_NZ, Loop);
+  E.label(Done);
+  E.op(GBZ80::RET);
+}
+
+// emitJumpTable - Jump to the entry A / 2 of the table of 16-bit addresses
+// that follows the call, see GBZ80AsmPrinter::EmitJumpTable. The routine
+// never returns, the return address is the table:
+//   pop hl
+//   add a, l
+//   ld l, a
+//   jr nc, .Lskip
+//   inc h
+// .Lskip:
+//   ld a, (hl+)
+//   ld h, (hl)
+//   ld l, a
+//   jp (hl)
+static void emitJumpTable(RoutineEmitter &E)
+{
+  MCSymbol *Skip = E.createLabel();
+  E.pop(GBZ80::HL);
+  E.alu(GBZ80::ADD8r, GBZ80::L);
+  E.ld(GBZ80::L, GBZ80::A);
+  E.jr(GBZ80::COND_NC, Skip);
+  E.unary(GBZ80::INC8r, GBZ80::H);
+  E.label(Skip);
+  E.emit(MCInstBuilder(GBZ80::LD8AHLI).addReg(GBZ80::A));
+  E.emit(MCInstBuilder(GBZ80::LD8rHL).addReg(GBZ80::H));
+  E.ld(GBZ80::L, GBZ80::A);
+  E.op(GBZ80::JPHL);
+}
+
+void GBZ80Runtime::emitRoutine(StringRef Name, MCStreamer &OS, MCContext &Ctx,
+                               const MCSubtargetInfo &STI,
+                               SmallVectorImpl<StringRef> &Deps)
+{
+  Routine R = getRoutine(Name);
+  if (R == NoRoutine)
+    llvm_unreachable("Not a runtime routine!");
+
+  MCSymbol *Sym = Ctx.GetOrCreateSymbol(Name);
+  OS.EmitSymbolAttribute(Sym, MCSA_Weak);
+  OS.EmitLabel(Sym);
+
+  RoutineEmitter E(OS, Ctx, STI, Deps);
+  switch (R)
+  {
+  case NoRoutine: break;
+  case MulQI:     emitMulQI(E); break;
+  case MulHI:     emitMulHI(E); break;
+  case UModQI:    emitUModQI(E); break;
+  case UDivQI:    emitUDivQI(E); break;
+  case ModQI:     emitModQI(E); break;
+  case DivQI:     emitDivQI(E); break;
+  case SDivQI:    emitSDivQI(E); break;
+  case UDivModHI: emitUDivModHI(E); break;
+  case UModHI:    emitUDivModHIWrapper(E, false); break;
+  case UDivHI:    emitUDivModHIWrapper(E, true); break;
+  case SDivModHI: emitSDivModHI(E); break;
+  case ModHI:     emitSignedDivModHI(E, false); break;
+  case DivHI:     emitSignedDivModHI(E, true); break;
+  case ShlSI:
+  case LShrSI:
+  case AShrSI:    emitShiftSI(E, R); break;
+  case Dispatch:  emitJumpTable(E); break;
+  }
+}
@@ -0,0 +1,38 @@
+//===-- GBZ80Runtime.h - GBZ80 runtime library routines ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the routines of the runtime library that the AsmPrinter
+// appends to a module calling them: multiply, divide and the i32 shifts.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80RUNTIME_H
+#define GBZ80RUNTIME_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+  class MCContext;
+  class MCStreamer;
+  class MCSubtargetInfo;
+
+  namespace GBZ80Runtime {
+    // isRoutine - Returns true if Name is a routine of the runtime library.
+    bool isRoutine(StringRef Name);
+
+    // emitRoutine - Emits the routine Name as a weak definition. The other
+    // routines it calls or jumps to are added to Deps.
+    void emitRoutine(StringRef Name, MCStreamer &OS, MCContext &Ctx,
+                     const MCSubtargetInfo &STI,
+                     SmallVectorImpl<StringRef> &Deps);
+  } // end namespace GBZ80Runtime
+} // end namespace llvm
+
+#endif
@@ -22,3 +22,37 @@ GBZ80SelectionDAGInfo::GBZ80SelectionDAGInfo(const GBZ80TargetMachine &tm)
 GBZ80SelectionDAGInfo::~GBZ80SelectionDAGInfo()
 {
 }
+
+// Copies and fills which are too long to be done with single loads and
+// stores become a loop around ld a,(hl+) or ld (hl+),a. This is also done
+// for the ones with a variable size, as the library calls would have to pass
+// the size on the stack.
+
+SDValue GBZ80SelectionDAGInfo::EmitTargetCodeForMemcpy(SelectionDAG &DAG,
+  SDLoc dl, SDValue Chain, SDValue Dst, SDValue Src, SDValue Size,
+  unsigned Align, bool isVolatile, bool AlwaysInline,
+  MachinePointerInfo DstPtrInfo, MachinePointerInfo SrcPtrInfo) const
+{
+  SDValue Glue;
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::BC, Size, Glue);
+  Glue  = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::DE, Dst, Glue);
+  Glue  = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::HL, Src, Glue);
+  Glue  = Chain.getValue(1);
+  return DAG.getNode(GBZ80ISD::MEMCPY, dl, MVT::Other, Chain, Glue);
+}
+
+SDValue GBZ80SelectionDAGInfo::EmitTargetCodeForMemset(SelectionDAG &DAG,
+  SDLoc dl, SDValue Chain, SDValue Dst, SDValue Val, SDValue Size,
+  unsigned Align, bool isVolatile, MachinePointerInfo DstPtrInfo) const
+{
+  SDValue Glue;
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::BC, Size, Glue);
+  Glue  = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::HL, Dst, Glue);
+  Glue  = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, dl, GBZ80::A, Val, Glue);
+  Glue  = Chain.getValue(1);
+  return DAG.getNode(GBZ80ISD::MEMSET, dl, MVT::Other, Chain, Glue);
+}
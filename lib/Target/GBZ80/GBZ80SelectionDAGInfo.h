@@ -21,6 +21,19 @@ namespace llvm {
   public:
     explicit GBZ80SelectionDAGInfo(const GBZ80TargetMachine &tm);
     ~GBZ80SelectionDAGInfo();
+
+    SDValue EmitTargetCodeForMemcpy(SelectionDAG &DAG, SDLoc dl,
+                                    SDValue Chain, SDValue Dst, SDValue Src,
+                                    SDValue Size, unsigned Align,
+                                    bool isVolatile, bool AlwaysInline,
+                                    MachinePointerInfo DstPtrInfo,
+                                    MachinePointerInfo SrcPtrInfo) const override;
+
+    SDValue EmitTargetCodeForMemset(SelectionDAG &DAG, SDLoc dl,
+                                    SDValue Chain, SDValue Dst, SDValue Val,
+                                    SDValue Size, unsigned Align,
+                                    bool isVolatile,
+                                    MachinePointerInfo DstPtrInfo) const override;
   }; // end class GBZ80SelectionDAGInfo
 } // end namespace llvm
 
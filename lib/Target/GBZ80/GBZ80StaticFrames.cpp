@@ -0,0 +1,281 @@
+//===-- GBZ80StaticFrames.cpp - Compiled stack for GBZ80 ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an opt-in pass that gives the locals of non-recursive
+// functions fixed addresses in WRAM, a "compiled stack". SP relative accesses
+// need ld hl,sp+e and a pointer walk on the GB CPU, while a local at a fixed
+// address is a single ld a,(nn) or ld (nn),a.
+//
+// A function can't have two activations live at the same time unless it is
+// part of a cycle in the call graph, so the static allocas of every function
+// outside of a cycle are moved into one internal array. Functions that are
+// never live at the same time share the same bytes: a function is placed
+// right after the deepest frame of all of its callers, so the frames along
+// any call path are disjoint and the array is only as large as the deepest
+// path through the call graph.
+//
+// An indirect call is treated as a call to every function whose address is
+// taken. Calls to declarations are assumed not to call back into the module,
+// which holds for a whole ROM built from one module. Recursive functions keep
+// their frames on the stack, and so do interrupt handlers and everything they
+// call, which can run in the middle of any other function.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80.h"
+#include "GBZ80TargetMachine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/MathExtras.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-static-frames"
+
+STATISTIC(NumStaticFrames, "Number of functions given a static frame");
+STATISTIC(NumStaticAllocas, "Number of allocas moved to a static frame");
+
+namespace {
+  // FrameNode - A function in the call graph used to place the frames. The
+  // node without a function stands for every indirect call.
+  struct FrameNode {
+    Function *F;
+    SmallVector<FrameNode *, 4> Callees;
+    // Offset - The first byte the frame may use, past the frames of all of
+    // the callers.
+    uint64_t Offset;
+
+    explicit FrameNode(Function *F) : F(F), Offset(0) {}
+  };
+} // end anonymous namespace
+
+namespace llvm {
+  template <> struct GraphTraits<FrameNode *> {
+    typedef FrameNode NodeType;
+    typedef SmallVectorImpl<FrameNode *>::iterator ChildIteratorType;
+
+    static NodeType *getEntryNode(FrameNode *N) { return N; }
+    static ChildIteratorType child_begin(NodeType *N) {
+      return N->Callees.begin();
+    }
+    static ChildIteratorType child_end(NodeType *N) {
+      return N->Callees.end();
+    }
+  };
+} // end namespace llvm
+
+namespace {
+  class GBZ80StaticFrames : public ModulePass {
+  public:
+    static char ID;
+    explicit GBZ80StaticFrames(GBZ80TargetMachine &TM)
+      : ModulePass(ID), DL(*TM.getDataLayout()) {
+      // llc doesn't register the IPA passes on its own.
+      initializeCallGraphWrapperPassPass(*PassRegistry::getPassRegistry());
+    }
+
+    bool runOnModule(Module &M) override;
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<CallGraphWrapperPass>();
+    }
+
+    const char *getPassName() const override {
+      return "GBZ80 Static Frames";
+    }
+
+  private:
+    const DataLayout &DL;
+
+    // Slot - An alloca and its offset from the start of its frame.
+    typedef std::pair<AllocaInst *, uint64_t> Slot;
+
+    uint64_t layoutFrame(Function &F, SmallVectorImpl<Slot> &Slots,
+                         unsigned &Align) const;
+  };
+  char GBZ80StaticFrames::ID = 0;
+} // end anonymous namespace
+
+// createGBZ80StaticFramesPass - Returns a pass that moves the locals of
+// non-recursive functions to fixed addresses.
+ModulePass *llvm::createGBZ80StaticFramesPass(GBZ80TargetMachine &TM) {
+  return new GBZ80StaticFrames(TM);
+}
+
+// layoutFrame - Collect the static allocas of F and give each an offset in
+// the frame. Returns the size of the frame, Align is set to the largest
+// alignment of the allocas.
+uint64_t GBZ80StaticFrames::layoutFrame(Function &F,
+                                        SmallVectorImpl<Slot> &Slots,
+                                        unsigned &Align) const
+{
+  uint64_t Size = 0;
+  Align = 1;
+  BasicBlock &Entry = F.getEntryBlock();
+  for (BasicBlock::iterator I = Entry.begin(), E = Entry.end(); I != E; ++I)
+  {
+    AllocaInst *AI = dyn_cast<AllocaInst>(I);
+    if (!AI || !AI->isStaticAlloca())
+      continue;
+
+    Type *Ty = AI->getAllocatedType();
+    uint64_t Count = cast<ConstantInt>(AI->getArraySize())->getZExtValue();
+    unsigned SlotAlign = AI->getAlignment();
+    if (!SlotAlign)
+      SlotAlign = DL.getPrefTypeAlignment(Ty);
+
+    Size = RoundUpToAlignment(Size, SlotAlign);
+    Slots.push_back(Slot(AI, Size));
+    Size += DL.getTypeAllocSize(Ty) * Count;
+    Align = std::max(Align, SlotAlign);
+  }
+  return Size;
+}
+
+bool GBZ80StaticFrames::runOnModule(Module &M)
+{
+  CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+
+  // Build the graph of the defined functions. Root calls everything so the
+  // walk below reaches every node.
+  std::vector<std::unique_ptr<FrameNode>> Nodes;
+  DenseMap<const Function *, FrameNode *> NodeMap;
+  FrameNode Root(nullptr), Indirect(nullptr);
+  Root.Callees.push_back(&Indirect);
+  for (Module::iterator F = M.begin(), E = M.end(); F != E; ++F)
+  {
+    if (F->isDeclaration())
+      continue;
+    Nodes.emplace_back(new FrameNode(F));
+    NodeMap[F] = Nodes.back().get();
+    Root.Callees.push_back(Nodes.back().get());
+    if (F->hasAddressTaken())
+      Indirect.Callees.push_back(Nodes.back().get());
+  }
+
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+  {
+    FrameNode *N = Nodes[i].get();
+    const CallGraphNode *CGN = CG[N->F];
+    for (CallGraphNode::const_iterator I = CGN->begin(), E = CGN->end();
+         I != E; ++I)
+    {
+      const Function *Callee = I->second->getFunction();
+      if (!Callee)
+        N->Callees.push_back(&Indirect);
+      else if (FrameNode *CalleeNode = NodeMap.lookup(Callee))
+        N->Callees.push_back(CalleeNode);
+    }
+  }
+
+  // Whatever an interrupt handler reaches may interrupt itself.
+  SmallPtrSet<FrameNode *, 16> Interruptible;
+  SmallVector<FrameNode *, 16> Worklist;
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    if (Nodes[i]->F->hasFnAttribute("interrupt"))
+      Worklist.push_back(Nodes[i].get());
+  while (!Worklist.empty())
+  {
+    FrameNode *N = Worklist.pop_back_val();
+    if (Interruptible.insert(N).second)
+      Worklist.append(N->Callees.begin(), N->Callees.end());
+  }
+
+  // scc_iterator returns the callees before their callers, walk the cycles
+  // the other way round so that every caller is placed before its callees.
+  std::vector<std::vector<FrameNode *>> SCCs;
+  for (scc_iterator<FrameNode *> I = scc_begin(&Root); !I.isAtEnd(); ++I)
+  {
+    std::vector<FrameNode *> SCC = *I;
+    if (I.hasLoop())
+      SCC.push_back(nullptr);
+    SCCs.push_back(std::move(SCC));
+  }
+
+  SmallVector<std::pair<Function *, uint64_t>, 16> Frames;
+  SmallVector<Slot, 16> Slots;
+  SmallVector<unsigned, 16> FrameSlots;
+  uint64_t TotalSize = 0;
+  unsigned TotalAlign = 1;
+  for (auto I = SCCs.rbegin(), E = SCCs.rend(); I != E; ++I)
+  {
+    // A cycle is marked with a null entry after its nodes.
+    const std::vector<FrameNode *> &SCC = *I;
+    bool IsCycle = SCC.back() == nullptr;
+
+    uint64_t Offset = 0;
+    for (FrameNode *N : SCC)
+      if (N)
+        Offset = std::max(Offset, N->Offset);
+
+    if (!IsCycle && SCC.front()->F && !Interruptible.count(SCC.front()))
+    {
+      Function &F = *SCC.front()->F;
+      unsigned Align;
+      unsigned FirstSlot = Slots.size();
+      uint64_t Size = layoutFrame(F, Slots, Align);
+      if (Size)
+      {
+        Offset = RoundUpToAlignment(Offset, Align);
+        Frames.push_back(std::make_pair(&F, Offset));
+        FrameSlots.push_back(FirstSlot);
+        Offset += Size;
+        TotalSize = std::max(TotalSize, Offset);
+        TotalAlign = std::max(TotalAlign, Align);
+      }
+      else
+        Slots.resize(FirstSlot);
+    }
+
+    for (FrameNode *N : SCC)
+      if (N)
+        for (FrameNode *Callee : N->Callees)
+          Callee->Offset = std::max(Callee->Offset, Offset);
+  }
+
+  if (Frames.empty())
+    return false;
+
+  LLVMContext &Ctx = M.getContext();
+  ArrayType *Ty = ArrayType::get(Type::getInt8Ty(Ctx), TotalSize);
+  GlobalVariable *Storage =
+    new GlobalVariable(M, Ty, false, GlobalValue::InternalLinkage,
+                       Constant::getNullValue(Ty), "__static_frames");
+  Storage->setAlignment(TotalAlign);
+
+  IntegerType *IntPtrTy = DL.getIntPtrType(Ctx);
+  FrameSlots.push_back(Slots.size());
+  for (unsigned i = 0, e = Frames.size(); i != e; ++i)
+  {
+    uint64_t Base = Frames[i].second;
+    for (unsigned s = FrameSlots[i], se = FrameSlots[i + 1]; s != se; ++s)
+    {
+      AllocaInst *AI = Slots[s].first;
+      Constant *Idx[] = {
+        ConstantInt::get(IntPtrTy, 0),
+        ConstantInt::get(IntPtrTy, Base + Slots[s].second)
+      };
+      Constant *Addr = ConstantExpr::getInBoundsGetElementPtr(Storage, Idx);
+      AI->replaceAllUsesWith(ConstantExpr::getPointerCast(Addr, AI->getType()));
+      AI->eraseFromParent();
+      ++NumStaticAllocas;
+    }
+    ++NumStaticFrames;
+  }
+  return true;
+}
@@ -0,0 +1,36 @@
+//===-- GBZ80Subtarget.cpp - GBZ80 Subtarget Information ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the GBZ80 specific subclass of TargetSubtargetInfo.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80Subtarget.h"
+#include "GBZ80.h"
+#include "GBZ80TargetMachine.h"
+#include "llvm/Support/TargetRegistry.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "gbz80-subtarget"
+
+#define GET_SUBTARGETINFO_TARGET_DESC
+#define GET_SUBTARGETINFO_CTOR
+#include "GBZ80GenSubtargetInfo.inc"
+
+void GBZ80Subtarget::anchor() {}
+
+GBZ80Subtarget::GBZ80Subtarget(const std::string &TT, const std::string &CPU,
+                               const std::string &FS, GBZ80TargetMachine &TM)
+  : GBZ80GenSubtargetInfo(TT, CPU, FS),
+    FrameLowering(TM), InstrInfo(TM), TLInfo(TM), TSInfo(TM)
+{
+  std::string CPUName = CPU.empty() ? "generic" : CPU;
+  ParseSubtargetFeatures(CPUName, FS);
+  InstrItins = getInstrItineraryForCPU(CPUName);
+}
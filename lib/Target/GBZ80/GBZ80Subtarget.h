@@ -0,0 +1,65 @@
+//===-- GBZ80Subtarget.h - Define Subtarget for the GBZ80 -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the GBZ80 specific subclass of TargetSubtargetInfo.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80SUBTARGET_H
+#define GBZ80SUBTARGET_H
+
+#include "GBZ80FrameLowering.h"
+#include "GBZ80ISelLowering.h"
+#include "GBZ80InstrInfo.h"
+#include "GBZ80RegisterInfo.h"
+#include "GBZ80SelectionDAGInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+#include <string>
+
+#define GET_SUBTARGETINFO_HEADER
+#include "GBZ80GenSubtargetInfo.inc"
+
+namespace llvm {
+  class StringRef;
+
+  class GBZ80Subtarget : public GBZ80GenSubtargetInfo {
+    virtual void anchor();
+    GBZ80FrameLowering FrameLowering;
+    GBZ80InstrInfo InstrInfo;
+    GBZ80TargetLowering TLInfo;
+    GBZ80SelectionDAGInfo TSInfo;
+    InstrItineraryData InstrItins;
+  public:
+    GBZ80Subtarget(const std::string &TT, const std::string &CPU,
+                   const std::string &FS, GBZ80TargetMachine &TM);
+
+    // ParseSubtargetFeatures - Parses features string setting specified
+    // subtarget options. Definition of function is auto generated by tblgen.
+    void ParseSubtargetFeatures(StringRef CPU, StringRef FS);
+
+    const GBZ80FrameLowering *getFrameLowering() const override {
+      return &FrameLowering;
+    }
+    const GBZ80InstrInfo *getInstrInfo() const override { return &InstrInfo; }
+    const GBZ80RegisterInfo *getRegisterInfo() const override {
+      return &InstrInfo.getRegisterInfo();
+    }
+    const GBZ80TargetLowering *getTargetLowering() const override {
+      return &TLInfo;
+    }
+    const GBZ80SelectionDAGInfo *getSelectionDAGInfo() const override {
+      return &TSInfo;
+    }
+    const InstrItineraryData *getInstrItineraryData() const override {
+      return &InstrItins;
+    }
+  }; // end class GBZ80Subtarget
+} // end namespace llvm
+
+#endif
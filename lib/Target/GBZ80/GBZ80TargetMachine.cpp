@@ -11,13 +11,28 @@
 //===----------------------------------------------------------------------===//
 
 #include "GBZ80.h"
+#include "GBZ80RegUsageInfo.h"
 #include "GBZ80TargetMachine.h"
+#include "GBZ80TargetTransformInfo.h"
 #include "llvm/CodeGen/Passes.h"
+#include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
+#include "llvm/IR/Verifier.h"
 #include "llvm/PassManager.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/TargetRegistry.h"
 
 using namespace llvm;
 
+static cl::opt<bool>
+StaticFrames("gbz80-static-frames", cl::Hidden, cl::init(false),
+             cl::desc("Place the locals of non-recursive functions at fixed "
+                      "addresses"));
+
+static cl::opt<bool>
+IPRA("gbz80-ipra", cl::Hidden, cl::init(false),
+     cl::desc("Compile callees first and give each call the registers its "
+              "callee really clobbers"));
+
 extern "C" void LLVMInitializeGBZ80Target() {
     // Register the target.
     RegisterTargetMachine<GBZ80TargetMachine> X(TheGBZ80Target);
@@ -27,7 +42,8 @@ extern "C" void LLVMInitializeGBZ80Target() {
  * Describes the memory layout of the Nintendo Game Boy.
  * Notes:
  *  - Little endian
- *  - 2-byte pointers, preferred alignment: 8 (?)
+ *  - 2-byte pointers, every type is byte aligned
+ *  - The only native integers are the 8-bit registers and their 16-bit pairs
  */
 GBZ80TargetMachine::GBZ80TargetMachine(const Target &T, StringRef TT,
                                        StringRef CPU, StringRef FS,
@@ -35,19 +51,43 @@ GBZ80TargetMachine::GBZ80TargetMachine(const Target &T, StringRef TT,
                                        Reloc::Model RM, CodeModel::Model CM,
                                        CodeGenOpt::Level OL)
   : LLVMTargetMachine(T, TT, CPU, FS, Options, RM, CM, OL),
-    DL("e-p:8:8"),
-    FrameLowering(*this), InstrInfo(*this), TSInfo(*this), TLInfo(*this) {
+    TLOF(make_unique<TargetLoweringObjectFileELF>()),
+    DL("e-m:e-p:16:8-i16:8-i32:8-i64:8-f32:8-f64:8-a:8-n8:16"),
+    Subtarget(TT, CPU, FS, *this) {
+    initAsmInfo();
+}
+
+GBZ80TargetMachine::~GBZ80TargetMachine() {}
+
+TargetIRAnalysis GBZ80TargetMachine::getTargetIRAnalysis() {
+    return TargetIRAnalysis(
+        [this](Function &) { return TargetTransformInfo(GBZ80TTIImpl(this)); });
 }
 
 namespace {
     class GBZ80PassConfig : public TargetPassConfig {
         public:
             GBZ80PassConfig(GBZ80TargetMachine *TM, PassManagerBase &PM)
-                : TargetPassConfig(TM, PM) {}
+                : TargetPassConfig(TM, PM) {
+                // The DAG scheduler already orders instructions with the
+                // itineraries before register allocation, use the
+                // MachineScheduler for the post-RA pass.
+                substitutePass(&PostRASchedulerID, &PostMachineSchedulerID);
+            }
             GBZ80TargetMachine &getGBZ80TargetMachine() const {
                 return getTM<GBZ80TargetMachine>();
             }
+            virtual void addIRPasses();
+            virtual void addISelPrepare();
             virtual bool addInstSelector();
+            virtual void addPreRegAlloc();
+            virtual void addPreSched2();
+            virtual void addPreEmitPass();
+
+        private:
+            // RegUsage - The registers preserved by the functions compiled so
+            // far. The pass config lives as long as the pass manager.
+            GBZ80RegUsageInfo RegUsage;
     };
 }
 
@@ -55,7 +95,55 @@ TargetPassConfig *GBZ80TargetMachine::createPassConfig(PassManagerBase &PM) {
     return new GBZ80PassConfig(this, PM);
 }
 
+void GBZ80PassConfig::addIRPasses() {
+    TargetPassConfig::addIRPasses();
+    if (StaticFrames)
+        addPass(createGBZ80StaticFramesPass(getGBZ80TargetMachine()));
+}
+
+void GBZ80PassConfig::addISelPrepare() {
+    if (!IPRA) {
+        TargetPassConfig::addISelPrepare();
+        return;
+    }
+    // The default preparation, with everything after the debug info verifier
+    // run one function at a time, callees first. A module pass further down
+    // would end the walk, and the stack protector pass has to be in the same
+    // function pass manager as the machine passes that use it.
+    addPreISel();
+    if (!DisableVerify)
+        addPass(createDebugInfoVerifierPass());
+    addPass(createGBZ80CallGraphOrderPass());
+    addPass(createStackProtectorPass(TM));
+    if (!DisableVerify)
+        addPass(createVerifierPass());
+}
+
 bool GBZ80PassConfig::addInstSelector() {
     addPass(createGBZ80ISelDAG(getGBZ80TargetMachine(), getOptLevel()));
     return false;
 }
+
+void GBZ80PassConfig::addPreRegAlloc() {
+    if (IPRA)
+        addPass(createGBZ80RegUsagePropagationPass(RegUsage));
+    if (getOptLevel() != CodeGenOpt::None)
+        addPass(createGBZ80AccumulatorCopiesPass());
+}
+
+void GBZ80PassConfig::addPreSched2() {
+    // Runs after the copies and spill pseudos have been expanded into ld r,r.
+    if (getOptLevel() != CodeGenOpt::None)
+        addPass(createGBZ80CopyPropagationPass());
+}
+
+void GBZ80PassConfig::addPreEmitPass() {
+    // Runs once the blocks are in their final order, the flags a compare
+    // may rely on are only followed within a block.
+    if (getOptLevel() != CodeGenOpt::None)
+        addPass(createGBZ80PeepholePass());
+    if (IPRA)
+        addPass(createGBZ80RegUsageCollectorPass(RegUsage), false);
+    // Must run last, it depends on the final layout and instruction sizes.
+    addPass(createGBZ80BranchRelaxationPass(), false);
+}
@@ -0,0 +1,227 @@
+//===-- GBZ80TargetTransformInfo.cpp - GBZ80 specific TTI -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the GBZ80TTIImpl class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80TargetTransformInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Target/TargetLowering.h"
+#include <algorithm>
+using namespace llvm;
+
+// The cost of an operation which becomes a call into the runtime library,
+// the call and the register shuffling around it. The loops of the routines
+// come on top of that.
+static const unsigned LibCallCost = 8 * TargetTransformInfo::TCC_Basic;
+
+unsigned GBZ80TTIImpl::getNumBytes(Type *Ty) const
+{
+  unsigned Elts = Ty->isVectorTy() ? Ty->getVectorNumElements() : 1;
+  unsigned Bits = DL->getTypeSizeInBits(Ty->getScalarType());
+  return Elts * std::max(1u, (Bits + 7) / 8);
+}
+
+// getUserCost - The cost of an instruction for the unroller and the other
+// users of CodeMetrics, in 8-bit operations instead of instructions.
+unsigned GBZ80TTIImpl::getUserCost(const User *U)
+{
+  unsigned Cost = BaseT::getUserCost(U);
+  const Instruction *I = dyn_cast<Instruction>(U);
+  if (!I || Cost == TTI::TCC_Free)
+    return Cost;
+
+  switch (I->getOpcode())
+  {
+  default:
+    return Cost;
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+  {
+    TTI::OperandValueKind Op2Info = TTI::OK_AnyValue;
+    TTI::OperandValueProperties Op2Props = TTI::OP_None;
+    if (const ConstantInt *CI = dyn_cast<ConstantInt>(I->getOperand(1)))
+    {
+      Op2Info = TTI::OK_UniformConstantValue;
+      if (CI->getValue().isPowerOf2())
+        Op2Props = TTI::OP_PowerOf2;
+    }
+    return getArithmeticInstrCost(I->getOpcode(), I->getType(),
+                                  TTI::OK_AnyValue, Op2Info, TTI::OP_None,
+                                  Op2Props);
+  }
+  case Instruction::ICmp:
+  case Instruction::FCmp:
+    return getCmpSelInstrCost(I->getOpcode(), I->getOperand(0)->getType(),
+                              I->getType());
+  case Instruction::Select:
+    return getCmpSelInstrCost(I->getOpcode(), I->getType(),
+                              I->getOperand(0)->getType());
+  case Instruction::Load:
+    return getMemoryOpCost(I->getOpcode(), I->getType(), 1, 0);
+  case Instruction::Store:
+    return getMemoryOpCost(I->getOpcode(), I->getOperand(0)->getType(), 1, 0);
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::FPToUI:
+  case Instruction::FPToSI:
+  case Instruction::UIToFP:
+  case Instruction::SIToFP:
+  case Instruction::FPTrunc:
+  case Instruction::FPExt:
+    return getCastInstrCost(I->getOpcode(), I->getType(),
+                            I->getOperand(0)->getType());
+  }
+}
+
+// Every instruction either has a form with an 8-bit immediate or loads its
+// operand with ld rr,nn, which is as cheap as a copy between register pairs.
+// A hoisted constant would tie up one of the three pairs instead, and hide
+// the high RAM addresses which ldh reaches directly.
+unsigned GBZ80TTIImpl::getIntImmCost(const APInt &Imm, Type *Ty)
+{
+  if (Imm == 0)
+    return TTI::TCC_Free;
+  return TTI::TCC_Basic * ((getNumBytes(Ty) + 1) / 2);
+}
+
+unsigned GBZ80TTIImpl::getIntImmCost(unsigned Opcode, unsigned Idx,
+                                     const APInt &Imm, Type *Ty)
+{
+  return TTI::TCC_Free;
+}
+
+unsigned GBZ80TTIImpl::getIntImmCost(Intrinsic::ID IID, unsigned Idx,
+                                     const APInt &Imm, Type *Ty)
+{
+  return TTI::TCC_Free;
+}
+
+// Unrolling saves the counter update and the jr of an iteration, a few bytes
+// and 20 cycles, but every copy of the body takes ROM space. Only loops with
+// a small body are unrolled fully, and none at all when optimizing for size.
+void GBZ80TTIImpl::getUnrollingPreferences(Loop *L,
+                                           TTI::UnrollingPreferences &UP)
+{
+  UP.Threshold = 40;
+  UP.OptSizeThreshold = 0;
+  UP.PartialThreshold = UP.PartialOptSizeThreshold = 0;
+  UP.Partial = UP.Runtime = false;
+}
+
+unsigned GBZ80TTIImpl::getArithmeticInstrCost(unsigned Opcode, Type *Ty,
+  TTI::OperandValueKind Opd1Info, TTI::OperandValueKind Opd2Info,
+  TTI::OperandValueProperties Opd1PropInfo,
+  TTI::OperandValueProperties Opd2PropInfo)
+{
+  unsigned Bytes = getNumBytes(Ty);
+  bool ConstOp = Opd2Info == TTI::OK_UniformConstantValue ||
+                 Opd2Info == TTI::OK_NonUniformConstantValue;
+
+  // Floating point is done in software.
+  if (Ty->getScalarType()->isFloatingPointTy())
+    return LibCallCost * Bytes;
+
+  switch (TLI->InstructionOpcodeToISD(Opcode))
+  {
+  default:
+    return TTI::TCC_Basic * Bytes;
+  case ISD::SHL:
+  case ISD::SRL:
+  case ISD::SRA:
+    // A constant shift is a sequence of single bit shifts through every
+    // byte, a variable one is a loop around it. The i32 shifts are library
+    // calls.
+    if (Bytes > 2)
+      return LibCallCost;
+    return TTI::TCC_Basic * Bytes * (ConstOp ? 2 : 8);
+  case ISD::MUL:
+    // Multiplies by a constant are shifts and adds, see LowerMUL.
+    if (ConstOp)
+      return TTI::TCC_Basic * Bytes * 4;
+    return LibCallCost * Bytes;
+  case ISD::UDIV:
+  case ISD::UREM:
+    if (ConstOp && Opd2PropInfo == TTI::OP_PowerOf2)
+      return TTI::TCC_Basic * Bytes * 2;
+    return LibCallCost * Bytes * 2;
+  case ISD::SDIV:
+  case ISD::SREM:
+    return LibCallCost * Bytes * 2;
+  }
+}
+
+unsigned GBZ80TTIImpl::getCastInstrCost(unsigned Opcode, Type *Dst, Type *Src)
+{
+  unsigned DstBytes = getNumBytes(Dst), SrcBytes = getNumBytes(Src);
+
+  if (Dst->getScalarType()->isFloatingPointTy() ||
+      Src->getScalarType()->isFloatingPointTy())
+    return LibCallCost;
+
+  switch (Opcode)
+  {
+  default:
+    return TTI::TCC_Basic;
+  case Instruction::Trunc:
+  case Instruction::BitCast:
+  case Instruction::PtrToInt:
+  case Instruction::IntToPtr:
+    // A subregister or the same registers.
+    if (DstBytes <= SrcBytes)
+      return TTI::TCC_Free;
+    return TTI::TCC_Basic * (DstBytes - SrcBytes);
+  case Instruction::ZExt:
+    // ld r,0 for every new byte.
+    return TTI::TCC_Basic * (DstBytes - SrcBytes);
+  case Instruction::SExt:
+    // add a,a and sbc a,a for the sign, then a copy for every new byte.
+    return TTI::TCC_Basic * (2 + DstBytes - SrcBytes);
+  }
+}
+
+unsigned GBZ80TTIImpl::getCmpSelInstrCost(unsigned Opcode, Type *ValTy,
+                                          Type *CondTy)
+{
+  unsigned Bytes = getNumBytes(ValTy);
+
+  if (ValTy->getScalarType()->isFloatingPointTy())
+    return LibCallCost;
+
+  // A compare goes through A a byte at a time. There are no conditional
+  // moves, a select is a branch around a copy.
+  if (Opcode == Instruction::Select)
+    return TTI::TCC_Basic * (1 + Bytes);
+  return TTI::TCC_Basic * 2 * Bytes;
+}
+
+unsigned GBZ80TTIImpl::getMemoryOpCost(unsigned Opcode, Type *Src,
+                                       unsigned Alignment,
+                                       unsigned AddressSpace)
+{
+  // Every byte is loaded or stored on its own.
+  return TTI::TCC_Basic * getNumBytes(Src);
+}
@@ -0,0 +1,97 @@
+//===-- GBZ80TargetTransformInfo.h - GBZ80 specific TTI ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the TargetTransformInfo implementation of the GBZ80
+// target. The machine has 8-bit registers only, so the costs are counted in
+// bytes: an i16 operation costs two 8-bit ones, an i32 operation four, and
+// multiplies, divides and variable shifts are loops or library calls.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80TARGETTRANSFORMINFO_H
+#define GBZ80TARGETTRANSFORMINFO_H
+
+#include "GBZ80TargetMachine.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/CodeGen/BasicTTIImpl.h"
+
+namespace llvm {
+  class GBZ80TTIImpl : public BasicTTIImplBase<GBZ80TTIImpl> {
+    typedef BasicTTIImplBase<GBZ80TTIImpl> BaseT;
+    typedef TargetTransformInfo TTI;
+    friend BaseT;
+
+    const GBZ80Subtarget *ST;
+    const GBZ80TargetLowering *TLI;
+
+    const GBZ80Subtarget *getST() const { return ST; }
+    const GBZ80TargetLowering *getTLI() const { return TLI; }
+
+    // getNumBytes - Returns the number of 8-bit operations an operation on Ty
+    // is split into.
+    unsigned getNumBytes(Type *Ty) const;
+
+  public:
+    explicit GBZ80TTIImpl(const GBZ80TargetMachine *TM)
+      : BaseT(TM), ST(TM->getSubtargetImpl()), TLI(ST->getTargetLowering()) {}
+
+    // Provide value semantics. MSVC requires that we spell all of these out.
+    GBZ80TTIImpl(const GBZ80TTIImpl &Arg)
+      : BaseT(static_cast<const BaseT &>(Arg)), ST(Arg.ST), TLI(Arg.TLI) {}
+    GBZ80TTIImpl(GBZ80TTIImpl &&Arg)
+      : BaseT(std::move(static_cast<BaseT &>(Arg))), ST(std::move(Arg.ST)),
+        TLI(std::move(Arg.TLI)) {}
+    GBZ80TTIImpl &operator=(const GBZ80TTIImpl &RHS) {
+      BaseT::operator=(static_cast<const BaseT &>(RHS));
+      ST = RHS.ST;
+      TLI = RHS.TLI;
+      return *this;
+    }
+    GBZ80TTIImpl &operator=(GBZ80TTIImpl &&RHS) {
+      BaseT::operator=(std::move(static_cast<BaseT &>(RHS)));
+      ST = std::move(RHS.ST);
+      TLI = std::move(RHS.TLI);
+      return *this;
+    }
+
+    // Scalar costs.
+    using BaseT::getUserCost;
+    unsigned getUserCost(const User *U);
+
+    using BaseT::getIntImmCost;
+    unsigned getIntImmCost(const APInt &Imm, Type *Ty);
+    unsigned getIntImmCost(unsigned Opcode, unsigned Idx, const APInt &Imm,
+                           Type *Ty);
+    unsigned getIntImmCost(Intrinsic::ID IID, unsigned Idx, const APInt &Imm,
+                           Type *Ty);
+
+    TTI::PopcntSupportKind getPopcntSupport(unsigned TyWidth) {
+      return TTI::PSK_Software;
+    }
+    void getUnrollingPreferences(Loop *L, TTI::UnrollingPreferences &UP);
+
+    // There are seven 8-bit registers and no vector registers at all.
+    unsigned getNumberOfRegisters(bool Vector) { return Vector ? 0 : 7; }
+    unsigned getRegisterBitWidth(bool Vector) { return Vector ? 0 : 8; }
+    unsigned getMaxInterleaveFactor() { return 1; }
+
+    unsigned getArithmeticInstrCost(
+        unsigned Opcode, Type *Ty,
+        TTI::OperandValueKind Opd1Info = TTI::OK_AnyValue,
+        TTI::OperandValueKind Opd2Info = TTI::OK_AnyValue,
+        TTI::OperandValueProperties Opd1PropInfo = TTI::OP_None,
+        TTI::OperandValueProperties Opd2PropInfo = TTI::OP_None);
+    unsigned getCastInstrCost(unsigned Opcode, Type *Dst, Type *Src);
+    unsigned getCmpSelInstrCost(unsigned Opcode, Type *ValTy, Type *CondTy);
+    unsigned getMemoryOpCost(unsigned Opcode, Type *Src, unsigned Alignment,
+                             unsigned AddressSpace);
+  }; // end class GBZ80TTIImpl
+} // end namespace llvm
+
+#endif
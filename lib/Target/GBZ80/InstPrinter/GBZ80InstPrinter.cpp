@@ -0,0 +1,59 @@
+//===-- GBZ80InstPrinter.cpp - Convert GBZ80 MCInst to assembly syntax ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class prints a GBZ80 MCInst to a .s file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80InstPrinter.h"
+#include "GBZ80.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "asm-printer"
+
+// Include the auto-generated portion of the assembly writer.
+#include "GBZ80GenAsmWriter.inc"
+
+void GBZ80InstPrinter::printInst(const MCInst *MI, raw_ostream &O,
+  StringRef Annot)
+{
+  printInstruction(MI, O);
+  printAnnotation(O, Annot);
+}
+
+void GBZ80InstPrinter::printOperand(const MCInst *MI, unsigned OpNo,
+  raw_ostream &O)
+{
+  const MCOperand &Op = MI->getOperand(OpNo);
+  if (Op.isReg())
+    O << getRegisterName(Op.getReg());
+  else if (Op.isImm())
+    O << Op.getImm();
+  else {
+    assert(Op.isExpr() && "unknown operand kind in printOperand");
+    O << *Op.getExpr();
+  }
+}
+
+void GBZ80InstPrinter::printCCOperand(const MCInst *MI, unsigned OpNo,
+  raw_ostream &O)
+{
+  switch (MI->getOperand(OpNo).getImm())
+  {
+  default: llvm_unreachable("Unsupported CC code");
+  case GBZ80::COND_NZ: O << "nz"; break;
+  case GBZ80::COND_Z:  O << "z";  break;
+  case GBZ80::COND_NC: O << "nc"; break;
+  case GBZ80::COND_C:  O << "c";  break;
+  }
+}
@@ -0,0 +1,39 @@
+//===-- GBZ80InstPrinter.h - Convert GBZ80 MCInst to asm syntax -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class prints a GBZ80 MCInst to a .s file.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80INSTPRINTER_H
+#define GBZ80INSTPRINTER_H
+
+#include "llvm/MC/MCInstPrinter.h"
+
+namespace llvm {
+  class MCOperand;
+
+  class GBZ80InstPrinter : public MCInstPrinter {
+  public:
+    GBZ80InstPrinter(const MCAsmInfo &MAI, const MCInstrInfo &MII,
+                     const MCRegisterInfo &MRI)
+      : MCInstPrinter(MAI, MII, MRI) {}
+
+    void printInst(const MCInst *MI, raw_ostream &O, StringRef Annot) override;
+
+    // Autogenerated by tblgen.
+    void printInstruction(const MCInst *MI, raw_ostream &O);
+    static const char *getRegisterName(unsigned RegNo);
+
+    void printOperand(const MCInst *MI, unsigned OpNo, raw_ostream &O);
+    void printCCOperand(const MCInst *MI, unsigned OpNo, raw_ostream &O);
+  }; // end class GBZ80InstPrinter
+} // end namespace llvm
+
+#endif
@@ -0,0 +1,131 @@
+//===-- GBZ80AsmBackend.cpp - GBZ80 Assembler Backend ---------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/GBZ80MCTargetDesc.h"
+#include "MCTargetDesc/GBZ80FixupKinds.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCELFObjectWriter.h"
+#include "llvm/MC/MCFixupKindInfo.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+
+static cl::opt<bool>
+EmitROMImage("gbz80-rom", cl::init(false),
+  cl::desc("Link the module into a GB ROM image instead of an ELF object"));
+
+// adjustFixupValue - Turn the resolved value of a fixup into the bytes that
+// are patched into the instruction.
+static uint64_t adjustFixupValue(unsigned Kind, uint64_t Value)
+{
+  switch (Kind)
+  {
+  default:
+    llvm_unreachable("Unknown fixup kind!");
+  case FK_Data_1:
+  case GBZ80::fixup_8:
+    return Value & 0xFF;
+  case FK_Data_2:
+  case GBZ80::fixup_16:
+    return Value & 0xFFFF;
+  case GBZ80::fixup_jr_pcrel_8:
+  {
+    // The value is relative to the displacement byte, the CPU adds the
+    // displacement to the address of the next instruction.
+    int64_t Disp = (int64_t)Value - 1;
+    if (Disp < -128 || Disp > 127)
+      report_fatal_error("GBZ80: jr target out of range");
+    return Disp & 0xFF;
+  }
+  }
+}
+
+namespace {
+  class GBZ80AsmBackend : public MCAsmBackend {
+    uint8_t OSABI;
+  public:
+    GBZ80AsmBackend(const Target &T, uint8_t osABI)
+      : MCAsmBackend(), OSABI(osABI) {}
+
+    unsigned getNumFixupKinds() const override {
+      return GBZ80::NumTargetFixupKinds;
+    }
+
+    const MCFixupKindInfo &getFixupKindInfo(MCFixupKind Kind) const override {
+      const static MCFixupKindInfo Infos[GBZ80::NumTargetFixupKinds] = {
+        // name                 offset bits flags
+        { "fixup_8",            0,     8,   0 },
+        { "fixup_16",           0,     16,  0 },
+        { "fixup_jr_pcrel_8",   0,     8,   MCFixupKindInfo::FKF_IsPCRel }
+      };
+
+      if (Kind < FirstTargetFixupKind)
+        return MCAsmBackend::getFixupKindInfo(Kind);
+
+      assert(unsigned(Kind - FirstTargetFixupKind) < getNumFixupKinds() &&
+             "Invalid kind!");
+      return Infos[Kind - FirstTargetFixupKind];
+    }
+
+    void applyFixup(const MCFixup &Fixup, char *Data, unsigned DataSize,
+                    uint64_t Value, bool IsPCRel) const override {
+      unsigned NumBytes = getFixupKindInfo(Fixup.getKind()).TargetSize / 8;
+      unsigned Offset = Fixup.getOffset();
+      assert(Offset + NumBytes <= DataSize && "Invalid fixup offset!");
+
+      Value = adjustFixupValue(Fixup.getKind(), Value);
+
+      // Immediate data is little endian.
+      for (unsigned i = 0; i != NumBytes; i++)
+        Data[Offset + i] = uint8_t((Value >> (i * 8)) & 0xFF);
+    }
+
+    // The assembler never relaxes instructions, the code generator picks
+    // between jr and jp itself. Every instruction already has its final
+    // size.
+    bool mayNeedRelaxation(const MCInst &Inst) const override {
+      return false;
+    }
+
+    bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                              const MCRelaxableFragment *DF,
+                              const MCAsmLayout &Layout) const override {
+      return false;
+    }
+
+    void relaxInstruction(const MCInst &Inst, MCInst &Res) const override {
+      Res = Inst;
+    }
+
+    bool writeNopData(uint64_t Count, MCObjectWriter *OW) const override {
+      // NOP is 0x00.
+      for (uint64_t i = 0; i != Count; i++)
+        OW->Write8(0x00);
+      return true;
+    }
+
+    MCObjectWriter *createObjectWriter(raw_ostream &OS) const override {
+      if (EmitROMImage)
+        return createGBZ80ROMObjectWriter(OS);
+      return createGBZ80ELFObjectWriter(OS, OSABI);
+    }
+  };
+} // end anonymous namespace
+
+MCAsmBackend *llvm::createGBZ80AsmBackend(const Target &T,
+                                          const MCRegisterInfo &MRI,
+                                          StringRef TT, StringRef CPU)
+{
+  uint8_t OSABI = MCELFObjectTargetWriter::getOSABI(Triple(TT).getOS());
+  return new GBZ80AsmBackend(T, OSABI);
+}
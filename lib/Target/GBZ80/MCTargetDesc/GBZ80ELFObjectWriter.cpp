@@ -0,0 +1,54 @@
+//===-- GBZ80ELFObjectWriter.cpp - GBZ80 ELF Writer -----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/GBZ80MCTargetDesc.h"
+#include "MCTargetDesc/GBZ80FixupKinds.h"
+#include "llvm/MC/MCELFObjectWriter.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+
+namespace {
+  class GBZ80ELFObjectWriter : public MCELFObjectTargetWriter {
+  public:
+    GBZ80ELFObjectWriter(uint8_t OSABI)
+      : MCELFObjectTargetWriter(/*Is64Bit*/ false, OSABI, ELF::EM_Z80,
+                                /*HasRelocationAddend*/ true) {}
+
+    virtual ~GBZ80ELFObjectWriter() {}
+  protected:
+    unsigned GetRelocType(const MCValue &Target, const MCFixup &Fixup,
+                          bool IsPCRel) const override;
+  };
+} // end anonymous namespace
+
+unsigned GBZ80ELFObjectWriter::GetRelocType(const MCValue &Target,
+                                            const MCFixup &Fixup,
+                                            bool IsPCRel) const
+{
+  switch ((unsigned)Fixup.getKind())
+  {
+  default:
+    llvm_unreachable("Unimplemented fixup -> relocation");
+  case FK_Data_1:
+  case GBZ80::fixup_8:          return ELF::R_GBZ80_8;
+  case FK_Data_2:
+  case GBZ80::fixup_16:         return ELF::R_GBZ80_16;
+  case GBZ80::fixup_jr_pcrel_8: return ELF::R_GBZ80_PCREL8;
+  }
+}
+
+MCObjectWriter *llvm::createGBZ80ELFObjectWriter(raw_ostream &OS,
+                                                 uint8_t OSABI)
+{
+  MCELFObjectTargetWriter *MOTW = new GBZ80ELFObjectWriter(OSABI);
+  return createELFObjectWriter(MOTW, OS, /*IsLittleEndian=*/true);
+}
@@ -0,0 +1,35 @@
+//===-- GBZ80FixupKinds.h - GBZ80 Specific Fixup Entries --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80FIXUPKINDS_H
+#define GBZ80FIXUPKINDS_H
+
+#include "llvm/MC/MCFixup.h"
+
+namespace llvm {
+  namespace GBZ80 {
+    enum Fixups {
+      // fixup_8 - 8-bit absolute immediate, e.g. ld a, n
+      fixup_8 = FirstTargetFixupKind,
+
+      // fixup_16 - 16-bit absolute address, e.g. jp nn, call nn, ld hl, nn
+      fixup_16,
+
+      // fixup_jr_pcrel_8 - 8-bit signed displacement of jr, relative to the
+      // address of the next instruction
+      fixup_jr_pcrel_8,
+
+      // Marker
+      LastTargetFixupKind,
+      NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
+    };
+  } // end namespace GBZ80
+} // end namespace llvm
+
+#endif
@@ -0,0 +1,29 @@
+//===-- GBZ80MCAsmInfo.cpp - GBZ80 asm properties -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the declarations of the GBZ80MCAsmInfo properties.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80MCAsmInfo.h"
+#include "llvm/ADT/StringRef.h"
+using namespace llvm;
+
+void GBZ80MCAsmInfo::anchor() {}
+
+GBZ80MCAsmInfo::GBZ80MCAsmInfo(StringRef TT)
+{
+  // The stack grows by whole register pairs (push/pop move two bytes).
+  PointerSize = CalleeSaveStackSlotSize = 2;
+
+  CommentString = ";";
+
+  AlignmentIsInBytes = false;
+  UsesELFSectionDirectiveForBSS = true;
+}
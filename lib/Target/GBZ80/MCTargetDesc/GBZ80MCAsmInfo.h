@@ -0,0 +1,29 @@
+//===-- GBZ80MCAsmInfo.h - GBZ80 asm properties -----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the declaration of the GBZ80MCAsmInfo class.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef GBZ80MCASMINFO_H
+#define GBZ80MCASMINFO_H
+
+#include "llvm/MC/MCAsmInfoELF.h"
+
+namespace llvm {
+  class StringRef;
+
+  class GBZ80MCAsmInfo : public MCAsmInfoELF {
+    void anchor() override;
+  public:
+    explicit GBZ80MCAsmInfo(StringRef TT);
+  }; // end class GBZ80MCAsmInfo
+} // end namespace llvm
+
+#endif
@@ -0,0 +1,179 @@
+//===-- GBZ80MCCodeEmitter.cpp - Convert GBZ80 code to machine code -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the GBZ80MCCodeEmitter class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "GBZ80MCTargetDesc.h"
+#include "MCTargetDesc/GBZ80FixupKinds.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "mccodeemitter"
+
+STATISTIC(MCNumEmitted, "Number of MC instructions emitted");
+
+namespace {
+  class GBZ80MCCodeEmitter : public MCCodeEmitter {
+    GBZ80MCCodeEmitter(const GBZ80MCCodeEmitter &) LLVM_DELETED_FUNCTION;
+    void operator=(const GBZ80MCCodeEmitter &) LLVM_DELETED_FUNCTION;
+    const MCInstrInfo &MCII;
+    MCContext &Ctx;
+
+  public:
+    GBZ80MCCodeEmitter(const MCInstrInfo &mcii, MCContext &ctx)
+      : MCII(mcii), Ctx(ctx) {}
+
+    ~GBZ80MCCodeEmitter() {}
+
+    void EncodeInstruction(const MCInst &MI, raw_ostream &OS,
+                           SmallVectorImpl<MCFixup> &Fixups,
+                           const MCSubtargetInfo &STI) const override;
+
+    // getBinaryCodeForInstr - TableGen'erated function for getting the
+    // binary encoding for an instruction.
+    uint64_t getBinaryCodeForInstr(const MCInst &MI,
+                                   SmallVectorImpl<MCFixup> &Fixups,
+                                   const MCSubtargetInfo &STI) const;
+
+    // getMachineOpValue - Return binary encoding of operand. If the machine
+    // operand requires relocation, record the relocation and return zero.
+    unsigned getMachineOpValue(const MCInst &MI, const MCOperand &MO,
+                               SmallVectorImpl<MCFixup> &Fixups,
+                               const MCSubtargetInfo &STI) const;
+
+    // getBREncoding - Return the encoding of a jp/call target, a 16-bit
+    // absolute address.
+    unsigned getBREncoding(const MCInst &MI, unsigned OpNo,
+                           SmallVectorImpl<MCFixup> &Fixups,
+                           const MCSubtargetInfo &STI) const;
+
+    // getJREncoding - Return the encoding of a jr target, an 8-bit
+    // displacement from the next instruction.
+    unsigned getJREncoding(const MCInst &MI, unsigned OpNo,
+                           SmallVectorImpl<MCFixup> &Fixups,
+                           const MCSubtargetInfo &STI) const;
+
+  private:
+    // getImmOffset - Return the offset of the immediate data in the
+    // instruction. The immediate always follows the opcode.
+    unsigned getImmOffset(const MCInst &MI) const {
+      const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+      return (Desc.TSFlags & GBZ80II::CBPrefix) ? 2 : 1;
+    }
+
+    unsigned getExprOpValue(const MCInst &MI, const MCOperand &MO,
+                            MCFixupKind Kind,
+                            SmallVectorImpl<MCFixup> &Fixups) const;
+  };
+} // end anonymous namespace
+
+MCCodeEmitter *llvm::createGBZ80MCCodeEmitter(const MCInstrInfo &MCII,
+                                              const MCRegisterInfo &MRI,
+                                              const MCSubtargetInfo &STI,
+                                              MCContext &Ctx)
+{
+  return new GBZ80MCCodeEmitter(MCII, Ctx);
+}
+
+void GBZ80MCCodeEmitter::EncodeInstruction(const MCInst &MI, raw_ostream &OS,
+  SmallVectorImpl<MCFixup> &Fixups, const MCSubtargetInfo &STI) const
+{
+  const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+  unsigned Size = Desc.getSize();
+
+  if (Desc.isPseudo() || Size == 0)
+    report_fatal_error("GBZ80: pseudo instruction reached the code emitter");
+
+  uint64_t Bits = getBinaryCodeForInstr(MI, Fixups, STI);
+
+  if (Desc.TSFlags & GBZ80II::CBPrefix)
+  {
+    OS << (char)0xCB;
+    Size--;
+  }
+
+  // Opcode first, then the immediate data in little endian byte order.
+  for (unsigned i = 0; i != Size; i++)
+  {
+    OS << (char)(Bits & 0xFF);
+    Bits >>= 8;
+  }
+
+  ++MCNumEmitted; // Keep track of the # of mi's emitted.
+}
+
+unsigned GBZ80MCCodeEmitter::getExprOpValue(const MCInst &MI,
+  const MCOperand &MO, MCFixupKind Kind,
+  SmallVectorImpl<MCFixup> &Fixups) const
+{
+  const MCExpr *Expr = MO.getExpr();
+
+  int64_t Res;
+  if (Kind != MCFixupKind(GBZ80::fixup_jr_pcrel_8) &&
+      Expr->EvaluateAsAbsolute(Res))
+    return Res;
+
+  Fixups.push_back(MCFixup::Create(getImmOffset(MI), Expr, Kind,
+                                   MI.getLoc()));
+  return 0;
+}
+
+unsigned GBZ80MCCodeEmitter::getMachineOpValue(const MCInst &MI,
+  const MCOperand &MO, SmallVectorImpl<MCFixup> &Fixups,
+  const MCSubtargetInfo &STI) const
+{
+  if (MO.isReg())
+    return Ctx.getRegisterInfo()->getEncodingValue(MO.getReg());
+
+  if (MO.isImm())
+    return MO.getImm();
+
+  assert(MO.isExpr() && "Unknown operand kind");
+
+  // The width of the immediate follows from the instruction size: one byte
+  // of opcode and either one or two bytes of data.
+  const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+  unsigned DataSize = Desc.getSize() - getImmOffset(MI);
+  MCFixupKind Kind = MCFixupKind(DataSize == 1 ? GBZ80::fixup_8
+                                               : GBZ80::fixup_16);
+  return getExprOpValue(MI, MO, Kind, Fixups);
+}
+
+unsigned GBZ80MCCodeEmitter::getBREncoding(const MCInst &MI, unsigned OpNo,
+  SmallVectorImpl<MCFixup> &Fixups, const MCSubtargetInfo &STI) const
+{
+  const MCOperand &MO = MI.getOperand(OpNo);
+  if (MO.isReg() || MO.isImm())
+    return getMachineOpValue(MI, MO, Fixups, STI);
+
+  return getExprOpValue(MI, MO, MCFixupKind(GBZ80::fixup_16), Fixups);
+}
+
+unsigned GBZ80MCCodeEmitter::getJREncoding(const MCInst &MI, unsigned OpNo,
+  SmallVectorImpl<MCFixup> &Fixups, const MCSubtargetInfo &STI) const
+{
+  const MCOperand &MO = MI.getOperand(OpNo);
+  if (MO.isImm())
+    return MO.getImm();
+
+  return getExprOpValue(MI, MO, MCFixupKind(GBZ80::fixup_jr_pcrel_8), Fixups);
+}
+
+#include "GBZ80GenMCCodeEmitter.inc"
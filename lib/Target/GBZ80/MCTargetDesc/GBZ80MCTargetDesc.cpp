@@ -12,7 +12,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "GBZ80MCTargetDesc.h"
+#include "GBZ80MCAsmInfo.h"
+#include "InstPrinter/GBZ80InstPrinter.h"
 
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/MC/MachineLocation.h"
 #include "llvm/MC/MCCodeGenInfo.h"
 #include "llvm/MC/MCELFStreamer.h"
@@ -30,7 +33,99 @@ using namespace llvm;
 #define GET_INSTRINFO_MC_DESC
 #include "GBZ80GenInstrInfo.inc"
 
+#define GET_SUBTARGETINFO_MC_DESC
+#include "GBZ80GenSubtargetInfo.inc"
+
 #define GET_REGINFO_MC_DESC
 #include "GBZ80GenRegisterInfo.inc"
 
-extern "C" void LLVMInitializeGBZ80TargetMC() {}
+static MCInstrInfo *createGBZ80MCInstrInfo() {
+  MCInstrInfo *X = new MCInstrInfo();
+  InitGBZ80MCInstrInfo(X);
+  return X;
+}
+
+static MCRegisterInfo *createGBZ80MCRegisterInfo(StringRef TT) {
+  MCRegisterInfo *X = new MCRegisterInfo();
+  InitGBZ80MCRegisterInfo(X, GBZ80::PC);
+  return X;
+}
+
+static MCSubtargetInfo *createGBZ80MCSubtargetInfo(StringRef TT, StringRef CPU,
+                                                   StringRef FS) {
+  MCSubtargetInfo *X = new MCSubtargetInfo();
+  InitGBZ80MCSubtargetInfo(X, TT, CPU, FS);
+  return X;
+}
+
+static MCCodeGenInfo *createGBZ80MCCodeGenInfo(StringRef TT, Reloc::Model RM,
+                                               CodeModel::Model CM,
+                                               CodeGenOpt::Level OL) {
+  MCCodeGenInfo *X = new MCCodeGenInfo();
+  // Everything is linked to fixed addresses, there is no PIC.
+  if (RM == Reloc::Default)
+    RM = Reloc::Static;
+  X->InitMCCodeGenInfo(RM, CM, OL);
+  return X;
+}
+
+static MCStreamer *createMCStreamer(const Target &T, StringRef TT,
+                                    MCContext &Context, MCAsmBackend &MAB,
+                                    raw_ostream &OS, MCCodeEmitter *Emitter,
+                                    const MCSubtargetInfo &STI, bool RelaxAll) {
+  return createELFStreamer(Context, MAB, OS, Emitter, RelaxAll);
+}
+
+static MCInstPrinter *createGBZ80MCInstPrinter(const Target &T,
+                                               unsigned SyntaxVariant,
+                                               const MCAsmInfo &MAI,
+                                               const MCInstrInfo &MII,
+                                               const MCRegisterInfo &MRI,
+                                               const MCSubtargetInfo &STI) {
+  if (SyntaxVariant == 0)
+    return new GBZ80InstPrinter(MAI, MII, MRI);
+  return nullptr;
+}
+
+uint64_t llvm::getGBZ80InterruptVector(StringRef Name) {
+  return StringSwitch<uint64_t>(Name)
+    .Case("vblank", 0x40)
+    .Case("stat",   0x48)
+    .Case("timer",  0x50)
+    .Case("serial", 0x58)
+    .Case("joypad", 0x60)
+    .Default(0);
+}
+
+extern "C" void LLVMInitializeGBZ80TargetMC() {
+  // Register the MC asm info.
+  RegisterMCAsmInfo<GBZ80MCAsmInfo> X(TheGBZ80Target);
+
+  // Register the MC codegen info.
+  TargetRegistry::RegisterMCCodeGenInfo(TheGBZ80Target,
+                                        createGBZ80MCCodeGenInfo);
+
+  // Register the MC instruction info.
+  TargetRegistry::RegisterMCInstrInfo(TheGBZ80Target, createGBZ80MCInstrInfo);
+
+  // Register the MC register info.
+  TargetRegistry::RegisterMCRegInfo(TheGBZ80Target, createGBZ80MCRegisterInfo);
+
+  // Register the MC subtarget info.
+  TargetRegistry::RegisterMCSubtargetInfo(TheGBZ80Target,
+                                          createGBZ80MCSubtargetInfo);
+
+  // Register the MCInstPrinter.
+  TargetRegistry::RegisterMCInstPrinter(TheGBZ80Target,
+                                        createGBZ80MCInstPrinter);
+
+  // Register the MC Code Emitter.
+  TargetRegistry::RegisterMCCodeEmitter(TheGBZ80Target,
+                                        createGBZ80MCCodeEmitter);
+
+  // Register the asm backend.
+  TargetRegistry::RegisterMCAsmBackend(TheGBZ80Target, createGBZ80AsmBackend);
+
+  // Register the object streamer.
+  TargetRegistry::RegisterMCObjectStreamer(TheGBZ80Target, createMCStreamer);
+}
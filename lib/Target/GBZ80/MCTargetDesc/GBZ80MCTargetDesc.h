@@ -17,9 +17,48 @@
 #include "llvm/Support/DataTypes.h"
 
 namespace llvm {
+    class MCAsmBackend;
+    class MCCodeEmitter;
+    class MCContext;
+    class MCInstrInfo;
+    class MCObjectWriter;
+    class MCRegisterInfo;
+    class MCSubtargetInfo;
+    class StringRef;
     class Target;
+    class raw_ostream;
 
     extern Target TheGBZ80Target;
+
+    MCCodeEmitter *createGBZ80MCCodeEmitter(const MCInstrInfo &MCII,
+                                            const MCRegisterInfo &MRI,
+                                            const MCSubtargetInfo &STI,
+                                            MCContext &Ctx);
+
+    MCAsmBackend *createGBZ80AsmBackend(const Target &T,
+                                        const MCRegisterInfo &MRI,
+                                        StringRef TT, StringRef CPU);
+
+    MCObjectWriter *createGBZ80ELFObjectWriter(raw_ostream &OS,
+                                               uint8_t OSABI);
+
+    MCObjectWriter *createGBZ80ROMObjectWriter(raw_ostream &OS);
+
+    // getGBZ80InterruptVector - Returns the address of the vector of the
+    // interrupt Name, one of "vblank", "stat", "timer", "serial" and
+    // "joypad", or 0 if there is no such interrupt. A handler with the
+    // "interrupt"="Name" attribute also gets the label __gbz80_isr_Name,
+    // which the ROM image writer points the vector to.
+    uint64_t getGBZ80InterruptVector(StringRef Name);
+
+    // Target specific flags of the instruction descriptors, see TSFlags in
+    // GBZ80InstrFormats.td.
+    namespace GBZ80II {
+      enum {
+        // The instruction is prefixed by 0xCB.
+        CBPrefix = 1 << 0
+      };
+    } // end namespace GBZ80II
 }
 
 #define GET_REGINFO_ENUM
@@ -28,4 +67,7 @@ namespace llvm {
 #define GET_INSTRINFO_ENUM
 #include "GBZ80GenInstrInfo.inc"
 
+#define GET_SUBTARGETINFO_ENUM
+#include "GBZ80GenSubtargetInfo.inc"
+
 #endif // GBZ80MCTARGETDESC_H
@@ -0,0 +1,1060 @@
+//===-- GBZ80ROMObjectWriter.cpp - GBZ80 ROM image writer -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements an object writer which links the module into a GB
+// cartridge image instead of writing a relocatable object.
+//
+// The cartridge ROM is made of 16 KiB banks. Bank 0 is always mapped at
+// 0x0000-0x3FFF, one of the other banks is mapped at 0x4000-0x7FFF by writing
+// its number to the MBC register at 0x2000. The image is laid out as follows:
+//
+//  - Bank 0 holds the interrupt vectors, the cartridge header, a startup
+//    routine, all read-only data, the interrupt handlers and the functions
+//    they call, the initial contents of the writable data and the far-call
+//    trampolines.
+//  - If everything fits into 32 KiB there is no bank switching at all, the
+//    code simply follows bank 0 and the cartridge has no MBC.
+//  - Otherwise code sections are packed into the switchable banks. Sections
+//    which reference each other are put into the same bank where possible,
+//    so that hot call chains do not switch banks.
+//  - Writable data lives in work RAM at 0xC000 and is copied from bank 0 by
+//    the startup routine, which then calls main.
+//  - Sections named .hram are placed into the high RAM at 0xFF80, where they
+//    are reached with ldh. Their initial contents are copied from bank 0 as
+//    well.
+//
+// A function in a switchable bank which is referenced from another bank is
+// reached through a trampoline in bank 0. The trampoline moves the return
+// address and the bank of the caller to a side stack in work RAM, maps the
+// bank of the callee and calls it, so that stack arguments are found where
+// the callee expects them. Then it maps the bank of the caller back and
+// returns to it. Registers are preserved on the way in and out, except F.
+// The side stack is a ring of 256 bytes, far calls may nest 85 deep.
+//
+// Interrupt handlers run with any bank mapped and must not use the side
+// stack the code they interrupt may be using, the functions they call are
+// kept in bank 0 with them.
+//
+// The vector of an interrupt jumps to the function with the matching
+// "interrupt" attribute, see getGBZ80InterruptVector. Interrupts without a
+// handler return right away.
+//
+// Use -function-sections so that functions can be packed individually.
+//
+// With -gbz80-rom-symbols the writer also lists the code symbols of the image
+// in a text file, one "bank:address size name" line each in hexadecimal,
+// sorted by bank and address. llvm-gbz80-sim uses it to attribute cycles to
+// functions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/GBZ80MCTargetDesc.h"
+#include "MCTargetDesc/GBZ80FixupKinds.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/MC/MCAsmLayout.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCELF.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCSectionELF.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ELF.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+ROMTitle("gbz80-rom-title", cl::init(""),
+  cl::desc("Title written into the cartridge header (at most 16 characters)"));
+
+static cl::opt<std::string>
+ROMSymbols("gbz80-rom-symbols", cl::init(""), cl::value_desc("filename"),
+  cl::desc("Write the addresses and sizes of the code symbols of the ROM "
+           "image to this file"));
+
+namespace {
+  // Memory map.
+  const uint64_t BankSize      = 0x4000;
+  const uint64_t BankedBase    = 0x4000;
+  const uint64_t MaxBanks      = 256;
+  const uint64_t StartupBase   = 0x0150;
+  const uint64_t RAMBase       = 0xC000;
+  const uint64_t RAMEnd        = 0xE000;
+  const uint64_t StackReserve  = 0x0100;
+  const uint64_t MBCBankSelect = 0x2000;
+  const uint64_t HRAMBase      = 0xFF80;
+  const uint64_t HRAMEnd       = 0xFFFF;
+
+  // Work RAM used by the trampolines: the number of the mapped bank and a
+  // scratch byte to carry A across the bank switch. A banked image also
+  // keeps the side stack of the far calls in the page below the stack, and
+  // the low byte of its pointer right before it.
+  const uint64_t CurBankAddr   = RAMBase;
+  const uint64_t ScratchAddr   = RAMBase + 1;
+  const uint64_t RAMDataBase   = RAMBase + 2;
+  const uint64_t SideStackBase = RAMEnd - StackReserve - 0x100;
+  const uint64_t SideSPAddr    = SideStackBase - 1;
+
+  const unsigned StartupSize    = 69;
+  const unsigned FarEnterSize   = 52;
+  const unsigned FarLeaveSize   = 39;
+  const unsigned TrampolineSize = 14;
+
+  const uint8_t NintendoLogo[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B,
+    0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+    0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC,
+    0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+  };
+
+  struct ROMSection {
+    // Handler is code that runs with any bank mapped, the sections of the
+    // interrupt handlers and of the functions they call.
+    enum SectionKind { Code, Handler, ROData, Data, BSS, HRAM };
+
+    const MCSectionData *SD;
+    SectionKind Kind;
+    uint64_t Size;
+    unsigned Align;
+    std::string Contents;
+
+    // ROM bank of Code and ROData sections, 0 for RAM sections.
+    unsigned Bank;
+    // Run-time address.
+    uint64_t Address;
+    // Offset of the contents in the image, -1 for BSS.
+    int64_t ImageOffset;
+  };
+
+  struct ROMReloc {
+    const MCSectionData *SD;
+    uint64_t Offset;
+    const MCSymbol *Symbol;
+    int64_t Addend;
+    unsigned Kind;
+  };
+
+  // The assembler writes the section contents through the stream of the
+  // object writer. This collects them so that they can be placed into banks
+  // before the image is written to the real output stream.
+  struct SectionBuffer {
+    SmallVector<char, 4096> Data;
+    raw_svector_ostream BufferOS;
+    SectionBuffer() : BufferOS(Data) {}
+  };
+
+  class GBZ80ROMObjectWriter : private SectionBuffer, public MCObjectWriter {
+    raw_ostream &ImageOS;
+
+    std::vector<ROMSection> Sections;
+    DenseMap<const MCSectionData *, unsigned> SectionIndex;
+    std::vector<ROMReloc> Relocs;
+    DenseMap<const MCSymbol *, uint64_t> CommonAddress;
+    DenseMap<const MCSymbol *, uint64_t> Trampolines;
+    std::vector<const MCSymbol *> TrampolineOrder;
+    std::vector<uint8_t> Image;
+    uint64_t FarEnter, FarLeave;
+    bool Banked;
+
+  public:
+    GBZ80ROMObjectWriter(raw_ostream &OS)
+      : MCObjectWriter(BufferOS, /*IsLittleEndian*/ true), ImageOS(OS),
+        FarEnter(0), FarLeave(0), Banked(false) {}
+
+    void ExecutePostLayoutBinding(MCAssembler &Asm,
+                                  const MCAsmLayout &Layout) override {}
+
+    void RecordRelocation(MCAssembler &Asm, const MCAsmLayout &Layout,
+                          const MCFragment *Fragment, const MCFixup &Fixup,
+                          MCValue Target, bool &IsPCRel,
+                          uint64_t &FixedValue) override;
+
+    void WriteObject(MCAssembler &Asm, const MCAsmLayout &Layout) override;
+
+  private:
+    void collectSections(MCAssembler &Asm, const MCAsmLayout &Layout);
+    void placeRAM(MCAssembler &Asm, uint64_t &DataSize, uint64_t &BSSStart,
+                  uint64_t &BSSSize);
+    uint64_t placeHRAM();
+    uint64_t placeBank0(uint64_t DataSize, uint64_t HRAMSize,
+                        uint64_t &DataLoad, uint64_t &HRAMLoad);
+    bool placeFlat(uint64_t Bank0End);
+    unsigned packBanks(MCAssembler &Asm);
+    void addTrampoline(MCAssembler &Asm, const MCSymbol &Sym,
+                       unsigned FromBank);
+
+    int getSymbolSection(MCAssembler &Asm, const MCSymbol &Sym) const;
+    bool isFunction(MCAssembler &Asm, const MCSymbol &Sym) const;
+    unsigned getSymbolBank(MCAssembler &Asm, const MCSymbol &Sym) const;
+    uint64_t getSymbolAddress(MCAssembler &Asm, const MCAsmLayout &Layout,
+                              const MCSymbol &Sym) const;
+    uint64_t getReferenceAddress(MCAssembler &Asm, const MCAsmLayout &Layout,
+                                 const MCSymbol &Sym, unsigned FromBank) const;
+
+    void writeHeader(unsigned NumBanks);
+    void writeVectors(MCAssembler &Asm, const MCAsmLayout &Layout);
+    void writeStartup(uint64_t DataLoad, uint64_t DataSize, uint64_t BSSStart,
+                      uint64_t BSSSize, uint64_t HRAMLoad, uint64_t HRAMSize,
+                      uint64_t Main);
+    void writeFarCall();
+    void writeTrampoline(uint64_t Offset, unsigned Bank, uint64_t Target);
+    void applyRelocs(MCAssembler &Asm, const MCAsmLayout &Layout);
+    void writeChecksums();
+    void writeSymbols(MCAssembler &Asm, const MCAsmLayout &Layout);
+
+    void put8(uint64_t Offset, uint8_t Value) { Image[Offset] = Value; }
+    void put16(uint64_t Offset, uint64_t Value) {
+      Image[Offset] = Value & 0xFF;
+      Image[Offset + 1] = (Value >> 8) & 0xFF;
+    }
+  };
+} // end anonymous namespace
+
+static uint64_t alignTo(uint64_t Value, unsigned Align)
+{
+  if (Align <= 1)
+    return Value;
+  return (Value + Align - 1) / Align * Align;
+}
+
+void GBZ80ROMObjectWriter::RecordRelocation(MCAssembler &Asm,
+  const MCAsmLayout &Layout, const MCFragment *Fragment, const MCFixup &Fixup,
+  MCValue Target, bool &IsPCRel, uint64_t &FixedValue)
+{
+  if (Target.getSymB())
+    report_fatal_error("GBZ80: symbol differences are not supported in a "
+                       "ROM image");
+
+  ROMReloc R;
+  R.SD = Fragment->getParent();
+  R.Offset = Layout.getFragmentOffset(Fragment) + Fixup.getOffset();
+  R.Symbol = Target.getSymA() ? &Target.getSymA()->getSymbol() : nullptr;
+  R.Addend = Target.getConstant();
+  R.Kind = Fixup.getKind();
+  Relocs.push_back(R);
+
+  // The value is patched into the image once all addresses are known.
+  FixedValue = 0;
+}
+
+void GBZ80ROMObjectWriter::collectSections(MCAssembler &Asm,
+  const MCAsmLayout &Layout)
+{
+  for (MCAssembler::const_iterator it = Asm.begin(), ie = Asm.end();
+       it != ie; ++it)
+  {
+    const MCSectionELF &Section =
+      static_cast<const MCSectionELF &>(it->getSection());
+    unsigned Flags = Section.getFlags();
+
+    // Debug info and the like are not part of the image.
+    if (!(Flags & ELF::SHF_ALLOC))
+      continue;
+
+    ROMSection S;
+    S.SD = &*it;
+    S.Size = Layout.getSectionAddressSize(&*it);
+    S.Align = it->getAlignment();
+    S.Bank = 0;
+    S.Address = 0;
+    S.ImageOffset = -1;
+
+    if (Section.getSectionName().startswith(".hram"))
+      S.Kind = ROMSection::HRAM;
+    else if (Flags & ELF::SHF_EXECINSTR)
+      S.Kind = ROMSection::Code;
+    else if (!(Flags & ELF::SHF_WRITE))
+      S.Kind = ROMSection::ROData;
+    else if (Section.getType() == ELF::SHT_NOBITS)
+      S.Kind = ROMSection::BSS;
+    else
+      S.Kind = ROMSection::Data;
+
+    if (Section.getType() != ELF::SHT_NOBITS)
+    {
+      uint64_t Start = BufferOS.tell();
+      Asm.writeSectionData(&*it, Layout);
+      S.Contents = BufferOS.str().substr(Start);
+    }
+
+    SectionIndex[&*it] = Sections.size();
+    Sections.push_back(S);
+  }
+
+  for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
+       ie = Asm.symbol_end(); it != ie; ++it)
+  {
+    const MCSymbol &Sym = it->getSymbol();
+    if (!Sym.getName().startswith("__gbz80_isr_"))
+      continue;
+    int Idx = getSymbolSection(Asm, Sym);
+    if (Idx >= 0 && Sections[Idx].Kind == ROMSection::Code)
+      Sections[Idx].Kind = ROMSection::Handler;
+  }
+
+  // So are the functions the handlers call, up to the leaves. A handler
+  // cannot go through a trampoline, it would overwrite the scratch byte and
+  // the side stack of the trampoline it interrupts.
+  for (bool Changed = true; Changed; )
+  {
+    Changed = false;
+    for (unsigned i = 0, e = Relocs.size(); i != e; ++i)
+    {
+      const ROMReloc &R = Relocs[i];
+      DenseMap<const MCSectionData *, unsigned>::const_iterator From =
+        SectionIndex.find(R.SD);
+      if (From == SectionIndex.end() || !R.Symbol ||
+          Sections[From->second].Kind != ROMSection::Handler ||
+          !isFunction(Asm, *R.Symbol))
+        continue;
+      int To = getSymbolSection(Asm, *R.Symbol);
+      if (To >= 0 && Sections[To].Kind == ROMSection::Code)
+      {
+        Sections[To].Kind = ROMSection::Handler;
+        Changed = true;
+      }
+    }
+  }
+}
+
+void GBZ80ROMObjectWriter::placeRAM(MCAssembler &Asm, uint64_t &DataSize,
+  uint64_t &BSSStart, uint64_t &BSSSize)
+{
+  uint64_t Addr = RAMDataBase;
+
+  // Initialized data first, so that it can be copied in one go.
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind != ROMSection::Data)
+      continue;
+    Addr = alignTo(Addr, S.Align);
+    S.Address = Addr;
+    Addr += S.Size;
+  }
+  DataSize = Addr - RAMDataBase;
+  BSSStart = Addr;
+
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind != ROMSection::BSS)
+      continue;
+    Addr = alignTo(Addr, S.Align);
+    S.Address = Addr;
+    Addr += S.Size;
+  }
+
+  for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
+       ie = Asm.symbol_end(); it != ie; ++it)
+  {
+    if (!it->isCommon())
+      continue;
+    Addr = alignTo(Addr, it->getCommonAlignment());
+    CommonAddress[&it->getSymbol()] = Addr;
+    Addr += it->getCommonSize();
+  }
+  BSSSize = Addr - BSSStart;
+
+  if (Addr > RAMEnd - StackReserve)
+    report_fatal_error("GBZ80: writable data does not fit into work RAM");
+}
+
+uint64_t GBZ80ROMObjectWriter::placeHRAM()
+{
+  uint64_t Addr = HRAMBase;
+
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind != ROMSection::HRAM)
+      continue;
+    Addr = alignTo(Addr, S.Align);
+    S.Address = Addr;
+    Addr += S.Size;
+  }
+
+  // 0xFFFF is the interrupt enable register.
+  if (Addr > HRAMEnd)
+    report_fatal_error("GBZ80: .hram data does not fit into high RAM");
+  return Addr - HRAMBase;
+}
+
+uint64_t GBZ80ROMObjectWriter::placeBank0(uint64_t DataSize,
+  uint64_t HRAMSize, uint64_t &DataLoad, uint64_t &HRAMLoad)
+{
+  uint64_t Addr = StartupBase + StartupSize;
+
+  // Read-only data stays in bank 0, it can be read from any bank, and so do
+  // the interrupt handlers.
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind != ROMSection::ROData && S.Kind != ROMSection::Handler)
+      continue;
+    Addr = alignTo(Addr, S.Align);
+    S.Address = S.ImageOffset = Addr;
+    Addr += S.Size;
+  }
+
+  // The initial contents of the writable data mirror its layout in RAM.
+  DataLoad = Addr;
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind == ROMSection::Data)
+      S.ImageOffset = DataLoad + (S.Address - RAMDataBase);
+  }
+
+  // Followed by the high RAM, zero filled sections included.
+  HRAMLoad = DataLoad + DataSize;
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind == ROMSection::HRAM)
+      S.ImageOffset = HRAMLoad + (S.Address - HRAMBase);
+  }
+  return HRAMLoad + HRAMSize;
+}
+
+bool GBZ80ROMObjectWriter::placeFlat(uint64_t Bank0End)
+{
+  uint64_t Addr = Bank0End;
+
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    ROMSection &S = Sections[i];
+    if (S.Kind != ROMSection::Code)
+      continue;
+    Addr = alignTo(Addr, S.Align);
+    S.Address = S.ImageOffset = Addr;
+    S.Bank = Addr / BankSize;
+    Addr += S.Size;
+  }
+  return Addr <= 2 * BankSize;
+}
+
+unsigned GBZ80ROMObjectWriter::packBanks(MCAssembler &Asm)
+{
+  // The affinity of two code sections is the number of references between
+  // them. Sections with a high affinity are packed into the same bank.
+  std::vector<std::map<unsigned, unsigned> > Affinity(Sections.size());
+  std::vector<unsigned> Unplaced;
+
+  for (unsigned i = 0, e = Relocs.size(); i != e; ++i)
+  {
+    const ROMReloc &R = Relocs[i];
+    DenseMap<const MCSectionData *, unsigned>::const_iterator From =
+      SectionIndex.find(R.SD);
+    if (From == SectionIndex.end() || !R.Symbol)
+      continue;
+    int To = getSymbolSection(Asm, *R.Symbol);
+    if (To < 0 || (unsigned)To == From->second ||
+        Sections[To].Kind != ROMSection::Code ||
+        Sections[From->second].Kind != ROMSection::Code)
+      continue;
+    Affinity[From->second][To]++;
+    Affinity[To][From->second]++;
+  }
+
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    if (Sections[i].Kind != ROMSection::Code)
+      continue;
+    if (Sections[i].Size > BankSize)
+      report_fatal_error("GBZ80: code section does not fit into a ROM bank");
+    Unplaced.push_back(i);
+  }
+
+  // Largest sections first, they are the hardest to fit. This also makes the
+  // largest unplaced section the seed of every new bank.
+  std::stable_sort(Unplaced.begin(), Unplaced.end(),
+    [this](unsigned A, unsigned B) {
+      return Sections[A].Size > Sections[B].Size;
+    });
+
+  unsigned Bank = 0;
+  while (!Unplaced.empty())
+  {
+    std::vector<unsigned> InBank;
+    uint64_t Used = 0;
+    Bank++;
+
+    for (;;)
+    {
+      int Best = -1;
+      unsigned BestWeight = 0;
+
+      for (unsigned i = 0, e = Unplaced.size(); i != e; ++i)
+      {
+        const ROMSection &S = Sections[Unplaced[i]];
+        if (alignTo(Used, S.Align) + S.Size > BankSize)
+          continue;
+
+        unsigned Weight = 0;
+        for (unsigned j = 0, je = InBank.size(); j != je; ++j)
+        {
+          std::map<unsigned, unsigned>::const_iterator It =
+            Affinity[Unplaced[i]].find(InBank[j]);
+          if (It != Affinity[Unplaced[i]].end())
+            Weight += It->second;
+        }
+        if (Best < 0 || Weight > BestWeight)
+        {
+          Best = i;
+          BestWeight = Weight;
+        }
+      }
+      if (Best < 0)
+        break;
+
+      ROMSection &S = Sections[Unplaced[Best]];
+      Used = alignTo(Used, S.Align);
+      S.Bank = Bank;
+      S.Address = BankedBase + Used;
+      S.ImageOffset = Bank * BankSize + Used;
+      Used += S.Size;
+
+      InBank.push_back(Unplaced[Best]);
+      Unplaced.erase(Unplaced.begin() + Best);
+    }
+  }
+  return Bank + 1;
+}
+
+void GBZ80ROMObjectWriter::addTrampoline(MCAssembler &Asm,
+  const MCSymbol &Sym, unsigned FromBank)
+{
+  if (!isFunction(Asm, Sym))
+    return;
+  unsigned Bank = getSymbolBank(Asm, Sym);
+  if (Bank == 0 || Bank == FromBank || Trampolines.count(&Sym))
+    return;
+  Trampolines[&Sym] = 0;
+  TrampolineOrder.push_back(&Sym);
+}
+
+int GBZ80ROMObjectWriter::getSymbolSection(MCAssembler &Asm,
+  const MCSymbol &Sym) const
+{
+  if (!Sym.isInSection() || Sym.isVariable())
+    return -1;
+  DenseMap<const MCSectionData *, unsigned>::const_iterator It =
+    SectionIndex.find(&Asm.getSectionData(Sym.getSection()));
+  if (It == SectionIndex.end())
+    return -1;
+  return It->second;
+}
+
+bool GBZ80ROMObjectWriter::isFunction(MCAssembler &Asm,
+  const MCSymbol &Sym) const
+{
+  return MCELF::GetType(Asm.getSymbolData(Sym)) == ELF::STT_FUNC;
+}
+
+unsigned GBZ80ROMObjectWriter::getSymbolBank(MCAssembler &Asm,
+  const MCSymbol &Sym) const
+{
+  int Idx = getSymbolSection(Asm, Sym);
+  return Idx < 0 ? 0 : Sections[Idx].Bank;
+}
+
+uint64_t GBZ80ROMObjectWriter::getSymbolAddress(MCAssembler &Asm,
+  const MCAsmLayout &Layout, const MCSymbol &Sym) const
+{
+  if (Sym.isVariable())
+  {
+    int64_t Res;
+    if (!Sym.getVariableValue()->EvaluateAsAbsolute(Res, Layout))
+      report_fatal_error("GBZ80: cannot evaluate symbol '" + Sym.getName() +
+                         "' in a ROM image");
+    return Res;
+  }
+
+  const MCSymbolData &SD = Asm.getSymbolData(Sym);
+  if (SD.isCommon())
+    return CommonAddress.lookup(&Sym);
+  if (Sym.isUndefined())
+    report_fatal_error("GBZ80: undefined symbol '" + Sym.getName() +
+                       "' in a ROM image");
+
+  int Idx = getSymbolSection(Asm, Sym);
+  if (Idx < 0)
+    report_fatal_error("GBZ80: symbol '" + Sym.getName() +
+                       "' is not in a ROM image section");
+  return Sections[Idx].Address + Layout.getSymbolOffset(&SD);
+}
+
+uint64_t GBZ80ROMObjectWriter::getReferenceAddress(MCAssembler &Asm,
+  const MCAsmLayout &Layout, const MCSymbol &Sym, unsigned FromBank) const
+{
+  if (Banked)
+  {
+    DenseMap<const MCSymbol *, uint64_t>::const_iterator It =
+      Trampolines.find(&Sym);
+    if (It != Trampolines.end() && getSymbolBank(Asm, Sym) != FromBank)
+      return It->second;
+  }
+  return getSymbolAddress(Asm, Layout, Sym);
+}
+
+void GBZ80ROMObjectWriter::writeHeader(unsigned NumBanks)
+{
+  // Interrupts return immediately unless the program installs handlers.
+  for (uint64_t Vector = 0x40; Vector <= 0x60; Vector += 8)
+    put8(Vector, 0xD9);                         // reti
+
+  // Entry point: nop; jp startup
+  put8(0x100, 0x00);
+  put8(0x101, 0xC3);
+  put16(0x102, StartupBase);
+
+  std::copy(NintendoLogo, NintendoLogo + sizeof(NintendoLogo),
+            Image.begin() + 0x104);
+
+  std::string Title = ROMTitle.substr(0, 16);
+  std::copy(Title.begin(), Title.end(), Image.begin() + 0x134);
+
+  // Cartridge type: ROM only or MBC5.
+  put8(0x147, Banked ? 0x19 : 0x00);
+
+  // ROM size, 32 KiB << N.
+  unsigned SizeCode = 0;
+  while ((2u << SizeCode) < NumBanks)
+    SizeCode++;
+  put8(0x148, SizeCode);
+
+  // Non-Japanese destination.
+  put8(0x14A, 0x01);
+}
+
+void GBZ80ROMObjectWriter::writeVectors(MCAssembler &Asm,
+  const MCAsmLayout &Layout)
+{
+  for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
+       ie = Asm.symbol_end(); it != ie; ++it)
+  {
+    const MCSymbol &Sym = it->getSymbol();
+    StringRef Name = Sym.getName();
+    if (!Name.startswith("__gbz80_isr_") || Sym.isUndefined())
+      continue;
+    uint64_t Vector = getGBZ80InterruptVector(Name.substr(12));
+    if (!Vector)
+      continue;
+    put8(Vector, 0xC3);                           // jp handler
+    put16(Vector + 1, getSymbolAddress(Asm, Layout, Sym));
+  }
+}
+
+void GBZ80ROMObjectWriter::writeStartup(uint64_t DataLoad, uint64_t DataSize,
+  uint64_t BSSStart, uint64_t BSSSize, uint64_t HRAMLoad, uint64_t HRAMSize,
+  uint64_t Main)
+{
+  static const uint8_t Startup[StartupSize] = {
+    0xF3,                   //       di
+    0x31, 0x00, 0xE0,       //       ld sp, 0xE000
+    0x3E, 0x01,             //       ld a, 1
+    0xEA, 0x00, 0x00,       //       ld (CurBank), a
+    0xEA, 0x00, 0x00,       //       ld (MBCBankSelect), a
+    0x21, 0x00, 0x00,       //       ld hl, DataLoad
+    0x11, 0x00, 0x00,       //       ld de, DataStart
+    0x01, 0x00, 0x00,       //       ld bc, DataSize
+    0x78,                   // copy: ld a, b
+    0xB1,                   //       or c
+    0x28, 0x06,             //       jr z, clear
+    0x2A,                   //       ld a, (hl+)
+    0x12,                   //       ld (de), a
+    0x13,                   //       inc de
+    0x0B,                   //       dec bc
+    0x18, 0xF6,             //       jr copy
+    0x21, 0x00, 0x00,       // clear: ld hl, BSSStart
+    0x01, 0x00, 0x00,       //       ld bc, BSSSize
+    0x78,                   // zero: ld a, b
+    0xB1,                   //       or c
+    0x28, 0x05,             //       jr z, hram
+    0xAF,                   //       xor a
+    0x22,                   //       ld (hl+), a
+    0x0B,                   //       dec bc
+    0x18, 0xF7,             //       jr zero
+    0x21, 0x00, 0x00,       // hram: ld hl, HRAMLoad
+    0x0E, 0x80,             //       ld c, HRAMBase & 0xFF
+    0x06, 0x00,             //       ld b, HRAMSize
+    0x78,                   // high: ld a, b
+    0xB7,                   //       or a
+    0x28, 0x06,             //       jr z, done
+    0x2A,                   //       ld a, (hl+)
+    0xE2,                   //       ld (c), a
+    0x0C,                   //       inc c
+    0x05,                   //       dec b
+    0x18, 0xF6,             //       jr high
+    0xCD, 0x00, 0x00,       // done: call main
+    0x76,                   // halt: halt
+    0x18, 0xFD              //       jr halt
+  };
+
+  std::copy(Startup, Startup + StartupSize, Image.begin() + StartupBase);
+  put16(StartupBase + 7, CurBankAddr);
+  put16(StartupBase + 10, MBCBankSelect);
+  put16(StartupBase + 13, DataLoad);
+  put16(StartupBase + 16, RAMDataBase);
+  put16(StartupBase + 19, DataSize);
+  put16(StartupBase + 32, BSSStart);
+  put16(StartupBase + 35, BSSSize);
+  put16(StartupBase + 47, HRAMLoad);
+  put8(StartupBase + 52, HRAMSize);
+  put16(StartupBase + 64, Main);
+}
+
+// writeFarCall - The two halves of a far call shared by the trampolines.
+// __gbz80_far_enter is called by a trampoline with the bank of the callee in
+// A and the A of the caller in the scratch byte. It pushes the bank and the
+// return address of the caller onto the side stack, drops the return address
+// from the stack and maps the bank of the callee. __gbz80_far_leave is jumped
+// to once the callee returned, it pops both and returns to the caller.
+void GBZ80ROMObjectWriter::writeFarCall()
+{
+  static const uint8_t Enter[FarEnterSize] = {
+    0xE5,                   // push hl
+    0xD5,                   // push de
+    0x57,                   // ld d, a
+    0xFA, 0x00, 0x00,       // ld a, (SideSP)
+    0x6F,                   // ld l, a
+    0x26, 0x00,             // ld h, SideStack >> 8
+    0xFA, 0x00, 0x00,       // ld a, (CurBank)
+    0x77,                   // ld (hl), a
+    0x2C,                   // inc l
+    0x7A,                   // ld a, d
+    0xEA, 0x00, 0x00,       // ld (CurBank), a
+    0xEA, 0x00, 0x00,       // ld (MBCBankSelect), a
+    0x54,                   // ld d, h
+    0x5D,                   // ld e, l
+    0xF8, 0x06,             // ld hl, sp+6              ; return address
+    0x2A,                   // ld a, (hl+)
+    0x12,                   // ld (de), a
+    0x1C,                   // inc e
+    0x7E,                   // ld a, (hl)
+    0x12,                   // ld (de), a
+    0x1C,                   // inc e
+    0x7B,                   // ld a, e
+    0xEA, 0x00, 0x00,       // ld (SideSP), a
+    0x2B,                   // dec hl
+    0x2B,                   // dec hl
+    0x3A,                   // ld a, (hl-)              ; trampoline
+    0x5E,                   // ld e, (hl)
+    0x23,                   // inc hl
+    0x23,                   // inc hl
+    0x73,                   // ld (hl), e
+    0x23,                   // inc hl
+    0x77,                   // ld (hl), a
+    0xD1,                   // pop de
+    0xE1,                   // pop hl
+    0xE8, 0x02,             // add sp, 2
+    0xFA, 0x00, 0x00,       // ld a, (Scratch)
+    0xC9                    // ret
+  };
+  static const uint8_t Leave[FarLeaveSize] = {
+    0xEA, 0x00, 0x00,       // ld (Scratch), a
+    0xF5,                   // push af                  ; return address
+    0xE5,                   // push hl
+    0xD5,                   // push de
+    0xFA, 0x00, 0x00,       // ld a, (SideSP)
+    0x6F,                   // ld l, a
+    0x26, 0x00,             // ld h, SideStack >> 8
+    0x2D,                   // dec l
+    0x56,                   // ld d, (hl)
+    0x2D,                   // dec l
+    0x5E,                   // ld e, (hl)
+    0x2D,                   // dec l
+    0x7D,                   // ld a, l
+    0xEA, 0x00, 0x00,       // ld (SideSP), a
+    0x7E,                   // ld a, (hl)
+    0xEA, 0x00, 0x00,       // ld (CurBank), a
+    0xEA, 0x00, 0x00,       // ld (MBCBankSelect), a
+    0xF8, 0x04,             // ld hl, sp+4
+    0x73,                   // ld (hl), e
+    0x23,                   // inc hl
+    0x72,                   // ld (hl), d
+    0xD1,                   // pop de
+    0xE1,                   // pop hl
+    0xFA, 0x00, 0x00,       // ld a, (Scratch)
+    0xC9                    // ret
+  };
+
+  std::copy(Enter, Enter + FarEnterSize, Image.begin() + FarEnter);
+  put16(FarEnter + 4, SideSPAddr);
+  put8(FarEnter + 8, SideStackBase >> 8);
+  put16(FarEnter + 10, CurBankAddr);
+  put16(FarEnter + 16, CurBankAddr);
+  put16(FarEnter + 19, MBCBankSelect);
+  put16(FarEnter + 33, SideSPAddr);
+  put16(FarEnter + 49, ScratchAddr);
+
+  std::copy(Leave, Leave + FarLeaveSize, Image.begin() + FarLeave);
+  put16(FarLeave + 1, ScratchAddr);
+  put16(FarLeave + 7, SideSPAddr);
+  put8(FarLeave + 11, SideStackBase >> 8);
+  put16(FarLeave + 19, SideSPAddr);
+  put16(FarLeave + 23, CurBankAddr);
+  put16(FarLeave + 26, MBCBankSelect);
+  put16(FarLeave + 36, ScratchAddr);
+}
+
+void GBZ80ROMObjectWriter::writeTrampoline(uint64_t Offset, unsigned Bank,
+  uint64_t Target)
+{
+  static const uint8_t Trampoline[TrampolineSize] = {
+    0xEA, 0x00, 0x00,       // ld (Scratch), a
+    0x3E, 0x00,             // ld a, Bank
+    0xCD, 0x00, 0x00,       // call __gbz80_far_enter
+    0xCD, 0x00, 0x00,       // call Target
+    0xC3, 0x00, 0x00        // jp __gbz80_far_leave
+  };
+
+  std::copy(Trampoline, Trampoline + TrampolineSize, Image.begin() + Offset);
+  put16(Offset + 1, ScratchAddr);
+  put8(Offset + 4, Bank);
+  put16(Offset + 6, FarEnter);
+  put16(Offset + 9, Target);
+  put16(Offset + 12, FarLeave);
+}
+
+void GBZ80ROMObjectWriter::applyRelocs(MCAssembler &Asm,
+  const MCAsmLayout &Layout)
+{
+  for (unsigned i = 0, e = Relocs.size(); i != e; ++i)
+  {
+    const ROMReloc &R = Relocs[i];
+    DenseMap<const MCSectionData *, unsigned>::const_iterator It =
+      SectionIndex.find(R.SD);
+    if (It == SectionIndex.end())
+      continue;
+
+    const ROMSection &S = Sections[It->second];
+    uint64_t Offset = S.ImageOffset + R.Offset;
+    uint64_t Value = R.Addend;
+    if (R.Symbol)
+      Value += getReferenceAddress(Asm, Layout, *R.Symbol, S.Bank);
+
+    switch (R.Kind)
+    {
+    default:
+      report_fatal_error("GBZ80: unsupported fixup in a ROM image");
+    case FK_Data_1:
+    case GBZ80::fixup_8:
+      put8(Offset, Value);
+      break;
+    case FK_Data_2:
+    case GBZ80::fixup_16:
+      put16(Offset, Value);
+      break;
+    case GBZ80::fixup_jr_pcrel_8:
+    {
+      int64_t Disp = (int64_t)Value - (int64_t)(S.Address + R.Offset + 1);
+      if (Disp < -128 || Disp > 127)
+        report_fatal_error("GBZ80: jr target out of range");
+      put8(Offset, Disp);
+      break;
+    }
+    }
+  }
+}
+
+void GBZ80ROMObjectWriter::writeChecksums()
+{
+  uint8_t HeaderSum = 0;
+  for (unsigned i = 0x134; i <= 0x14C; i++)
+    HeaderSum = HeaderSum - Image[i] - 1;
+  put8(0x14D, HeaderSum);
+
+  // The global checksum is big endian and does not include itself.
+  uint16_t Sum = 0;
+  for (unsigned i = 0, e = Image.size(); i != e; i++)
+    if (i != 0x14E && i != 0x14F)
+      Sum += Image[i];
+  put8(0x14E, Sum >> 8);
+  put8(0x14F, Sum & 0xFF);
+}
+
+void GBZ80ROMObjectWriter::WriteObject(MCAssembler &Asm,
+  const MCAsmLayout &Layout)
+{
+  uint64_t DataSize, BSSStart, BSSSize, DataLoad, HRAMLoad;
+  unsigned NumBanks = 2;
+
+  collectSections(Asm, Layout);
+  placeRAM(Asm, DataSize, BSSStart, BSSSize);
+  uint64_t HRAMSize = placeHRAM();
+  uint64_t Bank0End = placeBank0(DataSize, HRAMSize, DataLoad, HRAMLoad);
+
+  MCSymbol *Main = Asm.getContext().LookupSymbol(StringRef("main"));
+  if (!Main || Main->isUndefined())
+    report_fatal_error("GBZ80: a ROM image needs a main function");
+
+  if (!placeFlat(Bank0End))
+  {
+    Banked = true;
+    NumBanks = packBanks(Asm);
+    while (NumBanks & (NumBanks - 1))
+      NumBanks++;
+    if (NumBanks > MaxBanks)
+      report_fatal_error("GBZ80: program does not fit into the ROM");
+    if (BSSStart + BSSSize > SideSPAddr)
+      report_fatal_error("GBZ80: writable data does not fit into work RAM");
+
+    // Every function in a switchable bank which is referenced from outside
+    // of its bank gets a trampoline. The startup routine runs in bank 0.
+    addTrampoline(Asm, *Main, 0);
+    for (unsigned i = 0, e = Relocs.size(); i != e; ++i)
+    {
+      DenseMap<const MCSectionData *, unsigned>::const_iterator It =
+        SectionIndex.find(Relocs[i].SD);
+      if (It != SectionIndex.end() && Relocs[i].Symbol)
+        addTrampoline(Asm, *Relocs[i].Symbol, Sections[It->second].Bank);
+    }
+    FarEnter = Bank0End;
+    FarLeave = FarEnter + FarEnterSize;
+    Bank0End = FarLeave + FarLeaveSize;
+    for (unsigned i = 0, e = TrampolineOrder.size(); i != e; ++i)
+    {
+      Trampolines[TrampolineOrder[i]] = Bank0End;
+      Bank0End += TrampolineSize;
+    }
+  }
+  if (Bank0End > BankSize)
+    report_fatal_error("GBZ80: read-only data does not fit into ROM bank 0");
+
+  Image.assign(NumBanks * BankSize, 0);
+  writeHeader(NumBanks);
+
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    const ROMSection &S = Sections[i];
+    if (S.ImageOffset >= 0)
+      std::copy(S.Contents.begin(), S.Contents.end(),
+                Image.begin() + S.ImageOffset);
+  }
+
+  writeVectors(Asm, Layout);
+
+  if (Banked)
+    writeFarCall();
+  for (unsigned i = 0, e = TrampolineOrder.size(); i != e; ++i)
+  {
+    const MCSymbol *Sym = TrampolineOrder[i];
+    writeTrampoline(Trampolines[Sym], getSymbolBank(Asm, *Sym),
+                    getSymbolAddress(Asm, Layout, *Sym));
+  }
+
+  writeStartup(DataLoad, DataSize, BSSStart, BSSSize, HRAMLoad, HRAMSize,
+               getReferenceAddress(Asm, Layout, *Main, 0));
+  applyRelocs(Asm, Layout);
+  writeChecksums();
+  if (!ROMSymbols.empty())
+    writeSymbols(Asm, Layout);
+
+  ImageOS.write(reinterpret_cast<const char *>(Image.data()), Image.size());
+}
+
+void GBZ80ROMObjectWriter::writeSymbols(MCAssembler &Asm,
+  const MCAsmLayout &Layout)
+{
+  struct SymbolEntry {
+    unsigned Bank;
+    uint64_t Address;
+    uint64_t Size;
+    std::string Name;
+    bool operator<(const SymbolEntry &RHS) const {
+      if (Bank != RHS.Bank)
+        return Bank < RHS.Bank;
+      return Address < RHS.Address;
+    }
+  };
+  std::vector<SymbolEntry> Entries;
+
+  // A symbol extends up to the next symbol of its section or to the end of
+  // the section.
+  std::vector<std::vector<SymbolEntry> > BySection(Sections.size());
+  for (MCAssembler::const_symbol_iterator it = Asm.symbol_begin(),
+       ie = Asm.symbol_end(); it != ie; ++it)
+  {
+    const MCSymbol &Sym = it->getSymbol();
+    if (Sym.isTemporary() || Sym.getName().startswith("__gbz80_isr_"))
+      continue;
+    int Idx = getSymbolSection(Asm, Sym);
+    if (Idx < 0 || (Sections[Idx].Kind != ROMSection::Code &&
+                    Sections[Idx].Kind != ROMSection::Handler))
+      continue;
+    SymbolEntry E;
+    E.Bank = Sections[Idx].Bank;
+    E.Address = Sections[Idx].Address + Layout.getSymbolOffset(&*it);
+    E.Size = 0;
+    E.Name = Sym.getName();
+    BySection[Idx].push_back(E);
+  }
+  for (unsigned i = 0, e = Sections.size(); i != e; ++i)
+  {
+    std::vector<SymbolEntry> &Syms = BySection[i];
+    std::stable_sort(Syms.begin(), Syms.end());
+    for (unsigned j = 0, je = Syms.size(); j != je; ++j)
+    {
+      uint64_t End = j + 1 != je ? Syms[j + 1].Address
+                                 : Sections[i].Address + Sections[i].Size;
+      Syms[j].Size = End - Syms[j].Address;
+      // Section symbols and the like share the address of the next symbol.
+      if (Syms[j].Size)
+        Entries.push_back(Syms[j]);
+    }
+  }
+
+  // The code the writer adds itself.
+  SymbolEntry Startup = { 0, StartupBase, StartupSize, "__gbz80_startup" };
+  Entries.push_back(Startup);
+  if (Banked)
+  {
+    SymbolEntry Enter = { 0, FarEnter, FarEnterSize, "__gbz80_far_enter" };
+    SymbolEntry Leave = { 0, FarLeave, FarLeaveSize, "__gbz80_far_leave" };
+    Entries.push_back(Enter);
+    Entries.push_back(Leave);
+  }
+  for (unsigned i = 0, e = TrampolineOrder.size(); i != e; ++i)
+  {
+    const MCSymbol *Sym = TrampolineOrder[i];
+    SymbolEntry E = { 0, Trampolines[Sym], TrampolineSize,
+                      "__gbz80_far_" + Sym->getName().str() };
+    Entries.push_back(E);
+  }
+  std::stable_sort(Entries.begin(), Entries.end());
+
+  std::error_code EC;
+  raw_fd_ostream OS(ROMSymbols, EC, sys::fs::F_Text);
+  if (EC)
+    report_fatal_error("GBZ80: cannot open '" + ROMSymbols + "': " +
+                       EC.message());
+  for (unsigned i = 0, e = Entries.size(); i != e; ++i)
+    OS << format("%02x:%04x %04x ", Entries[i].Bank,
+                 (unsigned)Entries[i].Address, (unsigned)Entries[i].Size)
+       << Entries[i].Name << '\n';
+}
+
+MCObjectWriter *llvm::createGBZ80ROMObjectWriter(raw_ostream &OS)
+{
+  return new GBZ80ROMObjectWriter(OS);
+}
@@ -0,0 +1,51 @@
+; RUN: opt < %s -cost-model -analyze -mtriple=gbz80 | FileCheck %s
+
+; Costs are counted in 8-bit operations.
+define void @arith(i8 %a, i16 %b, i32 %c, float %f) {
+; CHECK: cost of 1 {{.*}} add i8
+  %1 = add i8 %a, 1
+; CHECK: cost of 2 {{.*}} add i16
+  %2 = add i16 %b, %b
+; CHECK: cost of 4 {{.*}} add i32
+  %3 = add i32 %c, %c
+; CHECK: cost of 16 {{.*}} shl i16
+  %4 = shl i16 %b, %b
+; CHECK: cost of 8 {{.*}} shl i32
+  %5 = shl i32 %c, %c
+; CHECK: cost of 16 {{.*}} mul i16
+  %6 = mul i16 %b, %b
+; CHECK: cost of 16 {{.*}} sdiv i8
+  %7 = sdiv i8 %a, %a
+; CHECK: cost of 32 {{.*}} fadd float
+  %8 = fadd float %f, %f
+  ret void
+}
+
+define void @casts(i8 %a, i16 %b) {
+; CHECK: cost of 1 {{.*}} zext i8
+  %1 = zext i8 %a to i16
+; CHECK: cost of 3 {{.*}} sext i8
+  %2 = sext i8 %a to i16
+; CHECK: cost of 0 {{.*}} trunc i16
+  %3 = trunc i16 %b to i8
+  ret void
+}
+
+define void @memory(i16 %b, i32 %c, i16* %p, i32* %q) {
+; CHECK: cost of 4 {{.*}} icmp eq i16
+  %1 = icmp eq i16 %b, 0
+; CHECK: cost of 3 {{.*}} select
+  %2 = select i1 %1, i16 %b, i16 0
+; CHECK: cost of 2 {{.*}} load i16
+  %3 = load i16* %p
+; CHECK: cost of 4 {{.*}} store i32
+  store i32 %c, i32* %q
+  ret void
+}
+
+; There are no vector registers, vectors are done a byte at a time.
+define void @vector() {
+; CHECK: cost of 4 {{.*}} add <4 x i8>
+  %1 = add <4 x i8> undef, undef
+  ret void
+}
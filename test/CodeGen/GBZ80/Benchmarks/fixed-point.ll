@@ -0,0 +1,52 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t.gb
+; RUN: llvm-gbz80-sim %t.gb -symbols=%t.sym | FileCheck %s
+
+; Damped motion in unsigned 8.8 fixed point: the velocity is scaled by 0.9
+; every frame and added to the position.
+
+; CHECK: halted after {{[0-9]+}} cycles
+; CHECK: hl = 0x2f54
+; CHECK: fxmul 32 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+; CHECK: simulate 1 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+
+; (a * b) >> 8 from the 8-bit halves of the operands.
+define i16 @fxmul(i16 %a, i16 %b) {
+  %ah = lshr i16 %a, 8
+  %al = and i16 %a, 255
+  %bh = lshr i16 %b, 8
+  %bl = and i16 %b, 255
+  %hh = mul i16 %ah, %bh
+  %hh8 = shl i16 %hh, 8
+  %hl = mul i16 %ah, %bl
+  %lh = mul i16 %al, %bh
+  %ll = mul i16 %al, %bl
+  %ll8 = lshr i16 %ll, 8
+  %s1 = add i16 %hh8, %hl
+  %s2 = add i16 %s1, %lh
+  %s3 = add i16 %s2, %ll8
+  ret i16 %s3
+}
+
+define i16 @simulate(i16 %v0, i16 %frames) {
+entry:
+  br label %loop
+
+loop:
+  %pos = phi i16 [ 0, %entry ], [ %pos.next, %loop ]
+  %v = phi i16 [ %v0, %entry ], [ %v.next, %loop ]
+  %i = phi i16 [ %frames, %entry ], [ %i.next, %loop ]
+  %pos.next = add i16 %pos, %v
+  %v.next = call i16 @fxmul(i16 %v, i16 230)
+  %i.next = add i16 %i, -1
+  %more = icmp ne i16 %i.next, 0
+  br i1 %more, label %loop, label %done
+
+done:
+  ret i16 %pos.next
+}
+
+define i16 @main() {
+  %r = call i16 @simulate(i16 1280, i16 32)
+  ret i16 %r
+}
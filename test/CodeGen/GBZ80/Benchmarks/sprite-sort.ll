@@ -0,0 +1,85 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t.gb
+; RUN: llvm-gbz80-sim %t.gb -symbols=%t.sym | FileCheck %s
+
+; Sorts the 40 entries of a shadow OAM by their y coordinate with an
+; insertion sort, then hashes the tile numbers in the new order.
+
+; CHECK: halted after {{[0-9]+}} cycles
+; CHECK: hl = 0xcf9a
+; CHECK: sort_sprites 1 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+
+%sprite = type { i8, i8, i8, i8 }
+
+@oam = global [160 x i8] c"\62\08\00\00\36\0C\01\00\75\10\02\00\1C\14\03\00\22\18\04\00\99\1C\05\00\28\20\06\00\6D\24\07\00\1E\28\08\00\91\2C\09\00\46\30\0A\00\19\34\0B\00\26\38\0C\00\7F\3C\0D\00\7B\40\0E\00\21\44\0F\00\4D\48\10\00\27\4C\11\00\9D\50\12\00\7C\54\13\00\1F\58\14\00\2F\5C\15\00\49\60\16\00\1F\64\17\00\75\68\18\00\1C\6C\19\00\48\70\1A\00\1B\74\1B\00\9E\78\1C\00\32\7C\1D\00\5A\80\1E\00\7B\84\1F\00\34\88\20\00\9A\8C\21\00\2E\90\22\00\5E\94\23\00\9F\98\24\00\3E\9C\25\00\2A\A0\26\00\40\A4\27\00"
+
+define void @sort_sprites(%sprite* %s, i8 %n) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i8 [ 1, %entry ], [ %i.next, %insert ]
+  %more = icmp ult i8 %i, %n
+  br i1 %more, label %pick, label %done
+
+pick:
+  %pi = getelementptr %sprite* %s, i8 %i
+  %e = load %sprite* %pi
+  %ey = extractvalue %sprite %e, 0
+  br label %inner
+
+inner:
+  %j = phi i8 [ %i, %pick ], [ %jm, %shift ]
+  %at0 = icmp eq i8 %j, 0
+  br i1 %at0, label %insert, label %compare
+
+compare:
+  %jm = add i8 %j, -1
+  %pjm = getelementptr %sprite* %s, i8 %jm
+  %yp = getelementptr %sprite* %pjm, i16 0, i32 0
+  %y = load i8* %yp
+  %gt = icmp ugt i8 %y, %ey
+  br i1 %gt, label %shift, label %insert
+
+shift:
+  %prev = load %sprite* %pjm
+  %pj = getelementptr %sprite* %s, i8 %j
+  store %sprite %prev, %sprite* %pj
+  br label %inner
+
+insert:
+  %pdst = getelementptr %sprite* %s, i8 %j
+  store %sprite %e, %sprite* %pdst
+  %i.next = add i8 %i, 1
+  br label %outer
+
+done:
+  ret void
+}
+
+define i16 @hash_tiles(%sprite* %s, i8 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %loop ]
+  %h = phi i16 [ 0, %entry ], [ %h.next, %loop ]
+  %p = getelementptr %sprite* %s, i8 %i, i32 2
+  %t = load i8* %p
+  %t16 = zext i8 %t to i16
+  %h31 = mul i16 %h, 31
+  %h.next = add i16 %h31, %t16
+  %i.next = add i8 %i, 1
+  %more = icmp ult i8 %i.next, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret i16 %h.next
+}
+
+define i16 @main() {
+  %s = bitcast [160 x i8]* @oam to %sprite*
+  call void @sort_sprites(%sprite* %s, i8 40)
+  %h = call i16 @hash_tiles(%sprite* %s, i8 40)
+  ret i16 %h
+}
@@ -0,0 +1,102 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t.gb
+; RUN: llvm-gbz80-sim %t.gb -symbols=%t.sym | FileCheck %s
+
+; A bytecode interpreter with an accumulator and a counter register, whose
+; dispatch is a dense switch over the opcode.
+
+; CHECK: halted after {{[0-9]+}} cycles
+; CHECK: hl = 0x0023
+; CHECK: interpret 1 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+
+;   ldx 50; lda 1
+; loop:
+;   shl; xorx; add 7; addx; dex; jnz loop
+;   halt
+@program = constant [13 x i8] c"\02\32\01\01\05\04\03\07\09\06\07\04\00"
+
+define i16 @interpret(i8* %code) {
+entry:
+  br label %dispatch
+
+dispatch:
+  %pc = phi i8 [ 0, %entry ], [ %pc2, %lda ], [ %pc2, %ldx ], [ %pc2, %add ],
+               [ %pc1, %xorx ], [ %pc1, %shl ], [ %pc1, %dex ], [ %pc.jnz, %jnz ],
+               [ %pc1, %rol ], [ %pc1, %addx ]
+  %a = phi i8 [ 0, %entry ], [ %a.lda, %lda ], [ %a, %ldx ], [ %a.add, %add ],
+              [ %a.xorx, %xorx ], [ %a.shl, %shl ], [ %a, %dex ], [ %a, %jnz ],
+              [ %a.rol, %rol ], [ %a.addx, %addx ]
+  %x = phi i8 [ 0, %entry ], [ %x, %lda ], [ %x.ldx, %ldx ], [ %x, %add ],
+              [ %x, %xorx ], [ %x, %shl ], [ %x.dex, %dex ], [ %x, %jnz ],
+              [ %x, %rol ], [ %x, %addx ]
+  %pop = getelementptr i8* %code, i8 %pc
+  %op = load i8* %pop
+  %pc1 = add i8 %pc, 1
+  %pc2 = add i8 %pc, 2
+  %parg = getelementptr i8* %code, i8 %pc1
+  switch i8 %op, label %halt [
+    i8 1, label %lda
+    i8 2, label %ldx
+    i8 3, label %add
+    i8 4, label %xorx
+    i8 5, label %shl
+    i8 6, label %dex
+    i8 7, label %jnz
+    i8 8, label %rol
+    i8 9, label %addx
+  ]
+
+lda:
+  %a.lda = load i8* %parg
+  br label %dispatch
+
+ldx:
+  %x.ldx = load i8* %parg
+  br label %dispatch
+
+add:
+  %imm = load i8* %parg
+  %a.add = add i8 %a, %imm
+  br label %dispatch
+
+xorx:
+  %a.xorx = xor i8 %a, %x
+  br label %dispatch
+
+shl:
+  %a.shl = shl i8 %a, 1
+  br label %dispatch
+
+dex:
+  %x.dex = add i8 %x, -1
+  br label %dispatch
+
+jnz:
+  %target = load i8* %parg
+  %nz = icmp ne i8 %x, 0
+  %pc.jnz = select i1 %nz, i8 %target, i8 %pc2
+  br label %dispatch
+
+rol:
+  %hi = lshr i8 %a, 7
+  %lo = shl i8 %a, 1
+  %a.rol = or i8 %lo, %hi
+  br label %dispatch
+
+addx:
+  %a.addx = add i8 %a, %x
+  br label %dispatch
+
+halt:
+  %a16 = zext i8 %a to i16
+  %x16 = zext i8 %x to i16
+  %x8 = shl i16 %x16, 8
+  %r = or i16 %x8, %a16
+  ret i16 %r
+}
+
+define i16 @main() {
+  %code = getelementptr [13 x i8]* @program, i16 0, i16 0
+  %r = call i16 @interpret(i8* %code)
+  ret i16 %r
+}
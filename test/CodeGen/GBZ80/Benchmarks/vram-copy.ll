@@ -0,0 +1,63 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t.gb
+; RUN: llvm-gbz80-sim %t.gb -symbols=%t.sym | FileCheck %s
+
+; Copies a tile set into VRAM and reads it back.
+
+; CHECK: halted after {{[0-9]+}} cycles
+; CHECK: hl = 0x3f80
+; CHECK: copy_tiles 2 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+; CHECK: sum_vram 1 {{[0-9]+}} {{[0-9]+}} {{[0-9]+}}
+
+@tiles = constant [128 x i8] c"\00\01\02\03\04\05\06\07\08\09\0A\0B\0C\0D\0E\0F\10\11\12\13\14\15\16\17\18\19\1A\1B\1C\1D\1E\1F !\22#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\5C]^_`abcdefghijklmnopqrstuvwxyz{|}~\7F"
+
+define void @copy_tiles(i8* %dst, i8* %src, i16 %n) {
+entry:
+  %empty = icmp eq i16 %n, 0
+  br i1 %empty, label %done, label %loop
+
+loop:
+  %d = phi i8* [ %dst, %entry ], [ %d.next, %loop ]
+  %s = phi i8* [ %src, %entry ], [ %s.next, %loop ]
+  %i = phi i16 [ %n, %entry ], [ %i.next, %loop ]
+  %v = load i8* %s
+  store volatile i8 %v, i8* %d
+  %d.next = getelementptr i8* %d, i16 1
+  %s.next = getelementptr i8* %s, i16 1
+  %i.next = add i16 %i, -1
+  %more = icmp ne i16 %i.next, 0
+  br i1 %more, label %loop, label %done
+
+done:
+  ret void
+}
+
+define i16 @sum_vram(i8* %p, i16 %n) {
+entry:
+  br label %loop
+
+loop:
+  %q = phi i8* [ %p, %entry ], [ %q.next, %loop ]
+  %i = phi i16 [ %n, %entry ], [ %i.next, %loop ]
+  %sum = phi i16 [ 0, %entry ], [ %sum.next, %loop ]
+  %v = load volatile i8* %q
+  %w = zext i8 %v to i16
+  %sum.next = add i16 %sum, %w
+  %q.next = getelementptr i8* %q, i16 1
+  %i.next = add i16 %i, -1
+  %more = icmp ne i16 %i.next, 0
+  br i1 %more, label %loop, label %done
+
+done:
+  ret i16 %sum.next
+}
+
+define i16 @main() {
+  %src = getelementptr [128 x i8]* @tiles, i16 0, i16 0
+  %vram = inttoptr i16 32768 to i8*
+  call void @copy_tiles(i8* %vram, i8* %src, i16 128)
+  %vram2 = inttoptr i16 32896 to i8*
+  call void @copy_tiles(i8* %vram2, i8* %src, i16 128)
+  %sum = call i16 @sum_vram(i8* %vram, i16 256)
+  ret i16 %sum
+}
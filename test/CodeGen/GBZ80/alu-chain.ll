@@ -0,0 +1,23 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+; A chain of 8-bit ALU operations stays in A, the operands are kept in the
+; other registers.
+
+define i8 @chain(i8 %a, i8 %b, i8* %p) {
+; CHECK-LABEL: chain:
+; CHECK: add a, [[B:[b-l]]]
+; CHECK-NEXT: xor [[X:[b-l]]]
+; CHECK-NEXT: and 15
+; CHECK-NEXT: sub [[B]]
+; CHECK-NEXT: or [[X]]
+; CHECK-NEXT: add a, {{[b-l]}}
+; CHECK-NEXT: pop
+  %x = load i8* %p
+  %1 = add i8 %a, %b
+  %2 = xor i8 %1, %x
+  %3 = and i8 %2, 15
+  %4 = sub i8 %3, %b
+  %5 = or i8 %4, %x
+  %6 = add i8 %5, %a
+  ret i8 %6
+}
@@ -0,0 +1,67 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+@g = global i8 5
+@w = global i16 4660
+
+declare void @ext(i8)
+
+define i8 @add8(i8 %a, i8 %b) {
+; CHECK-LABEL: add8:
+; CHECK: add a, h
+; CHECK-NEXT: ret
+  %r = add i8 %a, %b
+  ret i8 %r
+}
+
+define i16 @const16() {
+; CHECK-LABEL: const16:
+; CHECK: ld hl, 4660
+; CHECK-NEXT: ret
+  ret i16 4660
+}
+
+define i8 @loadg() {
+; CHECK-LABEL: loadg:
+; CHECK: ld a, (g)
+  %v = load i8* @g
+  ret i8 %v
+}
+
+define void @storeg(i8 %v) {
+; CHECK-LABEL: storeg:
+; CHECK: ld (g), a
+  store i8 %v, i8* @g
+  ret void
+}
+
+define i8 @loadhl(i8* %p) {
+; CHECK-LABEL: loadhl:
+; CHECK: ld a, (hl)
+  %v = load i8* %p
+  ret i8 %v
+}
+
+define i8 @branch(i8 %a, i8 %b) {
+; CHECK-LABEL: branch:
+; CHECK: cp h
+; CHECK-NEXT: jr nz, .LBB
+entry:
+  %c = icmp eq i8 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
+
+define void @calls(i8 %a) {
+; CHECK-LABEL: calls:
+; CHECK: call ext
+  call void @ext(i8 %a)
+  ret void
+}
+
+; CHECK: g:
+; CHECK-NEXT: .byte 5
+; CHECK: w:
+; CHECK-NEXT: .short 4660
@@ -0,0 +1,78 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -filetype=obj -o /dev/null
+
+@g0 = global i8 0
+@g1 = global i8 0
+@g2 = global i8 0
+@g3 = global i8 0
+
+; The branch over the 144 bytes of stores can't be a jr, the loop back edge
+; over a few bytes can.
+define void @far(i8 %a, i8 %n) {
+; CHECK-LABEL: far:
+; CHECK: jp z, [[EXIT:.LBB[0-9_]+]]
+; CHECK: [[LOOP:.LBB[0-9_]+]]:
+; CHECK: jr nz, [[LOOP]]
+; CHECK: [[EXIT]]:
+entry:
+  %z = icmp eq i8 %a, 0
+  br i1 %z, label %exit, label %big
+big:
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  store volatile i8 %a, i8* @g0
+  store volatile i8 %a, i8* @g1
+  store volatile i8 %a, i8* @g2
+  store volatile i8 %a, i8* @g3
+  br label %loop
+loop:
+  %i = phi i8 [ %n, %big ], [ %d, %loop ]
+  store volatile i8 %i, i8* @g0
+  %d = add i8 %i, -1
+  %c = icmp ne i8 %d, 0
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
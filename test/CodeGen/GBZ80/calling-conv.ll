@@ -0,0 +1,60 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+; Pointers and other 16-bit arguments go in HL, DE and BC, an i32 is passed
+; and returned in DEHL. fastcc functions preserve no registers, coldcc
+; functions preserve HL as well.
+
+define i16 @three(i16 %a, i16 %b, i16 %c) {
+; CHECK-LABEL: three:
+; CHECK-NOT: sp+
+; CHECK: add hl, de
+; CHECK-NEXT: add hl, bc
+  %1 = add i16 %a, %b
+  %2 = add i16 %1, %c
+  ret i16 %2
+}
+
+define i32 @ret32(i32 %x) {
+; CHECK-LABEL: ret32:
+; CHECK-NEXT: BB#
+; CHECK-NEXT: ret
+  ret i32 %x
+}
+
+define internal fastcc i16 @fast(i16 %a, i16 %b, i16 %c) {
+; CHECK-LABEL: fast:
+; CHECK-NOT: push
+; CHECK: add hl, de
+; CHECK-NEXT: add hl, bc
+; CHECK-NEXT: ret
+  %1 = add i16 %a, %b
+  %2 = add i16 %1, %c
+  ret i16 %2
+}
+
+define coldcc void @cold(i16 %a, i16 %b) {
+; CHECK-LABEL: cold:
+; CHECK: push hl
+; CHECK-NEXT: push de
+; CHECK: pop de
+; CHECK-NEXT: pop hl
+; CHECK-NEXT: ret
+  %1 = add i16 %a, %b
+  store i16 %1, i16* inttoptr (i16 49152 to i16*)
+  ret void
+}
+
+define i16 @caller(i16 %a, i16 %b, i16 %c) {
+; CHECK-LABEL: caller:
+; CHECK: call fast
+; CHECK: call cold
+; CHECK: ld hl, 7
+; CHECK-NEXT: ld de, 0
+; CHECK-NEXT: call ret32
+  %1 = call fastcc i16 @fast(i16 %a, i16 %b, i16 %c)
+  call coldcc void @cold(i16 %1, i16 %a)
+  %2 = call i32 @ret32(i32 7)
+  %3 = trunc i32 %2 to i16
+  %4 = add i16 %3, %1
+  ret i16 %4
+}
@@ -0,0 +1,90 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+@g = global i16 0
+@g8 = global i8 0
+
+; A 16-bit counter is tested against zero with "ld a, hi; or lo".
+define void @countdown(i16 %n) {
+; CHECK-LABEL: countdown:
+; CHECK: dec [[RP:bc|de|hl]]
+; CHECK-NEXT: ld a, {{[bdh]}}
+; CHECK-NEXT: or {{[cel]}}
+; CHECK-NEXT: jr nz
+entry:
+  br label %body
+body:
+  %i = phi i16 [ %n, %entry ], [ %d, %body ]
+  store volatile i8 0, i8* @g8
+  %d = add i16 %i, -1
+  %c = icmp ne i16 %d, 0
+  br i1 %c, label %body, label %exit
+exit:
+  ret void
+}
+
+; The high bytes are compared first, the low bytes only when they are equal.
+define i8 @eq_const(i16 %a) {
+; CHECK-LABEL: eq_const:
+; CHECK: ld a, h
+; CHECK-NEXT: cp 3
+; CHECK-NEXT: jr nz, [[JOIN:.LBB[0-9_]+]]
+; CHECK: ld a, l
+; CHECK-NEXT: cp 232
+; CHECK-NEXT: [[JOIN]]:
+; CHECK-NEXT: jr nz
+  %c = icmp eq i16 %a, 1000
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
+
+define i8 @ult(i16 %a) {
+; CHECK-LABEL: ult:
+; CHECK-NOT: sbc
+; CHECK: cp [[HI:[bcde]]]
+; CHECK-NEXT: jr nz, [[JOIN:.LBB[0-9_]+]]
+; CHECK: cp
+; CHECK-NEXT: [[JOIN]]:
+; CHECK-NEXT: jr nc
+  %b = load volatile i16* @g
+  %c = icmp ult i16 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
+
+; Signed compares flip the sign bits, there are no P and M conditions.
+define i8 @slt(i16 %a) {
+; CHECK-LABEL: slt:
+; CHECK: xor -128
+; CHECK: xor -128
+; CHECK: cp
+; CHECK-NEXT: jr nz
+; CHECK: cp
+; CHECK: jr nc
+  %b = load volatile i16* @g
+  %c = icmp slt i16 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
+
+define i8 @slt8(i8 %a, i8 %b) {
+; CHECK-LABEL: slt8:
+; CHECK: xor -128
+; CHECK: xor -128
+; CHECK: cp
+; CHECK-NEXT: jr nc
+  %c = icmp slt i8 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
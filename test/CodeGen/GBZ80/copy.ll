@@ -0,0 +1,37 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+; Register pairs are copied a byte at a time, SP is read with ld hl,sp+e and
+; written with ld sp,hl.
+
+declare i8* @llvm.stacksave()
+declare void @llvm.stackrestore(i8*)
+declare void @use(i8*)
+
+define i16 @pair(i16 %a, i16 %b) {
+; CHECK-LABEL: pair:
+; CHECK-NOT: push hl
+; CHECK: ld b, h
+; CHECK-NEXT: ld c, l
+; CHECK-NOT: pop
+; CHECK: ld h, d
+; CHECK-NEXT: ld l, e
+  %r = sub i16 %b, %a
+  ret i16 %r
+}
+
+define void @save() {
+; CHECK-LABEL: save:
+; CHECK: ld hl, sp+0
+; CHECK-NEXT: ld [[HI:[bd]]], h
+; CHECK-NEXT: ld [[LO:[ce]]], l
+; CHECK: call use
+; CHECK: call use
+; CHECK-NEXT: ld h, [[HI]]
+; CHECK-NEXT: ld l, [[LO]]
+; CHECK: ld sp, hl
+  %sp = call i8* @llvm.stacksave()
+  call void @use(i8* %sp)
+  call void @use(i8* %sp)
+  call void @llvm.stackrestore(i8* %sp)
+  ret void
+}
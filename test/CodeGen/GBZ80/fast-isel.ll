@@ -0,0 +1,102 @@
+; RUN: llc < %s -march=gbz80 -O0 -fast-isel -fast-isel-abort \
+; RUN:   -fast-isel-abort-args -verify-machineinstrs | FileCheck %s
+
+@buf = global [8 x i8] zeroinitializer
+@w = global i16 0
+@counter = global i8 0, section ".hram"
+
+declare i16 @use(i8, i16)
+
+; Absolute addresses are encoded in the load and store, ldh for the high page.
+; CHECK-LABEL: globals:
+; CHECK: ldh a, (counter)
+; CHECK: ld (buf+3), a
+; CHECK: ld a, (w)
+; CHECK: ld a, (w+1)
+; CHECK: ld (w), a
+; CHECK: ld (w+1), a
+define void @globals() {
+  %c = load volatile i8* @counter
+  store i8 %c, i8* getelementptr ([8 x i8]* @buf, i16 0, i16 3)
+  %v = load i16* @w
+  %n = add i16 %v, 1
+  store i16 %n, i16* @w
+  ret void
+}
+
+; Other pointers are loaded and stored through HL, the low byte of an i16
+; with ld a,(hl+).
+; CHECK-LABEL: pointers:
+; CHECK: ld a, (hl+)
+; CHECK: ld {{[bcde]}}, (hl)
+; CHECK: ld (hl+), a
+; CHECK: ld (hl), b
+; CHECK: ld a, 52
+; CHECK-NEXT: ld (hl+), a
+; CHECK-NEXT: ld (hl), 18
+define void @pointers(i16* %p, i16* %q) {
+  %v = load i16* %p
+  %s = shl i16 %v, 1
+  store i16 %s, i16* %q
+  %q1 = getelementptr i16* %q, i16 1
+  store i16 4660, i16* %q1
+  ret void
+}
+
+; A compare in the same block is folded into the branch. The loop keeps its
+; counter in a stack slot.
+; CHECK-LABEL: loop:
+; CHECK: ld hl, sp+
+; CHECK: ld (hl), 0
+; CHECK: .LBB2_1:
+; CHECK: cp
+; CHECK-NEXT: jr nc, .LBB2_3
+; CHECK: inc
+; CHECK: jr .LBB2_1
+; CHECK: .LBB2_3:
+; CHECK: ret
+define void @loop(i8* %p, i8 %n) {
+entry:
+  %i = alloca i8
+  store i8 0, i8* %i
+  br label %cond
+
+cond:
+  %iv = load i8* %i
+  %cmp = icmp ult i8 %iv, %n
+  br i1 %cmp, label %body, label %end
+
+body:
+  %idx = zext i8 %iv to i16
+  %ptr = getelementptr i8* %p, i16 %idx
+  store i8 %iv, i8* %ptr
+  %inc = add i8 %iv, 1
+  store i8 %inc, i8* %i
+  br label %cond
+
+end:
+  ret void
+}
+
+; Signed compares flip the sign bits, a 16-bit compare goes a byte at a time.
+; CHECK-LABEL: less:
+; CHECK: xor 128
+; CHECK: cp
+; CHECK: sbc a,
+; CHECK: ld a, 0
+; CHECK-NEXT: adc a, a
+define i8 @less(i16 %a, i16 %b) {
+  %c = icmp slt i16 %a, %b
+  %z = zext i1 %c to i8
+  ret i8 %z
+}
+
+; CHECK-LABEL: call:
+; CHECK: ld a, 7
+; CHECK: call use
+; CHECK: ret
+define i16 @call(i16 %x) {
+  %r = call i16 @use(i8 7, i16 %x)
+  %s = sub i16 %r, %x
+  ret i16 %s
+}
@@ -0,0 +1,79 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -o %t
+; RUN: od -A x -t x1 -v %t | FileCheck %s -check-prefix=ROM
+
+; The vectors of the handlers jump to them; the unused ones keep a reti.
+; ROM: 000040 c3 {{.. ..}} 00 00 00 00 00 c3 {{.. ..}} 00 00 00 00 00
+; ROM: 000050 d9 00 00 00 00 00 00 00 c3 {{.. ..}} 00 00 00 00 00
+; ROM: 000060 d9 00
+
+@counter = global i8 0
+@ticks = global i16 0
+
+define void @update(i8 %x) {
+  store volatile i8 %x, i8* @counter
+  ret void
+}
+
+; Only A and the flags are clobbered.
+define void @vblank() #0 {
+; CHECK-LABEL: vblank:
+; CHECK: __gbz80_isr_vblank:
+; CHECK-NOT: push
+; CHECK: push af
+; CHECK-NOT: push
+; CHECK: pop af
+; CHECK-NEXT: reti
+  %v = load volatile i8* @counter
+  %n = add i8 %v, 1
+  store volatile i8 %n, i8* @counter
+  ret void
+}
+
+; The callee may clobber everything but BC and DE.
+define void @stat() #1 {
+; CHECK-LABEL: stat:
+; CHECK: push hl
+; CHECK-NEXT: push af
+; CHECK: call update
+; CHECK-NEXT: pop af
+; CHECK-NEXT: pop hl
+; CHECK-NEXT: reti
+  %v = load volatile i8* @counter
+  call void @update(i8 %v)
+  ret void
+}
+
+; Stack slot accesses go through HL, and BC is saved like any other register.
+define void @serial() #2 {
+; CHECK-LABEL: serial:
+; CHECK: push hl
+; CHECK-NEXT: push bc
+; CHECK-NEXT: push af
+; CHECK-NEXT: add sp, -4
+; CHECK: add sp, 4
+; CHECK-NEXT: pop af
+; CHECK-NEXT: pop bc
+; CHECK-NEXT: pop hl
+; CHECK-NEXT: reti
+  %a = alloca [2 x i8]
+  %p = getelementptr [2 x i8]* %a, i16 0, i16 0
+  %q = getelementptr [2 x i8]* %a, i16 0, i16 1
+  %v = load volatile i8* @counter
+  store volatile i8 %v, i8* %p
+  store volatile i8 %v, i8* %q
+  %w = load volatile i8* %p
+  store volatile i8 %w, i8* @counter
+  %t = load volatile i16* @ticks
+  %n = add i16 %t, 1
+  store volatile i16 %n, i16* @ticks
+  ret void
+}
+
+define i16 @main() {
+  ret i16 0
+}
+
+attributes #0 = { "interrupt"="vblank" }
+attributes #1 = { "interrupt"="stat" }
+attributes #2 = { "interrupt"="serial" }
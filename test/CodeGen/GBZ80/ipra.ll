@@ -0,0 +1,41 @@
+; RUN: llc < %s -march=gbz80 -gbz80-ipra | FileCheck %s
+; RUN: llc < %s -march=gbz80 | FileCheck %s -check-prefix=NOIPRA
+
+; Callees are compiled before their callers, and a call only clobbers the
+; registers the callee really writes. leaf leaves HL alone, so the callers
+; keep their argument there instead of saving BC to hold it.
+
+@g = global i8 0
+
+; CHECK-LABEL: leaf:
+; CHECK-LABEL: caller:
+; CHECK-NOT: push
+; CHECK: call leaf
+; CHECK: call leaf
+; CHECK-NEXT: ret
+; NOIPRA-LABEL: caller:
+; NOIPRA: push bc
+define i16 @caller(i16 %a) {
+  call void @leaf(i8 1)
+  call void @leaf(i8 2)
+  ret i16 %a
+}
+
+; A function that may be replaced at link time keeps the calling convention.
+; CHECK-LABEL: callweak:
+; CHECK: push bc
+; CHECK: call weak
+define i16 @callweak(i16 %a) {
+  call void @weak(i8 1)
+  ret i16 %a
+}
+
+define weak void @weak(i8 %x) {
+  store i8 %x, i8* @g
+  ret void
+}
+
+define void @leaf(i8 %x) {
+  store i8 %x, i8* @g
+  ret void
+}
@@ -0,0 +1,346 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -filetype=obj -o /dev/null
+
+@g = global i8 0
+
+; A dense switch jumps through a table of block addresses that follows the
+; jump. The index is doubled in A and added to the address of the table.
+define void @dense(i8 %s) {
+; CHECK-LABEL: dense:
+; CHECK: jr c, .LBB0_
+; CHECK: add a, a
+; CHECK-NEXT: ld hl, [[TABLE:.Ltmp[0-9]+]]
+; CHECK-NEXT: add a, l
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: adc a, h
+; CHECK-NEXT: sub l
+; CHECK-NEXT: ld h, a
+; CHECK-NEXT: ld a, (hl+)
+; CHECK-NEXT: ld h, (hl)
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: jp (hl)
+; CHECK-NEXT: [[TABLE]]:
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB0_{{[0-9]+}}
+; CHECK-NOT: .short
+entry:
+  switch i8 %s, label %exit [
+    i8 0, label %s0
+    i8 1, label %s1
+    i8 2, label %s2
+    i8 3, label %s3
+    i8 4, label %s4
+    i8 5, label %s5
+    i8 6, label %s6
+    i8 7, label %s7
+    i8 8, label %s8
+    i8 9, label %s9
+  ]
+s0:
+  store volatile i8 10, i8* @g
+  br label %exit
+s1:
+  store volatile i8 11, i8* @g
+  br label %exit
+s2:
+  store volatile i8 12, i8* @g
+  br label %exit
+s3:
+  store volatile i8 13, i8* @g
+  br label %exit
+s4:
+  store volatile i8 14, i8* @g
+  br label %exit
+s5:
+  store volatile i8 15, i8* @g
+  br label %exit
+s6:
+  store volatile i8 16, i8* @g
+  br label %exit
+s7:
+  store volatile i8 17, i8* @g
+  br label %exit
+s8:
+  store volatile i8 18, i8* @g
+  br label %exit
+s9:
+  store volatile i8 19, i8* @g
+  br label %exit
+exit:
+  ret void
+}
+
+; When optimizing for size the runtime routine indexes the table that
+; follows the call.
+define void @dense_optsize(i8 %s) optsize {
+; CHECK-LABEL: dense_optsize:
+; CHECK: add a, a
+; CHECK-NEXT: call __gbz80_jumptable
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NEXT: .short .LBB1_{{[0-9]+}}
+; CHECK-NOT: .short
+entry:
+  switch i8 %s, label %exit [
+    i8 0, label %s0
+    i8 1, label %s1
+    i8 2, label %s2
+    i8 3, label %s3
+    i8 4, label %s4
+    i8 5, label %s5
+    i8 6, label %s6
+    i8 7, label %s7
+    i8 8, label %s8
+    i8 9, label %s9
+  ]
+s0:
+  store volatile i8 10, i8* @g
+  br label %exit
+s1:
+  store volatile i8 11, i8* @g
+  br label %exit
+s2:
+  store volatile i8 12, i8* @g
+  br label %exit
+s3:
+  store volatile i8 13, i8* @g
+  br label %exit
+s4:
+  store volatile i8 14, i8* @g
+  br label %exit
+s5:
+  store volatile i8 15, i8* @g
+  br label %exit
+s6:
+  store volatile i8 16, i8* @g
+  br label %exit
+s7:
+  store volatile i8 17, i8* @g
+  br label %exit
+s8:
+  store volatile i8 18, i8* @g
+  br label %exit
+s9:
+  store volatile i8 19, i8* @g
+  br label %exit
+exit:
+  ret void
+}
+
+; A table of more than 128 entries is indexed by a register pair.
+define void @large(i16 %s) {
+; CHECK-LABEL: large:
+; CHECK: ld hl, [[TABLE:.Ltmp[0-9]+]]
+; CHECK-NEXT: add hl, [[IDX:bc|de]]
+; CHECK-NEXT: add hl, [[IDX]]
+; CHECK-NEXT: ld a, (hl+)
+; CHECK-NEXT: ld h, (hl)
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: jp (hl)
+; CHECK-NEXT: [[TABLE]]:
+entry:
+  switch i16 %s, label %exit [
+    i16 0, label %s0
+    i16 2, label %s1
+    i16 4, label %s0
+    i16 6, label %s1
+    i16 8, label %s0
+    i16 10, label %s1
+    i16 12, label %s0
+    i16 14, label %s1
+    i16 16, label %s0
+    i16 18, label %s1
+    i16 20, label %s0
+    i16 22, label %s1
+    i16 24, label %s0
+    i16 26, label %s1
+    i16 28, label %s0
+    i16 30, label %s1
+    i16 32, label %s0
+    i16 34, label %s1
+    i16 36, label %s0
+    i16 38, label %s1
+    i16 40, label %s0
+    i16 42, label %s1
+    i16 44, label %s0
+    i16 46, label %s1
+    i16 48, label %s0
+    i16 50, label %s1
+    i16 52, label %s0
+    i16 54, label %s1
+    i16 56, label %s0
+    i16 58, label %s1
+    i16 60, label %s0
+    i16 62, label %s1
+    i16 64, label %s0
+    i16 66, label %s1
+    i16 68, label %s0
+    i16 70, label %s1
+    i16 72, label %s0
+    i16 74, label %s1
+    i16 76, label %s0
+    i16 78, label %s1
+    i16 80, label %s0
+    i16 82, label %s1
+    i16 84, label %s0
+    i16 86, label %s1
+    i16 88, label %s0
+    i16 90, label %s1
+    i16 92, label %s0
+    i16 94, label %s1
+    i16 96, label %s0
+    i16 98, label %s1
+    i16 100, label %s0
+    i16 102, label %s1
+    i16 104, label %s0
+    i16 106, label %s1
+    i16 108, label %s0
+    i16 110, label %s1
+    i16 112, label %s0
+    i16 114, label %s1
+    i16 116, label %s0
+    i16 118, label %s1
+    i16 120, label %s0
+    i16 122, label %s1
+    i16 124, label %s0
+    i16 126, label %s1
+    i16 128, label %s0
+    i16 130, label %s1
+  ]
+s0:
+  store volatile i8 10, i8* @g
+  br label %exit
+s1:
+  store volatile i8 11, i8* @g
+  br label %exit
+exit:
+  ret void
+}
+
+; Fewer cases are cheaper as a tree of compares.
+define void @small(i8 %s) {
+; CHECK-LABEL: small:
+; CHECK-NOT: jp (hl)
+; CHECK: ret
+entry:
+  switch i8 %s, label %exit [
+    i8 0, label %s0
+    i8 1, label %s1
+    i8 2, label %s2
+    i8 3, label %s3
+    i8 4, label %s4
+    i8 5, label %s5
+  ]
+s0:
+  store volatile i8 10, i8* @g
+  br label %exit
+s1:
+  store volatile i8 11, i8* @g
+  br label %exit
+s2:
+  store volatile i8 12, i8* @g
+  br label %exit
+s3:
+  store volatile i8 13, i8* @g
+  br label %exit
+s4:
+  store volatile i8 14, i8* @g
+  br label %exit
+s5:
+  store volatile i8 15, i8* @g
+  br label %exit
+exit:
+  ret void
+}
+
+; So are sparse cases.
+define void @sparse(i8 %s) {
+; CHECK-LABEL: sparse:
+; CHECK-NOT: jp (hl)
+; CHECK: ret
+entry:
+  switch i8 %s, label %exit [
+    i8 0, label %s0
+    i8 12, label %s1
+    i8 24, label %s2
+    i8 36, label %s3
+    i8 48, label %s4
+    i8 60, label %s5
+    i8 72, label %s6
+    i8 84, label %s7
+    i8 96, label %s8
+    i8 108, label %s9
+  ]
+s0:
+  store volatile i8 10, i8* @g
+  br label %exit
+s1:
+  store volatile i8 11, i8* @g
+  br label %exit
+s2:
+  store volatile i8 12, i8* @g
+  br label %exit
+s3:
+  store volatile i8 13, i8* @g
+  br label %exit
+s4:
+  store volatile i8 14, i8* @g
+  br label %exit
+s5:
+  store volatile i8 15, i8* @g
+  br label %exit
+s6:
+  store volatile i8 16, i8* @g
+  br label %exit
+s7:
+  store volatile i8 17, i8* @g
+  br label %exit
+s8:
+  store volatile i8 18, i8* @g
+  br label %exit
+s9:
+  store volatile i8 19, i8* @g
+  br label %exit
+exit:
+  ret void
+}
+
+; An indirectbr jumps through HL.
+define void @indirect(i8* %p) {
+; CHECK-LABEL: indirect:
+; CHECK: jp (hl)
+entry:
+  indirectbr i8* %p, [label %a, label %b]
+a:
+  store volatile i8 10, i8* @g
+  ret void
+b:
+  store volatile i8 11, i8* @g
+  ret void
+}
+
+; CHECK-LABEL: __gbz80_jumptable:
+; CHECK: pop hl
+; CHECK-NEXT: add a, l
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: jr nc
+; CHECK-NEXT: inc h
+; CHECK: ld a, (hl+)
+; CHECK-NEXT: ld h, (hl)
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: jp (hl)
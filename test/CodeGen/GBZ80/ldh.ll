@@ -0,0 +1,59 @@
+; RUN: llc < %s -march=gbz80 -show-mc-encoding | FileCheck %s
+
+@w = global i8 0
+@counter = global i8 0, section ".hram"
+
+; I/O registers live in the high page and are reached with ldh.
+define void @set_lcdc(i8 %v) {
+; CHECK-LABEL: set_lcdc:
+; CHECK: ldh (-192), a ; encoding: [0xe0,0x40]
+  store volatile i8 %v, i8* inttoptr (i16 65344 to i8*)
+  ret void
+}
+
+define i8 @get_ly() {
+; CHECK-LABEL: get_ly:
+; CHECK: ldh a, (-188) ; encoding: [0xf0,0x44]
+  %v = load volatile i8* inttoptr (i16 65348 to i8*)
+  ret i8 %v
+}
+
+; Globals in the .hram section are in the high page too.
+define void @bump() {
+; CHECK-LABEL: bump:
+; CHECK: ldh a, (counter) ; encoding: [0xf0,A]
+; CHECK-NEXT: fixup A - offset: 1, value: counter, kind: fixup_8
+; CHECK: ldh (counter), a
+; CHECK: ld a, (w) ; encoding: [0xfa,A,A]
+  %v = load i8* @counter
+  %n = add i8 %v, 1
+  store i8 %n, i8* @counter
+  store volatile i8 %n, i8* @w
+  %x = load volatile i8* @w
+  store volatile i8 %x, i8* @w
+  ret void
+}
+
+; A variable offset into the high page goes through C.
+define void @set_port(i8 %port, i8 %v) {
+; CHECK-LABEL: set_port:
+; CHECK: ld c, a
+; CHECK-NEXT: ld a, h
+; CHECK-NEXT: ld (c), a ; encoding: [0xe2]
+  %z = zext i8 %port to i16
+  %a = add i16 %z, 65280
+  %p = inttoptr i16 %a to i8*
+  store volatile i8 %v, i8* %p
+  ret void
+}
+
+define i8 @get_port(i8 %port) {
+; CHECK-LABEL: get_port:
+; CHECK: ld c, a
+; CHECK-NEXT: ld a, (c) ; encoding: [0xf2]
+  %z = zext i8 %port to i16
+  %a = or i16 %z, 65280
+  %p = inttoptr i16 %a to i8*
+  %v = load volatile i8* %p
+  ret i8 %v
+}
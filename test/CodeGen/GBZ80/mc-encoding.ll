@@ -0,0 +1,109 @@
+; RUN: llc < %s -march=gbz80 -show-mc-encoding | FileCheck %s
+; RUN: llc < %s -march=gbz80 -filetype=obj -o %t
+; RUN: llvm-readobj -h -r %t | FileCheck -check-prefix=OBJ %s
+
+@g = global i8 5
+@w = global i16 0
+@p = global i8* @g
+
+declare void @ext()
+
+; OBJ: Machine: EM_Z80
+; OBJ: Relocations [
+; OBJ:   Section ({{[0-9]+}}) .rela.text {
+; OBJ:     0x1 R_GBZ80_16 g 0x0
+; OBJ:     0x5 R_GBZ80_16 g 0x0
+; OBJ:     0x9 R_GBZ80_16 ext 0x0
+; OBJ:   Section ({{[0-9]+}}) .rela.data {
+; OBJ:     0x1 R_GBZ80_16 g 0x0
+
+define i8 @loadg() {
+; CHECK-LABEL: loadg:
+; CHECK: ld a, (g) ; encoding: [0xfa,A,A]
+; CHECK-NEXT: ; fixup A - offset: 1, value: g, kind: fixup_16
+  %v = load i8* @g
+  ret i8 %v
+}
+
+define void @storeg(i8 %v) {
+; CHECK-LABEL: storeg:
+; CHECK: ld (g), a ; encoding: [0xea,A,A]
+  store i8 %v, i8* @g
+  ret void
+}
+
+define void @calls() {
+; CHECK-LABEL: calls:
+; CHECK: call ext ; encoding: [0xcd,A,A]
+; CHECK-NEXT: ; fixup A - offset: 1, value: ext, kind: fixup_16
+; CHECK-NEXT: ret ; encoding: [0xc9]
+  call void @ext()
+  ret void
+}
+
+define i16 @const16() {
+; CHECK-LABEL: const16:
+; CHECK: ld hl, 4660 ; encoding: [0x21,0x34,0x12]
+  ret i16 4660
+}
+
+define i8 @neg8(i8 %a) {
+; CHECK-LABEL: neg8:
+; CHECK: cpl ; encoding: [0x2f]
+; CHECK-NEXT: inc a ; encoding: [0x3c]
+  %r = sub i8 0, %a
+  ret i8 %r
+}
+
+define i8 @shl2(i8 %a) {
+; CHECK-LABEL: shl2:
+; CHECK: sla a ; encoding: [0xcb,0x27]
+  %r = shl i8 %a, 2
+  ret i8 %r
+}
+
+define i16 @add16(i16 %a) {
+; CHECK-LABEL: add16:
+; CHECK: push bc ; encoding: [0xc5]
+; CHECK: ld bc, 300 ; encoding: [0x01,0x2c,0x01]
+; CHECK-NEXT: add hl, bc ; encoding: [0x09]
+; CHECK-NEXT: pop bc ; encoding: [0xc1]
+  %r = add i16 %a, 300
+  ret i16 %r
+}
+
+define i16 @sub16(i16 %a) {
+; CHECK-LABEL: sub16:
+; CHECK: ld a, l ; encoding: [0x7d]
+; CHECK-NEXT: sbc a, e ; encoding: [0x9b]
+; CHECK-NEXT: ld l, a ; encoding: [0x6f]
+; CHECK-NEXT: ld a, h ; encoding: [0x7c]
+; CHECK-NEXT: sbc a, d ; encoding: [0x9a]
+; CHECK-NEXT: ld h, a ; encoding: [0x67]
+  %b = load i16* @w
+  %r = sub i16 %a, %b
+  ret i16 %r
+}
+
+define i8 @branch(i8 %a, i8 %b) {
+; CHECK-LABEL: branch:
+; CHECK: jr nz, .LBB{{[0-9_]+}} ; encoding: [0x20,A]
+; CHECK-NEXT: ; fixup A - offset: 1, value: .LBB{{[0-9_]+}}, kind: fixup_jr_pcrel_8
+entry:
+  %c = icmp eq i8 %a, %b
+  br i1 %c, label %t, label %f
+t:
+  ret i8 1
+f:
+  ret i8 2
+}
+
+define i8 @stackslot() {
+; CHECK-LABEL: stackslot:
+; CHECK: ld hl, sp+1 ; encoding: [0xf8,0x01]
+  %a = alloca [2 x i8]
+  %p = getelementptr [2 x i8]* %a, i16 0, i16 1
+  store volatile i8 7, i8* %p
+  %v = load volatile i8* %p
+  ret i8 %v
+}
@@ -0,0 +1,87 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+declare void @llvm.memcpy.p0i8.p0i8.i16(i8*, i8*, i16, i32, i1)
+declare void @llvm.memset.p0i8.i16(i8*, i8, i16, i32, i1)
+
+@tile = global [16 x i8] zeroinitializer
+
+; The halves of a 16-bit access step HL along.
+define i16 @load16(i16* %p) {
+; CHECK-LABEL: load16:
+; CHECK: ld a, (hl+)
+; CHECK: ld {{[bcde]}}, (hl)
+  %v = load i16* %p
+  ret i16 %v
+}
+
+define void @store16(i16* %p) {
+; CHECK-LABEL: store16:
+; CHECK: ld a, 52
+; CHECK-NEXT: ld (hl+), a
+; CHECK-NEXT: ld (hl), 18
+  store i16 4660, i16* %p
+  ret void
+}
+
+define void @store_down(i8* %p, i8 %v) {
+; CHECK-LABEL: store_down:
+; CHECK: ld (hl-), a
+; CHECK-NEXT: ld (hl), a
+  store i8 %v, i8* %p
+  %q = getelementptr i8* %p, i16 -1
+  store i8 %v, i8* %q
+  ret void
+}
+
+; Copies of a variable or large size loop around ld a,(hl+).
+define void @copy_tile(i8* %d) {
+; CHECK-LABEL: copy_tile:
+; CHECK: ld bc, 16
+; CHECK: ld hl, tile
+; CHECK-NEXT: inc b
+; CHECK-NEXT: inc c
+; CHECK-NEXT: jr [[NEXT:.Ltmp[0-9]+]]
+; CHECK-NEXT: [[LOOP:.Ltmp[0-9]+]]:
+; CHECK-NEXT: ld a, (hl+)
+; CHECK-NEXT: ld (de), a
+; CHECK-NEXT: inc de
+; CHECK-NEXT: [[NEXT]]:
+; CHECK-NEXT: dec c
+; CHECK-NEXT: jr nz, [[LOOP]]
+; CHECK-NEXT: dec b
+; CHECK-NEXT: jr nz, [[LOOP]]
+  call void @llvm.memcpy.p0i8.p0i8.i16(i8* %d, i8* getelementptr ([16 x i8]* @tile, i16 0, i16 0), i16 16, i32 1, i1 false)
+  ret void
+}
+
+define void @copy_vram(i16 %n) {
+; CHECK-LABEL: copy_vram:
+; CHECK: ld de, -32768
+; CHECK: ld hl, 16384
+; CHECK: ld a, (hl+)
+; CHECK-NEXT: ld (de), a
+  call void @llvm.memcpy.p0i8.p0i8.i16(i8* inttoptr (i16 32768 to i8*), i8* inttoptr (i16 16384 to i8*), i16 %n, i32 1, i1 false)
+  ret void
+}
+
+; Fills loop around ld (hl+),a with the value in A.
+define void @fill(i8* %d, i8 %v) {
+; CHECK-LABEL: fill:
+; CHECK: ld bc, 300
+; CHECK: jr [[NEXT:.Ltmp[0-9]+]]
+; CHECK-NEXT: [[LOOP:.Ltmp[0-9]+]]:
+; CHECK-NEXT: ld (hl+), a
+; CHECK-NEXT: [[NEXT]]:
+; CHECK-NEXT: dec c
+  call void @llvm.memset.p0i8.i16(i8* %d, i8 %v, i16 300, i32 1, i1 false)
+  ret void
+}
+
+; Two bytes are still done with single stores.
+define void @fill2(i8* %d, i8 %v) {
+; CHECK-LABEL: fill2:
+; CHECK: ld (hl+), a
+; CHECK-NEXT: ld (hl), a
+  call void @llvm.memset.p0i8.i16(i8* %d, i8 %v, i16 2, i32 1, i1 false)
+  ret void
+}
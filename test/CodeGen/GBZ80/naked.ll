@@ -0,0 +1,14 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+; A naked function gets neither a prologue nor an epilogue.
+define void @stub() naked {
+; CHECK-LABEL: stub:
+; CHECK-NEXT: BB#0:
+; CHECK-NEXT: ;APP
+; CHECK-NEXT: ld a, 1
+; CHECK-NEXT: reti
+; CHECK-NEXT: ;NO_APP
+; CHECK-NOT: ret
+  call void asm sideeffect "ld a, 1\0A\09reti", ""()
+  unreachable
+}
@@ -0,0 +1,83 @@
+; RUN: llc < %s -march=gbz80 -verify-machineinstrs | FileCheck %s
+; RUN: llc < %s -march=gbz80 -show-mc-encoding | FileCheck %s -check-prefix=ENC
+
+; Compares with zero that the flags of the previous instruction make
+; redundant are removed, the rest become or a. A load through HL that only
+; feeds the next ALU operation is folded into it.
+
+@g = global i8 0
+
+define void @countdown(i8 %n) {
+; CHECK-LABEL: countdown:
+; CHECK: dec a
+; CHECK-NEXT: jr nz
+entry:
+  br label %loop
+loop:
+  %i = phi i8 [ %n, %entry ], [ %d, %loop ]
+  store volatile i8 %i, i8* @g
+  %d = add i8 %i, -1
+  %c = icmp ne i8 %d, 0
+  br i1 %c, label %loop, label %done
+done:
+  ret void
+}
+
+define i8 @andtest(i8 %a, i8 %b) {
+; CHECK-LABEL: andtest:
+; CHECK: and h
+; CHECK-NEXT: jr nz
+  %x = and i8 %a, %b
+  %c = icmp eq i8 %x, 0
+  br i1 %c, label %z, label %nz
+z:
+  ret i8 1
+nz:
+  ret i8 %x
+}
+
+define i8 @scan(i8* %p) {
+; CHECK-LABEL: scan:
+; CHECK: ld a, (hl)
+; CHECK-NEXT: inc hl
+; CHECK-NEXT: or a
+; CHECK-NEXT: jr nz
+entry:
+  br label %loop
+loop:
+  %q = phi i8* [ %p, %entry ], [ %n, %loop ]
+  %v = load i8* %q
+  %n = getelementptr i8* %q, i16 1
+  %c = icmp ne i8 %v, 0
+  br i1 %c, label %loop, label %done
+done:
+  %r = ptrtoint i8* %n to i16
+  %t = trunc i16 %r to i8
+  ret i8 %t
+}
+
+define i8 @cmpmem(i8 %a, i8* %p) {
+; CHECK-LABEL: cmpmem:
+; CHECK-NOT: ld
+; CHECK: cp (hl)
+; ENC: cp (hl) ; encoding: [0xbe]
+  %v = load i8* %p
+  %c = icmp eq i8 %a, %v
+  br i1 %c, label %z, label %nz
+z:
+  ret i8 7
+nz:
+  ret i8 3
+}
+
+define i8 @addmem(i8 %a, i8* %p) {
+; CHECK-LABEL: addmem:
+; CHECK-NOT: ld
+; CHECK: add a, (hl)
+; CHECK-NEXT: xor 3
+; ENC: add a, (hl) ; encoding: [0x86]
+  %v = load i8* %p
+  %s = add i8 %a, %v
+  %t = xor i8 %s, 3
+  ret i8 %t
+}
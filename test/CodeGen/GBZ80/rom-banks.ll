@@ -0,0 +1,100 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t
+; RUN: FileCheck %s -check-prefix=SYM < %t.sym
+; RUN: od -A x -t x1 -v %t | FileCheck %s
+; RUN: llvm-gbz80-sim %t -symbols=%t.sym | FileCheck %s -check-prefix=SIM
+
+; The read-only data fills most of bank 0, and the padding in the sections of
+; @far and @main keeps them out of each other's bank. The image needs an MBC.
+
+; SYM: 00:0150 0045 __gbz80_startup
+; SYM-NEXT: 00:0195 0008 tick
+; SYM-NEXT: 00:019d 0008 vblank
+; SYM-NEXT: 00:347a 0034 __gbz80_far_enter
+; SYM-NEXT: 00:34ae 0027 __gbz80_far_leave
+; SYM-NEXT: 00:34d5 000e __gbz80_far_main
+; SYM-NEXT: 00:34e3 000e __gbz80_far_far
+; SYM-NEXT: 01:4000 {{[0-9a-f]+}} far
+; SYM-NEXT: 01:{{[0-9a-f]+}} 2af8 far_pad
+; SYM-NEXT: 02:4000 {{[0-9a-f]+}} rotate
+; SYM-NEXT: 02:{{[0-9a-f]+}} {{[0-9a-f]+}} main
+; SYM-NEXT: 02:{{[0-9a-f]+}} 2710 main_pad
+
+; MBC5 cartridge with four banks of ROM.
+; CHECK: 000140 00 00 00 00 00 00 00 19 01
+
+; @vblank calls @tick directly.
+; CHECK: 000190 {{.*}} cd
+; CHECK-NEXT: 0001a0 95 01
+
+; __gbz80_far_enter keeps the bank and the return address of the caller on
+; the side stack at $de00, indexed by $ddff, and drops the return address from
+; the stack so that the callee finds its stack arguments:
+;   push hl; push de; ld d,a; ld a,($ddff); ld l,a; ld h,$de; ld a,($c000)
+;   ld (hl),a; inc l; ld a,d; ld ($c000),a; ld ($2000),a; ld d,h; ld e,l
+; CHECK: 003470 00 00 00 00 00 00 00 00 00 00 e5 d5 57 fa ff dd
+; CHECK-NEXT: 003480 6f 26 de fa 00 c0 77 2c 7a ea 00 c0 ea 00 20 54
+
+; The trampoline of @far keeps A in the scratch byte at $c001 and enters bank
+; 1, calls @far and leaves through __gbz80_far_leave:
+;   ld ($c001),a; ld a,1; call __gbz80_far_enter; call far
+;   jp __gbz80_far_leave
+; CHECK: 0034e0 c3 ae 34 ea 01 c0 3e 01 cd 7a 34 cd 00 40 c3 ae
+; CHECK-NEXT: 0034f0 34 00
+
+; @main in bank 2 calls @far through its trampoline, with two arguments on
+; the stack, and @rotate tail calls it with its own.
+; CHECK: 008050 e1 e8 08 c3 e3 34
+; CHECK: 008090 cd e3 34
+
+; (1 + 2*2 + 3*4 + 4*8 + 5*16) << 8 | (5 + 1*2 + 2*4 + 3*8 + 4*16)
+; SIM: halted after {{[0-9]+}} cycles
+; SIM: hl = 0x8167
+
+@data = constant [13000 x i8] zeroinitializer
+@far_pad = constant [11000 x i8] zeroinitializer, section ".text.far"
+@main_pad = constant [10000 x i8] zeroinitializer, section ".text.main"
+
+define fastcc i16 @far(i16 %a, i16 %b, i16 %c, i16 %d, i16 %e) {
+  %b1 = shl i16 %b, 1
+  %c2 = shl i16 %c, 2
+  %d3 = shl i16 %d, 3
+  %e4 = shl i16 %e, 4
+  %r0 = add i16 %a, %b1
+  %r1 = add i16 %r0, %c2
+  %r2 = add i16 %r1, %d3
+  %r = add i16 %r2, %e4
+  ret i16 %r
+}
+
+define fastcc i16 @rotate(i16 %a, i16 %b, i16 %c, i16 %d, i16 %e)
+    section ".text.main" {
+  %r = tail call fastcc i16 @far(i16 %e, i16 %a, i16 %b, i16 %c, i16 %d)
+  ret i16 %r
+}
+
+define i16 @main() {
+  %x = call fastcc i16 @far(i16 1, i16 2, i16 3, i16 4, i16 5)
+  %y = call fastcc i16 @rotate(i16 1, i16 2, i16 3, i16 4, i16 5)
+  %h = shl i16 %x, 8
+  %r = add i16 %h, %y
+  ret i16 %r
+}
+
+; The handler and the function it calls stay in bank 0, whatever bank they
+; interrupt.
+@ticks = global i8 0
+
+define void @tick() {
+  %v = load volatile i8* @ticks
+  %n = add i8 %v, 1
+  store volatile i8 %n, i8* @ticks
+  ret void
+}
+
+define void @vblank() #0 {
+  call void @tick()
+  ret void
+}
+
+attributes #0 = { "interrupt"="vblank" }
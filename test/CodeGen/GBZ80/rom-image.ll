@@ -0,0 +1,26 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -gbz80-rom-title=TEST -o %t
+; RUN: od -A x -t x1 -v %t | FileCheck %s
+
+; Entry point, Nintendo logo, title and checksums of the cartridge header.
+; CHECK: 000100 00 c3 50 01 ce ed 66 66 cc 0d 00 0b 03 73 00 83
+; CHECK: 000130 bb b9 33 3e 54 45 53 54 00 00 00 00 00 00 00 00
+; CHECK: 000140 00 00 00 00 00 00 00 00 00 00 01 00 00 a6 35 a8
+
+; Startup: di, ld sp,$e000, select bank 1, copy .data to WRAM, clear .bss,
+; copy .hram to $ff80 and call main.
+; CHECK: 000150 f3 31 00 e0 3e 01 ea 00 c0 ea 00 20 21 95 01 11
+; CHECK: 000170 05 c0 01 03 00 78 b1 28 05 af 22 0b 18 f7 21 98
+; CHECK: 000180 01 0e 80 06 01 78 b7 28 06 2a e2 0c 05 18 f6 cd
+
+; main reads @g from its WRAM address and writes @h with ldh.
+; CHECK: 000190 9c 01 76 18 fd 00 00 01 07 00 00 00 fa 04 c0 e0
+; CHECK: 0001a0 80 c9 00 00 00 00 00 00 00 00 00 00 00 00 00 00
+
+@g = global i8 1
+@h = global i8 7, section ".hram"
+
+define i8 @main() {
+  %v = load i8* @g
+  store i8 %v, i8* @h
+  ret i8 %v
+}
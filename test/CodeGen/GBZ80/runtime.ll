@@ -0,0 +1,147 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 | FileCheck %s -check-prefix=RT
+
+; Multiplies by a constant with few nonzero digits are shifts and adds.
+define i16 @mul10(i16 %a) {
+; CHECK-LABEL: mul10:
+; CHECK-NOT: call
+; CHECK: add hl, [[REG:bc|de]]
+; CHECK-NOT: call
+; CHECK: ret
+  %r = mul i16 %a, 10
+  ret i16 %r
+}
+
+; x * 7 = (x << 3) - x
+define i8 @mul7(i8 %a) {
+; CHECK-LABEL: mul7:
+; CHECK: sla a
+; CHECK-NEXT: sla a
+; CHECK-NEXT: sla a
+; CHECK-NEXT: sub
+; CHECK-NEXT: ret
+  %r = mul i8 %a, 7
+  ret i8 %r
+}
+
+; x * 11 = (((x << 2) - x) << 2) - x. Each subtract clears the carry for
+; itself.
+define i16 @mul11(i16 %a) {
+; CHECK-LABEL: mul11:
+; CHECK-NOT: call
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+; CHECK-NOT: call
+; CHECK: ret
+  %r = mul i16 %a, 11
+  ret i16 %r
+}
+
+; x * -5 = ((0 - x) << 2) - x
+define i16 @mulm5(i16 %a) {
+; CHECK-LABEL: mulm5:
+; CHECK-NOT: call
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+; CHECK-NOT: call
+; CHECK: ret
+  %r = mul i16 %a, -5
+  ret i16 %r
+}
+
+define i16 @sub2(i16 %a, i16 %b, i16 %c) {
+; CHECK-LABEL: sub2:
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+; CHECK: scf
+; CHECK-NEXT: ccf
+; CHECK: sbc a,
+  %d = sub i16 %b, %a
+  %e = sub i16 %d, %c
+  ret i16 %e
+}
+
+define i16 @mul16(i16 %a, i16 %b) {
+; CHECK-LABEL: mul16:
+; CHECK: call __mulhi3
+  %r = mul i16 %a, %b
+  ret i16 %r
+}
+
+define i16 @mulbig(i16 %a) {
+; CHECK-LABEL: mulbig:
+; CHECK: ld de, 21845
+; CHECK: call __mulhi3
+  %r = mul i16 %a, 21845
+  ret i16 %r
+}
+
+define i8 @sdiv8(i8 %a, i8 %b) {
+; CHECK-LABEL: sdiv8:
+; CHECK: call __divqi3
+  %r = sdiv i8 %a, %b
+  ret i8 %r
+}
+
+define i16 @udiv16(i16 %a, i16 %b) {
+; CHECK-LABEL: udiv16:
+; CHECK: call __udivhi3
+  %r = udiv i16 %a, %b
+  ret i16 %r
+}
+
+define i32 @shl32(i32 %a, i8 %b) {
+; CHECK-LABEL: shl32:
+; CHECK: call __ashlsi3
+  %c = zext i8 %b to i32
+  %r = shl i32 %a, %c
+  ret i32 %r
+}
+
+define i32 @ashr32(i32 %a, i8 %b) {
+; CHECK-LABEL: ashr32:
+; CHECK: call __ashrsi3
+  %c = zext i8 %b to i32
+  %r = ashr i32 %a, %c
+  ret i32 %r
+}
+
+; A routine the module defines itself is not replaced.
+define i32 @__ashrsi3(i32 %a, i8 %b) {
+  ret i32 %a
+}
+
+; The routines called follow the code, in the order of the first call, then
+; the ones they call in turn.
+; RT: .weak __mulhi3
+; RT-NEXT: __mulhi3:
+; RT: add hl, de
+; RT: .weak __divqi3
+; RT-NEXT: __divqi3:
+; RT: call __gbz80_sdivqi
+; RT: .weak __udivhi3
+; RT-NEXT: __udivhi3:
+; RT-NEXT: push bc
+; RT-NEXT: call __gbz80_udivmodhi
+; RT-NEXT: ld h, b
+; RT-NEXT: ld l, c
+; RT-NEXT: pop bc
+; RT-NEXT: ret
+; RT: .weak __ashlsi3
+; RT-NEXT: __ashlsi3:
+; RT-NEXT: and 31
+; RT-NOT: .weak __ashrsi3
+; RT: __gbz80_sdivqi:
+; RT: jp __umodqi3
+; RT: __gbz80_udivmodhi:
+; RT: __umodqi3:
+; RT-NOT: __ashrsi3:
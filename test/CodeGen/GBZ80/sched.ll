@@ -0,0 +1,21 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+@g = global i8 0
+
+; The 16 T-state load of @g is independent of the arithmetic, it is sunk to
+; its use instead of keeping its result live in a callee-saved register.
+define i8 @sched(i8 %a, i8 %b) {
+; CHECK-LABEL: sched:
+; CHECK-NOT: push
+; CHECK: add a, h
+; CHECK-NEXT: xor 5
+; CHECK-NEXT: ld h, a
+; CHECK-NEXT: ld a, (g)
+; CHECK-NEXT: add a, h
+; CHECK-NEXT: ret
+  %x = load i8* @g
+  %y = add i8 %a, %b
+  %z = xor i8 %y, 5
+  %r = add i8 %z, %x
+  ret i8 %r
+}
@@ -0,0 +1,70 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+
+define i8 @shl4(i8 %a) {
+; CHECK-LABEL: shl4:
+; CHECK: swap a
+; CHECK-NEXT: and -16
+; CHECK-NEXT: ret
+  %r = shl i8 %a, 4
+  ret i8 %r
+}
+
+define i8 @lshr6(i8 %a) {
+; CHECK-LABEL: lshr6:
+; CHECK: rlc a
+; CHECK-NEXT: rlc a
+; CHECK-NEXT: and 3
+; CHECK-NEXT: ret
+  %r = lshr i8 %a, 6
+  ret i8 %r
+}
+
+define i8 @ashr7(i8 %a) {
+; CHECK-LABEL: ashr7:
+; CHECK: add a, a
+; CHECK-NEXT: sbc a, a
+; CHECK-NEXT: ret
+  %r = ashr i8 %a, 7
+  ret i8 %r
+}
+
+define i8 @rotl3(i8 %a) {
+; CHECK-LABEL: rotl3:
+; CHECK: swap a
+; CHECK-NEXT: rrc a
+; CHECK-NEXT: ret
+  %x = shl i8 %a, 3
+  %y = lshr i8 %a, 5
+  %r = or i8 %x, %y
+  ret i8 %r
+}
+
+; x << 7 is x >> 1 moved up by a byte.
+define i16 @shl7(i16 %a) {
+; CHECK-LABEL: shl7:
+; CHECK: srl h
+; CHECK-NEXT: rr [[LO:[bcl]]]
+; CHECK-NEXT: rr [[ZERO:[bc]]]
+; CHECK-NOT: sla
+  %r = shl i16 %a, 7
+  ret i16 %r
+}
+
+define i16 @lshr12(i16 %a) {
+; CHECK-LABEL: lshr12:
+; CHECK: swap h
+; CHECK-NEXT: ld a, h
+; CHECK-NEXT: and 15
+; CHECK-NOT: srl
+  %r = lshr i16 %a, 12
+  ret i16 %r
+}
+
+define i16 @ashr8(i16 %a) {
+; CHECK-LABEL: ashr8:
+; CHECK: add a, [[HI:[bc]]]
+; CHECK-NEXT: sbc a, a
+; CHECK-NOT: sra
+  %r = ashr i16 %a, 8
+  ret i16 %r
+}
@@ -0,0 +1,62 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -gbz80-shift-ladder=false | FileCheck %s -check-prefix=LOOP
+
+; At -O2 a variable shift jumps into an unrolled ladder of shifts.
+define i8 @shl8(i8 %a, i8 %b) {
+; CHECK-LABEL: shl8:
+; CHECK: and 7
+; CHECK-NEXT: add a, a
+; CHECK-NEXT: cpl
+; CHECK-NEXT: scf
+; CHECK-NEXT: ld hl, [[END:.Ltmp[0-9]+]]
+; CHECK-NEXT: adc a, l
+; CHECK-NEXT: ld l, a
+; CHECK-NEXT: ld a, h
+; CHECK-NEXT: adc a, -1
+; CHECK-NEXT: ld h, a
+; CHECK-NEXT: jp (hl)
+; CHECK-NEXT: sla [[R:[bcde]]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: sla [[R]]
+; CHECK-NEXT: [[END]]:
+
+; LOOP-LABEL: shl8:
+; LOOP: or a
+; LOOP: sla
+; LOOP: dec
+; LOOP: jr nz
+  %r = shl i8 %a, %b
+  ret i8 %r
+}
+
+define i16 @ashr16(i16 %a, i8 %b) {
+; CHECK-LABEL: ashr16:
+; CHECK: and 15
+; CHECK-NEXT: add a, a
+; CHECK-NEXT: add a, a
+; CHECK: jp (hl)
+; CHECK-NEXT: sra [[HI:[bd]]]
+; CHECK-NEXT: rr [[LO:[ce]]]
+; CHECK-NEXT: sra [[HI]]
+; CHECK-NEXT: rr [[LO]]
+  %c = zext i8 %b to i16
+  %r = ashr i16 %a, %c
+  ret i16 %r
+}
+
+; The ladder is not used when optimizing for size.
+define i8 @lshr8_optsize(i8 %a, i8 %b) optsize {
+; CHECK-LABEL: lshr8_optsize:
+; CHECK: or a
+; CHECK: srl
+; CHECK-NEXT: dec
+; CHECK-NEXT: jr nz
+; CHECK-NOT: jp (hl)
+; CHECK: ret
+  %r = lshr i8 %a, %b
+  ret i8 %r
+}
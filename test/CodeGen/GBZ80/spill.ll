@@ -0,0 +1,116 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -O0 | FileCheck %s -check-prefix=O0
+
+; Spill slots are addressed with ld hl,sp+e. HL is pushed around the access
+; when it is live, and a 16-bit spill reloaded in the same block in stack
+; order becomes a push and pop.
+
+declare i16 @get()
+
+define i16 @lifo() {
+; CHECK-LABEL: lifo:
+; CHECK-NOT: add sp
+; CHECK: call get
+; CHECK-NEXT: push hl
+; CHECK: add hl, de
+; CHECK-NEXT: pop [[R:bc|de]]
+; CHECK-NEXT: add hl, [[R]]
+; CHECK-NOT: add sp
+; CHECK: ret
+  %x = call i16 @get()
+  %y = call i16 @get()
+  %z = call i16 @get()
+  %w = call i16 @get()
+  %1 = add i16 %w, %z
+  %2 = add i16 %1, %y
+  %3 = add i16 %2, %x
+  ret i16 %3
+}
+
+@p = global [8 x i8] zeroinitializer
+
+define i8 @pressure(i8 %x) {
+; CHECK-LABEL: pressure:
+; CHECK: add sp, -4
+; CHECK-NEXT: ld hl, sp+3
+; CHECK-NEXT: ld (hl), a
+; CHECK: push hl
+; CHECK-NEXT: ld hl, sp+{{[0-9]+}}
+; CHECK-NEXT: ld (hl), a
+; CHECK-NEXT: pop hl
+; CHECK: ld {{[bcde]}}, (hl)
+; CHECK-NEXT: pop hl
+; CHECK: add a, (hl)
+; CHECK-NEXT: add sp, 4
+  %a = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 0)
+  %b = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 1)
+  %c = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 2)
+  %d = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 3)
+  %e = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 4)
+  %f = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 5)
+  %g = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 6)
+  %h = load volatile i8* getelementptr ([8 x i8]* @p, i16 0, i16 7)
+  %1 = add i8 %a, %b
+  %2 = add i8 %1, %c
+  %3 = add i8 %2, %d
+  %4 = add i8 %3, %e
+  %5 = add i8 %4, %f
+  %6 = add i8 %5, %g
+  %7 = add i8 %6, %h
+  %8 = xor i8 %7, %a
+  %9 = xor i8 %8, %b
+  %10 = xor i8 %9, %c
+  %11 = xor i8 %10, %d
+  %12 = xor i8 %11, %e
+  %13 = xor i8 %12, %f
+  %14 = xor i8 %13, %g
+  %15 = xor i8 %14, %h
+  %16 = add i8 %15, %x
+  ret i8 %16
+}
+
+declare fastcc i16 @five(i16, i16, i16, i16, i16)
+
+; %x is spilled after the stack arguments are stored. A push there would
+; move them away from the return address, so the slot stays.
+define i16 @stack_args(i16 %a, i16 %b) {
+; CHECK-LABEL: stack_args:
+; CHECK: add sp, -6
+; CHECK: add hl, de
+; CHECK: ld hl, sp+{{[0-9]+}}
+; CHECK-NEXT: ld (hl), a
+; CHECK: ld hl, sp+{{[0-9]+}}
+; CHECK-NEXT: ld (hl), a
+; CHECK-NEXT: pop hl
+; CHECK-NOT: push
+; CHECK: call five
+; CHECK-NEXT: push hl
+; CHECK-NEXT: ld hl, sp+{{[0-9]+}}
+; CHECK-NEXT: ld c, (hl)
+; CHECK: add sp, 6
+  %x = add i16 %a, %b
+  %r = call fastcc i16 @five(i16 %x, i16 1, i16 2, i16 3, i16 4)
+  %s = add i16 %r, %x
+  ret i16 %s
+}
+
+; Two spills become a push and a pop. The second pop is right before the
+; return, it comes before the frame is freed and the callee-saved registers
+; are popped.
+define i32 @pop_last(i32 %a, i32 %b) {
+; O0-LABEL: pop_last:
+; O0: add sp, -8
+; O0: pop de
+; O0: pop de
+; O0-NEXT: add sp, 8
+; O0-NEXT: pop bc
+; O0-NEXT: ret
+  %d = sub i32 %b, %a
+  ret i32 %d
+}
+
+; The byte A is saved to when a spill runs out of registers is defined once,
+; in high RAM, by the module that uses it.
+; O0: .section .hram,"aw",@progbits
+; O0-NEXT: __gbz80_scratch:
+; O0-NEXT: .zero 1
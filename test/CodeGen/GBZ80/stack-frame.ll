@@ -0,0 +1,74 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -show-mc-encoding | FileCheck -check-prefix=ENC %s
+
+; Stack objects are addressed with ld hl,sp+e and the frame is allocated
+; with add sp,e, HL stays allocatable.
+
+declare void @use(i8*)
+declare void @four(i16, i16, i16, i16)
+
+define i8 @local(i8 %x) {
+; CHECK-LABEL: local:
+; CHECK: add sp, -4
+; CHECK-NEXT: ld hl, sp+2
+; CHECK-NEXT: ld (hl), a
+; CHECK-NEXT: ld a, (hl)
+; CHECK-NEXT: add sp, 4
+; CHECK-NEXT: ret
+; ENC-LABEL: local:
+; ENC: add sp, -4 ; encoding: [0xe8,0xfc]
+; ENC: ld hl, sp+2 ; encoding: [0xf8,0x02]
+  %a = alloca [4 x i8]
+  %p = getelementptr [4 x i8]* %a, i16 0, i16 2
+  store volatile i8 %x, i8* %p
+  %v = load volatile i8* %p
+  ret i8 %v
+}
+
+; Offsets out of reach of ld hl,sp+e are added up in HL, large frames take
+; several add sp,e.
+define void @big() {
+; CHECK-LABEL: big:
+; CHECK: add sp, -128
+; CHECK-NEXT: add sp, -72
+; CHECK-NEXT: ld hl, 150
+; CHECK-NEXT: add hl, sp
+; CHECK-NEXT: call use
+; CHECK-NEXT: ld hl, sp+0
+; CHECK-NEXT: call use
+; CHECK-NEXT: add sp, 127
+; CHECK-NEXT: add sp, 73
+  %a = alloca [200 x i8]
+  %p = getelementptr [200 x i8]* %a, i16 0, i16 150
+  call void @use(i8* %p)
+  %q = getelementptr [200 x i8]* %a, i16 0, i16 0
+  call void @use(i8* %q)
+  ret void
+}
+
+; Outgoing stack arguments are stored right above SP.
+define void @stackarg(i16 %x) {
+; CHECK-LABEL: stackarg:
+; CHECK: add sp, -2
+; CHECK: ld hl, sp+0
+; CHECK-NEXT: ld (hl+), a
+; CHECK-NEXT: ld (hl), 0
+; CHECK: call four
+; CHECK-NEXT: add sp, 2
+  call void @four(i16 %x, i16 1, i16 2, i16 7)
+  ret void
+}
+
+; Incoming stack arguments are above the return address and the saved
+; registers.
+define i16 @incoming(i16 %x, i16 %y, i16 %z, i16 %w) {
+; CHECK-LABEL: incoming:
+; CHECK: push de
+; CHECK-NEXT: push bc
+; CHECK: ld hl, sp+6
+; CHECK-NEXT: ld e, (hl)
+; CHECK-NEXT: ld hl, sp+7
+; CHECK-NEXT: ld d, (hl)
+  %s = add i16 %x, %w
+  ret i16 %s
+}
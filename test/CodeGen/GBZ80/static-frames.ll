@@ -0,0 +1,57 @@
+; RUN: llc < %s -march=gbz80 -gbz80-static-frames | FileCheck %s
+
+; The locals of functions outside of call graph cycles live at fixed
+; addresses. A callee is placed after the frames of all of its callers, while
+; functions that are never live at the same time share the same bytes.
+
+define internal i8 @leaf(i8 %x) {
+; CHECK-LABEL: leaf:
+; CHECK: ld (__static_frames+3), a
+; CHECK-NEXT: ld a, (__static_frames+3)
+  %a = alloca [4 x i8]
+  %p = getelementptr [4 x i8]* %a, i16 0, i16 2
+  store volatile i8 %x, i8* %p
+  %v = load volatile i8* %p
+  ret i8 %v
+}
+
+define i8 @mid(i8 %x) {
+; CHECK-LABEL: mid:
+; CHECK: ld (__static_frames), a
+; CHECK-NEXT: call leaf
+; CHECK: ld a, (__static_frames)
+  %b = alloca i8
+  store volatile i8 %x, i8* %b
+  %r = call i8 @leaf(i8 %x)
+  %v = load volatile i8* %b
+  %s = add i8 %v, %r
+  ret i8 %s
+}
+
+define i8 @other(i8 %x) {
+; CHECK-LABEL: other:
+; CHECK: ld (__static_frames), a
+  %c = alloca i16
+  %c8 = bitcast i16* %c to i8*
+  store volatile i8 %x, i8* %c8
+  %v = load volatile i8* %c8
+  ret i8 %v
+}
+
+; Recursion keeps the callee after the deepest caller of the cycle.
+define i8 @rec(i8 %x) {
+; CHECK-LABEL: rec:
+; CHECK: call rec
+; CHECK: call leaf
+  %c = icmp eq i8 %x, 0
+  br i1 %c, label %done, label %more
+more:
+  %y = add i8 %x, -1
+  %r = call i8 @rec(i8 %y)
+  %z = call i8 @leaf(i8 %r)
+  ret i8 %z
+done:
+  ret i8 0
+}
+
+; CHECK: .comm __static_frames,5,1
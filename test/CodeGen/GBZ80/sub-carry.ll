@@ -0,0 +1,68 @@
+; RUN: llc < %s -march=gbz80 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t.sym -o %t.gb
+; RUN: llvm-gbz80-sim %t.gb -symbols=%t.sym | FileCheck %s
+; RUN: llc < %s -march=gbz80 -O0 -filetype=obj -gbz80-rom -function-sections \
+; RUN:   -gbz80-rom-symbols=%t0.sym -o %t0.gb
+; RUN: llvm-gbz80-sim %t0.gb -symbols=%t0.sym | FileCheck %s
+
+; A 16-bit subtract clears the carry before its sbc. Several subtracts in one
+; DAG, from a constant multiply or a chain, each get their own carry clear.
+; @main returns the number of the first wrong result, 0 if there is none.
+
+; CHECK: halted after {{[0-9]+}} cycles
+; CHECK: hl = 0x0000
+
+define i16 @mul11(i16 %a) {
+  %r = mul i16 %a, 11
+  ret i16 %r
+}
+
+define i16 @mulm5(i16 %a) {
+  %r = mul i16 %a, -5
+  ret i16 %r
+}
+
+define i16 @sub2(i16 %a, i16 %b, i16 %c) {
+  %d = sub i16 %b, %a
+  %e = sub i16 %d, %c
+  ret i16 %e
+}
+
+define i32 @sub2_32(i32 %a, i32 %b, i32 %c) {
+  %d = sub i32 %b, %a
+  %e = sub i32 %d, %c
+  ret i32 %e
+}
+
+define i16 @main() {
+entry:
+  %r1 = call i16 @mul11(i16 1234)
+  %ok1 = icmp eq i16 %r1, 13574
+  br i1 %ok1, label %t2, label %fail1
+
+t2:
+  %r2 = call i16 @mulm5(i16 1234)
+  %ok2 = icmp eq i16 %r2, -6170
+  br i1 %ok2, label %t3, label %fail2
+
+t3:
+  %r3 = call i16 @sub2(i16 100, i16 5000, i16 7)
+  %ok3 = icmp eq i16 %r3, 4893
+  br i1 %ok3, label %t4, label %fail3
+
+t4:
+  %r4 = call i32 @sub2_32(i32 100000, i32 3000000, i32 12345)
+  %ok4 = icmp eq i32 %r4, 2887655
+  br i1 %ok4, label %pass, label %fail4
+
+pass:
+  ret i16 0
+fail1:
+  ret i16 1
+fail2:
+  ret i16 2
+fail3:
+  ret i16 3
+fail4:
+  ret i16 4
+}
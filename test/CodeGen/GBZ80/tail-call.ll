@@ -0,0 +1,128 @@
+; RUN: llc < %s -march=gbz80 | FileCheck %s
+; RUN: llc < %s -march=gbz80 -O0 -verify-machineinstrs \
+; RUN:   | FileCheck %s -check-prefix=O0
+
+; A call in tail position jumps to the callee after the epilogue, the callee
+; returns to the caller's caller. FastISel leaves tail calls to SelectionDAG,
+; they are done at -O0 as well.
+
+declare i8 @f8(i8)
+declare i16 @f16(i16)
+declare i16 @f2(i16, i16)
+declare void @g()
+declare coldcc void @cold_callee()
+declare fastcc i16 @fast_callee(i16, i16)
+declare fastcc i16 @rot_callee(i16, i16, i16, i16, i16)
+
+define i8 @fwd8(i8 %a) {
+; CHECK-LABEL: fwd8:
+; CHECK-NEXT: BB#
+; CHECK-NEXT: jp f8
+; O0-LABEL: fwd8:
+; O0: jp f8
+; O0-NEXT: .Ltmp
+  %r = tail call i8 @f8(i8 %a)
+  ret i8 %r
+}
+
+define i16 @fwd16(i16 %a) {
+; CHECK-LABEL: fwd16:
+; CHECK: inc hl
+; CHECK-NEXT: jp f16
+  %b = add i16 %a, 1
+  %r = tail call i16 @f16(i16 %b)
+  ret i16 %r
+}
+
+; The second argument is in DE, which the caller restores before the jump.
+define i16 @in_de(i16 %a, i16 %b) {
+; CHECK-LABEL: in_de:
+; CHECK: call f2
+; CHECK: ret
+  %r = tail call i16 @f2(i16 %a, i16 %b)
+  ret i16 %r
+}
+
+; A fastcc function has nothing to restore.
+define fastcc i16 @fast_swap(i16 %a, i16 %b) {
+; CHECK-LABEL: fast_swap:
+; CHECK-NOT: call
+; CHECK: jp fast_callee
+  %r = tail call fastcc i16 @fast_callee(i16 %b, i16 %a)
+  ret i16 %r
+}
+
+; A coldcc function preserves HL, a C function doesn't.
+define coldcc void @cold_to_c() {
+; CHECK-LABEL: cold_to_c:
+; CHECK: call g
+; CHECK: ret
+  tail call void @g()
+  ret void
+}
+
+define coldcc void @cold_to_cold() {
+; CHECK-LABEL: cold_to_cold:
+; CHECK-NEXT: BB#
+; CHECK-NEXT: jp cold_callee
+  tail call coldcc void @cold_callee()
+  ret void
+}
+
+; An interrupt handler returns with reti.
+define void @handler() "interrupt" {
+; CHECK-LABEL: handler:
+; CHECK: call g
+; CHECK: reti
+  tail call void @g()
+  ret void
+}
+
+define void @indirect(void ()* %p) {
+; CHECK-LABEL: indirect:
+; CHECK-NEXT: BB#
+; CHECK-NEXT: jp (hl)
+  tail call void %p()
+  ret void
+}
+
+; The stack arguments of the callee are stored over the caller's own, after
+; both have been loaded.
+define fastcc i16 @rotate(i16 %a, i16 %b, i16 %c, i16 %d, i16 %e) {
+; CHECK-LABEL: rotate:
+; CHECK-NOT: call
+; CHECK: add sp, 8
+; CHECK-NEXT: jp rot_callee
+; O0-LABEL: rotate:
+; O0-NOT: call
+; O0: jp rot_callee
+; O0-NEXT: .Ltmp
+  %r = tail call fastcc i16 @rot_callee(i16 %e, i16 %a, i16 %b, i16 %c, i16 %d)
+  ret i16 %r
+}
+
+; More stack arguments than the caller has don't fit.
+define fastcc i16 @no_room(i16 %a) {
+; CHECK-LABEL: no_room:
+; CHECK: call rot_callee
+; CHECK: ret
+  %r = tail call fastcc i16 @rot_callee(i16 %a, i16 %a, i16 %a, i16 %a, i16 %a)
+  ret i16 %r
+}
+
+; The return is duplicated into both blocks, which share the jump.
+define i8 @both(i8 %a) {
+; CHECK-LABEL: both:
+; CHECK-NOT: call
+; CHECK: jp f8
+; CHECK-NOT: ret
+entry:
+  %c = icmp eq i8 %a, 0
+  br i1 %c, label %t, label %f
+t:
+  %r1 = tail call i8 @f8(i8 1)
+  ret i8 %r1
+f:
+  %r2 = tail call i8 @f8(i8 %a)
+  ret i8 %r2
+}
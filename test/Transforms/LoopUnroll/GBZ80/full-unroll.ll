@@ -0,0 +1,76 @@
+; RUN: opt < %s -S -mtriple=gbz80 -loop-unroll | FileCheck %s
+
+; A short loop over bytes is unrolled fully.
+define i8 @sum4(i8* %p) {
+; CHECK-LABEL: @sum4(
+; CHECK: load i8
+; CHECK: load i8
+; CHECK: load i8
+; CHECK: load i8
+; CHECK-NOT: load
+; CHECK-NOT: br i1
+; CHECK: ret i8
+entry:
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i8 [ 0, %entry ], [ %s.next, %loop ]
+  %q = getelementptr i8* %p, i8 %i
+  %v = load i8* %q
+  %s.next = add i8 %s, %v
+  %i.next = add i8 %i, 1
+  %done = icmp eq i8 %i.next, 4
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i8 %s.next
+}
+
+; Nothing grows when optimizing for size.
+define i8 @sum4_optsize(i8* %p) optsize {
+; CHECK-LABEL: @sum4_optsize(
+; CHECK: load i8
+; CHECK-NOT: load
+; CHECK: br i1
+entry:
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i8 [ 0, %entry ], [ %s.next, %loop ]
+  %q = getelementptr i8* %p, i8 %i
+  %v = load i8* %q
+  %s.next = add i8 %s, %v
+  %i.next = add i8 %i, 1
+  %done = icmp eq i8 %i.next, 4
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i8 %s.next
+}
+
+; The same over 16 words would take a lot of ROM.
+define i16 @sum16(i16* %p) {
+; CHECK-LABEL: @sum16(
+; CHECK: loop:
+; CHECK: load i16
+; CHECK-NOT: load
+; CHECK: br i1
+entry:
+  br label %loop
+
+loop:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i16 [ 0, %entry ], [ %s.next, %loop ]
+  %q = getelementptr i16* %p, i8 %i
+  %v = load i16* %q
+  %w = shl i16 %v, 1
+  %s.next = add i16 %s, %w
+  %i.next = add i8 %i, 1
+  %done = icmp eq i8 %i.next, 16
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i16 %s.next
+}
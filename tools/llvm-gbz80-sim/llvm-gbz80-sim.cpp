@@ -0,0 +1,744 @@
+//===-- llvm-gbz80-sim.cpp - Cycle counting GBZ80 simulator ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program runs a GB cartridge image written by llc -gbz80-rom and counts
+// the T-cycles it spends in each function. It measures the code generated by
+// the GBZ80 backend, it is not an emulator of the console: there is no video,
+// sound, timer or interrupt, the I/O registers are plain memory and the only
+// memory bank controller feature is the ROM bank select at 0x2000-0x3FFF.
+//
+// The program starts at 0x100 and stops at the first halt or stop, which the
+// startup routine of the image executes when main returns. The function table
+// needs the symbol file written by llc -gbz80-rom-symbols. For each function
+// it lists the number of calls, the cycles spent in it and in the functions
+// it called, the cycles spent in the function itself and its size in bytes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+using namespace llvm;
+
+static cl::opt<std::string>
+InputFilename(cl::Positional, cl::desc("<rom image>"), cl::Required);
+
+static cl::opt<std::string>
+SymbolFilename("symbols", cl::desc("Symbol file written by llc "
+                                   "-gbz80-rom-symbols"),
+               cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<unsigned long long>
+MaxCycles("max-cycles", cl::desc("Give up after this many T-cycles"),
+          cl::init(100000000));
+
+static cl::opt<bool>
+Trace("trace", cl::desc("Print the registers before every instruction"));
+
+static cl::opt<bool>
+ShowAll("all", cl::desc("List the functions which were not executed too"));
+
+static std::string ToolName;
+
+namespace {
+struct Function {
+  std::string Name;
+  unsigned Bank;
+  unsigned Address;
+  unsigned Size;
+  uint64_t Calls;
+  uint64_t Cycles;
+  uint64_t SelfCycles;
+  // Number of frames of this function on the call stack, and the cycle count
+  // when the outermost one was entered.
+  unsigned Active;
+  uint64_t EnterCycles;
+};
+
+// A call which has not returned yet. RetSP is the address of its return
+// address on the stack, the call returns once SP has moved above it.
+struct Frame {
+  unsigned RetSP;
+  int Func;
+};
+
+class Machine {
+public:
+  enum { FlagZ = 0x80, FlagN = 0x40, FlagH = 0x20, FlagC = 0x10 };
+
+  uint8_t A, F, B, C, D, E, H, L;
+  uint16_t SP, PC;
+  bool IME;
+  bool Stopped;
+  uint64_t Cycles;
+
+  Machine(std::vector<uint8_t> &ROM, std::vector<Function> &Funcs);
+
+  // step - Executes one instruction. Returns false if the opcode is invalid.
+  bool step();
+
+private:
+  std::vector<uint8_t> &ROM;
+  std::vector<uint8_t> RAM;
+  unsigned Bank;
+
+  std::vector<Function> &Funcs;
+  // The function owning each byte of the image, -1 if there is none.
+  std::vector<int> Owner;
+  std::vector<Frame> Frames;
+  bool Returned;
+
+  unsigned romOffset(uint16_t Addr) const {
+    if (Addr < 0x4000)
+      return Addr;
+    return Bank * 0x4000 + (Addr - 0x4000);
+  }
+  int funcAt(uint16_t Addr) const {
+    if (Addr >= 0x8000)
+      return -1;
+    unsigned Offset = romOffset(Addr);
+    return Offset < Owner.size() ? Owner[Offset] : -1;
+  }
+
+  uint8_t read8(uint16_t Addr) const {
+    if (Addr < 0x8000) {
+      unsigned Offset = romOffset(Addr);
+      return Offset < ROM.size() ? ROM[Offset] : 0xFF;
+    }
+    // Echo RAM mirrors work RAM.
+    if (Addr >= 0xE000 && Addr < 0xFE00)
+      Addr -= 0x2000;
+    return RAM[Addr - 0x8000];
+  }
+  void write8(uint16_t Addr, uint8_t Value) {
+    if (Addr < 0x8000) {
+      if (Addr >= 0x2000 && Addr < 0x4000)
+        Bank = Value;
+      return;
+    }
+    if (Addr >= 0xE000 && Addr < 0xFE00)
+      Addr -= 0x2000;
+    RAM[Addr - 0x8000] = Value;
+  }
+  uint16_t read16(uint16_t Addr) const {
+    return read8(Addr) | (read8(Addr + 1) << 8);
+  }
+  void write16(uint16_t Addr, uint16_t Value) {
+    write8(Addr, Value & 0xFF);
+    write8(Addr + 1, Value >> 8);
+  }
+
+  uint8_t fetch8() { return read8(PC++); }
+  uint16_t fetch16() {
+    uint16_t Value = read16(PC);
+    PC += 2;
+    return Value;
+  }
+  void push16(uint16_t Value) {
+    SP -= 2;
+    write16(SP, Value);
+  }
+  uint16_t pop16() {
+    uint16_t Value = read16(SP);
+    SP += 2;
+    return Value;
+  }
+
+  uint16_t getBC() const { return (B << 8) | C; }
+  uint16_t getDE() const { return (D << 8) | E; }
+  uint16_t getHL() const { return (H << 8) | L; }
+  void setBC(uint16_t V) { B = V >> 8; C = V & 0xFF; }
+  void setDE(uint16_t V) { D = V >> 8; E = V & 0xFF; }
+  void setHL(uint16_t V) { H = V >> 8; L = V & 0xFF; }
+
+  // Register pairs as encoded in the p field: BC, DE, HL, SP or AF.
+  uint16_t getRP(unsigned P, bool AF) const;
+  void setRP(unsigned P, bool AF, uint16_t Value);
+
+  // Registers as encoded in the y and z fields: B, C, D, E, H, L, (HL), A.
+  uint8_t getR(unsigned R) const;
+  void setR(unsigned R, uint8_t Value);
+
+  void setFlags(bool Z, bool N, bool HC, bool CY) {
+    F = (Z ? FlagZ : 0) | (N ? FlagN : 0) | (HC ? FlagH : 0) |
+        (CY ? FlagC : 0);
+  }
+  bool condition(unsigned CC) const;
+  void alu(unsigned Op, uint8_t Value);
+  uint8_t rotate(unsigned Op, uint8_t Value);
+  uint16_t addSP(uint8_t Disp);
+  unsigned stepCB();
+
+  void call(uint16_t Target, uint16_t Ret);
+  void ret();
+  void popFrames();
+};
+} // end anonymous namespace
+
+Machine::Machine(std::vector<uint8_t> &ROM, std::vector<Function> &Funcs)
+    : A(0x01), F(0xB0), B(0), C(0x13), D(0), E(0xD8), H(0x01), L(0x4D),
+      SP(0xFFFE), PC(0x100), IME(false), Stopped(false), Cycles(0), ROM(ROM),
+      RAM(0x8000), Bank(1), Funcs(Funcs), Owner(ROM.size(), -1),
+      Returned(false) {
+  for (unsigned i = 0, e = Funcs.size(); i != e; ++i) {
+    const Function &Fn = Funcs[i];
+    unsigned Base = Fn.Address < 0x4000 ? Fn.Address
+                                        : Fn.Bank * 0x4000 +
+                                              (Fn.Address - 0x4000);
+    for (unsigned j = 0; j != Fn.Size && Base + j < Owner.size(); ++j)
+      Owner[Base + j] = i;
+  }
+}
+
+uint16_t Machine::getRP(unsigned P, bool AF) const {
+  switch (P) {
+  case 0: return getBC();
+  case 1: return getDE();
+  case 2: return getHL();
+  default: return AF ? (A << 8) | F : SP;
+  }
+}
+
+void Machine::setRP(unsigned P, bool AF, uint16_t Value) {
+  switch (P) {
+  case 0: setBC(Value); break;
+  case 1: setDE(Value); break;
+  case 2: setHL(Value); break;
+  default:
+    if (AF) {
+      A = Value >> 8;
+      F = Value & 0xF0;
+    } else
+      SP = Value;
+  }
+}
+
+uint8_t Machine::getR(unsigned R) const {
+  switch (R) {
+  case 0: return B;
+  case 1: return C;
+  case 2: return D;
+  case 3: return E;
+  case 4: return H;
+  case 5: return L;
+  case 6: return read8(getHL());
+  default: return A;
+  }
+}
+
+void Machine::setR(unsigned R, uint8_t Value) {
+  switch (R) {
+  case 0: B = Value; break;
+  case 1: C = Value; break;
+  case 2: D = Value; break;
+  case 3: E = Value; break;
+  case 4: H = Value; break;
+  case 5: L = Value; break;
+  case 6: write8(getHL(), Value); break;
+  default: A = Value; break;
+  }
+}
+
+bool Machine::condition(unsigned CC) const {
+  switch (CC) {
+  case 0: return !(F & FlagZ);
+  case 1: return F & FlagZ;
+  case 2: return !(F & FlagC);
+  default: return F & FlagC;
+  }
+}
+
+void Machine::alu(unsigned Op, uint8_t Value) {
+  unsigned Carry = (F & FlagC) ? 1 : 0;
+  unsigned Res;
+  switch (Op) {
+  case 0: // add
+  case 1: // adc
+    if (Op == 0)
+      Carry = 0;
+    Res = A + Value + Carry;
+    setFlags((Res & 0xFF) == 0, false, (A & 0xF) + (Value & 0xF) + Carry > 0xF,
+             Res > 0xFF);
+    A = Res;
+    break;
+  case 2: // sub
+  case 3: // sbc
+  case 7: // cp
+    if (Op != 3)
+      Carry = 0;
+    Res = A - Value - Carry;
+    setFlags((Res & 0xFF) == 0, true, (A & 0xF) < (Value & 0xF) + Carry,
+             A < Value + Carry);
+    if (Op != 7)
+      A = Res;
+    break;
+  case 4: // and
+    A &= Value;
+    setFlags(A == 0, false, true, false);
+    break;
+  case 5: // xor
+    A ^= Value;
+    setFlags(A == 0, false, false, false);
+    break;
+  default: // or
+    A |= Value;
+    setFlags(A == 0, false, false, false);
+    break;
+  }
+}
+
+uint8_t Machine::rotate(unsigned Op, uint8_t Value) {
+  unsigned Carry = (F & FlagC) ? 1 : 0;
+  uint8_t Res;
+  bool CY;
+  switch (Op) {
+  case 0: Res = (Value << 1) | (Value >> 7); CY = Value & 0x80; break; // rlc
+  case 1: Res = (Value >> 1) | (Value << 7); CY = Value & 1; break;    // rrc
+  case 2: Res = (Value << 1) | Carry; CY = Value & 0x80; break;        // rl
+  case 3: Res = (Value >> 1) | (Carry << 7); CY = Value & 1; break;    // rr
+  case 4: Res = Value << 1; CY = Value & 0x80; break;                  // sla
+  case 5: Res = (Value >> 1) | (Value & 0x80); CY = Value & 1; break;  // sra
+  case 6: Res = (Value << 4) | (Value >> 4); CY = false; break;        // swap
+  default: Res = Value >> 1; CY = Value & 1; break;                    // srl
+  }
+  setFlags(Res == 0, false, false, CY);
+  return Res;
+}
+
+uint16_t Machine::addSP(uint8_t Disp) {
+  uint16_t Res = SP + (int8_t)Disp;
+  setFlags(false, false, (SP & 0xF) + (Disp & 0xF) > 0xF,
+           (SP & 0xFF) + Disp > 0xFF);
+  return Res;
+}
+
+void Machine::call(uint16_t Target, uint16_t Ret) {
+  push16(Ret);
+  PC = Target;
+
+  Frame Fr = { SP, funcAt(Target) };
+  Frames.push_back(Fr);
+  if (Fr.Func < 0)
+    return;
+  Function &Fn = Funcs[Fr.Func];
+  Fn.Calls++;
+  if (!Fn.Active++)
+    Fn.EnterCycles = Cycles;
+}
+
+void Machine::ret() {
+  PC = pop16();
+  Returned = true;
+}
+
+// popFrames - Ends the calls that returned, or whose frames were dropped by a
+// change of SP. The cycles of the ret belong to the callee.
+void Machine::popFrames() {
+  Returned = false;
+  while (!Frames.empty() && Frames.back().RetSP < SP) {
+    Frame Fr = Frames.back();
+    Frames.pop_back();
+    if (Fr.Func < 0)
+      continue;
+    Function &Fn = Funcs[Fr.Func];
+    if (!--Fn.Active)
+      Fn.Cycles += Cycles - Fn.EnterCycles;
+  }
+}
+
+unsigned Machine::stepCB() {
+  uint8_t Op = fetch8();
+  unsigned X = Op >> 6, Y = (Op >> 3) & 7, Z = Op & 7;
+  uint8_t Value = getR(Z);
+
+  switch (X) {
+  case 0:
+    setR(Z, rotate(Y, Value));
+    break;
+  case 1: // bit
+    F = (F & FlagC) | FlagH | ((Value & (1 << Y)) ? 0 : FlagZ);
+    return Z == 6 ? 12 : 8;
+  case 2: // res
+    setR(Z, Value & ~(1 << Y));
+    break;
+  default: // set
+    setR(Z, Value | (1 << Y));
+    break;
+  }
+  return Z == 6 ? 16 : 8;
+}
+
+bool Machine::step() {
+  uint16_t OpPC = PC;
+  uint8_t Op = fetch8();
+  unsigned X = Op >> 6, Y = (Op >> 3) & 7, Z = Op & 7;
+  unsigned P = Y >> 1, Q = Y & 1;
+  unsigned T = 4;
+
+  switch (X) {
+  case 0:
+    switch (Z) {
+    case 0:
+      if (Y == 0) {                       // nop
+      } else if (Y == 1) {                // ld (nn), sp
+        write16(fetch16(), SP);
+        T = 20;
+      } else if (Y == 2) {                // stop
+        fetch8();
+        Stopped = true;
+      } else {                            // jr [cc,] d
+        int8_t Disp = fetch8();
+        T = 8;
+        if (Y == 3 || condition(Y - 4)) {
+          PC += Disp;
+          T = 12;
+        }
+      }
+      break;
+    case 1:
+      if (!Q) {                           // ld rr, nn
+        setRP(P, false, fetch16());
+        T = 12;
+      } else {                            // add hl, rr
+        uint16_t HL = getHL(), RR = getRP(P, false);
+        F = (F & FlagZ) | (((HL & 0xFFF) + (RR & 0xFFF)) > 0xFFF ? FlagH : 0) |
+            ((unsigned)HL + RR > 0xFFFF ? FlagC : 0);
+        setHL(HL + RR);
+        T = 8;
+      }
+      break;
+    case 2: {                             // ld (rr), a / ld a, (rr)
+      uint16_t Addr = P == 0 ? getBC() : P == 1 ? getDE() : getHL();
+      if (Q)
+        A = read8(Addr);
+      else
+        write8(Addr, A);
+      if (P == 2)
+        setHL(Addr + 1);
+      else if (P == 3)
+        setHL(Addr - 1);
+      T = 8;
+      break;
+    }
+    case 3:                               // inc rr / dec rr
+      setRP(P, false, getRP(P, false) + (Q ? -1 : 1));
+      T = 8;
+      break;
+    case 4: {                             // inc r
+      uint8_t Res = getR(Y) + 1;
+      setR(Y, Res);
+      F = (F & FlagC) | (Res == 0 ? FlagZ : 0) |
+          ((Res & 0xF) == 0 ? FlagH : 0);
+      T = Y == 6 ? 12 : 4;
+      break;
+    }
+    case 5: {                             // dec r
+      uint8_t Res = getR(Y) - 1;
+      setR(Y, Res);
+      F = (F & FlagC) | FlagN | (Res == 0 ? FlagZ : 0) |
+          ((Res & 0xF) == 0xF ? FlagH : 0);
+      T = Y == 6 ? 12 : 4;
+      break;
+    }
+    case 6:                               // ld r, n
+      setR(Y, fetch8());
+      T = Y == 6 ? 12 : 8;
+      break;
+    default:
+      switch (Y) {
+      case 0: case 1: case 2: case 3:     // rlca, rrca, rla, rra
+        A = rotate(Y, A);
+        F &= ~FlagZ;
+        break;
+      case 4: {                           // daa
+        unsigned Res = A;
+        bool CY = F & FlagC;
+        if (!(F & FlagN)) {
+          if (CY || Res > 0x99) {
+            Res += 0x60;
+            CY = true;
+          }
+          if ((F & FlagH) || (Res & 0xF) > 9)
+            Res += 6;
+        } else {
+          if (CY)
+            Res -= 0x60;
+          if (F & FlagH)
+            Res -= 6;
+        }
+        A = Res;
+        F = (F & FlagN) | (A == 0 ? FlagZ : 0) | (CY ? FlagC : 0);
+        break;
+      }
+      case 5:                             // cpl
+        A = ~A;
+        F |= FlagN | FlagH;
+        break;
+      case 6:                             // scf
+        F = (F & FlagZ) | FlagC;
+        break;
+      default:                            // ccf
+        F = (F & (FlagZ | FlagC)) ^ FlagC;
+        break;
+      }
+      break;
+    }
+    break;
+
+  case 1:
+    if (Y == 6 && Z == 6) {               // halt
+      Stopped = true;
+      break;
+    }
+    setR(Y, getR(Z));                     // ld r, r'
+    T = (Y == 6 || Z == 6) ? 8 : 4;
+    break;
+
+  case 2:                                 // alu a, r
+    alu(Y, getR(Z));
+    T = Z == 6 ? 8 : 4;
+    break;
+
+  default:
+    switch (Z) {
+    case 0:
+      if (Y < 4) {                        // ret cc
+        T = 8;
+        if (condition(Y)) {
+          ret();
+          T = 20;
+        }
+      } else if (Y == 4) {                // ldh (n), a
+        write8(0xFF00 + fetch8(), A);
+        T = 12;
+      } else if (Y == 5) {                // add sp, d
+        SP = addSP(fetch8());
+        T = 16;
+      } else if (Y == 6) {                // ldh a, (n)
+        A = read8(0xFF00 + fetch8());
+        T = 12;
+      } else {                            // ld hl, sp+d
+        setHL(addSP(fetch8()));
+        T = 12;
+      }
+      break;
+    case 1:
+      if (!Q) {                           // pop rr
+        setRP(P, true, pop16());
+        T = 12;
+      } else if (P == 0 || P == 1) {      // ret, reti
+        ret();
+        if (P == 1)
+          IME = true;
+        T = 16;
+      } else if (P == 2) {                // jp hl
+        PC = getHL();
+      } else {                            // ld sp, hl
+        SP = getHL();
+        T = 8;
+      }
+      break;
+    case 2:
+      if (Y < 4) {                        // jp cc, nn
+        uint16_t Target = fetch16();
+        T = 12;
+        if (condition(Y)) {
+          PC = Target;
+          T = 16;
+        }
+      } else if (Y == 4) {                // ld (c), a
+        write8(0xFF00 + C, A);
+        T = 8;
+      } else if (Y == 5) {                // ld (nn), a
+        write8(fetch16(), A);
+        T = 16;
+      } else if (Y == 6) {                // ld a, (c)
+        A = read8(0xFF00 + C);
+        T = 8;
+      } else {                            // ld a, (nn)
+        A = read8(fetch16());
+        T = 16;
+      }
+      break;
+    case 3:
+      if (Y == 0) {                       // jp nn
+        PC = fetch16();
+        T = 16;
+      } else if (Y == 1) {
+        T = stepCB();
+      } else if (Y == 6) {                // di
+        IME = false;
+      } else if (Y == 7) {                // ei
+        IME = true;
+      } else {
+        PC = OpPC;
+        return false;
+      }
+      break;
+    case 4:
+      if (Y >= 4) {
+        PC = OpPC;
+        return false;
+      } else {                            // call cc, nn
+        uint16_t Target = fetch16();
+        T = 12;
+        if (condition(Y)) {
+          call(Target, PC);
+          T = 24;
+        }
+      }
+      break;
+    case 5:
+      if (!Q) {                           // push rr
+        push16(getRP(P, true));
+        T = 16;
+      } else if (P == 0) {                // call nn
+        uint16_t Target = fetch16();
+        call(Target, PC);
+        T = 24;
+      } else {
+        PC = OpPC;
+        return false;
+      }
+      break;
+    case 6:                               // alu a, n
+      alu(Y, fetch8());
+      T = 8;
+      break;
+    default:                              // rst
+      call(Y * 8, PC);
+      T = 16;
+      break;
+    }
+    break;
+  }
+
+  Cycles += T;
+  int Fn = funcAt(OpPC);
+  if (Fn >= 0)
+    Funcs[Fn].SelfCycles += T;
+  if (Returned)
+    popFrames();
+  return true;
+}
+
+// readSymbols - Reads the "bank:address size name" lines of a symbol file.
+static bool readSymbols(StringRef Filename, std::vector<Function> &Funcs) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(Filename);
+  if (std::error_code EC = BufOrErr.getError()) {
+    errs() << ToolName << ": " << Filename << ": " << EC.message() << '\n';
+    return false;
+  }
+
+  StringRef Rest = BufOrErr.get()->getBuffer();
+  unsigned LineNo = 0;
+  while (!Rest.empty()) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    Line = Line.trim();
+    LineNo++;
+    if (Line.empty() || Line[0] == ';')
+      continue;
+
+    StringRef BankStr, AddrStr, SizeStr, Name;
+    std::tie(BankStr, Line) = Line.split(':');
+    std::tie(AddrStr, Line) = Line.split(' ');
+    std::tie(SizeStr, Name) = Line.ltrim().split(' ');
+    Function Fn = Function();
+    Fn.Name = Name.trim();
+    if (BankStr.getAsInteger(16, Fn.Bank) ||
+        AddrStr.getAsInteger(16, Fn.Address) ||
+        SizeStr.getAsInteger(16, Fn.Size) || Fn.Name.empty()) {
+      errs() << ToolName << ": " << Filename << ":" << LineNo
+             << ": malformed symbol\n";
+      return false;
+    }
+    Funcs.push_back(Fn);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  // Print a stack trace if we signal out.
+  sys::PrintStackTraceOnErrorSignal();
+  PrettyStackTraceProgram X(argc, argv);
+
+  llvm_shutdown_obj Y; // Call llvm_shutdown() on exit.
+  cl::ParseCommandLineOptions(argc, argv, "GBZ80 cycle counting simulator\n");
+  ToolName = argv[0];
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(InputFilename);
+  if (std::error_code EC = BufOrErr.getError()) {
+    errs() << ToolName << ": " << InputFilename << ": " << EC.message()
+           << '\n';
+    return 1;
+  }
+  StringRef Contents = BufOrErr.get()->getBuffer();
+  std::vector<uint8_t> ROM(Contents.begin(), Contents.end());
+  if (ROM.size() < 0x150) {
+    errs() << ToolName << ": " << InputFilename << ": not a ROM image\n";
+    return 1;
+  }
+
+  std::vector<Function> Funcs;
+  if (!SymbolFilename.empty() && !readSymbols(SymbolFilename, Funcs))
+    return 1;
+
+  Machine M(ROM, Funcs);
+  while (!M.Stopped) {
+    if (Trace)
+      errs() << format("%04x: af=%02x%02x bc=%02x%02x ", M.PC, M.A, M.F, M.B,
+                       M.C)
+             << format("de=%02x%02x hl=%02x%02x sp=%04x\n", M.D, M.E, M.H,
+                       M.L, M.SP);
+    if (!M.step()) {
+      errs() << ToolName << ": invalid opcode at "
+             << format("0x%04x", M.PC) << '\n';
+      return 1;
+    }
+    if (M.Cycles >= MaxCycles) {
+      errs() << ToolName << ": no halt after " << M.Cycles << " cycles\n";
+      return 1;
+    }
+  }
+
+  outs() << "halted after " << M.Cycles << " cycles\n";
+  outs() << format("a = 0x%02x, bc = 0x%02x%02x, ", M.A, M.B, M.C)
+         << format("de = 0x%02x%02x, hl = 0x%02x%02x\n", M.D, M.E, M.H, M.L);
+  if (Funcs.empty())
+    return 0;
+
+  outs() << "\nfunction                    calls       cycles         self  bytes\n";
+  for (unsigned i = 0, e = Funcs.size(); i != e; ++i) {
+    const Function &Fn = Funcs[i];
+    if (!ShowAll && !Fn.Calls && !Fn.SelfCycles)
+      continue;
+    outs() << format("%-24s %8llu ", Fn.Name.c_str(),
+                     (unsigned long long)Fn.Calls);
+    // Code which is only ever jumped to is part of the cycles of its callers.
+    if (Fn.Calls)
+      outs() << format("%12llu", (unsigned long long)Fn.Cycles);
+    else
+      outs() << "           -";
+    outs() << format(" %12llu %6u\n", (unsigned long long)Fn.SelfCycles,
+                     Fn.Size);
+  }
+  return 0;
+}